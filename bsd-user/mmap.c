@@ -42,6 +42,11 @@ void mmap_unlock(void)
     }
 }
 
+bool have_mmap_lock(void)
+{
+    return mmap_lock_count > 0;
+}
+
 /* Grab lock to make sure things are in a consistent state after fork().  */
 void mmap_fork_start(void)
 {
@@ -66,6 +71,11 @@ void mmap_lock(void)
 void mmap_unlock(void)
 {
 }
+
+bool have_mmap_lock(void)
+{
+    return true;
+}
 #endif
 
 /* NOTE: all the constants are the HOST ones, but addresses are target. */
@@ -0,0 +1,277 @@
+/*
+ * Example of an out-of-process Cortex-M peripheral
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * A periodic timer, to be attached with something like:
+ *
+ *   -device cortexm:remote-peripheral,path=/tmp/timer.sock,
+ *           mmio-address=0x40030000,mmio-size-bytes=0x400,irq=16,num-irq=1
+ *
+ * Registers:
+ *   0x00 CTRL    RW  bit 0 enables the timer, bit 1 the interrupt
+ *   0x04 STATUS  R   bit 0 set at each period; served by QEMU (shadow)
+ *   0x08 ICR     W   writing 1 to bit 0 clears it in STATUS
+ *   0x0C COUNT   R   number of periods elapsed
+ *   0x10 PERIOD  RW  period in milliseconds
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/timer.h"
+#include "hw/cortexm/remote-peripheral-protocol.h"
+
+#include "../shm-client/shm-client.h"
+
+#define TIMER_CTRL      0x00
+#define TIMER_STATUS    0x04
+#define TIMER_ICR       0x08
+#define TIMER_COUNT     0x0C
+#define TIMER_PERIOD    0x10
+
+#define TIMER_CTRL_EN   (1 << 0)
+#define TIMER_CTRL_IE   (1 << 1)
+#define TIMER_STATUS_TICK (1 << 0)
+
+typedef struct RemoteTimer {
+    ShmClient client;
+    bool verbose;
+    uint32_t ctrl;
+    uint32_t status;
+    uint32_t count;
+    uint32_t period;
+    int64_t next_tick;
+} RemoteTimer;
+
+/* show usage and exit with given error code */
+static void
+remote_timer_usage(const char *name, int code)
+{
+    fprintf(stderr, "%s [opts]\n", name);
+    fprintf(stderr, "  -h: show this help\n");
+    fprintf(stderr, "  -S <unix_sock_path>: path to the unix socket\n"
+                    "     of the peripheral to implement (mandatory)\n");
+    fprintf(stderr, "  -v: print the accesses\n");
+    exit(code);
+}
+
+static void
+remote_timer_send(RemoteTimer *t, uint8_t type, uint32_t offset,
+                  uint64_t value)
+{
+    RemotePeripheralMsg msg = {
+        .type = type,
+        .offset = offset,
+        .value = value,
+    };
+
+    /* QEMU consumes quickly, and the ring holds thousands of messages */
+    while (shm_client_write(&t->client, &msg, sizeof(msg)) == 0) {
+        g_usleep(10);
+    }
+}
+
+static void
+remote_timer_update_status(RemoteTimer *t)
+{
+    remote_timer_send(t, REMOTE_PERIPHERAL_MSG_SHADOW_SET, TIMER_STATUS,
+                      t->status);
+}
+
+static void
+remote_timer_reset(RemoteTimer *t)
+{
+    t->ctrl = 0;
+    t->status = 0;
+    t->count = 0;
+    t->period = 1000;
+    t->next_tick = 0;
+
+    /* Shadows are cleared by QEMU on reset, declare them again */
+    remote_timer_update_status(t);
+}
+
+static uint64_t
+remote_timer_read(RemoteTimer *t, uint32_t offset)
+{
+    switch (offset) {
+    case TIMER_CTRL:
+        return t->ctrl;
+    case TIMER_STATUS:
+        return t->status;
+    case TIMER_COUNT:
+        return t->count;
+    case TIMER_PERIOD:
+        return t->period;
+    default:
+        return 0;
+    }
+}
+
+static void
+remote_timer_write(RemoteTimer *t, uint32_t offset, uint64_t value)
+{
+    switch (offset) {
+    case TIMER_CTRL:
+        if ((value & TIMER_CTRL_EN) && !(t->ctrl & TIMER_CTRL_EN)) {
+            t->next_tick = get_clock() + t->period * SCALE_MS;
+        }
+        t->ctrl = value;
+        break;
+    case TIMER_ICR:
+        if (value & t->status) {
+            t->status &= ~value;
+            remote_timer_update_status(t);
+        }
+        break;
+    case TIMER_PERIOD:
+        t->period = MAX(value, 1);
+        break;
+    default:
+        break;
+    }
+}
+
+static int
+remote_timer_handle(RemoteTimer *t, RemotePeripheralMsg *msg)
+{
+    if (t->verbose && msg->type != REMOTE_PERIPHERAL_MSG_HELLO) {
+        printf("%s 0x%02x/%d 0x%" PRIx64 "\n",
+               msg->type == REMOTE_PERIPHERAL_MSG_READ ? "rd" :
+               msg->type == REMOTE_PERIPHERAL_MSG_WRITE ? "wr" : "rst",
+               msg->offset, msg->size, msg->value);
+    }
+
+    switch (msg->type) {
+    case REMOTE_PERIPHERAL_MSG_HELLO:
+        if (msg->value != REMOTE_PERIPHERAL_VERSION) {
+            fprintf(stderr, "unsupported protocol version %" PRIu64 "\n",
+                    msg->value);
+            return -EPROTONOSUPPORT;
+        }
+        remote_timer_reset(t);
+        break;
+
+    case REMOTE_PERIPHERAL_MSG_READ:
+        /* STATUS updates were sent before, as the protocol wants */
+        remote_timer_send(t, REMOTE_PERIPHERAL_MSG_READ_REPLY, msg->offset,
+                          remote_timer_read(t, msg->offset & ~3));
+        break;
+
+    case REMOTE_PERIPHERAL_MSG_WRITE:
+        remote_timer_write(t, msg->offset & ~3, msg->value);
+        break;
+
+    case REMOTE_PERIPHERAL_MSG_RESET:
+        remote_timer_reset(t);
+        break;
+
+    default:
+        return -EPROTO;
+    }
+    return 0;
+}
+
+static void
+remote_timer_tick(RemoteTimer *t)
+{
+    t->count++;
+    t->next_tick += t->period * SCALE_MS;
+
+    if (!(t->status & TIMER_STATUS_TICK)) {
+        t->status |= TIMER_STATUS_TICK;
+        remote_timer_update_status(t);
+    }
+    if (t->ctrl & TIMER_CTRL_IE) {
+        remote_timer_send(t, REMOTE_PERIPHERAL_MSG_SET_IRQ, 0, 0);
+    }
+}
+
+static int
+remote_timer_run(RemoteTimer *t)
+{
+    RemotePeripheralMsg msg;
+    int64_t now;
+    int timeout, ret;
+
+    for (;;) {
+        timeout = -1;
+        if (t->ctrl & TIMER_CTRL_EN) {
+            now = get_clock();
+            while (now >= t->next_tick) {
+                remote_timer_tick(t);
+            }
+            timeout = (t->next_tick - now + SCALE_MS - 1) / SCALE_MS;
+        }
+
+        ret = shm_client_wait(&t->client, timeout);
+        if (ret < 0) {
+            return ret == -EPIPE ? 0 : ret;
+        }
+
+        while (shm_client_read(&t->client, &msg, sizeof(msg)) == sizeof(msg)) {
+            ret = remote_timer_handle(t, &msg);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        if (t->verbose) {
+            fflush(stdout);
+        }
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    RemoteTimer t = { 0 };
+    const char *unix_sock_path = NULL;
+    int c, ret;
+
+    while ((c = getopt(argc, argv,
+                       "h"  /* help */
+                       "S:" /* unix_sock_path */
+                       "v"  /* verbose */
+                      )) != -1) {
+
+        switch (c) {
+        case 'h': /* help */
+            remote_timer_usage(argv[0], 0);
+            break;
+
+        case 'S': /* unix_sock_path */
+            unix_sock_path = optarg;
+            break;
+
+        case 'v': /* verbose */
+            t.verbose = true;
+            break;
+
+        default:
+            remote_timer_usage(argv[0], 1);
+            break;
+        }
+    }
+    if (!unix_sock_path) {
+        remote_timer_usage(argv[0], 1);
+    }
+
+    ret = shm_client_connect(&t.client, unix_sock_path);
+    if (ret < 0) {
+        fprintf(stderr, "cannot connect to %s: %s\n", unix_sock_path,
+                strerror(-ret));
+        return 1;
+    }
+
+    ret = remote_timer_run(&t);
+    shm_client_close(&t.client);
+
+    if (ret < 0) {
+        fprintf(stderr, "%s\n", strerror(-ret));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Standalone client for the "shm" chardev backend
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
+
+#include "shm-client.h"
+
+typedef struct ShmClientArgs {
+    const char *unix_sock_path;
+    bool throughput;
+    uint64_t write_size;
+} ShmClientArgs;
+
+/* show shm_client_usage and exit with given error code */
+static void
+shm_client_usage(const char *name, int code)
+{
+    fprintf(stderr, "%s [opts]\n", name);
+    fprintf(stderr, "  -h: show this help\n");
+    fprintf(stderr, "  -S <unix_sock_path>: path to the unix socket\n"
+                    "     of the chardev to connect to (mandatory)\n");
+    fprintf(stderr, "  -t: discard the data received from QEMU and print\n"
+                    "     the throughput every second, instead of copying\n"
+                    "     the data to stdout\n");
+    fprintf(stderr, "  -w <size>: send <size> bytes of test data to QEMU,\n"
+                    "     print the throughput and exit\n");
+    exit(code);
+}
+
+/* parse the program arguments, exit on error */
+static void
+shm_client_parse_args(ShmClientArgs *args, int argc, char *argv[])
+{
+    int64_t size;
+    int c;
+
+    while ((c = getopt(argc, argv,
+                       "h"  /* help */
+                       "S:" /* unix_sock_path */
+                       "t"  /* throughput */
+                       "w:" /* write_size */
+                      )) != -1) {
+
+        switch (c) {
+        case 'h': /* help */
+            shm_client_usage(argv[0], 0);
+            break;
+
+        case 'S': /* unix_sock_path */
+            args->unix_sock_path = optarg;
+            break;
+
+        case 't': /* throughput */
+            args->throughput = true;
+            break;
+
+        case 'w': /* write_size */
+            size = qemu_strtosz_suffix(optarg, NULL, QEMU_STRTOSZ_DEFSUFFIX_B);
+            if (size <= 0) {
+                fprintf(stderr, "cannot parse size %s\n", optarg);
+                shm_client_usage(argv[0], 1);
+            }
+            args->write_size = size;
+            break;
+
+        default:
+            shm_client_usage(argv[0], 1);
+            break;
+        }
+    }
+
+    if (!args->unix_sock_path) {
+        shm_client_usage(argv[0], 1);
+    }
+}
+
+static void
+shm_client_print_rate(uint64_t bytes, int64_t ns)
+{
+    printf("%" PRIu64 " bytes in %.3f s: %.2f MB/s\n", bytes, ns / 1e9,
+           ns ? bytes / 1e6 / (ns / 1e9) : 0.0);
+    fflush(stdout);
+}
+
+/* send test data to QEMU as fast as it is consumed */
+static int
+shm_client_send(ShmClient *client, uint64_t size)
+{
+    uint8_t buf[4096];
+    uint64_t sent = 0;
+    int64_t start;
+    size_t n, i;
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = ' ' + i % 95;
+    }
+
+    start = get_clock();
+    while (sent < size) {
+        n = shm_client_write(client, buf, MIN(sizeof(buf), size - sent));
+        if (!n) {
+            /* nothing tells us when the ring drains */
+            g_usleep(10);
+        }
+        sent += n;
+    }
+    shm_client_print_rate(sent, get_clock() - start);
+    return 0;
+}
+
+/* receive data from QEMU until it closes the connection */
+static int
+shm_client_receive(ShmClient *client, bool throughput)
+{
+    const uint8_t *data;
+    uint64_t bytes = 0;
+    int64_t start, now;
+    size_t n;
+    int ret;
+
+    start = get_clock();
+    for (;;) {
+        ret = shm_client_wait(client, throughput ? 1000 : -1);
+        if (ret < 0) {
+            return ret == -EPIPE ? 0 : ret;
+        }
+
+        while ((n = shm_client_peek(client, &data)) > 0) {
+            if (!throughput && fwrite(data, 1, n, stdout) != n) {
+                return -EIO;
+            }
+            shm_client_consume(client, n);
+            bytes += n;
+        }
+
+        if (throughput) {
+            now = get_clock();
+            if (now - start >= NANOSECONDS_PER_SECOND) {
+                shm_client_print_rate(bytes, now - start);
+                bytes = 0;
+                start = now;
+            }
+        } else {
+            fflush(stdout);
+        }
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    ShmClientArgs args = { 0 };
+    ShmClient client;
+    int ret;
+
+    shm_client_parse_args(&args, argc, argv);
+
+    ret = shm_client_connect(&client, args.unix_sock_path);
+    if (ret < 0) {
+        fprintf(stderr, "cannot connect to %s: %s\n", args.unix_sock_path,
+                strerror(-ret));
+        return 1;
+    }
+
+    if (args.write_size) {
+        ret = shm_client_send(&client, args.write_size);
+    } else {
+        ret = shm_client_receive(&client, args.throughput);
+    }
+    shm_client_close(&client);
+
+    if (ret < 0) {
+        fprintf(stderr, "%s\n", strerror(-ret));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * Client library for the "shm" chardev backend
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <poll.h>
+
+#include "qemu-common.h"
+#include "qemu/cutils.h"
+#include "qemu/sockets.h"
+
+#include "shm-client.h"
+
+/* receive the protocol version and the descriptors from QEMU */
+static int
+shm_client_read_fds(ShmClient *client, int *fds, size_t nfds)
+{
+    uint32_t version;
+    struct msghdr msg;
+    struct iovec iov[1];
+    union {
+        struct cmsghdr cmsg;
+        char control[CMSG_SPACE(3 * sizeof(int))];
+    } msg_control;
+    struct cmsghdr *cmsg;
+    ssize_t ret;
+
+    assert(nfds == 3);
+
+    iov[0].iov_base = &version;
+    iov[0].iov_len = sizeof(version);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &msg_control;
+    msg.msg_controllen = sizeof(msg_control);
+
+    do {
+        ret = recvmsg(client->sock_fd, &msg, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return -errno;
+    }
+    if (ret != sizeof(version)) {
+        return -EPROTO;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_len == CMSG_LEN(3 * sizeof(int)) &&
+            cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+            break;
+        }
+    }
+    if (!cmsg) {
+        return -EPROTO;
+    }
+
+    if (version != SHM_RING_VERSION) {
+        close(fds[0]);
+        close(fds[1]);
+        close(fds[2]);
+        return -EPROTONOSUPPORT;
+    }
+    return 0;
+}
+
+/* map the segment and check that its layout makes sense */
+static int
+shm_client_map(ShmClient *client)
+{
+    ShmRingHeader *hdr;
+    struct stat st;
+    uint32_t ring_size, data_offset;
+
+    if (fstat(client->shm_fd, &st) < 0) {
+        return -errno;
+    }
+    if (st.st_size < sizeof(ShmRingHeader)) {
+        return -EPROTO;
+    }
+
+    client->map_size = st.st_size;
+    client->base = mmap(NULL, client->map_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, client->shm_fd, 0);
+    if (client->base == MAP_FAILED) {
+        client->base = NULL;
+        return -errno;
+    }
+
+    hdr = client->base;
+    ring_size = hdr->ring_size;
+    data_offset = hdr->data_offset;
+    if (hdr->magic != SHM_RING_MAGIC || hdr->version != SHM_RING_VERSION ||
+        !ring_size || (ring_size & (ring_size - 1)) ||
+        data_offset < sizeof(ShmRingHeader) ||
+        data_offset + (uint64_t)SHM_RING_COUNT * ring_size >
+        client->map_size) {
+        return -EPROTO;
+    }
+
+    shm_ring_port_init(&client->rx, client->base, ring_size, data_offset,
+                       SHM_RING_TO_CLIENT);
+    shm_ring_port_init(&client->tx, client->base, ring_size, data_offset,
+                       SHM_RING_FROM_CLIENT);
+    return 0;
+}
+
+int
+shm_client_connect(ShmClient *client, const char *unix_sock_path)
+{
+    struct sockaddr_un sun;
+    int fds[3];
+    int ret;
+
+    memset(client, 0, sizeof(*client));
+    client->shm_fd = -1;
+    client->notify_fd = -1;
+    client->kick_fd = -1;
+
+    if (strlen(unix_sock_path) >= sizeof(sun.sun_path)) {
+        return -ENAMETOOLONG;
+    }
+
+    client->sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->sock_fd < 0) {
+        return -errno;
+    }
+
+    sun.sun_family = AF_UNIX;
+    pstrcpy(sun.sun_path, sizeof(sun.sun_path), unix_sock_path);
+    if (connect(client->sock_fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+        ret = -errno;
+        goto err;
+    }
+
+    ret = shm_client_read_fds(client, fds, ARRAY_SIZE(fds));
+    if (ret < 0) {
+        goto err;
+    }
+    client->shm_fd = fds[0];
+    client->notify_fd = fds[1];
+    client->kick_fd = fds[2];
+    qemu_set_nonblock(client->notify_fd);
+    qemu_set_nonblock(client->kick_fd);
+
+    ret = shm_client_map(client);
+    if (ret < 0) {
+        goto err;
+    }
+    return 0;
+
+err:
+    shm_client_close(client);
+    return ret;
+}
+
+void
+shm_client_close(ShmClient *client)
+{
+    if (client->base) {
+        munmap(client->base, client->map_size);
+        client->base = NULL;
+    }
+    if (client->kick_fd >= 0) {
+        close(client->kick_fd);
+        client->kick_fd = -1;
+    }
+    if (client->notify_fd >= 0) {
+        close(client->notify_fd);
+        client->notify_fd = -1;
+    }
+    if (client->shm_fd >= 0) {
+        close(client->shm_fd);
+        client->shm_fd = -1;
+    }
+    if (client->sock_fd >= 0) {
+        close(client->sock_fd);
+        client->sock_fd = -1;
+    }
+}
+
+size_t
+shm_client_write(ShmClient *client, const void *buf, size_t len)
+{
+    uint64_t value = 1;
+    bool notify;
+
+    len = shm_ring_write(&client->tx, buf, len, &notify);
+    if (notify) {
+        /* eventfds want 8 bytes; a full pipe means QEMU is already awake */
+        while (write(client->kick_fd, &value, sizeof(value)) < 0 &&
+               errno == EINTR) {
+            /* retry */
+        }
+    }
+    return len;
+}
+
+size_t
+shm_client_peek(ShmClient *client, const uint8_t **data)
+{
+    return shm_ring_peek(&client->rx, data);
+}
+
+void
+shm_client_consume(ShmClient *client, size_t len)
+{
+    shm_ring_consume(&client->rx, len);
+}
+
+size_t
+shm_client_read(ShmClient *client, void *buf, size_t len)
+{
+    const uint8_t *data;
+    size_t n, done = 0;
+
+    while (done < len) {
+        n = MIN(shm_ring_peek(&client->rx, &data), len - done);
+        if (!n) {
+            break;
+        }
+        memcpy((uint8_t *)buf + done, data, n);
+        shm_ring_consume(&client->rx, n);
+        done += n;
+    }
+    return done;
+}
+
+int
+shm_client_wait(ShmClient *client, int timeout_ms)
+{
+    struct pollfd pfd[2];
+    const uint8_t *data;
+    char buf[64];
+    int ret;
+
+    for (;;) {
+        /* the producer only notifies us when the ring was empty */
+        if (shm_ring_peek(&client->rx, &data)) {
+            return 1;
+        }
+
+        pfd[0].fd = client->notify_fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = client->sock_fd;
+        pfd[1].events = POLLIN;
+        ret = poll(pfd, ARRAY_SIZE(pfd), timeout_ms);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (ret == 0) {
+            return shm_ring_peek(&client->rx, &data) ? 1 : 0;
+        }
+
+        if (pfd[1].revents) {
+            ret = read(client->sock_fd, buf, sizeof(buf));
+            if (ret == 0 || (ret < 0 && errno != EINTR && errno != EAGAIN)) {
+                return -EPIPE;
+            }
+        }
+        if (pfd[0].revents & POLLIN) {
+            while (read(client->notify_fd, buf, sizeof(buf)) > 0) {
+                /* drain the notifier */
+            }
+        }
+    }
+}
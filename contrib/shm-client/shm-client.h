@@ -0,0 +1,108 @@
+/*
+ * Client library for the "shm" chardev backend
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SHM_CLIENT_H
+#define SHM_CLIENT_H
+
+/**
+ * This file provides helpers to exchange data with a QEMU character
+ * device created with "-chardev shm,path=...".  The client connects to
+ * the unix socket, receives the shared memory segment and the notifiers,
+ * and then reads and writes the rings directly, without system calls
+ * except to sleep on an empty ring or to wake QEMU up.
+ *
+ * A standalone client based on this file is provided to measure the
+ * throughput of the backend.
+ */
+
+#include "qemu/shm-ring.h"
+
+/**
+ * Structure describing a shm chardev client
+ */
+typedef struct ShmClient {
+    int sock_fd;                /**< unix socket, only used to detect EOF */
+    int shm_fd;                 /**< shared memory segment */
+    int notify_fd;              /**< readable when data arrives from QEMU */
+    int kick_fd;                /**< written to wake QEMU up */
+    void *base;                 /**< mapping of the segment */
+    size_t map_size;            /**< size of the mapping */
+    ShmRingPort rx;             /**< ring from QEMU */
+    ShmRingPort tx;             /**< ring to QEMU */
+} ShmClient;
+
+/**
+ * Connect to QEMU
+ *
+ * @client: the client to initialize
+ * @unix_sock_path: path of the unix socket given to the chardev
+ *
+ * Returns: 0 on success, or a negative errno value on error
+ */
+int shm_client_connect(ShmClient *client, const char *unix_sock_path);
+
+/**
+ * Disconnect from QEMU and release all resources
+ *
+ * @client: the client
+ */
+void shm_client_close(ShmClient *client);
+
+/**
+ * Send data to QEMU without blocking
+ *
+ * @client: the client
+ * @buf: the data
+ * @len: the number of bytes to send
+ *
+ * Returns: the number of bytes sent, 0 if the ring is full
+ */
+size_t shm_client_write(ShmClient *client, const void *buf, size_t len);
+
+/**
+ * Receive data from QEMU without blocking
+ *
+ * @client: the client
+ * @buf: the buffer
+ * @len: the size of the buffer
+ *
+ * Returns: the number of bytes received, 0 if the ring is empty
+ */
+size_t shm_client_read(ShmClient *client, void *buf, size_t len);
+
+/**
+ * Look at the data received from QEMU without copying it
+ *
+ * The data stays in the ring until released with shm_client_consume().
+ *
+ * @client: the client
+ * @data: set to the first byte received
+ *
+ * Returns: the number of bytes available contiguously at @data
+ */
+size_t shm_client_peek(ShmClient *client, const uint8_t **data);
+
+/**
+ * Release data returned by shm_client_peek()
+ *
+ * @client: the client
+ * @len: the number of bytes to release
+ */
+void shm_client_consume(ShmClient *client, size_t len);
+
+/**
+ * Wait for data from QEMU
+ *
+ * @client: the client
+ * @timeout_ms: the timeout in milliseconds, -1 to wait forever
+ *
+ * Returns: 1 if data is available, 0 on timeout, or a negative errno
+ * value on error; -EPIPE means that QEMU closed the connection
+ */
+int shm_client_wait(ShmClient *client, int timeout_ms);
+
+#endif /* SHM_CLIENT_H */
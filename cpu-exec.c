@@ -268,10 +268,8 @@ static bool tb_cmp(const void *p, const void *d)
     return false;
 }
 
-static TranslationBlock *tb_find_physical(CPUState *cpu,
-                                          target_ulong pc,
-                                          target_ulong cs_base,
-                                          uint32_t flags)
+TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
+                                   target_ulong cs_base, uint32_t flags)
 {
     tb_page_addr_t phys_pc;
     struct tb_desc desc;
@@ -284,7 +282,7 @@ static TranslationBlock *tb_find_physical(CPUState *cpu,
     phys_pc = get_page_addr_code(desc.env, pc);
     desc.phys_page1 = phys_pc & TARGET_PAGE_MASK;
     h = tb_hash_func(phys_pc, pc, flags);
-    return qht_lookup(&tcg_ctx.tb_ctx.htable, tb_cmp, &desc, h);
+    return qht_lookup(&tb_ctx.htable, tb_cmp, &desc, h);
 }
 
 static TranslationBlock *tb_find_slow(CPUState *cpu,
@@ -294,11 +292,18 @@ static TranslationBlock *tb_find_slow(CPUState *cpu,
 {
     TranslationBlock *tb;
 
-    tb = tb_find_physical(cpu, pc, cs_base, flags);
+    tb = tb_htable_lookup(cpu, pc, cs_base, flags);
     if (tb) {
         goto found;
     }
 
+#if defined(CONFIG_USER_ONLY) && defined(TARGET_PARALLEL_TRANSLATE)
+    /* Translate without holding tb_lock, so that the other threads can
+     * go on finding and translating TBs in the meantime.
+     */
+    tb_unlock();
+    tb = tb_gen_code_parallel(cpu, pc, cs_base, flags, 0);
+#else
 #ifdef CONFIG_USER_ONLY
     /* mmap_lock is needed by tb_gen_code, and mmap_lock must be
      * taken outside tb_lock.  Since we're momentarily dropping
@@ -308,7 +313,7 @@ static TranslationBlock *tb_find_slow(CPUState *cpu,
     tb_unlock();
     mmap_lock();
     tb_lock();
-    tb = tb_find_physical(cpu, pc, cs_base, flags);
+    tb = tb_htable_lookup(cpu, pc, cs_base, flags);
     if (tb) {
         mmap_unlock();
         goto found;
@@ -321,6 +326,7 @@ static TranslationBlock *tb_find_slow(CPUState *cpu,
 #ifdef CONFIG_USER_ONLY
     mmap_unlock();
 #endif
+#endif
 
 found:
     /* we add the TB in the virtual pc hash table */
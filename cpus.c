@@ -46,6 +46,7 @@
 #include "qapi-event.h"
 #include "hw/nmi.h"
 #include "sysemu/replay.h"
+#include "qemu/base64.h"
 
 #ifndef _WIN32
 #include "qemu/compatfd.h"
@@ -1738,6 +1739,277 @@ exit:
     fclose(f);
 }
 
+/* Limit on the data moved by one memory-read or memory-write */
+#define MEMORY_ACCESS_MAX (64 * 1024 * 1024)
+
+static bool memory_access_cpu(bool has_physical, bool physical,
+                              bool has_cpu_index, int64_t cpu_index,
+                              CPUState **cpu, Error **errp)
+{
+    *cpu = NULL;
+    if (!has_physical || physical) {
+        return true;
+    }
+    *cpu = qemu_get_cpu(has_cpu_index ? cpu_index : 0);
+    if (*cpu == NULL) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "cpu-index",
+                   "a CPU number");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Copy between @buf and guest memory at @addr, virtual for @cpu and
+ * physical if it is NULL.  Only RAM and ROM are accessed, directly, so
+ * this can be done while the vCPUs run; MMIO is refused since reading a
+ * device register may have side effects.  With a NULL @buf, only check
+ * that the access would succeed.
+ */
+static bool memory_access(CPUState *cpu, uint64_t addr, uint8_t *buf,
+                          uint64_t len, bool is_write, Error **errp)
+{
+    AddressSpace *as = &address_space_memory;
+
+    while (len) {
+        hwaddr phys = addr, xlat, l = len;
+        MemoryRegion *mr;
+
+        if (cpu) {
+            target_ulong page = addr & TARGET_PAGE_MASK;
+
+            phys = cpu_get_phys_page_debug(cpu, page);
+            if (phys == -1) {
+                error_setg(errp, "Address 0x%" PRIx64 " is not mapped", addr);
+                return false;
+            }
+            as = cpu->as;
+            phys += addr & ~TARGET_PAGE_MASK;
+            l = MIN(l, page + TARGET_PAGE_SIZE - addr);
+        }
+
+        rcu_read_lock();
+        mr = address_space_translate(as, phys, &xlat, &l, is_write);
+        if (!memory_access_is_direct(mr, is_write)) {
+            rcu_read_unlock();
+            error_setg(errp, "Address 0x%" PRIx64 " is not %s", addr,
+                       is_write ? "RAM" : "RAM or ROM");
+            return false;
+        }
+        if (buf) {
+            address_space_rw(as, phys, MEMTXATTRS_UNSPECIFIED, buf, l,
+                             is_write);
+            buf += l;
+        }
+        rcu_read_unlock();
+
+        addr += l;
+        len -= l;
+    }
+    return true;
+}
+
+/* Copy @len bytes from @fd to @buf, or back, at @offset in the file */
+static bool memory_access_fd(int fd, const char *fdname, uint8_t *buf,
+                             uint64_t len, int64_t offset, bool from_fd,
+                             Error **errp)
+{
+#ifndef _WIN32
+    uint64_t pos;
+    ssize_t n;
+
+    for (pos = 0; pos < len; pos += MAX(n, 0)) {
+        if (from_fd) {
+            n = pread(fd, buf + pos, len - pos, offset + pos);
+        } else {
+            n = pwrite(fd, buf + pos, len - pos, offset + pos);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            error_setg_errno(errp, errno, "Cannot %s '%s'",
+                             from_fd ? "read from" : "write to", fdname);
+            return false;
+        }
+        if (n == 0 && from_fd) {
+            error_setg(errp, "Unexpected end of file on '%s'", fdname);
+            return false;
+        }
+    }
+    return true;
+#else
+    error_setg(errp, "Parameter 'fdname' is not supported on this host");
+    return false;
+#endif
+}
+
+MemoryDataList *qmp_memory_read(MemoryRangeList *ranges,
+                                bool has_physical, bool physical,
+                                bool has_cpu_index, int64_t cpu_index,
+                                bool has_fdname, const char *fdname,
+                                bool has_offset, int64_t offset,
+                                Error **errp)
+{
+    MemoryDataList *head = NULL, *cur_item = NULL, *info;
+    MemoryRangeList *r;
+    CPUState *cpu;
+    uint8_t *buf = NULL;
+    uint64_t total = 0, pos;
+    int fd = -1;
+
+    if (!memory_access_cpu(has_physical, physical, has_cpu_index, cpu_index,
+                           &cpu, errp)) {
+        return NULL;
+    }
+
+    for (r = ranges; r; r = r->next) {
+        if (r->value->size < 0 ||
+            r->value->size > MEMORY_ACCESS_MAX - total) {
+            error_setg(errp, "Invalid size %" PRId64 " at address 0x%"
+                       PRIx64, r->value->size, r->value->addr);
+            return NULL;
+        }
+        total += r->value->size;
+    }
+
+    if (has_fdname) {
+        fd = monitor_get_fd(cur_mon, fdname, errp);
+        if (fd < 0) {
+            return NULL;
+        }
+    }
+
+    buf = g_malloc(total);
+    for (r = ranges, pos = 0; r; pos += r->value->size, r = r->next) {
+        if (!memory_access(cpu, r->value->addr, buf + pos, r->value->size,
+                           false, errp)) {
+            goto out;
+        }
+    }
+
+    if (fd >= 0 &&
+        !memory_access_fd(fd, fdname, buf, total, has_offset ? offset : 0,
+                          false, errp)) {
+        goto out;
+    }
+
+    for (r = ranges, pos = 0; r; pos += r->value->size, r = r->next) {
+        info = g_malloc0(sizeof(*info));
+        info->value = g_malloc0(sizeof(*info->value));
+        info->value->addr = r->value->addr;
+        info->value->has_size = true;
+        info->value->size = r->value->size;
+        if (fd < 0) {
+            info->value->has_data = true;
+            info->value->data = g_base64_encode(buf + pos, r->value->size);
+        }
+
+        if (!cur_item) {
+            head = cur_item = info;
+        } else {
+            cur_item->next = info;
+            cur_item = info;
+        }
+    }
+
+out:
+    if (fd >= 0) {
+        close(fd);
+    }
+    g_free(buf);
+    return head;
+}
+
+void qmp_memory_write(MemoryDataList *ranges,
+                      bool has_physical, bool physical,
+                      bool has_cpu_index, int64_t cpu_index,
+                      bool has_fdname, const char *fdname,
+                      bool has_offset, int64_t offset,
+                      Error **errp)
+{
+    MemoryDataList *r;
+    CPUState *cpu;
+    uint8_t *buf = NULL;
+    uint64_t total = 0, pos;
+    size_t len;
+    int fd = -1;
+
+    if (!memory_access_cpu(has_physical, physical, has_cpu_index, cpu_index,
+                           &cpu, errp)) {
+        return;
+    }
+
+    /* Gather all the data first, so that a bad range writes nothing */
+    for (r = ranges; r; r = r->next) {
+        if (has_fdname ? !r->value->has_size : !r->value->has_data) {
+            error_setg(errp, "Missing '%s' at address 0x%" PRIx64,
+                       has_fdname ? "size" : "data", r->value->addr);
+            return;
+        }
+        if (has_fdname) {
+            len = r->value->size;
+            if (r->value->size < 0) {
+                len = MEMORY_ACCESS_MAX + 1;
+            }
+        } else {
+            len = strlen(r->value->data) / 4 * 3;
+        }
+        if (len > MEMORY_ACCESS_MAX - total) {
+            error_setg(errp, "Invalid size at address 0x%" PRIx64,
+                       r->value->addr);
+            return;
+        }
+        total += len;
+    }
+
+    if (has_fdname) {
+        fd = monitor_get_fd(cur_mon, fdname, errp);
+        if (fd < 0) {
+            return;
+        }
+        buf = g_malloc(total);
+        if (!memory_access_fd(fd, fdname, buf, total, has_offset ? offset : 0,
+                              true, errp)) {
+            goto out;
+        }
+    } else {
+        buf = g_malloc(total);
+        for (r = ranges, pos = 0; r; r = r->next) {
+            uint8_t *data = qbase64_decode(r->value->data, -1, &len, errp);
+
+            if (!data) {
+                goto out;
+            }
+            memcpy(buf + pos, data, len);
+            g_free(data);
+            r->value->has_size = true;
+            r->value->size = len;
+            pos += len;
+        }
+    }
+
+    for (r = ranges; r; r = r->next) {
+        if (!memory_access(cpu, r->value->addr, NULL, r->value->size,
+                           true, errp)) {
+            goto out;
+        }
+    }
+    /* With virtual addresses, the page tables may have changed since */
+    for (r = ranges, pos = 0; r; pos += r->value->size, r = r->next) {
+        if (!memory_access(cpu, r->value->addr, buf + pos, r->value->size,
+                           true, errp)) {
+            goto out;
+        }
+    }
+
+out:
+    if (fd >= 0) {
+        close(fd);
+    }
+    g_free(buf);
+}
+
 void qmp_inject_nmi(Error **errp)
 {
     nmi_monitor_handle(monitor_get_cpu_index(), errp);
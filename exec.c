@@ -631,6 +631,8 @@ void cpu_exec_exit(CPUState *cpu)
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
         vmstate_unregister(NULL, &vmstate_cpu_common, cpu);
     }
+    g_free(cpu->dirty_ring);
+    cpu->dirty_ring = NULL;
 }
 
 void cpu_exec_init(CPUState *cpu, Error **errp)
@@ -1019,6 +1021,101 @@ bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
     return dirty;
 }
 
+/* Number of pages each vCPU can log between two dirty bitmap syncs; past
+ * that, the next sync falls back to walking the whole bitmap.
+ */
+#define DIRTY_RING_SIZE 4096
+
+/* Log in the dirty ring of @cpu that the page at @addr is about to be
+ * marked dirty for migration.  Returns false if the ring is full, in
+ * which case the page is only tracked by the bitmap.
+ *
+ * Called with the iothread lock held.
+ */
+bool cpu_physical_memory_dirty_ring_push(CPUState *cpu, ram_addr_t addr)
+{
+    if (cpu_physical_memory_get_dirty_flag(addr, DIRTY_MEMORY_MIGRATION)) {
+        /* Logged already, or covered by a full bitmap walk anyway */
+        return true;
+    }
+    if (!cpu->dirty_ring) {
+        cpu->dirty_ring = g_new(unsigned long, DIRTY_RING_SIZE);
+    }
+    if (cpu->dirty_ring_count == DIRTY_RING_SIZE) {
+        return false;
+    }
+    cpu->dirty_ring[cpu->dirty_ring_count++] = addr >> TARGET_PAGE_BITS;
+    return true;
+}
+
+/* Move the pages logged in the vCPU dirty rings from the migration dirty
+ * bitmap to @dest, and add the number of pages newly set in @dest to
+ * @num_dirty.  The cost is proportional to the number of pages written
+ * since the last sync rather than to the size of RAM.
+ *
+ * Returns false if some dirty pages were not logged in the rings; the
+ * caller must then sync the whole bitmap with
+ * cpu_physical_memory_sync_dirty_bitmap().
+ *
+ * Called with the iothread lock held.
+ */
+bool cpu_physical_memory_sync_dirty_rings(unsigned long *dest,
+                                          uint64_t *num_dirty)
+{
+    DirtyMemoryBlocks *blocks;
+    CPUState *cpu;
+    bool complete;
+    unsigned int i;
+
+    /* Pages marked dirty after this point are either logged in a ring or
+     * picked up by the next sync.
+     */
+    complete = !atomic_xchg(&ram_list.dirty_rings_incomplete, false);
+
+    rcu_read_lock();
+    blocks = atomic_rcu_read(&ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION]);
+    CPU_FOREACH(cpu) {
+        for (i = 0; complete && i < cpu->dirty_ring_count; i++) {
+            unsigned long page = cpu->dirty_ring[i];
+            unsigned long idx = page / DIRTY_MEMORY_BLOCK_SIZE;
+            unsigned long offset = page % DIRTY_MEMORY_BLOCK_SIZE;
+
+            if (bitmap_test_and_clear_atomic(blocks->blocks[idx], offset, 1) &&
+                !test_and_set_bit(page, dest)) {
+                (*num_dirty)++;
+            }
+        }
+        cpu->dirty_ring_count = 0;
+    }
+    rcu_read_unlock();
+
+    return complete;
+}
+
+/* Write-protect RAM in the TCG TLBs again after the migration dirty bits
+ * were cleared, so that the next write to each page goes through the
+ * notdirty slow path and gets logged.
+ *
+ * Called with the iothread lock held.
+ */
+void cpu_physical_memory_rearm_dirty_tracking(void)
+{
+    RAMBlock *block;
+    CPUState *cpu;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    rcu_read_lock();
+    QLIST_FOREACH_RCU(block, &ram_list.blocks, next) {
+        CPU_FOREACH(cpu) {
+            tlb_reset_dirty(cpu, (uintptr_t)block->host, block->used_length);
+        }
+    }
+    rcu_read_unlock();
+}
+
 /* Called from RCU critical section */
 hwaddr memory_region_section_get_iotlb(CPUState *cpu,
                                        MemoryRegionSection *section,
@@ -1976,6 +2073,7 @@ static void notdirty_mem_write(void *opaque, hwaddr ram_addr,
     if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
         tb_invalidate_phys_page_fast(ram_addr, size);
     }
+    cpu_physical_memory_prepare_write(ram_addr, size);
     switch (size) {
     case 1:
         stb_p(qemu_map_ram_ptr(NULL, ram_addr), val);
@@ -1990,10 +2088,17 @@ static void notdirty_mem_write(void *opaque, hwaddr ram_addr,
         abort();
     }
     /* Set both VGA and migration bits for simplicity and to remove
-     * the notdirty callback faster.
+     * the notdirty callback faster.  The migration bit is logged in the
+     * dirty ring of the CPU, unless it has overflowed.
      */
-    cpu_physical_memory_set_dirty_range(ram_addr, size,
-                                        DIRTY_CLIENTS_NOCODE);
+    if (cpu_physical_memory_dirty_ring_push(current_cpu, ram_addr)) {
+        cpu_physical_memory_set_dirty_range(ram_addr, size,
+                                            1 << DIRTY_MEMORY_VGA);
+        cpu_physical_memory_set_dirty_flag(ram_addr, DIRTY_MEMORY_MIGRATION);
+    } else {
+        cpu_physical_memory_set_dirty_range(ram_addr, size,
+                                            DIRTY_CLIENTS_NOCODE);
+    }
     /* we remove the notdirty callback only if the code has been
        flushed */
     if (!cpu_physical_memory_is_clean(ram_addr)) {
@@ -2562,6 +2667,8 @@ static MemTxResult address_space_write_continue(AddressSpace *as, hwaddr addr,
         } else {
             /* RAM case */
             ptr = qemu_map_ram_ptr(mr->ram_block, addr1);
+            cpu_physical_memory_prepare_write(
+                memory_region_get_ram_addr(mr) + addr1, l);
             memcpy(ptr, buf, l);
             invalidate_and_set_dirty(mr, addr1, l);
         }
@@ -2715,9 +2822,33 @@ void cpu_physical_memory_rw(hwaddr addr, uint8_t *buf,
 
 enum write_rom_type {
     WRITE_DATA,
+    UPDATE_DATA,
     FLUSH_CACHE,
 };
 
+/* Write only the target pages of [ptr, ptr + len) whose contents differ
+ * from buf, so that translated code for the unchanged pages survives.
+ */
+static void update_rom_pages(MemoryRegion *mr, hwaddr addr1, uint8_t *ptr,
+                             const uint8_t *buf, hwaddr len)
+{
+    hwaddr l;
+
+    while (len > 0) {
+        l = MIN(len, TARGET_PAGE_SIZE - (addr1 & ~TARGET_PAGE_MASK));
+        if (memcmp(ptr, buf, l) != 0) {
+            cpu_physical_memory_prepare_write(
+                memory_region_get_ram_addr(mr) + addr1, l);
+            memcpy(ptr, buf, l);
+            invalidate_and_set_dirty(mr, addr1, l);
+        }
+        len -= l;
+        buf += l;
+        ptr += l;
+        addr1 += l;
+    }
+}
+
 static inline void cpu_physical_memory_write_rom_internal(AddressSpace *as,
     hwaddr addr, const uint8_t *buf, int len, enum write_rom_type type)
 {
@@ -2739,9 +2870,14 @@ static inline void cpu_physical_memory_write_rom_internal(AddressSpace *as,
             ptr = qemu_map_ram_ptr(mr->ram_block, addr1);
             switch (type) {
             case WRITE_DATA:
+                cpu_physical_memory_prepare_write(
+                    memory_region_get_ram_addr(mr) + addr1, l);
                 memcpy(ptr, buf, l);
                 invalidate_and_set_dirty(mr, addr1, l);
                 break;
+            case UPDATE_DATA:
+                update_rom_pages(mr, addr1, ptr, buf, l);
+                break;
             case FLUSH_CACHE:
                 flush_icache_range((uintptr_t)ptr, (uintptr_t)ptr + l);
                 break;
@@ -2761,6 +2897,15 @@ void cpu_physical_memory_write_rom(AddressSpace *as, hwaddr addr,
     cpu_physical_memory_write_rom_internal(as, addr, buf, len, WRITE_DATA);
 }
 
+/* Like cpu_physical_memory_write_rom, but skips the target pages that
+ * already hold the data; used to restore ROM images on reset.
+ */
+void cpu_physical_memory_update_rom(AddressSpace *as, hwaddr addr,
+                                    const uint8_t *buf, int len)
+{
+    cpu_physical_memory_write_rom_internal(as, addr, buf, len, UPDATE_DATA);
+}
+
 void cpu_flush_icache_range(hwaddr start, int len)
 {
     /*
@@ -2947,6 +3092,10 @@ void *address_space_map(AddressSpace *as,
     memory_region_ref(mr);
     *plen = done;
     ptr = qemu_ram_ptr_length(mr->ram_block, base, plen);
+    if (is_write) {
+        cpu_physical_memory_prepare_write(memory_region_get_ram_addr(mr) + base,
+                                          *plen);
+    }
     rcu_read_unlock();
 
     return ptr;
@@ -3319,6 +3468,8 @@ void address_space_stl_notdirty(AddressSpace *as, hwaddr addr, uint32_t val,
         r = memory_region_dispatch_write(mr, addr1, val, 4, attrs);
     } else {
         ptr = qemu_map_ram_ptr(mr->ram_block, addr1);
+        cpu_physical_memory_prepare_write(memory_region_get_ram_addr(mr) + addr1,
+                                          4);
         stl_p(ptr, val);
 
         dirty_log_mask = memory_region_get_dirty_log_mask(mr);
@@ -3374,6 +3525,8 @@ static inline void address_space_stl_internal(AddressSpace *as,
     } else {
         /* RAM case */
         ptr = qemu_map_ram_ptr(mr->ram_block, addr1);
+        cpu_physical_memory_prepare_write(memory_region_get_ram_addr(mr) + addr1,
+                                          4);
         switch (endian) {
         case DEVICE_LITTLE_ENDIAN:
             stl_le_p(ptr, val);
@@ -3483,6 +3636,8 @@ static inline void address_space_stw_internal(AddressSpace *as,
     } else {
         /* RAM case */
         ptr = qemu_map_ram_ptr(mr->ram_block, addr1);
+        cpu_physical_memory_prepare_write(memory_region_get_ram_addr(mr) + addr1,
+                                          2);
         switch (endian) {
         case DEVICE_LITTLE_ENDIAN:
             stw_le_p(ptr, val);
@@ -310,6 +310,41 @@ static void *load_at(int fd, off_t offset, size_t size)
     return ptr;
 }
 
+/*
+ * Symbols of an ELF image, for the disassembler.  The symbol and string
+ * tables are copied when the image is loaded, so that the file is not
+ * kept mapped; the symbols are only sorted by the first lookup.
+ */
+typedef struct ElfSymInfo {
+    struct syminfo s;
+    void *syms;
+    uint64_t syms_size;
+    char *strtab;
+    uint64_t strtab_size;
+    int must_swab;
+    int clear_lsb;
+    bool parsed;
+} ElfSymInfo;
+
+/* Return a pointer to part of a mapped image, NULL if not in the file */
+static void *elf_image_ptr(GMappedFile *file, uint64_t offset, uint64_t size)
+{
+    uint64_t length = g_mapped_file_get_length(file);
+
+    if (offset > length || size > length - offset) {
+        return NULL;
+    }
+    return g_mapped_file_get_contents(file) + offset;
+}
+
+/* Return a copy of part of a mapped image, NULL if not in the file */
+static void *elf_image_dup(GMappedFile *file, uint64_t offset, uint64_t size)
+{
+    void *ptr = elf_image_ptr(file, offset, size);
+
+    return ptr ? g_memdup(ptr, size) : NULL;
+}
+
 #ifdef ELF_CLASS
 #undef ELF_CLASS
 #endif
@@ -783,6 +818,8 @@ struct Rom {
     size_t datasize;
 
     uint8_t *data;
+    /* If set, data points into this mapping and is not to be freed */
+    GMappedFile *mapped_file;
     MemoryRegion *mr;
     int isrom;
     char *fw_dir;
@@ -795,6 +832,17 @@ struct Rom {
 static FWCfgState *fw_cfg;
 static QTAILQ_HEAD(, Rom) roms = QTAILQ_HEAD_INITIALIZER(roms);
 
+static void rom_free_data(Rom *rom)
+{
+    if (rom->mapped_file) {
+        g_mapped_file_unref(rom->mapped_file);
+        rom->mapped_file = NULL;
+    } else {
+        g_free(rom->data);
+    }
+    rom->data = NULL;
+}
+
 static void rom_insert(Rom *rom)
 {
     Rom *item;
@@ -972,11 +1020,14 @@ MemoryRegion *rom_add_blob(const char *name, const void *blob, size_t len,
 
 /* This function is specific for elf program because we don't need to allocate
  * all the rom. We just allocate the first part and the rest is just zeros. This
- * is why romsize and datasize are different. Also, this function seize the
- * memory ownership of "data", so we don't have to allocate and copy the buffer.
+ * is why romsize and datasize are different. Also, "data" points into the
+ * mapped ELF file, which is referenced until the first reset, so we don't
+ * have to allocate and copy the buffer.  The file must not be truncated or
+ * rewritten in place before then; after it, ROM segments are dropped and
+ * RAM segments are copied.
  */
-int rom_add_elf_program(const char *name, void *data, size_t datasize,
-                        size_t romsize, hwaddr addr)
+int rom_add_elf_program(const char *name, GMappedFile *mapped_file, void *data,
+                        size_t datasize, size_t romsize, hwaddr addr)
 {
     Rom *rom;
 
@@ -992,6 +1043,7 @@ int rom_add_elf_program(const char *name, void *data, size_t datasize,
     rom->datasize = datasize;
     rom->romsize  = romsize;
     rom->data     = data;
+    rom->mapped_file = g_mapped_file_ref(mapped_file);
     rom_insert(rom);
     return 0;
 }
@@ -1029,13 +1081,27 @@ static void rom_reset(void *unused)
             void *host = memory_region_get_ram_ptr(rom->mr);
             memcpy(host, rom->data, rom->datasize);
         } else {
-            cpu_physical_memory_write_rom(&address_space_memory,
-                                          rom->addr, rom->data, rom->datasize);
+            /*
+             * Only rewrite the pages that the guest changed since the last
+             * reset, so that the code translated from the unchanged ones
+             * (typically all of flash) can be reused.
+             */
+            cpu_physical_memory_update_rom(&address_space_memory,
+                                           rom->addr, rom->data, rom->datasize);
         }
         if (rom->isrom) {
             /* rom needs to be written only once */
-            g_free(rom->data);
-            rom->data = NULL;
+            rom_free_data(rom);
+        } else if (rom->mapped_file) {
+            /*
+             * RAM is written again at each reset; keep a copy rather than
+             * the mapping, since the file may be rebuilt in place meanwhile.
+             * This costs the same memory as reading the segment did; only
+             * ROM segments, typically all of flash, are never copied.
+             */
+            rom->data = g_memdup(rom->data, rom->datasize);
+            g_mapped_file_unref(rom->mapped_file);
+            rom->mapped_file = NULL;
         }
         /*
          * The rom loader is really on the same level as firmware in the guest
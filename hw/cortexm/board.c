@@ -138,6 +138,11 @@ BoardGraphicContext *cortexm_board_init_graphic_image(CortexMBoardState *board,
 static void cortexm_board_class_init_callback(ObjectClass *klass, void *data)
 {
     qemu_log_function_name();
+
+    MachineClass *mc = MACHINE_CLASS(klass);
+
+    /* Peripherals like the remote ones may be added with -device. */
+    mc->has_dynamic_sysbus = true;
 }
 
 static const TypeInfo cortexm_board_type_init = {
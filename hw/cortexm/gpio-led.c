@@ -196,7 +196,7 @@ static void gpio_led_turn(GPIOLEDState *state, bool is_on)
  */
 static void gpio_led_irq_handler(void *opaque, int n, int level)
 {
-    GPIOLEDState *state = GPIO_LED_STATE(opaque);
+    GPIOLEDState *state = GPIO_LED_STATE_FAST(opaque);
 
     /* There should be only one IRQ for the LED */
     assert(n == 0);
@@ -25,6 +25,9 @@
 
 #include "qemu/osdep.h"
 #include "qemu/timer.h"
+#include "qemu/atomic.h"
+#include "qemu/thread.h"
+#include "qemu/event_notifier.h"
 #include "qemu/error-report.h"
 
 #if defined(CONFIG_VERBOSE)
@@ -49,15 +52,195 @@ static void cortexm_graphic_led_turn(BoardGraphicContext *board_graphic_context,
 static bool is_not_nographic = false;
 static bool is_terminated = false;
 
+/*
+ * Graphic events are passed between threads on lock-free lists; the
+ * devices post to the SDL thread, and the SDL thread posts the user
+ * actions back to the I/O thread. Producers push on the head, the
+ * consumer takes the whole list at once and reverses it.
+ */
+typedef struct GraphicEvent {
+    struct GraphicEvent *next;
+    int code;
+    void *data1;
+    void *data2;
+} GraphicEvent;
+
+typedef struct {
+    GraphicEvent *head;
+} GraphicEventQueue;
+
+/* Device requests, processed on the SDL thread. */
+static GraphicEventQueue ui_queue;
+
+/* User actions, processed on the I/O thread. */
+static GraphicEventQueue io_queue;
+static EventNotifier io_notifier;
+
+static QemuThread sdl_thread;
+static QemuEvent terminated_event;
+
+#if !defined(USE_GRAPHIC_POLL_EVENT)
+static QemuEvent start_event;
+static QemuEvent ready_event;
+#endif /* !defined(USE_GRAPHIC_POLL_EVENT) */
+
 /* ------------------------------------------------------------------------- */
 
-static void cortexm_graphic_process_event(SDL_Event* event)
+/*
+ * Returns true if the queue was empty, in which case the consumer
+ * must be woken up.
+ */
+static bool cortexm_graphic_queue_push(GraphicEventQueue *queue, int code,
+        void *data1, void *data2)
+{
+    GraphicEvent *event = g_new(GraphicEvent, 1);
+    GraphicEvent *head;
+
+    event->code = code;
+    event->data1 = data1;
+    event->data2 = data2;
+
+    do {
+        head = atomic_read(&queue->head);
+        event->next = head;
+    } while (atomic_cmpxchg(&queue->head, head, event) != head);
+
+    return (head == NULL);
+}
+
+/*
+ * Take all queued events, in the order they were pushed.
+ */
+static GraphicEvent *cortexm_graphic_queue_take(GraphicEventQueue *queue)
+{
+    GraphicEvent *event = atomic_xchg(&queue->head, NULL);
+    GraphicEvent *first = NULL;
+    GraphicEvent *next;
+
+    while (event != NULL) {
+        next = event->next;
+        event->next = first;
+        first = event;
+        event = next;
+    }
+    return first;
+}
+
+/*
+ * Called on the SDL thread, to pass user actions to the devices.
+ */
+static void cortexm_graphic_post_io_event(int code, void *data1, void *data2)
+{
+    if (cortexm_graphic_queue_push(&io_queue, code, data1, data2)) {
+        event_notifier_set(&io_notifier);
+    }
+}
+
+/*
+ * Called on the I/O thread, with the iothread lock taken.
+ */
+static void cortexm_graphic_process_io_events(EventNotifier *notifier)
+{
+    GraphicEvent *event;
+    GraphicEvent *next;
+
+    event_notifier_test_and_clear(notifier);
+
+    for (event = cortexm_graphic_queue_take(&io_queue); event != NULL;
+            event = next) {
+        next = event->next;
+
+        switch (event->code) {
+
+        case GRAPHIC_EVENT_WINDOW_CLOSE:
+            // Quit the program
+            fprintf(stderr, "Graphic window closed. Quit.\n");
+            exit(1);
+
+        default:
+            qemu_log_mask(LOG_UNIMP, "Unimplemented I/O event %d\n",
+                    event->code);
+        }
+        g_free(event);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void cortexm_graphic_process_user_event(int code, void *data1,
+        void *data2)
 {
     GPIOLEDState *state;
     bool is_on;
     BoardGraphicContext *board_graphic_context;
-    int exit_code;
 
+    switch (code) {
+
+    case GRAPHIC_EVENT_WAKEUP:
+        /* The queue is processed after each event. */
+        break;
+
+    case GRAPHIC_EVENT_BOARD_INIT:
+        board_graphic_context = (BoardGraphicContext *) data1;
+
+        if (!cortexm_graphic_board_is_graphic_context_initialised(
+                board_graphic_context)) {
+            cortexm_graphic_board_init_graphic_context(board_graphic_context);
+        }
+        break;
+
+    case GRAPHIC_EVENT_LED_INIT:
+        state = (GPIOLEDState *) data1;
+
+        if (!cortexm_graphic_led_is_graphic_context_initialised(
+                &(state->led_graphic_context))) {
+            cortexm_graphic_led_init_graphic_context(
+                    state->board_graphic_context,
+                    &(state->led_graphic_context), state->colour.red,
+                    state->colour.green, state->colour.blue);
+        }
+        break;
+
+    case GRAPHIC_EVENT_LED_TURN:
+        state = (GPIOLEDState *) data1;
+        is_on = (bool) data2;
+
+        cortexm_graphic_led_turn(state->board_graphic_context,
+                &(state->led_graphic_context), is_on);
+        break;
+
+    case GRAPHIC_EVENT_QUIT:
+        cortexm_graphic_quit();
+        break;
+
+    default:
+        qemu_log_mask(LOG_UNIMP, "Unimplemented user event %d\n", code);
+    }
+}
+
+/*
+ * Process the device requests queued since the last call. Once SDL
+ * was quit, the requests are discarded.
+ */
+static void cortexm_graphic_process_queue(void)
+{
+    GraphicEvent *event;
+    GraphicEvent *next;
+
+    for (event = cortexm_graphic_queue_take(&ui_queue); event != NULL;
+            event = next) {
+        next = event->next;
+        if (!atomic_read(&is_terminated)) {
+            cortexm_graphic_process_user_event(event->code, event->data1,
+                    event->data2);
+        }
+        g_free(event);
+    }
+}
+
+#if defined(CONFIG_SDL)
+static void cortexm_graphic_process_event(SDL_Event* event)
+{
     switch (event->type) {
 
 #if defined(CONFIG_SDLABI_2_0)
@@ -90,62 +273,14 @@ static void cortexm_graphic_process_event(SDL_Event* event)
         break;
 
     case SDL_QUIT:
-        // Quit the program
-        fprintf(stderr, "Graphic window closed. Quit.\n");
-        cortexm_graphic_quit();
-        exit(1);
+        // Let the I/O thread quit the program.
+        cortexm_graphic_post_io_event(GRAPHIC_EVENT_WINDOW_CLOSE, NULL, NULL);
+        break;
 
     case SDL_USEREVENT:
-
         // User events, enqueued with SDL_PushEvent().
-        switch (event->user.code) {
-
-        case GRAPHIC_EVENT_BOARD_INIT:
-            board_graphic_context = (BoardGraphicContext *) event->user.data1;
-
-            if (!cortexm_graphic_board_is_graphic_context_initialised(
-                    board_graphic_context)) {
-                cortexm_graphic_board_init_graphic_context(
-                        board_graphic_context);
-            }
-            break;
-
-        case GRAPHIC_EVENT_LED_INIT:
-            state = (GPIOLEDState *) event->user.data1;
-
-            if (!cortexm_graphic_led_is_graphic_context_initialised(
-                    &(state->led_graphic_context))) {
-                cortexm_graphic_led_init_graphic_context(
-                        state->board_graphic_context,
-                        &(state->led_graphic_context), state->colour.red,
-                        state->colour.green, state->colour.blue);
-            }
-            break;
-
-        case GRAPHIC_EVENT_LED_TURN:
-            state = (GPIOLEDState *) event->user.data1;
-            is_on = (bool) event->user.data2;
-
-            cortexm_graphic_led_turn(state->board_graphic_context,
-                    &(state->led_graphic_context), is_on);
-            break;
-
-        case GRAPHIC_EVENT_QUIT:
-            cortexm_graphic_quit();
-            break;
-
-        case GRAPHIC_EVENT_EXIT:
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
-            exit_code = (int) event->user.data1;
-#pragma GCC diagnostic pop
-            cortexm_graphic_quit();
-            exit(exit_code);
-
-        default:
-            qemu_log_mask(LOG_UNIMP, "Unimplemented user event %d\n",
-                    event->user.code);
-        }
+        cortexm_graphic_process_user_event(event->user.code,
+                event->user.data1, event->user.data2);
         break;
 
     default:
@@ -153,6 +288,7 @@ static void cortexm_graphic_process_event(SDL_Event* event)
         break;
     }
 }
+#endif /* defined(CONFIG_SDL) */
 
 #if defined(USE_GRAPHIC_POLL_EVENT)
 static QEMUTimer *event_loop_timer;
@@ -167,10 +303,16 @@ void cortexm_graphic_init_timer(void)
 
     /* The event loop will be processed from time to time. */
     event_loop_timer = timer_new_ms(QEMU_CLOCK_REALTIME, (void (*)(void *))cortexm_graphic_event_loop, &event_loop_timer);
+    /* Let the wakeups be batched with other ones. */
+    timer_set_slack(event_loop_timer, 10);
     timer_mod(event_loop_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME));
 }
 #endif /* defined(USE_GRAPHIC_POLL_EVENT) */
 
+#if defined(CONFIG_SDL)
+static void cortexm_graphic_sdl_init(void);
+#endif /* defined(CONFIG_SDL) */
+
 void cortexm_graphic_event_loop(void)
 {
 #if !defined(USE_GRAPHIC_POLL_EVENT)
@@ -183,13 +325,25 @@ void cortexm_graphic_event_loop(void)
 
 #if !defined(USE_GRAPHIC_POLL_EVENT)
 
+    // Wait for the application thread to parse the options.
+    qemu_event_wait(&start_event);
+    if (is_not_nographic) {
+        return;
+    }
+
+    cortexm_graphic_sdl_init();
+    qemu_event_set(&ready_event);
+
 #if defined(CONFIG_SDLABI_2_0)
     // Raise graphic responsiveness.
     SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
 #endif
 
+    // Sleep until there is something to do; the devices wake up the
+    // thread with a GRAPHIC_EVENT_WAKEUP.
     while (SDL_WaitEvent(&event)) {
         cortexm_graphic_process_event(&event);
+        cortexm_graphic_process_queue();
     }
 
 #else
@@ -197,6 +351,7 @@ void cortexm_graphic_event_loop(void)
     while (SDL_PollEvent(&event)) {
         cortexm_graphic_process_event(&event);
     }
+    cortexm_graphic_process_queue();
 
     timer_mod(event_loop_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + 10);
 
@@ -206,31 +361,32 @@ void cortexm_graphic_event_loop(void)
 }
 
 /*
- * Called from different threads to enqueue jobs via the event loop.
+ * Called from different threads to enqueue jobs for the event loop.
  * This ensures all graphic primitives are executed on the allowed thread.
+ * Never blocks; only the first job queued after the event loop ran
+ * posts an SDL event to wake it up.
  */
 int cortexm_graphic_push_event(int code, void *data1, void *data2)
 {
     qemu_log_mask(LOG_TRACE, "%s(%d)\n", __FUNCTION__, code);
 
+    if (is_not_nographic || atomic_read(&is_terminated)) {
+        return 0;
+    }
+
 #if defined(CONFIG_SDL)
 
     SDL_Event event;
 
-    event.type = SDL_USEREVENT;
-    event.user.code = code;
-    event.user.data1 = data1;
-    event.user.data2 = data2;
-
-    // TODO: if multi-thread access is needed, add a mutex.
-    int ret = SDL_PushEvent(&event);
+    if (!cortexm_graphic_queue_push(&ui_queue, code, data1, data2)) {
+        return 0;
+    }
 
-#if defined(CONFIG_SDLABI_2_0)
-    // Used to give the scheduler a chance to yield.
-    SDL_Delay(1);
-#endif
+    memset(&event, 0, sizeof(event));
+    event.type = SDL_USEREVENT;
+    event.user.code = GRAPHIC_EVENT_WAKEUP;
 
-    return ret;
+    return SDL_PushEvent(&event);
 
 #else
 
@@ -297,32 +453,63 @@ void cortexm_graphic_quit(void)
     qemu_log_mask(LOG_TRACE, "%s() SDL_Quit()\n", __FUNCTION__);
     SDL_Quit();
 
-    is_terminated = true;
+    atomic_set(&is_terminated, true);
+    qemu_event_set(&terminated_event);
 
 #endif /* defined(CONFIG_SDL) */
 }
 
 /* ------------------------------------------------------------------------- */
 
-static QemuThread start_thread;
-
 /*
  * Called via the atexit() mechanism, to clean the board graphic context.
  */
 static void cortexm_graphic_atexit(void)
 {
-    if (qemu_thread_is_self(&start_thread)) {
-        // If running on the main thread, directly quit.
+    if (atomic_read(&is_terminated)) {
+        return;
+    }
+
+    if (qemu_thread_is_self(&sdl_thread)) {
+        // If running on the SDL thread, directly quit.
         cortexm_graphic_quit();
     } else {
-        // If on another thread, defer to main thread and wait.
+        // If on another thread, defer to the SDL thread and wait.
         cortexm_graphic_push_event(GRAPHIC_EVENT_QUIT, NULL, NULL);
 
-        while (!is_terminated) {
-            qemu_log_mask(LOG_TRACE, "%s() wait\n", __FUNCTION__);
-            SDL_Delay(100);
-        }
+        qemu_log_mask(LOG_TRACE, "%s() wait\n", __FUNCTION__);
+        qemu_event_wait(&terminated_event);
+    }
+}
+
+#if defined(CONFIG_SDL)
+/*
+ * Called on the thread which will run the SDL event loop.
+ */
+static void cortexm_graphic_sdl_init(void)
+{
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        error_printf("Unable to initialize SDL:  %s\n", SDL_GetError());
+        exit(1);
     }
+
+    atexit(cortexm_graphic_atexit);
+
+    qemu_thread_get_self(&sdl_thread);
+}
+#endif /* defined(CONFIG_SDL) */
+
+/*
+ * Called on the main thread, before any other thread is created.
+ */
+void cortexm_graphic_init(void)
+{
+    qemu_event_init(&terminated_event, false);
+
+#if !defined(USE_GRAPHIC_POLL_EVENT)
+    qemu_event_init(&start_event, false);
+    qemu_event_init(&ready_event, false);
+#endif /* !defined(USE_GRAPHIC_POLL_EVENT) */
 }
 
 /*
@@ -336,22 +523,27 @@ void cortexm_graphic_start(bool nographic)
 
     is_not_nographic = nographic;
 
-    if (is_not_nographic) {
-        return;
+    if (!is_not_nographic) {
+        event_notifier_init(&io_notifier, 0);
+        event_notifier_set_handler(&io_notifier, false,
+                cortexm_graphic_process_io_events);
     }
 
-#if defined(CONFIG_SDL)
+#if !defined(USE_GRAPHIC_POLL_EVENT)
 
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-        error_printf("Unable to initialize SDL:  %s\n", SDL_GetError());
-        exit(1);
+    // SDL is initialised on the main thread, which runs its event loop.
+    qemu_event_set(&start_event);
+    if (!is_not_nographic) {
+        qemu_event_wait(&ready_event);
     }
 
-    atexit(cortexm_graphic_atexit);
+#elif defined(CONFIG_SDL)
 
-#endif /* defined(CONFIG_SDL) */
+    if (!is_not_nographic) {
+        cortexm_graphic_sdl_init();
+    }
 
-    qemu_thread_get_self(&start_thread);
+#endif /* !defined(USE_GRAPHIC_POLL_EVENT) */
 }
 
 /* ------------------------------------------------------------------------- */
@@ -246,49 +246,49 @@ void peripheral_register_compute_auto_bits(Object *obj)
 
 peripheral_register_t peripheral_register_read_value(Object* obj)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(obj);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(obj);
 
     return (state->value & state->readable_bits);
 }
 
 void peripheral_register_write_value(Object* obj, peripheral_register_t value)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(obj);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(obj);
 
     state->value = value & state->writable_bits;
 }
 
 peripheral_register_t peripheral_register_get_raw_value(Object* obj)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(obj);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(obj);
 
     return state->value;
 }
 
 void peripheral_register_set_raw_value(Object* obj, peripheral_register_t value)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(obj);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(obj);
 
     state->value = value;
 }
 
 void peripheral_register_or_raw_value(Object* obj, peripheral_register_t value)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(obj);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(obj);
 
     state->value |= value;
 }
 
 void peripheral_register_and_raw_value(Object* obj, peripheral_register_t value)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(obj);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(obj);
 
     state->value &= value;
 }
 
 peripheral_register_t peripheral_register_get_raw_prev_value(Object* obj)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(obj);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(obj);
 
     return state->prev_value;
 }
@@ -460,8 +460,8 @@ peripheral_register_t peripheral_register_widen(peripheral_register_t old_value,
 static peripheral_register_t peripheral_register_read_callback(Object *reg,
         Object *periph, uint32_t addr, uint32_t offset, unsigned size)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(reg);
-    PeripheralState *periph_state = PERIPHERAL_STATE(periph);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(reg);
+    PeripheralState *periph_state = PERIPHERAL_STATE_FAST(periph);
 
     /* Validate alignment */
     if (!peripheral_register_check_access(size, offset, state->access_flags)) {
@@ -504,8 +504,8 @@ static void peripheral_register_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value)
 {
-    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE(reg);
-    PeripheralState *periph_state = PERIPHERAL_STATE(periph);
+    PeripheralRegisterState *state = PERIPHERAL_REGISTER_STATE_FAST(reg);
+    PeripheralState *periph_state = PERIPHERAL_STATE_FAST(periph);
 
     /* Validate alignment */
     if (!peripheral_register_check_access(size, offset, state->access_flags)) {
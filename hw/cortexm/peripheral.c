@@ -60,8 +60,8 @@ Object *peripheral_new_with_info(Object *parent_obj, const char *node_name,
 static uint64_t peripheral_read_callback(void *opaque, hwaddr addr,
         unsigned size)
 {
-    PeripheralState *state = (PeripheralState *) opaque;
-    PeripheralClass *per_class = PERIPHERAL_GET_CLASS(opaque);
+    PeripheralState *state = PERIPHERAL_STATE_FAST(opaque);
+    PeripheralClass *per_class = PERIPHERAL_GET_CLASS_FAST(state);
 
     if (per_class->is_enabled) {
         if (!per_class->is_enabled(OBJECT(state))) {
@@ -83,8 +83,7 @@ static uint64_t peripheral_read_callback(void *opaque, hwaddr addr,
     }
 #endif
 
-    PeripheralRegisterState *reg = PERIPHERAL_REGISTER_STATE(
-            state->registers[index]);
+    PeripheralRegisterState *reg = state->registers[index];
     if (reg == NULL) {
         qemu_log_mask(LOG_UNIMP,
                 "%s: Peripheral read of size %d at offset " "0x%"PRIX64" not implemented.\n",
@@ -96,7 +95,7 @@ static uint64_t peripheral_read_callback(void *opaque, hwaddr addr,
     uint32_t reg_addr = addr & ~(state->register_size_bytes - 1);
     uint32_t reg_offset = addr & (state->register_size_bytes - 1);
 
-    PeripheralRegisterClass *reg_class = PERIPHERAL_REGISTER_GET_CLASS(reg);
+    PeripheralRegisterClass *reg_class = PERIPHERAL_REGISTER_GET_CLASS_FAST(reg);
 
     /* Read the register value. */
     uint64_t value = 0;
@@ -120,9 +119,9 @@ static uint64_t peripheral_read_callback(void *opaque, hwaddr addr,
 static void peripheral_write_callback(void *opaque, hwaddr addr, uint64_t value,
         unsigned size)
 {
-    PeripheralState *state = (PeripheralState *) opaque;
+    PeripheralState *state = PERIPHERAL_STATE_FAST(opaque);
 
-    PeripheralClass *per_class = PERIPHERAL_GET_CLASS(opaque);
+    PeripheralClass *per_class = PERIPHERAL_GET_CLASS_FAST(state);
 
     if (per_class->is_enabled) {
         if (!per_class->is_enabled(OBJECT(state))) {
@@ -144,8 +143,7 @@ static void peripheral_write_callback(void *opaque, hwaddr addr, uint64_t value,
 #endif
 
     // Identify the register inside the peripheral, by index.
-    PeripheralRegisterState *reg = PERIPHERAL_REGISTER_STATE(
-            state->registers[index]);
+    PeripheralRegisterState *reg = state->registers[index];
     if (reg == NULL) {
         qemu_log_mask(LOG_UNIMP,
                 "%s: Write of size %d at offset 0x%"PRIX64" not implemented.\n",
@@ -157,7 +155,7 @@ static void peripheral_write_callback(void *opaque, hwaddr addr, uint64_t value,
     uint32_t reg_addr = addr & ~(state->register_size_bytes - 1);
     uint32_t reg_offset = addr & (state->register_size_bytes - 1);
 
-    PeripheralRegisterClass *reg_class = PERIPHERAL_REGISTER_GET_CLASS(reg);
+    PeripheralRegisterClass *reg_class = PERIPHERAL_REGISTER_GET_CLASS_FAST(reg);
     /* Write the value to the register. */
     if (reg_class->write) {
         reg_class->write(OBJECT(reg), OBJECT(state), reg_addr, reg_offset, size,
@@ -232,11 +230,11 @@ static int peripheral_populate_registers_array_foreach(Object *obj,
         assert(index < periph->registers_size_ptrs);
         if (periph->registers[index]) {
             error_report("Register %s overlaps %s at 0x%X", reg->name,
-            PERIPHERAL_REGISTER_STATE(periph->registers[index])->name,
-                    reg->offset_bytes);
+                    periph->registers[index]->name, reg->offset_bytes);
         }
 
-        periph->registers[index] = obj;
+        /* Checked here once, so that accesses need not check it again. */
+        periph->registers[index] = reg;
 
         peripheral_register_compute_auto_bits(obj);
     }
@@ -254,13 +252,18 @@ static void peripheral_realize_callback(DeviceState *dev, Error **errp)
     }
 
     PeripheralState *state = PERIPHERAL_STATE(dev);
+    PeripheralClass *per_class = PERIPHERAL_GET_CLASS(dev);
 
     const char *node_name = state->mmio_node_name;
     if (node_name == NULL) {
         node_name = "mmio";
     }
-    memory_region_init_io(&state->mmio, OBJECT(dev), &register_ops, state,
-            node_name, state->mmio_size_bytes);
+    const MemoryRegionOps *ops = per_class->mmio_ops;
+    if (ops == NULL) {
+        ops = &register_ops;
+    }
+    memory_region_init_io(&state->mmio, OBJECT(dev), ops, state, node_name,
+            state->mmio_size_bytes);
 
     sysbus_init_mmio(SYS_BUS_DEVICE(dev), &state->mmio);
     sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0x0, state->mmio_address);
@@ -285,7 +288,8 @@ static void peripheral_realize_callback(DeviceState *dev, Error **errp)
             / state->register_size_bytes) + 1;
 
     /* Allocate the array of pointers to registers. */
-    state->registers = g_malloc0_n(state->registers_size_ptrs, sizeof(Object*));
+    state->registers = g_new0(PeripheralRegisterState *,
+            state->registers_size_ptrs);
 
     /* Fill in the array with pointers to registers. */
     object_child_foreach(OBJECT(dev),
@@ -84,10 +84,10 @@ peripheral_register_t register_bitfield_read_value(Object* obj)
 {
     assert(obj);
 
-    PeripheralRegisterState *reg = PERIPHERAL_REGISTER_STATE(obj->parent);
+    PeripheralRegisterState *reg = PERIPHERAL_REGISTER_STATE_FAST(obj->parent);
     assert(reg);
 
-    RegisterBitfieldState *state = REGISTER_BITFIELD_STATE(obj);
+    RegisterBitfieldState *state = REGISTER_BITFIELD_STATE_FAST(obj);
 
     return (reg->value & state->mask) >> state->shift;
 }
@@ -99,10 +99,10 @@ bool register_bitfield_is_zero(Object* obj)
 {
     assert(obj);
 
-    PeripheralRegisterState *reg = PERIPHERAL_REGISTER_STATE(obj->parent);
+    PeripheralRegisterState *reg = PERIPHERAL_REGISTER_STATE_FAST(obj->parent);
     assert(reg);
 
-    RegisterBitfieldState *state = REGISTER_BITFIELD_STATE(obj);
+    RegisterBitfieldState *state = REGISTER_BITFIELD_STATE_FAST(obj);
 
     return (reg->value & state->mask) == 0;
 }
@@ -0,0 +1,604 @@
+/*
+ * Cortex-M peripheral implemented by another process.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <hw/cortexm/remote-peripheral.h>
+#include <hw/cortexm/helper.h>
+
+#include "qemu/error-report.h"
+#include "qemu/bitmap.h"
+#include "qemu/processor.h"
+#include "qemu/timer.h"
+#include "qemu/main-loop.h"
+#include "qapi/error.h"
+
+#include <sys/mman.h>
+#include <poll.h>
+
+/*
+ * Most peripheral processes answer within a few microseconds; spinning
+ * that long is cheaper than going to sleep and being woken up.
+ */
+#define REMOTE_PERIPHERAL_SPIN_NS   (20 * SCALE_US)
+
+static gboolean remote_peripheral_accept(QIOChannel *channel,
+        GIOCondition cond, void *opaque);
+
+/* ----- Private ----------------------------------------------------------- */
+
+static void remote_peripheral_clear_shadows(CortexMRemotePeripheralState *state)
+{
+    bitmap_zero(state->shadow_valid, state->num_shadows);
+    state->write_posted = false;
+}
+
+/*
+ * Forget the current process and wait for the next one.
+ */
+static void remote_peripheral_drop_client(CortexMRemotePeripheralState *state)
+{
+    if (state->hup_tag) {
+        g_source_remove(state->hup_tag);
+        state->hup_tag = 0;
+    }
+    qemu_set_fd_handler(event_notifier_get_fd(&state->rx_notifier), NULL,
+            NULL, NULL);
+    object_unref(OBJECT(state->ioc));
+    state->ioc = NULL;
+
+    remote_peripheral_clear_shadows(state);
+
+    state->listen_tag = qio_channel_add_watch(QIO_CHANNEL(state->listen_ioc),
+            G_IO_IN, remote_peripheral_accept, state, NULL);
+}
+
+static void remote_peripheral_protocol_error(
+        CortexMRemotePeripheralState *state, const char *reason)
+{
+    error_report("%s: %s, disconnecting %s",
+            object_get_typename(OBJECT(state)), reason, state->path);
+    remote_peripheral_drop_client(state);
+}
+
+/*
+ * Queue a message for the process. Returns false if the process is gone.
+ */
+static bool remote_peripheral_send(CortexMRemotePeripheralState *state,
+        RemotePeripheralMsg *msg)
+{
+    int64_t deadline = 0;
+    bool notify;
+
+    while (state->ioc) {
+        if (shm_ring_write(&state->tx, msg, sizeof(*msg), &notify)) {
+            if (notify) {
+                event_notifier_set(&state->tx_notifier);
+            }
+            return true;
+        }
+
+        /* The ring is full; the process does not say when it drains. */
+        if (!deadline) {
+            deadline = get_clock() + state->timeout_ms * SCALE_MS;
+        } else if (get_clock() > deadline) {
+            remote_peripheral_protocol_error(state, "request ring stuck");
+            break;
+        }
+        g_usleep(10);
+    }
+    return false;
+}
+
+/*
+ * Take the next message from the process, if any.
+ */
+static bool remote_peripheral_recv(CortexMRemotePeripheralState *state,
+        RemotePeripheralMsg *msg)
+{
+    const uint8_t *data;
+    size_t n;
+
+    if (!state->ioc) {
+        return false;
+    }
+
+    n = shm_ring_peek(&state->rx, &data);
+    if (n == 0) {
+        return false;
+    }
+    if (n < sizeof(*msg)) {
+        remote_peripheral_protocol_error(state, "truncated message");
+        return false;
+    }
+
+    memcpy(msg, data, sizeof(*msg));
+    shm_ring_consume(&state->rx, sizeof(*msg));
+    return true;
+}
+
+/*
+ * Process a message that is not the answer to a read.
+ */
+static void remote_peripheral_handle(CortexMRemotePeripheralState *state,
+        RemotePeripheralMsg *msg)
+{
+    PeripheralState *periph = PERIPHERAL_STATE_FAST(state);
+    uint32_t index = msg->offset / periph->register_size_bytes;
+
+    switch (msg->type) {
+    case REMOTE_PERIPHERAL_MSG_SET_IRQ:
+        if (msg->offset >= state->num_irq || state->nvic == NULL) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                    "%s: Interrupt %u not connected.\n",
+                    object_get_typename(OBJECT(state)), msg->offset);
+            break;
+        }
+        cortexm_nvic_set_pending(state->nvic, state->irq + msg->offset);
+        break;
+
+    case REMOTE_PERIPHERAL_MSG_SHADOW_SET:
+    case REMOTE_PERIPHERAL_MSG_SHADOW_CLEAR:
+        if ((msg->offset & (periph->register_size_bytes - 1))
+                || index >= state->num_shadows) {
+            remote_peripheral_protocol_error(state, "bad shadow offset");
+            break;
+        }
+        if (msg->type == REMOTE_PERIPHERAL_MSG_SHADOW_SET) {
+            state->shadow_values[index] = msg->value;
+            set_bit(index, state->shadow_valid);
+        } else {
+            clear_bit(index, state->shadow_valid);
+        }
+        break;
+
+    case REMOTE_PERIPHERAL_MSG_READ_REPLY:
+        remote_peripheral_protocol_error(state, "unexpected read reply");
+        break;
+
+    default:
+        remote_peripheral_protocol_error(state, "unknown message");
+        break;
+    }
+}
+
+/* Process everything the process sent on its own. */
+static void remote_peripheral_drain(CortexMRemotePeripheralState *state)
+{
+    RemotePeripheralMsg msg;
+
+    while (remote_peripheral_recv(state, &msg)) {
+        remote_peripheral_handle(state, &msg);
+    }
+}
+
+/*
+ * Wait for the answer to a read, processing the messages sent before it.
+ * The vCPU is stalled meanwhile, so spin a little before sleeping.
+ */
+static bool remote_peripheral_wait_reply(CortexMRemotePeripheralState *state,
+        RemotePeripheralMsg *reply)
+{
+    int64_t now = get_clock();
+    int64_t spin_end = now + REMOTE_PERIPHERAL_SPIN_NS;
+    int64_t deadline = now + state->timeout_ms * SCALE_MS;
+    struct pollfd pfd[2];
+    int ret;
+
+    for (;;) {
+        while (remote_peripheral_recv(state, reply)) {
+            if (reply->type == REMOTE_PERIPHERAL_MSG_READ_REPLY) {
+                return true;
+            }
+            remote_peripheral_handle(state, reply);
+        }
+        if (!state->ioc) {
+            return false;
+        }
+
+        now = get_clock();
+        if (now < spin_end) {
+            cpu_relax();
+            continue;
+        }
+        if (now >= deadline) {
+            remote_peripheral_protocol_error(state, "read timed out");
+            return false;
+        }
+
+        /* The notifier may be set by a message already processed. */
+        pfd[0].fd = event_notifier_get_fd(&state->rx_notifier);
+        pfd[0].events = POLLIN;
+        pfd[1].fd = QIO_CHANNEL_SOCKET(state->ioc)->fd;
+        pfd[1].events = 0;
+        ret = poll(pfd, ARRAY_SIZE(pfd),
+                (deadline - now + SCALE_MS - 1) / SCALE_MS);
+        if (ret > 0 && (pfd[1].revents & (POLLHUP | POLLERR))) {
+            remote_peripheral_protocol_error(state, "connection closed");
+            return false;
+        }
+        if (ret > 0 && (pfd[0].revents & POLLIN)) {
+            event_notifier_test_and_clear(&state->rx_notifier);
+        }
+    }
+}
+
+/* Messages sent by the process while the guest is not reading. */
+static void remote_peripheral_read_handler(void *opaque)
+{
+    CortexMRemotePeripheralState *state = opaque;
+
+    event_notifier_test_and_clear(&state->rx_notifier);
+    remote_peripheral_drain(state);
+}
+
+/* The process is not expected to write to the socket; this only sees EOF. */
+static gboolean remote_peripheral_hup(QIOChannel *channel, GIOCondition cond,
+        void *opaque)
+{
+    CortexMRemotePeripheralState *state = opaque;
+    char buf[64];
+    ssize_t ret;
+
+    ret = qio_channel_read(channel, buf, sizeof(buf), NULL);
+    if (ret > 0 || ret == QIO_CHANNEL_ERR_BLOCK) {
+        return TRUE;
+    }
+
+    state->hup_tag = 0;
+    remote_peripheral_drop_client(state);
+    return FALSE;
+}
+
+static gboolean remote_peripheral_accept(QIOChannel *channel,
+        GIOCondition cond, void *opaque)
+{
+    CortexMRemotePeripheralState *state = opaque;
+    PeripheralState *periph = PERIPHERAL_STATE(state);
+    ShmRingHeader *hdr = state->base;
+    QIOChannelSocket *sioc;
+    uint32_t version = SHM_RING_VERSION;
+    struct iovec iov = { .iov_base = &version, .iov_len = sizeof(version) };
+    RemotePeripheralMsg msg;
+    int fds[3];
+
+    sioc = qio_channel_socket_accept(QIO_CHANNEL_SOCKET(channel), NULL);
+    if (!sioc) {
+        return TRUE;
+    }
+
+    /* Start afresh, whatever the previous process left behind. */
+    memset(hdr->rings, 0, sizeof(hdr->rings));
+    event_notifier_test_and_clear(&state->tx_notifier);
+    event_notifier_test_and_clear(&state->rx_notifier);
+
+    fds[0] = state->shm_fd;
+    fds[1] = state->tx_notifier.rfd;
+    fds[2] = state->rx_notifier.wfd;
+    if (qio_channel_writev_full(QIO_CHANNEL(sioc), &iov, 1, fds,
+            ARRAY_SIZE(fds), NULL) != iov.iov_len) {
+        object_unref(OBJECT(sioc));
+        return TRUE;
+    }
+
+    state->ioc = QIO_CHANNEL(sioc);
+    state->hup_tag = qio_channel_add_watch(state->ioc,
+            G_IO_IN | G_IO_HUP | G_IO_ERR, remote_peripheral_hup, state, NULL);
+    qemu_set_fd_handler(event_notifier_get_fd(&state->rx_notifier),
+            remote_peripheral_read_handler, NULL, state);
+    state->listen_tag = 0;
+
+    remote_peripheral_clear_shadows(state);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = REMOTE_PERIPHERAL_MSG_HELLO;
+    msg.size = periph->register_size_bytes;
+    msg.offset = periph->mmio_size_bytes;
+    msg.value = REMOTE_PERIPHERAL_VERSION;
+    remote_peripheral_send(state, &msg);
+
+    return FALSE;
+}
+
+/**
+ * Memory region read callback.
+ *
+ * Serve shadow registers locally, unless a write that may change them
+ * was not yet acknowledged; ask the process for everything else.
+ */
+static uint64_t remote_peripheral_read_callback(void *opaque, hwaddr addr,
+        unsigned size)
+{
+    CortexMRemotePeripheralState *state = opaque;
+    PeripheralState *periph = PERIPHERAL_STATE_FAST(state);
+    uint32_t index = addr / periph->register_size_bytes;
+    uint32_t reg_offset = addr & (periph->register_size_bytes - 1);
+    RemotePeripheralMsg msg;
+
+    /* Cheap when there is nothing, and keeps the shadows fresh. */
+    remote_peripheral_drain(state);
+
+    if (index < state->num_shadows && test_bit(index, state->shadow_valid)
+            && (!state->write_posted || !state->ioc)) {
+        return peripheral_register_shorten(state->shadow_values[index],
+                reg_offset, size, periph->is_little_endian);
+    }
+
+    if (!state->ioc) {
+        qemu_log_mask(LOG_UNIMP,
+                "%s: Read of size %d at offset 0x%"PRIX64" with no "
+                "peripheral process connected.\n",
+                object_get_typename(OBJECT(state)), size, addr);
+        return 0;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = REMOTE_PERIPHERAL_MSG_READ;
+    msg.size = size;
+    msg.offset = addr;
+    if (!remote_peripheral_send(state, &msg)
+            || !remote_peripheral_wait_reply(state, &msg)) {
+        return 0;
+    }
+
+    state->write_posted = false;
+    return msg.value;
+}
+
+/**
+ * Memory region write callback.
+ *
+ * Writes are posted; the process sees them in order with the reads.
+ */
+static void remote_peripheral_write_callback(void *opaque, hwaddr addr,
+        uint64_t value, unsigned size)
+{
+    CortexMRemotePeripheralState *state = opaque;
+    RemotePeripheralMsg msg;
+
+    if (!state->ioc) {
+        qemu_log_mask(LOG_UNIMP,
+                "%s: Write of size %d at offset 0x%"PRIX64" with no "
+                "peripheral process connected.\n",
+                object_get_typename(OBJECT(state)), size, addr);
+        return;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = REMOTE_PERIPHERAL_MSG_WRITE;
+    msg.size = size;
+    msg.offset = addr;
+    msg.value = value;
+    if (remote_peripheral_send(state, &msg)) {
+        state->write_posted = true;
+    }
+}
+
+static const MemoryRegionOps remote_peripheral_ops = {
+    .read = remote_peripheral_read_callback,
+    .write = remote_peripheral_write_callback,
+    .endianness = DEVICE_NATIVE_ENDIAN, };
+
+static bool remote_peripheral_create_segment(
+        CortexMRemotePeripheralState *state, Error **errp)
+{
+    static int count;
+    ShmRingHeader *hdr;
+    uint32_t data_offset;
+    char *name;
+
+    name = g_strdup_printf("/qemu-periph-%d-%d", getpid(), count++);
+    state->shm_fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (state->shm_fd < 0) {
+        error_setg_errno(errp, errno, "cannot create %s", name);
+        g_free(name);
+        return false;
+    }
+    /* Processes get the segment by file descriptor only. */
+    shm_unlink(name);
+    g_free(name);
+
+    data_offset = ROUND_UP(sizeof(ShmRingHeader), getpagesize());
+    state->map_size = data_offset + SHM_RING_COUNT * state->ring_size;
+    if (ftruncate(state->shm_fd, state->map_size) < 0) {
+        error_setg_errno(errp, errno, "cannot resize segment");
+        goto fail;
+    }
+    state->base = mmap(NULL, state->map_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, state->shm_fd, 0);
+    if (state->base == MAP_FAILED) {
+        state->base = NULL;
+        error_setg_errno(errp, errno, "cannot map segment");
+        goto fail;
+    }
+
+    hdr = state->base;
+    hdr->magic = SHM_RING_MAGIC;
+    hdr->version = SHM_RING_VERSION;
+    hdr->ring_size = state->ring_size;
+    hdr->data_offset = data_offset;
+    shm_ring_port_init(&state->tx, state->base, state->ring_size, data_offset,
+            SHM_RING_TO_CLIENT);
+    shm_ring_port_init(&state->rx, state->base, state->ring_size, data_offset,
+            SHM_RING_FROM_CLIENT);
+    return true;
+
+fail:
+    close(state->shm_fd);
+    state->shm_fd = -1;
+    return false;
+}
+
+static void remote_peripheral_instance_init_callback(Object *obj)
+{
+    qemu_log_function_name();
+
+    CortexMRemotePeripheralState *state = CORTEXM_REMOTE_PERIPHERAL_STATE(obj);
+
+    state->shm_fd = -1;
+}
+
+static void remote_peripheral_realize_callback(DeviceState *dev, Error **errp)
+{
+    qemu_log_function_name();
+
+    CortexMRemotePeripheralState *state = CORTEXM_REMOTE_PERIPHERAL_STATE(dev);
+    PeripheralState *periph = PERIPHERAL_STATE(dev);
+    SocketAddress *addr;
+    int err;
+
+    if (state->path == NULL) {
+        error_setg(errp, "remote peripheral: 'path' is mandatory");
+        return;
+    }
+    if (periph->mmio_size_bytes == 0) {
+        error_setg(errp, "remote peripheral: 'mmio-size-bytes' is mandatory");
+        return;
+    }
+    if (state->ring_size < 4096 || state->ring_size > (1 << 30)
+            || (state->ring_size & (state->ring_size - 1))) {
+        error_setg(errp, "remote peripheral: 'ring-size' must be a power "
+                "of two, between 4K and 1G");
+        return;
+    }
+    if (state->num_irq && state->irq < 16) {
+        error_setg(errp, "remote peripheral: 'irq' must be the exception "
+                "number of an external interrupt");
+        return;
+    }
+
+    if (state->nvic == NULL && state->num_irq) {
+        /* Created with -device, use the one of the MCU. */
+        state->nvic = (CortexMNVICState *) object_resolve_path_type(
+                "/machine/cortexm/nvic", TYPE_CORTEXM_NVIC, NULL);
+        if (state->nvic == NULL) {
+            error_setg(errp, "remote peripheral: no NVIC");
+            return;
+        }
+    }
+
+    /* The NVIC num_irq counts the external interrupts, from #16 on. */
+    if (state->num_irq && (uint64_t) state->irq - 16 + state->num_irq
+            > state->nvic->num_irq) {
+        error_setg(errp, "remote peripheral: 'irq' and 'num-irq' exceed "
+                "the %u NVIC interrupts", state->nvic->num_irq);
+        return;
+    }
+
+    /* Call parent realize(); this creates the MMIO region. */
+    if (!cm_device_parent_realize(dev, errp,
+            TYPE_CORTEXM_REMOTE_PERIPHERAL)) {
+        return;
+    }
+
+    state->num_shadows = periph->mmio_size_bytes / periph->register_size_bytes;
+    state->shadow_valid = bitmap_new(state->num_shadows);
+    state->shadow_values = g_new0(uint64_t, state->num_shadows);
+
+    err = event_notifier_init(&state->tx_notifier, 0);
+    if (err < 0) {
+        error_setg_errno(errp, -err, "remote peripheral: cannot create "
+                "notifier");
+        return;
+    }
+    err = event_notifier_init(&state->rx_notifier, 0);
+    if (err < 0) {
+        error_setg_errno(errp, -err, "remote peripheral: cannot create "
+                "notifier");
+        return;
+    }
+
+    if (!remote_peripheral_create_segment(state, errp)) {
+        return;
+    }
+
+    addr = g_new0(SocketAddress, 1);
+    addr->type = SOCKET_ADDRESS_KIND_UNIX;
+    addr->u.q_unix.data = g_new0(UnixSocketAddress, 1);
+    addr->u.q_unix.data->path = g_strdup(state->path);
+    state->listen_ioc = qio_channel_socket_new();
+    err = qio_channel_socket_listen_sync(state->listen_ioc, addr, errp);
+    qapi_free_SocketAddress(addr);
+    if (err < 0) {
+        return;
+    }
+    state->listen_tag = qio_channel_add_watch(QIO_CHANNEL(state->listen_ioc),
+            G_IO_IN, remote_peripheral_accept, state, NULL);
+}
+
+static void remote_peripheral_reset_callback(DeviceState *dev)
+{
+    qemu_log_function_name();
+
+    CortexMRemotePeripheralState *state = CORTEXM_REMOTE_PERIPHERAL_STATE(dev);
+    RemotePeripheralMsg msg;
+
+    /* Call parent reset(). */
+    cm_device_parent_reset(dev, TYPE_CORTEXM_REMOTE_PERIPHERAL);
+
+    remote_peripheral_clear_shadows(state);
+
+    if (state->ioc) {
+        memset(&msg, 0, sizeof(msg));
+        msg.type = REMOTE_PERIPHERAL_MSG_RESET;
+        remote_peripheral_send(state, &msg);
+    }
+}
+
+static Property remote_peripheral_properties[] = {
+        DEFINE_PROP_STRING("path", CortexMRemotePeripheralState, path),
+        DEFINE_PROP_UINT32("ring-size", CortexMRemotePeripheralState,
+                ring_size, 65536),
+        DEFINE_PROP_UINT32("timeout-ms", CortexMRemotePeripheralState,
+                timeout_ms, 5000),
+        DEFINE_PROP_INT32("irq", CortexMRemotePeripheralState, irq, 0),
+        DEFINE_PROP_UINT32("num-irq", CortexMRemotePeripheralState, num_irq,
+                0),
+        DEFINE_PROP_NON_VOID_PTR("nvic", CortexMRemotePeripheralState,
+                nvic, CortexMNVICState *),
+    DEFINE_PROP_END_OF_LIST() };
+
+static void remote_peripheral_class_init_callback(ObjectClass *klass,
+        void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = remote_peripheral_reset_callback;
+    dc->realize = remote_peripheral_realize_callback;
+
+    dc->props = remote_peripheral_properties;
+    dc->desc = "Cortex-M peripheral implemented by another process";
+
+    PeripheralClass *per_class = PERIPHERAL_CLASS(klass);
+    per_class->mmio_ops = &remote_peripheral_ops;
+}
+
+static const TypeInfo remote_peripheral_type_info = {
+    .name = TYPE_CORTEXM_REMOTE_PERIPHERAL,
+    .parent = TYPE_CORTEXM_REMOTE_PERIPHERAL_PARENT,
+    .instance_init = remote_peripheral_instance_init_callback,
+    .instance_size = sizeof(CortexMRemotePeripheralState),
+    .class_init = remote_peripheral_class_init_callback,
+    .class_size = sizeof(CortexMRemotePeripheralClass) /**/
+};
+
+static void remote_peripheral_register_types(void)
+{
+    type_register_static(&remote_peripheral_type_info);
+}
+
+type_init(remote_peripheral_register_types);
+
+/* ------------------------------------------------------------------------- */
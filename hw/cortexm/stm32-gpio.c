@@ -68,7 +68,7 @@ static void stm32_gpio_update_odr_and_idr(STM32GPIOState *state, Object *odr,
 static bool stm32_gpio_is_enabled(Object *obj)
 {
 #if 1
-    STM32GPIOState *state = STM32_GPIO_STATE(obj);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(obj);
 
     const STM32Capabilities *capabilities = state->capabilities;
     assert(capabilities != NULL);
@@ -114,7 +114,7 @@ static void stm32f1_gpio_crl_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32GPIOState *state = STM32_GPIO_STATE(periph);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(periph);
 
     stm32f1_gpio_update_dir_mask(state, 0);
 }
@@ -123,7 +123,7 @@ static void stm32f1_gpio_crh_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32GPIOState *state = STM32_GPIO_STATE(periph);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(periph);
 
     stm32f1_gpio_update_dir_mask(state, 1);
 }
@@ -132,7 +132,7 @@ static void stm32f1_gpio_odr_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32GPIOState *state = STM32_GPIO_STATE(periph);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(periph);
 
     Object *odr = state->f1.reg.odr;
     assert(odr);
@@ -147,7 +147,7 @@ static void stm32f1_gpio_bsrr_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32GPIOState *state = STM32_GPIO_STATE(periph);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(periph);
 
     Object *odr = state->f1.reg.odr;
     assert(odr);
@@ -166,7 +166,7 @@ static void stm32f1_gpio_brr_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32GPIOState *state = STM32_GPIO_STATE(periph);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(periph);
 
     Object *odr = state->f1.reg.odr;
     assert(odr);
@@ -349,7 +349,7 @@ static void stm32f4_gpio_moder_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32GPIOState *state = STM32_GPIO_STATE(periph);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(periph);
 
     stm32f4_gpio_update_dir_mask(state);
 }
@@ -358,7 +358,7 @@ static void stm32f4_gpio_odr_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32GPIOState *state = STM32_GPIO_STATE(periph);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(periph);
 
     Object *odr = state->f4.reg.odr;
     assert(odr);
@@ -374,7 +374,7 @@ static void stm32f4_gpio_bsrr_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32GPIOState *state = STM32_GPIO_STATE(periph);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(periph);
 
     Object *odr = state->f4.reg.odr;
     assert(odr);
@@ -631,7 +631,7 @@ static void stm32_gpio_in_irq_handler(void *opaque, int n, int level)
 {
     qemu_log_function_name();
 
-    STM32GPIOState *state = STM32_GPIO_STATE(opaque);
+    STM32GPIOState *state = STM32_GPIO_STATE_FAST(opaque);
     unsigned pin = n;
 
     assert(pin < STM32_GPIO_PIN_COUNT);
@@ -44,7 +44,7 @@
 // TODO: rework reference to RCC to use links.
 static bool stm32_usart_is_enabled(Object *obj)
 {
-    STM32USARTState *state = STM32_USART_STATE(obj);
+    STM32USARTState *state = STM32_USART_STATE_FAST(obj);
 
     const STM32Capabilities *capabilities = state->capabilities;
     assert(capabilities != NULL);
@@ -197,7 +197,7 @@ static int smt32f4_usart_get_irq_vector(STM32USARTState *state)
 
 static int stm32f4_usart_can_receive(void *obj)
 {
-    STM32USARTState *state = STM32_USART_STATE((Object * )obj);
+    STM32USARTState *state = STM32_USART_STATE_FAST(obj);
 
     int32_t sr = peripheral_register_get_raw_value(state->reg.sr);
     if (!(sr & USART_SR_RXNE)) {
@@ -209,7 +209,7 @@ static int stm32f4_usart_can_receive(void *obj)
 
 static void stm32f4_usart_receive(void *obj, const uint8_t *buf, int size)
 {
-    STM32USARTState *state = STM32_USART_STATE((Object * )obj);
+    STM32USARTState *state = STM32_USART_STATE_FAST(obj);
 
     int32_t cr1 = peripheral_register_get_raw_value(state->reg.cr1);
 
@@ -231,7 +231,7 @@ static void stm32f4_usart_receive(void *obj, const uint8_t *buf, int size)
 static void stm32f4_usart_dr_post_read_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size)
 {
-    STM32USARTState *state = STM32_USART_STATE(periph);
+    STM32USARTState *state = STM32_USART_STATE_FAST(periph);
 
     peripheral_register_and_raw_value(state->reg.sr, ~USART_SR_RXNE);
     if (state->chr) {
@@ -243,7 +243,7 @@ static void stm32f4_usart_dr_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32USARTState *state = STM32_USART_STATE(periph);
+    STM32USARTState *state = STM32_USART_STATE_FAST(periph);
     unsigned char ch;
 
     int32_t cr1 = peripheral_register_get_raw_value(state->reg.cr1);
@@ -253,6 +253,10 @@ static void stm32f4_usart_dr_post_write_callback(Object *reg, Object *periph,
         if (state->chr) {
             ch = full_value; /* Use only the lower 8 bits */
             qemu_chr_fe_write_all(state->chr, &ch, 1);
+            if (qemu_chr_fe_txbuf_full(state->chr)) {
+                /* TXE/TC are set when the backend catches up */
+                return;
+            }
         }
         /* transmission is immediately complete */
         peripheral_register_or_raw_value(state->reg.sr,
@@ -264,11 +268,36 @@ static void stm32f4_usart_dr_post_write_callback(Object *reg, Object *periph,
     }
 }
 
+/*
+ * Backpressure from the character device: while its transmit buffer is
+ * full, the data register is reported busy, so that the firmware waits
+ * instead of having its output dropped.
+ */
+static void stm32f4_usart_txbuf_callback(void *obj, bool full)
+{
+    STM32USARTState *state = STM32_USART_STATE_FAST(obj);
+
+    int32_t cr1 = peripheral_register_get_raw_value(state->reg.cr1);
+
+    if (full) {
+        peripheral_register_and_raw_value(state->reg.sr,
+                ~(USART_SR_TC | USART_SR_TXE));
+        return;
+    }
+
+    peripheral_register_or_raw_value(state->reg.sr,
+    USART_SR_TC | USART_SR_TXE);
+    if ((cr1 & USART_CR1_TXEIE) || (cr1 & USART_CR1_TCIE)) {
+        cortexm_nvic_set_pending(state->nvic,
+                smt32f4_usart_get_irq_vector(state));
+    }
+}
+
 static void stm32f4_usart_cr1_post_write_callback(Object *reg, Object *periph,
         uint32_t addr, uint32_t offset, unsigned size,
         peripheral_register_t value, peripheral_register_t full_value)
 {
-    STM32USARTState *state = STM32_USART_STATE(periph);
+    STM32USARTState *state = STM32_USART_STATE_FAST(periph);
 
     int32_t sr = peripheral_register_get_raw_value(state->reg.sr);
 
@@ -364,6 +393,8 @@ static void stm32_usart_realize_callback(DeviceState *dev, Error **errp)
         if (state->chr) {
             qemu_chr_add_handlers(state->chr, stm32f4_usart_can_receive,
                     stm32f4_usart_receive, NULL, obj);
+            qemu_chr_fe_set_txbuf_handler(state->chr,
+                    stm32f4_usart_txbuf_callback, obj);
         }
 
         break;
@@ -126,12 +126,30 @@ static void draw_line_src16(void *opaque, uint8_t *dst, const uint8_t *src,
     }
 }
 
+/* Format of the framebuffer in pixman terms, when it can be displayed
+ * without conversion.  */
+static pixman_format_code_t fb_pixman_format(BCM2835FBState *s)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    return 0;
+#else
+    switch (s->bpp) {
+    case 16:
+        return s->pixo ? PIXMAN_r5g6b5 : PIXMAN_b5g6r5;
+    case 24:
+        return s->pixo ? PIXMAN_b8g8r8 : PIXMAN_r8g8b8;
+    case 32:
+        return s->pixo ? PIXMAN_x8b8g8r8 : PIXMAN_x8r8g8b8;
+    default:
+        return 0;
+    }
+#endif
+}
+
 static void fb_update_display(void *opaque)
 {
     BCM2835FBState *s = opaque;
-    DisplaySurface *surface = qemu_console_surface(s->con);
-    int first = 0;
-    int last = 0;
+    DisplaySurface *surface;
     int src_width = 0;
     int dest_width = 0;
 
@@ -142,6 +160,21 @@ static void fb_update_display(void *opaque)
     src_width = s->xres * (s->bpp >> 3);
     dest_width = s->xres;
 
+    if (s->invalidate) {
+        framebuffer_update_memory_section(&s->fbsection, s->dma_mr, s->base,
+                                          s->yres, src_width);
+        framebuffer_share_surface(s->con, &s->fbsection, s->xres, s->yres,
+                                  src_width, fb_pixman_format(s));
+    }
+
+    surface = qemu_console_surface(s->con);
+    if (is_buffer_shared(surface)) {
+        framebuffer_update_console(s->con, &s->fbsection, s->xres, s->yres,
+                                   src_width, 0, s->invalidate, NULL, NULL);
+        s->invalidate = false;
+        return;
+    }
+
     switch (surface_bits_per_pixel(surface)) {
     case 0:
         return;
@@ -164,18 +197,9 @@ static void fb_update_display(void *opaque)
         break;
     }
 
-    if (s->invalidate) {
-        framebuffer_update_memory_section(&s->fbsection, s->dma_mr, s->base,
-                                          s->yres, src_width);
-    }
-
-    framebuffer_update_display(surface, &s->fbsection, s->xres, s->yres,
-                               src_width, dest_width, 0, s->invalidate,
-                               draw_line_src16, s, &first, &last);
-
-    if (first >= 0) {
-        dpy_gfx_update(s->con, 0, first, s->xres, last - first + 1);
-    }
+    framebuffer_update_console(s->con, &s->fbsection, s->xres, s->yres,
+                               src_width, dest_width, s->invalidate,
+                               draw_line_src16, s);
 
     s->invalidate = false;
 }
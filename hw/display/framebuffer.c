@@ -123,3 +123,96 @@ void framebuffer_update_display(
     *first_row = first;
     *last_row = last;
 }
+
+/* Render the dirty parts of an unrotated framebuffer to the console's
+ * surface and tell the console about each band of redrawn rows.  */
+void framebuffer_update_console(
+    QemuConsole *con,
+    MemoryRegionSection *mem_section,
+    int cols, /* Width in pixels.  */
+    int rows, /* Height in pixels.  */
+    int src_width, /* Length of source line, in bytes.  */
+    int dest_row_pitch, /* Bytes between adjacent vertical output pixels.  */
+    int invalidate, /* nonzero to redraw the whole image.  */
+    drawfn fn,
+    void *opaque)
+{
+    DisplaySurface *ds = qemu_console_surface(con);
+    uint8_t *dest = NULL;
+    uint8_t *src;
+    ram_addr_t addr;
+    MemoryRegion *mem;
+    int first = -1;
+    int i;
+
+    mem = mem_section->mr;
+    if (!mem) {
+        return;
+    }
+    memory_region_sync_dirty_bitmap(mem);
+
+    addr = mem_section->offset_within_region;
+    src = memory_region_get_ram_ptr(mem) + addr;
+    if (fn) {
+        dest = surface_data(ds);
+    }
+
+    for (i = 0; i < rows; i++) {
+        if (invalidate ||
+            memory_region_get_dirty(mem, addr, src_width, DIRTY_MEMORY_VGA)) {
+            if (fn) {
+                fn(opaque, dest, src, cols, 0);
+            }
+            if (first < 0) {
+                first = i;
+            }
+        } else if (first >= 0) {
+            dpy_gfx_update(con, 0, first, cols, i - first);
+            first = -1;
+        }
+        addr += src_width;
+        src += src_width;
+        dest += dest_row_pitch;
+    }
+    if (first >= 0) {
+        dpy_gfx_update(con, 0, first, cols, rows - first);
+    }
+    memory_region_reset_dirty(mem, mem_section->offset_within_region,
+                              (hwaddr)src_width * rows, DIRTY_MEMORY_VGA);
+}
+
+/* Make the console display the framebuffer memory directly if possible,
+ * otherwise make sure that it has a surface of its own.  */
+bool framebuffer_share_surface(
+    QemuConsole *con,
+    MemoryRegionSection *mem_section,
+    int cols,
+    int rows,
+    int src_width,
+    pixman_format_code_t format)
+{
+    DisplaySurface *surface = qemu_console_surface(con);
+    uint8_t *src;
+
+    if (!mem_section->mr || !format || !dpy_gfx_check_format(con, format)) {
+        if (surface && is_buffer_shared(surface)) {
+            qemu_console_resize(con, cols, rows);
+        }
+        return false;
+    }
+
+    src = memory_region_get_ram_ptr(mem_section->mr) +
+          mem_section->offset_within_region;
+    if (surface && is_buffer_shared(surface) &&
+        surface_data(surface) == src &&
+        surface_format(surface) == format &&
+        surface_width(surface) == cols &&
+        surface_height(surface) == rows &&
+        surface_stride(surface) == src_width) {
+        return true;
+    }
+    surface = qemu_create_displaysurface_from(cols, rows, format,
+                                              src_width, src);
+    dpy_gfx_replace_surface(con, surface);
+    return true;
+}
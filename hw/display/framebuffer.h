@@ -2,6 +2,7 @@
 #define QEMU_FRAMEBUFFER_H
 
 #include "exec/memory.h"
+#include "ui/qemu-pixman.h"
 
 /* Framebuffer device helper routines.  */
 
@@ -62,4 +63,51 @@ void framebuffer_update_display(
     int *first_row,
     int *last_row);
 
+/* framebuffer_update_console: Draw the framebuffer on the console surface
+ * and report the changed parts to the console.
+ *
+ * Like framebuffer_update_display() with a @dest_col_pitch of zero, except
+ * that dpy_gfx_update() is called for each band of consecutive redrawn rows
+ * instead of once for the whole range between the first and the last one.
+ * @fn may be NULL if the console surface was created with
+ * framebuffer_share_surface(); then nothing is drawn and only
+ * the dirty rows are reported.
+ */
+void framebuffer_update_console(
+    QemuConsole *con,
+    MemoryRegionSection *mem_section,
+    int cols,
+    int rows,
+    int src_width,
+    int dest_row_pitch,
+    int invalidate,
+    drawfn fn,
+    void *opaque);
+
+/* framebuffer_share_surface: Make the console surface use the framebuffer
+ * memory as its pixel data, so that no conversion is needed.
+ *
+ * @con: #QemuConsole that displays the framebuffer.
+ * @mem_section: #MemoryRegionSection provided by
+ * framebuffer_update_memory_section().  Call this function again whenever
+ * the section is updated.
+ * @cols: Width the screen.
+ * @rows: Height of the screen.
+ * @src_width: Number of bytes in framebuffer memory between two rows.
+ * @format: pixman format of the framebuffer in host byte order, or zero
+ * if it has none.
+ *
+ * Returns true if the console surface now shares the framebuffer.  If it
+ * returns false, the console has a surface of its own that the caller must
+ * draw to; a previously shared surface is replaced by a new one of the
+ * default format.
+ */
+bool framebuffer_share_surface(
+    QemuConsole *con,
+    MemoryRegionSection *mem_section,
+    int cols,
+    int rows,
+    int src_width,
+    pixman_format_code_t format);
+
 #endif
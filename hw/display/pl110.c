@@ -131,18 +131,49 @@ static int pl110_enabled(PL110State *s)
   return (s->cr & PL110_CR_EN) && (s->cr & PL110_CR_PWR);
 }
 
+static void pl110_update_palette(PL110State *s, int n);
+
+/* Format of the direct colour modes in pixman terms, when the
+ * framebuffer can be displayed without conversion.  */
+static pixman_format_code_t pl110_pixman_format(PL110State *s, int fn_index)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    return 0;
+#else
+    if (s->cr & (PL110_CR_BEBO | PL110_CR_BEPO)) {
+        return 0;
+    }
+    switch (fn_index) {
+    case BPP_16:
+        return PIXMAN_x1r5g5b5;
+    case BPP_16 + 24:
+        return PIXMAN_x1b5g5r5;
+    case BPP_32:
+        return PIXMAN_x8r8g8b8;
+    case BPP_32 + 24:
+        return PIXMAN_x8b8g8r8;
+    case BPP_16_565:
+        return PIXMAN_r5g6b5;
+    case BPP_16_565 + 24:
+        return PIXMAN_b5g6r5;
+    default:
+        return 0;
+    }
+#endif
+}
+
 static void pl110_update_display(void *opaque)
 {
     PL110State *s = (PL110State *)opaque;
     SysBusDevice *sbd;
-    DisplaySurface *surface = qemu_console_surface(s->con);
+    DisplaySurface *surface;
     drawfn* fntable;
     drawfn fn;
     int dest_width;
     int src_width;
     int bpp_offset;
-    int first;
-    int last;
+    int fn_index;
+    int i;
 
     if (!pl110_enabled(s)) {
         return;
@@ -150,33 +181,6 @@ static void pl110_update_display(void *opaque)
 
     sbd = SYS_BUS_DEVICE(s);
 
-    switch (surface_bits_per_pixel(surface)) {
-    case 0:
-        return;
-    case 8:
-        fntable = pl110_draw_fn_8;
-        dest_width = 1;
-        break;
-    case 15:
-        fntable = pl110_draw_fn_15;
-        dest_width = 2;
-        break;
-    case 16:
-        fntable = pl110_draw_fn_16;
-        dest_width = 2;
-        break;
-    case 24:
-        fntable = pl110_draw_fn_24;
-        dest_width = 3;
-        break;
-    case 32:
-        fntable = pl110_draw_fn_32;
-        dest_width = 4;
-        break;
-    default:
-        fprintf(stderr, "pl110: Bad color depth\n");
-        exit(1);
-    }
     if (s->cr & PL110_CR_BGR)
         bpp_offset = 0;
     else
@@ -209,13 +213,7 @@ static void pl110_update_display(void *opaque)
             break;
         }
     }
-
-    if (s->cr & PL110_CR_BEBO)
-        fn = fntable[s->bpp + 8 + bpp_offset];
-    else if (s->cr & PL110_CR_BEPO)
-        fn = fntable[s->bpp + 16 + bpp_offset];
-    else
-        fn = fntable[s->bpp + bpp_offset];
+    fn_index = s->bpp + bpp_offset;
 
     src_width = s->cols;
     switch (s->bpp) {
@@ -239,25 +237,69 @@ static void pl110_update_display(void *opaque)
         src_width <<= 2;
         break;
     }
-    dest_width *= s->cols;
-    first = 0;
     if (s->invalidate) {
         framebuffer_update_memory_section(&s->fbsection,
                                           sysbus_address_space(sbd),
                                           s->upbase,
                                           s->rows, src_width);
+        if (!framebuffer_share_surface(s->con, &s->fbsection,
+                                       s->cols, s->rows, src_width,
+                                       pl110_pixman_format(s, fn_index))) {
+            /* The surface format may have changed */
+            for (i = 0; i < 128; i++) {
+                pl110_update_palette(s, i);
+            }
+        }
     }
 
-    framebuffer_update_display(surface, &s->fbsection,
-                               s->cols, s->rows,
-                               src_width, dest_width, 0,
-                               s->invalidate,
-                               fn, s->palette,
-                               &first, &last);
+    surface = qemu_console_surface(s->con);
+    if (is_buffer_shared(surface)) {
+        framebuffer_update_console(s->con, &s->fbsection,
+                                   s->cols, s->rows, src_width, 0,
+                                   s->invalidate, NULL, NULL);
+        s->invalidate = 0;
+        return;
+    }
 
-    if (first >= 0) {
-        dpy_gfx_update(s->con, 0, first, s->cols, last - first + 1);
+    switch (surface_bits_per_pixel(surface)) {
+    case 0:
+        return;
+    case 8:
+        fntable = pl110_draw_fn_8;
+        dest_width = 1;
+        break;
+    case 15:
+        fntable = pl110_draw_fn_15;
+        dest_width = 2;
+        break;
+    case 16:
+        fntable = pl110_draw_fn_16;
+        dest_width = 2;
+        break;
+    case 24:
+        fntable = pl110_draw_fn_24;
+        dest_width = 3;
+        break;
+    case 32:
+        fntable = pl110_draw_fn_32;
+        dest_width = 4;
+        break;
+    default:
+        fprintf(stderr, "pl110: Bad color depth\n");
+        exit(1);
     }
+
+    if (s->cr & PL110_CR_BEBO)
+        fn = fntable[fn_index + 8];
+    else if (s->cr & PL110_CR_BEPO)
+        fn = fntable[fn_index + 16];
+    else
+        fn = fntable[fn_index];
+
+    dest_width *= s->cols;
+    framebuffer_update_console(s->con, &s->fbsection,
+                               s->cols, s->rows, src_width, dest_width,
+                               s->invalidate, fn, s->palette);
     s->invalidate = 0;
 }
 
@@ -1208,12 +1208,18 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 }
 
 /* TX */
+
+/* Packets popped from the TX queue at once, and completed together */
+#define VIRTIO_NET_TX_BATCH 32
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtQueueElement *elems[VIRTIO_NET_TX_BATCH];
     VirtQueueElement *elem;
     int32_t num_packets = 0;
+    unsigned int i, j, num, filled;
     int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
@@ -1224,77 +1230,98 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         return num_packets;
     }
 
-    for (;;) {
-        ssize_t ret;
-        unsigned int out_num;
-        struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
-        struct virtio_net_hdr_mrg_rxbuf mhdr;
-
-        elem = virtqueue_pop(q->tx_vq, sizeof(VirtQueueElement));
-        if (!elem) {
+    while (num_packets < n->tx_burst) {
+        num = virtqueue_pop_batch(q->tx_vq, sizeof(VirtQueueElement),
+                                  (void **)elems,
+                                  MIN(VIRTIO_NET_TX_BATCH,
+                                      n->tx_burst - num_packets));
+        if (!num) {
             break;
         }
 
-        out_num = elem->out_num;
-        out_sg = elem->out_sg;
-        if (out_num < 1) {
-            error_report("virtio-net header not in first element");
-            exit(1);
-        }
-
-        if (n->has_vnet_hdr) {
-            if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
-                n->guest_hdr_len) {
-                error_report("virtio-net header incorrect");
+        for (i = filled = 0; i < num; i++) {
+            ssize_t ret;
+            unsigned int out_num;
+            struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1];
+            struct iovec *out_sg;
+            struct virtio_net_hdr_mrg_rxbuf mhdr;
+
+            elem = elems[i];
+            out_num = elem->out_num;
+            out_sg = elem->out_sg;
+            if (out_num < 1) {
+                error_report("virtio-net header not in first element");
                 exit(1);
             }
-            if (n->needs_vnet_hdr_swap) {
-                virtio_net_hdr_swap(vdev, (void *) &mhdr);
-                sg2[0].iov_base = &mhdr;
-                sg2[0].iov_len = n->guest_hdr_len;
-                out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
-                                   out_sg, out_num,
-                                   n->guest_hdr_len, -1);
-                if (out_num == VIRTQUEUE_MAX_SIZE) {
-                    goto drop;
-		}
-                out_num += 1;
-                out_sg = sg2;
-	    }
-        }
-        /*
-         * If host wants to see the guest header as is, we can
-         * pass it on unchanged. Otherwise, copy just the parts
-         * that host is interested in.
-         */
-        assert(n->host_hdr_len <= n->guest_hdr_len);
-        if (n->host_hdr_len != n->guest_hdr_len) {
-            unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
+
+            if (n->has_vnet_hdr) {
+                if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
+                    n->guest_hdr_len) {
+                    error_report("virtio-net header incorrect");
+                    exit(1);
+                }
+                if (n->needs_vnet_hdr_swap) {
+                    virtio_net_hdr_swap(vdev, (void *) &mhdr);
+                    sg2[0].iov_base = &mhdr;
+                    sg2[0].iov_len = n->guest_hdr_len;
+                    out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
                                        out_sg, out_num,
-                                       0, n->host_hdr_len);
-            sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
-                             out_sg, out_num,
-                             n->guest_hdr_len, -1);
-            out_num = sg_num;
-            out_sg = sg;
-        }
+                                       n->guest_hdr_len, -1);
+                    if (out_num == VIRTQUEUE_MAX_SIZE) {
+                        goto drop;
+                    }
+                    out_num += 1;
+                    out_sg = sg2;
+                }
+            }
+            /*
+             * If host wants to see the guest header as is, we can
+             * pass it on unchanged. Otherwise, copy just the parts
+             * that host is interested in.
+             */
+            assert(n->host_hdr_len <= n->guest_hdr_len);
+            if (n->host_hdr_len != n->guest_hdr_len) {
+                unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
+                                           out_sg, out_num,
+                                           0, n->host_hdr_len);
+                sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
+                                 out_sg, out_num,
+                                 n->guest_hdr_len, -1);
+                out_num = sg_num;
+                out_sg = sg;
+            }
 
-        ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
-                                      out_sg, out_num, virtio_net_tx_complete);
-        if (ret == 0) {
-            virtio_queue_set_notification(q->tx_vq, 0);
-            q->async_tx.elem = elem;
-            return -EBUSY;
-        }
+            ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic,
+                                                            queue_index),
+                                          out_sg, out_num,
+                                          virtio_net_tx_complete);
+            if (ret == 0) {
+                /*
+                 * Complete the packets sent so far, and give back the
+                 * ones that were popped after this one, most recent
+                 * first.
+                 */
+                for (j = num - 1; j > i; j--) {
+                    virtqueue_discard(q->tx_vq, elems[j], 0);
+                    g_free(elems[j]);
+                }
+                if (filled) {
+                    virtqueue_flush(q->tx_vq, filled);
+                    virtio_notify(vdev, q->tx_vq);
+                }
+                virtio_queue_set_notification(q->tx_vq, 0);
+                q->async_tx.elem = elem;
+                return -EBUSY;
+            }
 
 drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
-        g_free(elem);
-
-        if (++num_packets >= n->tx_burst) {
-            break;
+            virtqueue_fill(q->tx_vq, elem, 0, filled++);
+            g_free(elem);
         }
+
+        virtqueue_flush(q->tx_vq, filled);
+        virtio_notify(vdev, q->tx_vq);
+        num_packets += num;
     }
     return num_packets;
 }
@@ -72,6 +72,42 @@ uint8_t sdbus_read_data(SDBus *sdbus)
     return 0;
 }
 
+void sdbus_write_data_buf(SDBus *sdbus, const uint8_t *buf, size_t length)
+{
+    SDState *card = get_card(sdbus);
+
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+
+        if (sc->write_data_buf) {
+            sc->write_data_buf(card, buf, length);
+            return;
+        }
+        while (length--) {
+            sc->write_data(card, *buf++);
+        }
+    }
+}
+
+void sdbus_read_data_buf(SDBus *sdbus, uint8_t *buf, size_t length)
+{
+    SDState *card = get_card(sdbus);
+
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+
+        if (sc->read_data_buf) {
+            sc->read_data_buf(card, buf, length);
+            return;
+        }
+        while (length--) {
+            *buf++ = sc->read_data(card);
+        }
+    } else {
+        memset(buf, 0, length);
+    }
+}
+
 bool sdbus_data_ready(SDBus *sdbus)
 {
     SDState *card = get_card(sdbus);
@@ -213,45 +213,45 @@ error:
 
 /* Transfer data between the card and the FIFO.  This is complicated by
    the FIFO holding 32-bit words and the card taking data in single byte
-   chunks.  FIFO bytes are transferred in little-endian order.  */
+   chunks.  FIFO bytes are transferred in little-endian order.  The whole
+   FIFO is moved to or from the card in a single call.  */
 
 static void pl181_fifo_run(PL181State *s)
 {
+    uint8_t buf[PL181_FIFO_LEN * 4];
     uint32_t bits;
     uint32_t value = 0;
-    int n;
+    uint32_t len, n;
     int is_read;
 
     is_read = (s->datactrl & PL181_DATA_DIRECTION) != 0;
     if (s->datacnt != 0 && (!is_read || sd_data_ready(s->card))
             && !s->linux_hack) {
         if (is_read) {
-            n = 0;
-            while (s->datacnt && s->fifo_len < PL181_FIFO_LEN) {
-                value |= (uint32_t)sd_read_data(s->card) << (n * 8);
-                s->datacnt--;
-                n++;
-                if (n == 4) {
+            len = MIN(s->datacnt, (PL181_FIFO_LEN - s->fifo_len) * 4);
+            sd_read_data_buf(s->card, buf, len);
+            s->datacnt -= len;
+            for (n = 0; n < len; n++) {
+                value |= (uint32_t)buf[n] << ((n & 3) * 8);
+                if ((n & 3) == 3) {
                     pl181_fifo_push(s, value);
-                    n = 0;
                     value = 0;
                 }
             }
-            if (n != 0) {
+            if (len & 3) {
                 pl181_fifo_push(s, value);
             }
         } else { /* write */
-            n = 0;
-            while (s->datacnt > 0 && (s->fifo_len > 0 || n > 0)) {
-                if (n == 0) {
+            len = MIN(s->datacnt, s->fifo_len * 4);
+            for (n = 0; n < len; n++) {
+                if ((n & 3) == 0) {
                     value = pl181_fifo_pop(s);
-                    n = 4;
                 }
-                n--;
-                s->datacnt--;
-                sd_write_data(s->card, value & 0xff);
+                buf[n] = value & 0xff;
                 value >>= 8;
             }
+            s->datacnt -= len;
+            sd_write_data_buf(s->card, buf, len);
         }
     }
     s->status &= ~(PL181_STATUS_RX_FIFO | PL181_STATUS_TX_FIFO);
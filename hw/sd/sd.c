@@ -1596,6 +1596,74 @@ static void sd_blk_write(SDState *sd, uint64_t addr, uint32_t len)
 #define APP_READ_BLOCK(a, len)	memset(sd->data, 0xec, len)
 #define APP_WRITE_BLOCK(a, len)
 
+static inline int sd_io_len(SDState *sd)
+{
+    return (sd->ocr & (1 << 30)) ? 512 : sd->blk_len;
+}
+
+/* Start of a CMD25 block - check that the address is valid */
+static bool sd_write_block_valid(SDState *sd)
+{
+    if (sd->data_start + sd->blk_len > sd->size) {
+        sd->card_status |= ADDRESS_ERROR;
+        return false;
+    }
+    if (sd_wp_addr(sd, sd->data_start)) {
+        sd->card_status |= WP_VIOLATION;
+        return false;
+    }
+    return true;
+}
+
+/* A CMD24/CMD25 block has been committed to the backing store */
+static void sd_write_block_done(SDState *sd)
+{
+    sd->blk_written++;
+    sd->csd[14] |= 0x40;
+
+    /* Bzzzzzzztt .... Operation complete.  */
+    if (sd->current_cmd == 24) {
+        sd->state = sd_transfer_state;
+        return;
+    }
+
+    sd->data_start += sd->blk_len;
+    sd->data_offset = 0;
+    if (sd->multi_blk_cnt != 0) {
+        if (--sd->multi_blk_cnt == 0) {
+            /* Stop! */
+            sd->state = sd_transfer_state;
+            return;
+        }
+    }
+
+    sd->state = sd_receivingdata_state;
+}
+
+/* A CMD17/CMD18 block has been sent to the host */
+static void sd_read_block_done(SDState *sd, int io_len)
+{
+    if (sd->current_cmd == 17) {
+        sd->state = sd_transfer_state;
+        return;
+    }
+
+    sd->data_start += io_len;
+    sd->data_offset = 0;
+
+    if (sd->multi_blk_cnt != 0) {
+        if (--sd->multi_blk_cnt == 0) {
+            /* Stop! */
+            sd->state = sd_transfer_state;
+            return;
+        }
+    }
+
+    if (sd->data_start + io_len > sd->size) {
+        sd->card_status |= ADDRESS_ERROR;
+    }
+}
+
 void sd_write_data(SDState *sd, uint8_t value)
 {
     int i;
@@ -1619,45 +1687,20 @@ void sd_write_data(SDState *sd, uint8_t value)
             /* TODO: Check CRC before committing */
             sd->state = sd_programming_state;
             BLK_WRITE_BLOCK(sd->data_start, sd->data_offset);
-            sd->blk_written ++;
-            sd->csd[14] |= 0x40;
-            /* Bzzzzzzztt .... Operation complete.  */
-            sd->state = sd_transfer_state;
+            sd_write_block_done(sd);
         }
         break;
 
     case 25:	/* CMD25:  WRITE_MULTIPLE_BLOCK */
-        if (sd->data_offset == 0) {
-            /* Start of the block - let's check the address is valid */
-            if (sd->data_start + sd->blk_len > sd->size) {
-                sd->card_status |= ADDRESS_ERROR;
-                break;
-            }
-            if (sd_wp_addr(sd, sd->data_start)) {
-                sd->card_status |= WP_VIOLATION;
-                break;
-            }
+        if (sd->data_offset == 0 && !sd_write_block_valid(sd)) {
+            break;
         }
         sd->data[sd->data_offset++] = value;
         if (sd->data_offset >= sd->blk_len) {
             /* TODO: Check CRC before committing */
             sd->state = sd_programming_state;
             BLK_WRITE_BLOCK(sd->data_start, sd->data_offset);
-            sd->blk_written++;
-            sd->data_start += sd->blk_len;
-            sd->data_offset = 0;
-            sd->csd[14] |= 0x40;
-
-            /* Bzzzzzzztt .... Operation complete.  */
-            if (sd->multi_blk_cnt != 0) {
-                if (--sd->multi_blk_cnt == 0) {
-                    /* Stop! */
-                    sd->state = sd_transfer_state;
-                    break;
-                }
-            }
-
-            sd->state = sd_receivingdata_state;
+            sd_write_block_done(sd);
         }
         break;
 
@@ -1747,7 +1790,7 @@ uint8_t sd_read_data(SDState *sd)
     if (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))
         return 0x00;
 
-    io_len = (sd->ocr & (1 << 30)) ? 512 : sd->blk_len;
+    io_len = sd_io_len(sd);
 
     switch (sd->current_cmd) {
     case 6:	/* CMD6:   SWITCH_FUNCTION */
@@ -1788,35 +1831,13 @@ uint8_t sd_read_data(SDState *sd)
         break;
 
     case 17:	/* CMD17:  READ_SINGLE_BLOCK */
-        if (sd->data_offset == 0)
-            BLK_READ_BLOCK(sd->data_start, io_len);
-        ret = sd->data[sd->data_offset ++];
-
-        if (sd->data_offset >= io_len)
-            sd->state = sd_transfer_state;
-        break;
-
     case 18:	/* CMD18:  READ_MULTIPLE_BLOCK */
         if (sd->data_offset == 0)
             BLK_READ_BLOCK(sd->data_start, io_len);
         ret = sd->data[sd->data_offset ++];
 
         if (sd->data_offset >= io_len) {
-            sd->data_start += io_len;
-            sd->data_offset = 0;
-
-            if (sd->multi_blk_cnt != 0) {
-                if (--sd->multi_blk_cnt == 0) {
-                    /* Stop! */
-                    sd->state = sd_transfer_state;
-                    break;
-                }
-            }
-
-            if (sd->data_start + io_len > sd->size) {
-                sd->card_status |= ADDRESS_ERROR;
-                break;
-            }
+            sd_read_block_done(sd, io_len);
         }
         break;
 
@@ -1858,6 +1879,133 @@ uint8_t sd_read_data(SDState *sd)
     return ret;
 }
 
+/* Number of whole blocks, up to max, that a CMD17/CMD18 read or a
+ * CMD24/CMD25 write can go through without stopping on an error.
+ */
+static size_t sd_bulk_blocks(SDState *sd, size_t max, int len, bool is_write)
+{
+    uint64_t addr = sd->data_start;
+    size_t n;
+
+    if (sd->current_cmd == 17 || sd->current_cmd == 24) {
+        return MIN(max, 1);
+    }
+    if (sd->multi_blk_cnt != 0) {
+        max = MIN(max, sd->multi_blk_cnt);
+    }
+    for (n = 0; n < max; n++, addr += len) {
+        if (addr + len > sd->size || (is_write && sd_wp_addr(sd, addr))) {
+            break;
+        }
+    }
+    return n;
+}
+
+/* Read length bytes from the card.  Whole blocks of a CMD17/CMD18 read
+ * are read straight into buf, several at a time; everything else goes
+ * through the byte-wide sd_read_data().
+ */
+void sd_read_data_buf(SDState *sd, uint8_t *buf, size_t length)
+{
+    size_t n, l;
+    int io_len;
+
+    while (length > 0) {
+        if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+            sd->state != sd_sendingdata_state ||
+            (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION)) ||
+            (sd->current_cmd != 17 && sd->current_cmd != 18) ||
+            sd_io_len(sd) == 0) {
+            *buf++ = sd_read_data(sd);
+            length--;
+            continue;
+        }
+
+        io_len = sd_io_len(sd);
+        if (sd->data_offset == 0) {
+            n = sd_bulk_blocks(sd, length / io_len, io_len, false);
+            if (n > 0) {
+                DPRINTF("sd_read_data_buf: addr = 0x%08llx, %zu blocks\n",
+                        (unsigned long long) sd->data_start, n);
+                if (blk_pread(sd->blk, sd->data_start, buf, n * io_len) < 0) {
+                    fprintf(stderr,
+                            "sd_read_data_buf: read error on host side\n");
+                }
+                buf += n * io_len;
+                length -= n * io_len;
+                while (n-- > 0) {
+                    sd_read_block_done(sd, io_len);
+                }
+                continue;
+            }
+            BLK_READ_BLOCK(sd->data_start, io_len);
+        }
+
+        l = MIN(length, io_len - sd->data_offset);
+        memcpy(buf, sd->data + sd->data_offset, l);
+        sd->data_offset += l;
+        buf += l;
+        length -= l;
+        if (sd->data_offset >= io_len) {
+            sd_read_block_done(sd, io_len);
+        }
+    }
+}
+
+/* Write length bytes to the card, the counterpart of sd_read_data_buf().  */
+void sd_write_data_buf(SDState *sd, const uint8_t *buf, size_t length)
+{
+    size_t n, l;
+
+    while (length > 0) {
+        if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+            sd->state != sd_receivingdata_state ||
+            (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION)) ||
+            (sd->current_cmd != 24 && sd->current_cmd != 25) ||
+            sd->blk_len == 0) {
+            sd_write_data(sd, *buf++);
+            length--;
+            continue;
+        }
+
+        if (sd->data_offset == 0) {
+            if (sd->current_cmd == 25 && !sd_write_block_valid(sd)) {
+                continue;
+            }
+            n = sd_bulk_blocks(sd, length / sd->blk_len, sd->blk_len, true);
+        } else {
+            n = 0;
+        }
+        if (n > 0) {
+            /* TODO: Check CRC before committing */
+            sd->state = sd_programming_state;
+            if (blk_pwrite(sd->blk, sd->data_start, buf,
+                           n * sd->blk_len, 0) < 0) {
+                fprintf(stderr,
+                        "sd_write_data_buf: write error on host side\n");
+            }
+            buf += n * sd->blk_len;
+            length -= n * sd->blk_len;
+            while (n-- > 0) {
+                sd_write_block_done(sd);
+            }
+            continue;
+        }
+
+        l = MIN(length, sd->blk_len - sd->data_offset);
+        memcpy(sd->data + sd->data_offset, buf, l);
+        sd->data_offset += l;
+        buf += l;
+        length -= l;
+        if (sd->data_offset >= sd->blk_len) {
+            /* TODO: Check CRC before committing */
+            sd->state = sd_programming_state;
+            BLK_WRITE_BLOCK(sd->data_start, sd->data_offset);
+            sd_write_block_done(sd);
+        }
+    }
+}
+
 bool sd_data_ready(SDState *sd)
 {
     return sd->state == sd_sendingdata_state;
@@ -1914,6 +2062,8 @@ static void sd_class_init(ObjectClass *klass, void *data)
     sc->do_command = sd_do_command;
     sc->write_data = sd_write_data;
     sc->read_data = sd_read_data;
+    sc->write_data_buf = sd_write_data_buf;
+    sc->read_data_buf = sd_read_data_buf;
     sc->data_ready = sd_data_ready;
     sc->enable = sd_enable;
     sc->get_inserted = sd_get_inserted;
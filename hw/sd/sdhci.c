@@ -316,16 +316,12 @@ static void sdhci_end_transfer(SDHCIState *s)
 /* Fill host controller's read buffer with BLKSIZE bytes of data from card */
 static void sdhci_read_block_from_card(SDHCIState *s)
 {
-    int index = 0;
-
     if ((s->trnmod & SDHC_TRNS_MULTI) &&
             (s->trnmod & SDHC_TRNS_BLK_CNT_EN) && (s->blkcnt == 0)) {
         return;
     }
 
-    for (index = 0; index < (s->blksize & 0x0fff); index++) {
-        s->fifo_buffer[index] = sdbus_read_data(&s->sdbus);
-    }
+    sdbus_read_data_buf(&s->sdbus, s->fifo_buffer, s->blksize & 0x0fff);
 
     /* New data now available for READ through Buffer Port Register */
     s->prnsts |= SDHC_DATA_AVAILABLE;
@@ -398,8 +394,6 @@ static uint32_t sdhci_read_dataport(SDHCIState *s, unsigned size)
 /* Write data from host controller FIFO to card */
 static void sdhci_write_block_to_card(SDHCIState *s)
 {
-    int index = 0;
-
     if (s->prnsts & SDHC_SPACE_AVAILABLE) {
         if (s->norintstsen & SDHC_NISEN_WBUFRDY) {
             s->norintsts |= SDHC_NIS_WBUFRDY;
@@ -416,9 +410,7 @@ static void sdhci_write_block_to_card(SDHCIState *s)
         }
     }
 
-    for (index = 0; index < (s->blksize & 0x0fff); index++) {
-        sdbus_write_data(&s->sdbus, s->fifo_buffer[index]);
-    }
+    sdbus_write_data_buf(&s->sdbus, s->fifo_buffer, s->blksize & 0x0fff);
 
     /* Next data can be written through BUFFER DATORT register */
     s->prnsts |= SDHC_SPACE_AVAILABLE;
@@ -481,7 +473,7 @@ static void sdhci_write_dataport(SDHCIState *s, uint32_t value, unsigned size)
 static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
 {
     bool page_aligned = false;
-    unsigned int n, begin;
+    unsigned int begin;
     const uint16_t block_size = s->blksize & 0x0fff;
     uint32_t boundary_chk = 1 << (((s->blksize & 0xf000) >> 12) + 12);
     uint32_t boundary_count = boundary_chk - (s->sdmasysad % boundary_chk);
@@ -498,9 +490,7 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
                 SDHC_DAT_LINE_ACTIVE;
         while (s->blkcnt) {
             if (s->data_count == 0) {
-                for (n = 0; n < block_size; n++) {
-                    s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
-                }
+                sdbus_read_data_buf(&s->sdbus, s->fifo_buffer, block_size);
             }
             begin = s->data_count;
             if (((boundary_count + begin) < block_size) && page_aligned) {
@@ -539,9 +529,7 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
                             &s->fifo_buffer[begin], s->data_count);
             s->sdmasysad += s->data_count - begin;
             if (s->data_count == block_size) {
-                for (n = 0; n < block_size; n++) {
-                    sdbus_write_data(&s->sdbus, s->fifo_buffer[n]);
-                }
+                sdbus_write_data_buf(&s->sdbus, s->fifo_buffer, block_size);
                 s->data_count = 0;
                 if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
                     s->blkcnt--;
@@ -567,21 +555,16 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
 
 static void sdhci_sdma_transfer_single_block(SDHCIState *s)
 {
-    int n;
     uint32_t datacnt = s->blksize & 0x0fff;
 
     if (s->trnmod & SDHC_TRNS_READ) {
-        for (n = 0; n < datacnt; n++) {
-            s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
-        }
+        sdbus_read_data_buf(&s->sdbus, s->fifo_buffer, datacnt);
         dma_memory_write(&address_space_memory, s->sdmasysad, s->fifo_buffer,
                          datacnt);
     } else {
         dma_memory_read(&address_space_memory, s->sdmasysad, s->fifo_buffer,
                         datacnt);
-        for (n = 0; n < datacnt; n++) {
-            sdbus_write_data(&s->sdbus, s->fifo_buffer[n]);
-        }
+        sdbus_write_data_buf(&s->sdbus, s->fifo_buffer, datacnt);
     }
 
     if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
@@ -644,6 +627,51 @@ static void get_adma_description(SDHCIState *s, ADMADescr *dscr)
     }
 }
 
+/* Transfer the whole blocks at the start of an ADMA data descriptor
+ * directly between the card and guest memory, without going through
+ * the FIFO buffer.  Returns the number of bytes transferred.
+ */
+static unsigned int sdhci_adma_transfer_blocks(SDHCIState *s, hwaddr addr,
+                                               unsigned int length)
+{
+    const uint16_t block_size = s->blksize & 0x0fff;
+    DMADirection dir = (s->trnmod & SDHC_TRNS_READ) ?
+                       DMA_DIRECTION_FROM_DEVICE : DMA_DIRECTION_TO_DEVICE;
+    unsigned int blocks;
+    dma_addr_t len;
+    void *mem;
+
+    if (s->data_count != 0 || block_size == 0) {
+        return 0;
+    }
+    blocks = length / block_size;
+    if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
+        blocks = MIN(blocks, s->blkcnt);
+    }
+    if (blocks == 0) {
+        return 0;
+    }
+
+    len = (dma_addr_t)blocks * block_size;
+    mem = dma_memory_map(&address_space_memory, addr, &len, dir);
+    if (!mem) {
+        return 0;
+    }
+    blocks = len / block_size;
+    if (dir == DMA_DIRECTION_FROM_DEVICE) {
+        sdbus_read_data_buf(&s->sdbus, mem, blocks * block_size);
+    } else {
+        sdbus_write_data_buf(&s->sdbus, mem, blocks * block_size);
+    }
+    dma_memory_unmap(&address_space_memory, mem, len, dir,
+                     blocks * block_size);
+
+    if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
+        s->blkcnt -= blocks;
+    }
+    return blocks * block_size;
+}
+
 /* Advanced DMA data transfer */
 
 static void sdhci_do_adma(SDHCIState *s)
@@ -682,10 +710,19 @@ static void sdhci_do_adma(SDHCIState *s)
 
             if (s->trnmod & SDHC_TRNS_READ) {
                 while (length) {
-                    if (s->data_count == 0) {
-                        for (n = 0; n < block_size; n++) {
-                            s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
+                    n = sdhci_adma_transfer_blocks(s, dscr.addr, length);
+                    if (n) {
+                        dscr.addr += n;
+                        length -= n;
+                        if ((s->trnmod & SDHC_TRNS_BLK_CNT_EN) &&
+                            s->blkcnt == 0) {
+                            break;
                         }
+                        continue;
+                    }
+                    if (s->data_count == 0) {
+                        sdbus_read_data_buf(&s->sdbus, s->fifo_buffer,
+                                            block_size);
                     }
                     begin = s->data_count;
                     if ((length + begin) < block_size) {
@@ -711,6 +748,16 @@ static void sdhci_do_adma(SDHCIState *s)
                 }
             } else {
                 while (length) {
+                    n = sdhci_adma_transfer_blocks(s, dscr.addr, length);
+                    if (n) {
+                        dscr.addr += n;
+                        length -= n;
+                        if ((s->trnmod & SDHC_TRNS_BLK_CNT_EN) &&
+                            s->blkcnt == 0) {
+                            break;
+                        }
+                        continue;
+                    }
                     begin = s->data_count;
                     if ((length + begin) < block_size) {
                         s->data_count = length + begin;
@@ -724,9 +771,8 @@ static void sdhci_do_adma(SDHCIState *s)
                                     s->data_count - begin);
                     dscr.addr += s->data_count - begin;
                     if (s->data_count == block_size) {
-                        for (n = 0; n < block_size; n++) {
-                            sdbus_write_data(&s->sdbus, s->fifo_buffer[n]);
-                        }
+                        sdbus_write_data_buf(&s->sdbus, s->fifo_buffer,
+                                             block_size);
                         s->data_count = 0;
                         if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
                             s->blkcnt--;
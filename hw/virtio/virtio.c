@@ -119,11 +119,47 @@ void virtio_queue_update_rings(VirtIODevice *vdev, int n)
                               vring->align);
 }
 
+/* Descriptor table of a virtqueue, mapped for the duration of a batch */
+typedef struct VRingDescMap {
+    hwaddr pa;
+    hwaddr len;
+    VRingDesc *table;
+} VRingDescMap;
+
+static void vring_desc_map(VirtQueue *vq, VRingDescMap *map)
+{
+    hwaddr len;
+
+    map->pa = vq->vring.desc;
+    map->len = len = vq->vring.num * sizeof(VRingDesc);
+    map->table = address_space_map(&address_space_memory, map->pa, &len,
+                                   false);
+    if (map->table && len < map->len) {
+        address_space_unmap(&address_space_memory, map->table, len, false, 0);
+        map->table = NULL;
+    }
+}
+
+static void vring_desc_unmap(VRingDescMap *map)
+{
+    if (map->table) {
+        address_space_unmap(&address_space_memory, map->table, map->len,
+                            false, 0);
+    }
+}
+
 static void vring_desc_read(VirtIODevice *vdev, VRingDesc *desc,
-                            hwaddr desc_pa, int i)
+                            VRingDescMap *map, hwaddr desc_pa, int i)
 {
-    address_space_read(&address_space_memory, desc_pa + i * sizeof(VRingDesc),
-                       MEMTXATTRS_UNSPECIFIED, (void *)desc, sizeof(VRingDesc));
+    if (map && map->table && desc_pa == map->pa &&
+        i < map->len / sizeof(VRingDesc)) {
+        *desc = map->table[i];
+    } else {
+        address_space_read(&address_space_memory,
+                           desc_pa + i * sizeof(VRingDesc),
+                           MEMTXATTRS_UNSPECIFIED, (void *)desc,
+                           sizeof(VRingDesc));
+    }
     virtio_tswap64s(vdev, &desc->addr);
     virtio_tswap32s(vdev, &desc->len);
     virtio_tswap16s(vdev, &desc->flags);
@@ -346,7 +382,8 @@ static unsigned int virtqueue_get_head(VirtQueue *vq, unsigned int idx)
 }
 
 static unsigned virtqueue_read_next_desc(VirtIODevice *vdev, VRingDesc *desc,
-                                         hwaddr desc_pa, unsigned int max)
+                                         VRingDescMap *map, hwaddr desc_pa,
+                                         unsigned int max)
 {
     unsigned int next;
 
@@ -365,7 +402,7 @@ static unsigned virtqueue_read_next_desc(VirtIODevice *vdev, VRingDesc *desc,
         exit(1);
     }
 
-    vring_desc_read(vdev, desc, desc_pa, next);
+    vring_desc_read(vdev, desc, map, desc_pa, next);
     return next;
 }
 
@@ -390,7 +427,7 @@ void virtqueue_get_avail_bytes(VirtQueue *vq, unsigned int *in_bytes,
         num_bufs = total_bufs;
         i = virtqueue_get_head(vq, idx++);
         desc_pa = vq->vring.desc;
-        vring_desc_read(vdev, &desc, desc_pa, i);
+        vring_desc_read(vdev, &desc, NULL, desc_pa, i);
 
         if (desc.flags & VRING_DESC_F_INDIRECT) {
             if (desc.len % sizeof(VRingDesc)) {
@@ -409,7 +446,7 @@ void virtqueue_get_avail_bytes(VirtQueue *vq, unsigned int *in_bytes,
             max = desc.len / sizeof(VRingDesc);
             desc_pa = desc.addr;
             num_bufs = i = 0;
-            vring_desc_read(vdev, &desc, desc_pa, i);
+            vring_desc_read(vdev, &desc, NULL, desc_pa, i);
         }
 
         do {
@@ -427,7 +464,8 @@ void virtqueue_get_avail_bytes(VirtQueue *vq, unsigned int *in_bytes,
             if (in_total >= max_in_bytes && out_total >= max_out_bytes) {
                 goto done;
             }
-        } while ((i = virtqueue_read_next_desc(vdev, &desc, desc_pa, max)) != max);
+        } while ((i = virtqueue_read_next_desc(vdev, &desc, NULL, desc_pa,
+                                               max)) != max);
 
         if (!indirect)
             total_bufs = num_bufs;
@@ -545,7 +583,9 @@ void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_num)
     return elem;
 }
 
-void *virtqueue_pop(VirtQueue *vq, size_t sz)
+/* Pop the element at last_avail_idx, which the caller knows is there */
+static VirtQueueElement *virtqueue_pop_one(VirtQueue *vq, size_t sz,
+                                           VRingDescMap *map)
 {
     unsigned int i, head, max;
     hwaddr desc_pa = vq->vring.desc;
@@ -556,13 +596,6 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     struct iovec iov[VIRTQUEUE_MAX_SIZE];
     VRingDesc desc;
 
-    if (virtio_queue_empty(vq)) {
-        return NULL;
-    }
-    /* Needed after virtio_queue_empty(), see comment in
-     * virtqueue_num_heads(). */
-    smp_rmb();
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = 0;
 
@@ -574,11 +607,8 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     }
 
     i = head = virtqueue_get_head(vq, vq->last_avail_idx++);
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        vring_set_avail_event(vq, vq->last_avail_idx);
-    }
 
-    vring_desc_read(vdev, &desc, desc_pa, i);
+    vring_desc_read(vdev, &desc, map, desc_pa, i);
     if (desc.flags & VRING_DESC_F_INDIRECT) {
         if (desc.len % sizeof(VRingDesc)) {
             error_report("Invalid size for indirect buffer table");
@@ -589,7 +619,7 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
         max = desc.len / sizeof(VRingDesc);
         desc_pa = desc.addr;
         i = 0;
-        vring_desc_read(vdev, &desc, desc_pa, i);
+        vring_desc_read(vdev, &desc, map, desc_pa, i);
     }
 
     /* Collect all the descriptors */
@@ -611,7 +641,8 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
             error_report("Looped descriptor");
             exit(1);
         }
-    } while ((i = virtqueue_read_next_desc(vdev, &desc, desc_pa, max)) != max);
+    } while ((i = virtqueue_read_next_desc(vdev, &desc, map, desc_pa,
+                                           max)) != max);
 
     /* Now copy what we have collected and mapped */
     elem = virtqueue_alloc_element(sz, out_num, in_num);
@@ -631,6 +662,52 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     return elem;
 }
 
+void *virtqueue_pop(VirtQueue *vq, size_t sz)
+{
+    VirtQueueElement *elem;
+
+    if (virtio_queue_empty(vq)) {
+        return NULL;
+    }
+    /* Needed after virtio_queue_empty(), see comment in
+     * virtqueue_num_heads(). */
+    smp_rmb();
+
+    elem = virtqueue_pop_one(vq, sz, NULL);
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return elem;
+}
+
+/*
+ * Pop up to @max elements into @elems, mapping the descriptor table once
+ * for all of them.  Returns the number of elements popped.
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    VRingDescMap map;
+    unsigned int i, num;
+
+    /* Only the heads published so far: the map may be a snapshot */
+    num = MIN(max, virtqueue_num_heads(vq, vq->last_avail_idx));
+    if (!num) {
+        return 0;
+    }
+
+    vring_desc_map(vq, &map);
+    for (i = 0; i < num; i++) {
+        elems[i] = virtqueue_pop_one(vq, sz, &map);
+    }
+    vring_desc_unmap(&map);
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return num;
+}
+
 /* Reading and writing a structure directly to QEMUFile is *awful*, but
  * it is what QEMU has always done by mistake.  We can change it sooner
  * or later by bumping the version number of the affected vm states.
@@ -26,6 +26,7 @@ typedef struct ThreadPool ThreadPool;
 
 ThreadPool *thread_pool_new(struct AioContext *ctx);
 void thread_pool_free(ThreadPool *pool);
+void thread_pool_set_max_threads(ThreadPool *pool, int max_threads);
 
 BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
         ThreadPoolFunc *func, void *arg,
@@ -0,0 +1,69 @@
+/*
+ * Data path of the ARMv8 Crypto Extensions instructions
+ *
+ * Copyright (C) 2013 - 2014 Linaro Ltd <ard.biesheuvel@linaro.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef QCRYPTO_ARM_CE_H
+#define QCRYPTO_ARM_CE_H
+
+/*
+ * The operations of the AES, SHA-1, SHA-256 and PMULL instructions, on
+ * the 128-bit value of a Q register (l[0] is the low half, as in the
+ * vfp.regs[] pair of the CPU state).
+ *
+ * On x86 hosts with AES-NI, SHA-NI and PCLMULQDQ the instructions
+ * are mapped onto the host ones, chosen when QEMU starts; the results
+ * are bit for bit those of the portable versions, which are exported
+ * with a _generic suffix so that they can be compared.
+ */
+
+typedef union ArmCEState {
+    uint8_t    bytes[16];
+    uint32_t   words[4];
+    uint64_t   l[2];
+} ArmCEState;
+
+/* AESE (decrypt false) or AESD: (Inv)SubBytes((Inv)ShiftRows(st ^ rk)) */
+void arm_ce_aese(ArmCEState *st, const ArmCEState *rk, bool decrypt);
+/* AESMC (decrypt false) or AESIMC: (Inv)MixColumns(st) */
+void arm_ce_aesmc(ArmCEState *st, bool decrypt);
+
+/* SHA1C (op 0), SHA1P (1), SHA1M (2), SHA1SU0 (3) */
+void arm_ce_sha1_3reg(ArmCEState *d, const ArmCEState *n,
+                      const ArmCEState *m, int op);
+void arm_ce_sha1h(ArmCEState *d, const ArmCEState *m);
+void arm_ce_sha1su1(ArmCEState *d, const ArmCEState *m);
+
+void arm_ce_sha256h(ArmCEState *d, const ArmCEState *n, const ArmCEState *m);
+void arm_ce_sha256h2(ArmCEState *d, const ArmCEState *n, const ArmCEState *m);
+void arm_ce_sha256su0(ArmCEState *d, const ArmCEState *m);
+void arm_ce_sha256su1(ArmCEState *d, const ArmCEState *n,
+                      const ArmCEState *m);
+
+/* Low and high halves of the 64 x 64 -> 128 polynomial product */
+uint64_t arm_ce_pmull_64_lo(uint64_t op1, uint64_t op2);
+uint64_t arm_ce_pmull_64_hi(uint64_t op1, uint64_t op2);
+
+/* Portable versions, for testing. */
+void arm_ce_aese_generic(ArmCEState *st, const ArmCEState *rk, bool decrypt);
+void arm_ce_aesmc_generic(ArmCEState *st, bool decrypt);
+void arm_ce_sha1_3reg_generic(ArmCEState *d, const ArmCEState *n,
+                              const ArmCEState *m, int op);
+void arm_ce_sha1su1_generic(ArmCEState *d, const ArmCEState *m);
+void arm_ce_sha256h_generic(ArmCEState *d, const ArmCEState *n,
+                            const ArmCEState *m);
+void arm_ce_sha256h2_generic(ArmCEState *d, const ArmCEState *n,
+                             const ArmCEState *m);
+void arm_ce_sha256su0_generic(ArmCEState *d, const ArmCEState *m);
+void arm_ce_sha256su1_generic(ArmCEState *d, const ArmCEState *n,
+                              const ArmCEState *m);
+uint64_t arm_ce_pmull_64_lo_generic(uint64_t op1, uint64_t op2);
+uint64_t arm_ce_pmull_64_hi_generic(uint64_t op1, uint64_t op2);
+
+#endif /* QCRYPTO_ARM_CE_H */
@@ -105,6 +105,8 @@ void stq_be_phys(AddressSpace *as, hwaddr addr, uint64_t val);
 
 void cpu_physical_memory_write_rom(AddressSpace *as, hwaddr addr,
                                    const uint8_t *buf, int len);
+void cpu_physical_memory_update_rom(AddressSpace *as, hwaddr addr,
+                                    const uint8_t *buf, int len);
 void cpu_flush_icache_range(hwaddr start, int len);
 
 extern struct MemoryRegion io_mem_rom;
@@ -56,7 +56,14 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags,
                               int cflags);
+TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
+                                   target_ulong cs_base, uint32_t flags);
 #if defined(CONFIG_USER_ONLY)
+TranslationBlock *tb_gen_code_parallel(CPUState *cpu,
+                                       target_ulong pc, target_ulong cs_base,
+                                       uint32_t flags, int cflags);
+void tb_translate_fork_start(void);
+void tb_translate_fork_end(int child);
 void cpu_list_lock(void);
 void cpu_list_unlock(void);
 #else
@@ -381,6 +388,7 @@ void tlb_fill(CPUState *cpu, target_ulong addr, MMUAccessType access_type,
 #if defined(CONFIG_USER_ONLY)
 void mmap_lock(void);
 void mmap_unlock(void);
+bool have_mmap_lock(void);
 
 static inline tb_page_addr_t get_page_addr_code(CPUArchState *env1, target_ulong addr)
 {
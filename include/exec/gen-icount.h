@@ -3,11 +3,12 @@
 
 #include "qemu/timer.h"
 
-/* Helpers for instruction counting code generation.  */
+/* Helpers for instruction counting code generation.  The state is per
+   thread, like tcg_ctx.  */
 
-static int icount_start_insn_idx;
-static TCGLabel *icount_label;
-static TCGLabel *exitreq_label;
+static __thread int icount_start_insn_idx;
+static __thread TCGLabel *icount_label;
+static __thread TCGLabel *exitreq_label;
 
 static inline void gen_tb_start(TranslationBlock *tb)
 {
@@ -59,7 +60,7 @@ static void gen_tb_end(TranslationBlock *tb, int num_insns)
     }
 
     /* Terminate the linked list.  */
-    tcg_ctx.gen_op_buf[tcg_ctx.gen_op_buf[0].prev].next = 0;
+    tcg_ctx->gen_op_buf[tcg_ctx->gen_op_buf[0].prev].next = 0;
 }
 
 static inline void gen_io_start(void)
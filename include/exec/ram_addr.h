@@ -86,6 +86,10 @@ typedef struct RAMList {
     /* RCU-enabled, writes protected by the ramlist lock. */
     QLIST_HEAD(, RAMBlock) blocks;
     DirtyMemoryBlocks *dirty_memory[DIRTY_MEMORY_NUM];
+    /* Set when pages were marked dirty for migration without being logged
+     * in a vCPU dirty ring, so that the whole bitmap has to be synced.
+     */
+    bool dirty_rings_incomplete;
     uint32_t version;
 } RAMList;
 extern RAMList ram_list;
@@ -300,6 +304,10 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
 
     rcu_read_unlock();
 
+    if (mask & (1 << DIRTY_MEMORY_MIGRATION)) {
+        atomic_set(&ram_list.dirty_rings_incomplete, true);
+    }
+
     xen_modified_memory(start, length);
 }
 
@@ -354,6 +362,7 @@ static inline void cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
 
         rcu_read_unlock();
 
+        atomic_set(&ram_list.dirty_rings_incomplete, true);
         xen_modified_memory(start, pages << TARGET_PAGE_BITS);
     } else {
         uint8_t clients = tcg_enabled() ? DIRTY_CLIENTS_ALL : DIRTY_CLIENTS_NOCODE;
@@ -392,6 +401,25 @@ static inline void cpu_physical_memory_clear_dirty_range(ram_addr_t start,
 }
 
 
+extern bool ram_cow_active;
+void ram_cow_prepare_write(ram_addr_t start, ram_addr_t length);
+
+/* Called before guest RAM is written other than by TCG code, so that
+ * a background snapshot can save the old contents first.
+ */
+static inline void cpu_physical_memory_prepare_write(ram_addr_t start,
+                                                     ram_addr_t length)
+{
+    if (unlikely(atomic_read(&ram_cow_active))) {
+        ram_cow_prepare_write(start, length);
+    }
+}
+
+bool cpu_physical_memory_dirty_ring_push(CPUState *cpu, ram_addr_t addr);
+bool cpu_physical_memory_sync_dirty_rings(unsigned long *dest,
+                                          uint64_t *num_dirty);
+void cpu_physical_memory_rearm_dirty_tracking(void);
+
 static inline
 uint64_t cpu_physical_memory_sync_dirty_bitmap(unsigned long *dest,
                                                ram_addr_t start,
@@ -33,13 +33,20 @@ struct TBContext {
 
     TranslationBlock *tbs;
     struct qht htable;
-    int nb_tbs;
     /* any access to the tbs or the page table must use this lock */
     QemuMutex tb_lock;
 
+    /* Bumped under mmap_lock whenever guest code may have changed, so
+     * that a TB translated outside the locks can be checked before it
+     * is published.
+     */
+    unsigned code_write_count;
+
     /* statistics */
     int tb_flush_count;
     int tb_phys_invalidate_count;
 };
 
+extern TBContext tb_ctx;
+
 #endif
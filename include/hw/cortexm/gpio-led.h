@@ -24,6 +24,7 @@
 #include "qemu/typedefs.h"
 #include "hw/sysbus.h"
 
+#include <hw/cortexm/helper.h>
 #include <hw/cortexm/graphic.h>
 
 /* ------------------------------------------------------------------------- */
@@ -87,6 +88,8 @@ typedef struct {
 
 #define GPIO_LED_STATE(obj) \
     OBJECT_CHECK(GPIOLEDState, (obj), TYPE_GPIO_LED)
+#define GPIO_LED_STATE_FAST(obj) \
+    CM_OBJECT_CAST(GPIOLEDState, (obj), TYPE_GPIO_LED)
 
 typedef struct {
     /*< private >*/
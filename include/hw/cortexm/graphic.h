@@ -34,10 +34,10 @@
 
 /* ------------------------------------------------------------------------- */
 
-// Use polling on the QEMU I/O thread instead of a separate thread.
-#define USE_GRAPHIC_POLL_EVENT
-// On windows always use polling.
-#if !defined(USE_GRAPHIC_POLL_EVENT) && defined(WIN32)
+// Run SDL on the main thread, blocked in SDL_WaitEvent(), and QEMU on a
+// separate thread. On windows the I/O event loop fails if moved to
+// another thread, so poll on the QEMU I/O thread instead.
+#if defined(WIN32) || !defined(CONFIG_SDL)
 #define USE_GRAPHIC_POLL_EVENT
 #endif
 
@@ -77,14 +77,17 @@ typedef struct {
 enum {
     GRAPHIC_EVENT_NONE = 0,
     GRAPHIC_EVENT_QUIT,
-    GRAPHIC_EVENT_EXIT,
     GRAPHIC_EVENT_BOARD_INIT,
     GRAPHIC_EVENT_LED_INIT,
     GRAPHIC_EVENT_LED_TURN,
+    GRAPHIC_EVENT_WAKEUP,
+    GRAPHIC_EVENT_WINDOW_CLOSE,
 };
 
 /* ------------------------------------------------------------------------- */
 
+void cortexm_graphic_init(void);
+
 void cortexm_graphic_start(bool nographic);
 
 #if defined(USE_GRAPHIC_POLL_EVENT)
@@ -97,8 +100,6 @@ int cortexm_graphic_push_event(int code, void *data1, void *data2);
 
 void cortexm_graphic_event_loop(void);
 
-//void cortexm_graphic_init_timer(void);
-
 /* ----- Board graphic functions ----- */
 void cortexm_graphic_board_clear_graphic_context(
         BoardGraphicContext *board_graphic_context);
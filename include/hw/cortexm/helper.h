@@ -44,6 +44,34 @@
 
 /* ------------------------------------------------------------------------- */
 
+/*
+ * Casts for the MMIO, interrupt and character device paths, which run
+ * several times per guest access. The pointers they get were stored
+ * after a checked cast (when the memory region, the register array or
+ * the handler was set up). Without --enable-qom-cast-debug, OBJECT_CHECK()
+ * does not check either, so these only save its out of line call and
+ * trace point; with it, they check like OBJECT_CHECK().
+ *
+ * The layout requirement of the cast (the parent object first) is
+ * verified at compile time.
+ */
+#define CM_OBJECT_CAST_LAYOUT_OK(type) \
+    (0 * sizeof(char[offsetof(type, parent_obj) == 0 ? 1 : -1]))
+
+#if defined(CONFIG_QOM_CAST_DEBUG)
+#define CM_OBJECT_CAST(type, obj, name) \
+    (OBJECT_CHECK(type, (obj), (name)) + CM_OBJECT_CAST_LAYOUT_OK(type))
+#define CM_OBJECT_GET_CLASS(klass, obj, name) \
+    OBJECT_GET_CLASS(klass, (obj), (name))
+#else
+#define CM_OBJECT_CAST(type, obj, name) \
+    ((type *)(obj) + CM_OBJECT_CAST_LAYOUT_OK(type))
+#define CM_OBJECT_GET_CLASS(klass, obj, name) \
+    ((klass *)OBJECT(obj)->class)
+#endif
+
+/* ------------------------------------------------------------------------- */
+
 typedef uint64_t peripheral_register_t;
 
 /* ------------------------------------------------------------------------- */
@@ -157,6 +157,8 @@ typedef DeviceState PeripheralRegisterParentState;
 /* Class definitions. */
 #define PERIPHERAL_REGISTER_GET_CLASS(obj) \
     OBJECT_GET_CLASS(PeripheralRegisterClass, (obj), TYPE_PERIPHERAL_REGISTER)
+#define PERIPHERAL_REGISTER_GET_CLASS_FAST(obj) \
+    CM_OBJECT_GET_CLASS(PeripheralRegisterClass, (obj), TYPE_PERIPHERAL_REGISTER)
 #define PERIPHERAL_REGISTER_CLASS(klass) \
     OBJECT_CLASS_CHECK(PeripheralRegisterClass, (klass), TYPE_PERIPHERAL_REGISTER)
 
@@ -177,6 +179,8 @@ typedef struct {
 /* Instance definitions. */
 #define PERIPHERAL_REGISTER_STATE(obj) \
     OBJECT_CHECK(PeripheralRegisterState, (obj), TYPE_PERIPHERAL_REGISTER)
+#define PERIPHERAL_REGISTER_STATE_FAST(obj) \
+    CM_OBJECT_CAST(PeripheralRegisterState, (obj), TYPE_PERIPHERAL_REGISTER)
 
 typedef struct {
     /*< private >*/
@@ -61,6 +61,8 @@ typedef bool (*peripheral_is_enabled_t)(Object *obj);
 /* Class definitions. */
 #define PERIPHERAL_GET_CLASS(obj) \
     OBJECT_GET_CLASS(PeripheralClass, (obj), TYPE_PERIPHERAL)
+#define PERIPHERAL_GET_CLASS_FAST(obj) \
+    CM_OBJECT_GET_CLASS(PeripheralClass, (obj), TYPE_PERIPHERAL)
 #define PERIPHERAL_CLASS(klass) \
     OBJECT_CLASS_CHECK(PeripheralClass, (klass), TYPE_PERIPHERAL)
 
@@ -70,6 +72,13 @@ typedef struct {
     /*< public >*/
 
     peripheral_is_enabled_t is_enabled;
+
+    /*
+     * Accessors of the MMIO region; by default, accesses are forwarded
+     * to the registers. Peripherals that are not made of registers,
+     * like the remote ones, set their own.
+     */
+    const MemoryRegionOps *mmio_ops;
 } PeripheralClass;
 
 /* ------------------------------------------------------------------------- */
@@ -77,6 +86,8 @@ typedef struct {
 /* Instance definitions. */
 #define PERIPHERAL_STATE(obj) \
     OBJECT_CHECK(PeripheralState, (obj), TYPE_PERIPHERAL)
+#define PERIPHERAL_STATE_FAST(obj) \
+    CM_OBJECT_CAST(PeripheralState, (obj), TYPE_PERIPHERAL)
 
 typedef struct {
     /*< private >*/
@@ -104,7 +115,8 @@ typedef struct {
     uint32_t num_registers;
 
     uint32_t registers_size_ptrs;
-    Object **registers;
+    /* Registers indexed by offset / register_size_bytes, NULL for gaps. */
+    PeripheralRegisterState **registers;
 
     bool is_little_endian;
 } PeripheralState;
@@ -81,6 +81,8 @@ typedef struct {
 /* Instance definitions. */
 #define REGISTER_BITFIELD_STATE(obj) \
     OBJECT_CHECK(RegisterBitfieldState, (obj), TYPE_REGISTER_BITFIELD)
+#define REGISTER_BITFIELD_STATE_FAST(obj) \
+    CM_OBJECT_CAST(RegisterBitfieldState, (obj), TYPE_REGISTER_BITFIELD)
 
 typedef struct {
     /*< private >*/
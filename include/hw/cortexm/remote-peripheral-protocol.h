@@ -0,0 +1,78 @@
+/*
+ * Protocol between QEMU and out-of-process Cortex-M peripherals.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REMOTE_PERIPHERAL_PROTOCOL_H_
+#define REMOTE_PERIPHERAL_PROTOCOL_H_
+
+#include "qemu/shm-ring.h"
+
+/*
+ * The transport is the one of the "shm" chardev (see qemu/shm-ring.h):
+ * the peripheral process connects to a unix socket and receives a shared
+ * memory segment with two rings and one notifier per direction. The
+ * rings carry fixed size RemotePeripheralMsg records; since the ring size
+ * is a multiple of the record size, a record is always written, read and
+ * released as a whole.
+ *
+ * Upon connection, QEMU sends HELLO. Register writes are posted, and
+ * register reads wait for a READ_REPLY. The peripheral processes the
+ * requests in order; before answering a read, it must send the SHADOW_SET
+ * updates caused by the requests before it.
+ *
+ * A peripheral may send SET_IRQ, SHADOW_SET and SHADOW_CLEAR at any time.
+ * Reads of a register declared with SHADOW_SET are answered by QEMU from
+ * the last value received, without a round trip, unless a write was
+ * posted since the last READ_REPLY. This is meant for read-only status
+ * registers, whose changes are pushed by the peripheral.
+ *
+ * All fields are in host byte order; offsets are relative to the start
+ * of the peripheral and aligned to the register size.
+ */
+
+#define REMOTE_PERIPHERAL_VERSION   1
+
+typedef enum {
+    /* From QEMU: version in value, MMIO size in offset, register size */
+    REMOTE_PERIPHERAL_MSG_HELLO = 1,
+    /* From QEMU: read size bytes at offset; answered with READ_REPLY */
+    REMOTE_PERIPHERAL_MSG_READ,
+    /* From QEMU: write size bytes of value at offset */
+    REMOTE_PERIPHERAL_MSG_WRITE,
+    /* From QEMU: the peripheral is reset; all shadows are cleared */
+    REMOTE_PERIPHERAL_MSG_RESET,
+
+    /* From the peripheral: value read at offset */
+    REMOTE_PERIPHERAL_MSG_READ_REPLY = 0x80,
+    /* From the peripheral: make its interrupt line offset (0 based) pending */
+    REMOTE_PERIPHERAL_MSG_SET_IRQ,
+    /* From the peripheral: serve reads of offset locally, with value */
+    REMOTE_PERIPHERAL_MSG_SHADOW_SET,
+    /* From the peripheral: forward reads of offset again */
+    REMOTE_PERIPHERAL_MSG_SHADOW_CLEAR,
+} RemotePeripheralMsgType;
+
+typedef struct {
+    uint8_t type;
+    uint8_t size;
+    uint16_t reserved;
+    uint32_t offset;
+    uint64_t value;
+} RemotePeripheralMsg;
+
+/* ------------------------------------------------------------------------- */
+
+#endif /* REMOTE_PERIPHERAL_PROTOCOL_H_ */
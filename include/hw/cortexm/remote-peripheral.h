@@ -0,0 +1,122 @@
+/*
+ * Cortex-M peripheral implemented by another process.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORTEXM_REMOTE_PERIPHERAL_H_
+#define CORTEXM_REMOTE_PERIPHERAL_H_
+
+#include "qemu/osdep.h"
+
+#include "io/channel-socket.h"
+#include "qemu/event_notifier.h"
+#include <hw/cortexm/peripheral.h>
+#include <hw/cortexm/nvic.h>
+#include <hw/cortexm/remote-peripheral-protocol.h>
+
+/**
+ * The register bank of the peripheral lives in an external process,
+ * connected with the protocol described in remote-peripheral-protocol.h.
+ *
+ * Accesses to the MMIO area are forwarded to the process; reads wait for
+ * the answer, spinning for a while before sleeping, writes do not wait.
+ * The process may raise the interrupts given to the peripheral, and may
+ * ask QEMU to serve some registers (typically status registers) from a
+ * local copy, which it keeps up to date.
+ */
+
+/* ------------------------------------------------------------------------- */
+
+#define TYPE_CORTEXM_REMOTE_PERIPHERAL \
+    TYPE_CORTEXM_PREFIX "remote" TYPE_PERIPHERAL_SUFFIX
+
+/* ------------------------------------------------------------------------- */
+
+/* Parent definitions. */
+#define TYPE_CORTEXM_REMOTE_PERIPHERAL_PARENT TYPE_PERIPHERAL
+typedef PeripheralClass CortexMRemotePeripheralParentClass;
+typedef PeripheralState CortexMRemotePeripheralParentState;
+
+/* ------------------------------------------------------------------------- */
+
+/* Class definitions. */
+#define CORTEXM_REMOTE_PERIPHERAL_GET_CLASS(obj) \
+    OBJECT_GET_CLASS(CortexMRemotePeripheralClass, (obj), \
+            TYPE_CORTEXM_REMOTE_PERIPHERAL)
+#define CORTEXM_REMOTE_PERIPHERAL_CLASS(klass) \
+    OBJECT_CLASS_CHECK(CortexMRemotePeripheralClass, (klass), \
+            TYPE_CORTEXM_REMOTE_PERIPHERAL)
+
+typedef struct {
+    /*< private >*/
+    CortexMRemotePeripheralParentClass parent_class;
+    /*< public >*/
+
+    /* None, so far. */
+} CortexMRemotePeripheralClass;
+
+/* ------------------------------------------------------------------------- */
+
+/* Instance definitions. */
+#define CORTEXM_REMOTE_PERIPHERAL_STATE(obj) \
+    OBJECT_CHECK(CortexMRemotePeripheralState, (obj), \
+            TYPE_CORTEXM_REMOTE_PERIPHERAL)
+
+typedef struct {
+    /*< private >*/
+    CortexMRemotePeripheralParentState parent_obj;
+    /*< public >*/
+
+    /* Path of the unix socket the peripheral process connects to. */
+    char *path;
+
+    /* Size of each ring, in bytes. */
+    uint32_t ring_size;
+
+    /* How long a read may wait for the peripheral process. */
+    uint32_t timeout_ms;
+
+    /* Exception number of the first interrupt, and number of interrupts. */
+    int32_t irq;
+    uint32_t num_irq;
+
+    CortexMNVICState *nvic;
+
+    /* Shared memory segment and rings. */
+    void *base;
+    size_t map_size;
+    int shm_fd;
+    ShmRingPort tx; /* To the process. */
+    ShmRingPort rx; /* From the process. */
+    EventNotifier tx_notifier;
+    EventNotifier rx_notifier;
+
+    QIOChannelSocket *listen_ioc;
+    guint listen_tag;
+    QIOChannel *ioc;
+    guint hup_tag;
+
+    /* Shadow registers, indexed by offset / register size. */
+    unsigned long *shadow_valid;
+    uint64_t *shadow_values;
+    uint32_t num_shadows;
+
+    /* A write was posted since the last read reply. */
+    bool write_posted;
+} CortexMRemotePeripheralState;
+
+/* ------------------------------------------------------------------------- */
+
+#endif /* CORTEXM_REMOTE_PERIPHERAL_H_ */
@@ -76,6 +76,8 @@ typedef enum {
 
 #define STM32_GPIO_STATE(obj) \
     OBJECT_CHECK(STM32GPIOState, (obj), TYPE_STM32_GPIO)
+#define STM32_GPIO_STATE_FAST(obj) \
+    CM_OBJECT_CAST(STM32GPIOState, (obj), TYPE_STM32_GPIO)
 
 typedef struct {
     /*< private >*/
@@ -57,6 +57,8 @@ typedef struct {
 /* Instance definitions. */
 #define STM32_RCC_STATE(obj) \
     OBJECT_CHECK(STM32RCCState, (obj), TYPE_STM32_RCC)
+#define STM32_RCC_STATE_FAST(obj) \
+    CM_OBJECT_CAST(STM32RCCState, (obj), TYPE_STM32_RCC)
 
 typedef struct {
     /*< private >*/
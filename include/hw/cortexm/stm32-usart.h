@@ -82,6 +82,8 @@ typedef enum {
 
 #define STM32_USART_STATE(obj) \
     OBJECT_CHECK(STM32USARTState, (obj), TYPE_STM32_USART)
+#define STM32_USART_STATE_FAST(obj) \
+    CM_OBJECT_CAST(STM32USARTState, (obj), TYPE_STM32_USART)
 
 typedef struct {
     /*< private >*/
@@ -80,21 +80,6 @@ static int glue(symfind, SZ)(const void *s0, const void *s1)
     return result;
 }
 
-static const char *glue(lookup_symbol, SZ)(struct syminfo *s,
-                                           hwaddr orig_addr)
-{
-    struct elf_sym *syms = glue(s->disas_symtab.elf, SZ);
-    struct elf_sym *sym;
-
-    sym = bsearch(&orig_addr, syms, s->disas_num_syms, sizeof(*syms),
-                  glue(symfind, SZ));
-    if (sym != NULL) {
-        return s->disas_strtab + sym->st_name;
-    }
-
-    return "";
-}
-
 static int glue(symcmp, SZ)(const void *s0, const void *s1)
 {
     struct elf_sym *sym0 = (struct elf_sym *)s0;
@@ -104,51 +89,33 @@ static int glue(symcmp, SZ)(const void *s0, const void *s1)
         : ((sym0->st_value > sym1->st_value) ? 1 : 0);
 }
 
-static int glue(load_symbols, SZ)(struct elfhdr *ehdr, int fd, int must_swab,
-                                  int clear_lsb)
+static void glue(parse_symbols, SZ)(ElfSymInfo *es)
 {
-    struct elf_shdr *symtab, *strtab, *shdr_table = NULL;
-    struct elf_sym *syms = NULL;
-    struct syminfo *s;
+    struct elf_sym *syms = es->syms;
     int nsyms, i;
-    char *str = NULL;
-
-    shdr_table = load_at(fd, ehdr->e_shoff,
-                         sizeof(struct elf_shdr) * ehdr->e_shnum);
-    if (!shdr_table)
-        return -1;
-
-    if (must_swab) {
-        for (i = 0; i < ehdr->e_shnum; i++) {
-            glue(bswap_shdr, SZ)(shdr_table + i);
-        }
-    }
 
-    symtab = glue(find_section, SZ)(shdr_table, ehdr->e_shnum, SHT_SYMTAB);
-    if (!symtab)
-        goto fail;
-    syms = load_at(fd, symtab->sh_offset, symtab->sh_size);
-    if (!syms)
-        goto fail;
+    es->parsed = true;
+    es->syms = NULL;
 
-    nsyms = symtab->sh_size / sizeof(struct elf_sym);
+    nsyms = es->syms_size / sizeof(struct elf_sym);
 
     i = 0;
     while (i < nsyms) {
-        if (must_swab)
+        if (es->must_swab)
             glue(bswap_sym, SZ)(&syms[i]);
         /* We are only interested in function symbols.
            Throw everything else away.  */
         if (syms[i].st_shndx == SHN_UNDEF ||
                 syms[i].st_shndx >= SHN_LORESERVE ||
-                ELF_ST_TYPE(syms[i].st_info) != STT_FUNC) {
+                ELF_ST_TYPE(syms[i].st_info) != STT_FUNC ||
+                syms[i].st_name >= es->strtab_size) {
             nsyms--;
             if (i < nsyms) {
                 syms[i] = syms[nsyms];
             }
             continue;
         }
-        if (clear_lsb) {
+        if (es->clear_lsb) {
             /* The bottom address bit marks a Thumb or MIPS16 symbol.  */
             syms[i].st_value &= ~(glue(glue(Elf, SZ), _Addr))1;
         }
@@ -163,30 +130,94 @@ static int glue(load_symbols, SZ)(struct elfhdr *ehdr, int fd, int must_swab,
         }
     }
 
-    /* String table */
-    if (symtab->sh_link >= ehdr->e_shnum)
+    glue(es->s.disas_symtab.elf, SZ) = syms;
+    es->s.disas_num_syms = nsyms;
+    es->s.disas_strtab = es->strtab;
+}
+
+static const char *glue(lookup_symbol, SZ)(struct syminfo *s,
+                                           hwaddr orig_addr)
+{
+    ElfSymInfo *es = container_of(s, ElfSymInfo, s);
+    struct elf_sym *syms;
+    struct elf_sym *sym;
+
+    if (!es->parsed) {
+        glue(parse_symbols, SZ)(es);
+    }
+
+    syms = glue(s->disas_symtab.elf, SZ);
+    sym = bsearch(&orig_addr, syms, s->disas_num_syms, sizeof(*syms),
+                  glue(symfind, SZ));
+    if (sym != NULL) {
+        return s->disas_strtab + sym->st_name;
+    }
+
+    return "";
+}
+
+/*
+ * Most runs never look symbols up, so only copy the tables out of the
+ * file; they are filtered and sorted by the first lookup_symbol().
+ */
+static void glue(load_symbols, SZ)(struct elfhdr *ehdr, GMappedFile *file,
+                                   int must_swab, int clear_lsb)
+{
+    struct elf_shdr *symtab, *strtab, *shdr_table;
+    ElfSymInfo *es;
+    char *str = NULL;
+    void *syms = NULL;
+    int i;
+
+    if (!ehdr->e_shnum) {
+        return;
+    }
+
+    shdr_table = elf_image_dup(file, ehdr->e_shoff,
+                               sizeof(struct elf_shdr) * ehdr->e_shnum);
+    if (!shdr_table) {
+        return;
+    }
+
+    if (must_swab) {
+        for (i = 0; i < ehdr->e_shnum; i++) {
+            glue(bswap_shdr, SZ)(shdr_table + i);
+        }
+    }
+
+    symtab = glue(find_section, SZ)(shdr_table, ehdr->e_shnum, SHT_SYMTAB);
+    if (!symtab || symtab->sh_link >= ehdr->e_shnum) {
         goto fail;
+    }
+
+    /* String table; it must end with a NUL */
     strtab = &shdr_table[symtab->sh_link];
+    str = elf_image_dup(file, strtab->sh_offset, strtab->sh_size);
+    if (!str || !strtab->sh_size || str[strtab->sh_size - 1] != '\0') {
+        goto fail;
+    }
 
-    str = load_at(fd, strtab->sh_offset, strtab->sh_size);
-    if (!str)
+    syms = elf_image_dup(file, symtab->sh_offset, symtab->sh_size);
+    if (!syms) {
         goto fail;
+    }
 
-    /* Commit */
-    s = g_malloc0(sizeof(*s));
-    s->lookup_symbol = glue(lookup_symbol, SZ);
-    glue(s->disas_symtab.elf, SZ) = syms;
-    s->disas_num_syms = nsyms;
-    s->disas_strtab = str;
-    s->next = syminfos;
-    syminfos = s;
+    es = g_new0(ElfSymInfo, 1);
+    es->s.lookup_symbol = glue(lookup_symbol, SZ);
+    es->syms = syms;
+    es->syms_size = symtab->sh_size;
+    es->strtab = str;
+    es->strtab_size = strtab->sh_size;
+    es->must_swab = must_swab;
+    es->clear_lsb = clear_lsb;
+    es->s.next = syminfos;
+    syminfos = &es->s;
     g_free(shdr_table);
-    return 0;
+    return;
  fail:
     g_free(syms);
     g_free(str);
     g_free(shdr_table);
-    return -1;
 }
 
 static int glue(elf_reloc, SZ)(struct elfhdr *ehdr, int fd, int must_swab,
@@ -270,6 +301,7 @@ static int glue(load_elf, SZ)(const char *name, int fd,
     int size, i, total_size;
     elf_word mem_size, file_size;
     uint64_t addr, low = (uint64_t)-1, high = 0;
+    GMappedFile *mapped_file = NULL;
     uint8_t *data = NULL;
     char label[128];
     int ret = ELF_LOAD_FAILED;
@@ -323,17 +355,22 @@ static int glue(load_elf, SZ)(const char *name, int fd,
     if (pentry)
    	*pentry = (uint64_t)(elf_sword)ehdr.e_entry;
 
-    glue(load_symbols, SZ)(&ehdr, fd, must_swab, clear_lsb);
-
-    size = ehdr.e_phnum * sizeof(phdr[0]);
-    if (lseek(fd, ehdr.e_phoff, SEEK_SET) != ehdr.e_phoff) {
+    /*
+     * The segments are used in place in a private mapping of the file,
+     * so that they are neither read nor kept in memory twice; pages are
+     * only copied if relocations or swapping modify them.
+     */
+    mapped_file = g_mapped_file_new_from_fd(fd, true, NULL);
+    if (!mapped_file) {
         goto fail;
     }
-    phdr = g_malloc0(size);
+
+    glue(load_symbols, SZ)(&ehdr, mapped_file, must_swab, clear_lsb);
+
+    size = ehdr.e_phnum * sizeof(phdr[0]);
+    phdr = elf_image_dup(mapped_file, ehdr.e_phoff, size);
     if (!phdr)
         goto fail;
-    if (read(fd, phdr, size) != size)
-        goto fail;
     if (must_swab) {
         for(i = 0; i < ehdr.e_phnum; i++) {
             ph = &phdr[i];
@@ -346,13 +383,11 @@ static int glue(load_elf, SZ)(const char *name, int fd,
         ph = &phdr[i];
         if (ph->p_type == PT_LOAD) {
             mem_size = ph->p_memsz; /* Size of the ROM */
-            file_size = ph->p_filesz; /* Size of the allocated data */
-            data = g_malloc0(file_size);
+            file_size = ph->p_filesz; /* Size of the data in the file */
+            data = NULL;
             if (ph->p_filesz > 0) {
-                if (lseek(fd, ph->p_offset, SEEK_SET) < 0) {
-                    goto fail;
-                }
-                if (read(fd, data, file_size) != file_size) {
+                data = elf_image_ptr(mapped_file, ph->p_offset, file_size);
+                if (!data) {
                     goto fail;
                 }
             }
@@ -399,26 +434,28 @@ static int glue(load_elf, SZ)(const char *name, int fd,
 
             snprintf(label, sizeof(label), "phdr #%d: %s", i, name);
 
-            /* rom_add_elf_program() seize the ownership of 'data' */
-            rom_add_elf_program(label, data, file_size, mem_size, addr);
+            /* rom_add_elf_program() keeps a reference to the mapping */
+            rom_add_elf_program(label, mapped_file, data, file_size,
+                                mem_size, addr);
 
             total_size += mem_size;
             if (addr < low)
                 low = addr;
             if ((addr + mem_size) > high)
                 high = addr + mem_size;
-
-            data = NULL;
         }
     }
     g_free(phdr);
+    g_mapped_file_unref(mapped_file);
     if (lowaddr)
         *lowaddr = (uint64_t)(elf_sword)low;
     if (highaddr)
         *highaddr = (uint64_t)(elf_sword)high;
     return total_size;
  fail:
-    g_free(data);
     g_free(phdr);
+    if (mapped_file) {
+        g_mapped_file_unref(mapped_file);
+    }
     return ret;
 }
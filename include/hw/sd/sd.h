@@ -87,6 +87,8 @@ typedef struct {
     int (*do_command)(SDState *sd, SDRequest *req, uint8_t *response);
     void (*write_data)(SDState *sd, uint8_t value);
     uint8_t (*read_data)(SDState *sd);
+    void (*write_data_buf)(SDState *sd, const uint8_t *buf, size_t length);
+    void (*read_data_buf)(SDState *sd, uint8_t *buf, size_t length);
     bool (*data_ready)(SDState *sd);
     void (*enable)(SDState *sd, bool enable);
     bool (*get_inserted)(SDState *sd);
@@ -120,6 +122,8 @@ int sd_do_command(SDState *sd, SDRequest *req,
                   uint8_t *response);
 void sd_write_data(SDState *sd, uint8_t value);
 uint8_t sd_read_data(SDState *sd);
+void sd_write_data_buf(SDState *sd, const uint8_t *buf, size_t length);
+void sd_read_data_buf(SDState *sd, uint8_t *buf, size_t length);
 void sd_set_cb(SDState *sd, qemu_irq readonly, qemu_irq insert);
 bool sd_data_ready(SDState *sd);
 /* sd_enable should not be used -- it is only used on the nseries boards,
@@ -137,6 +141,8 @@ void sd_enable(SDState *sd, bool enable);
 int sdbus_do_command(SDBus *sd, SDRequest *req, uint8_t *response);
 void sdbus_write_data(SDBus *sd, uint8_t value);
 uint8_t sdbus_read_data(SDBus *sd);
+void sdbus_write_data_buf(SDBus *sd, const uint8_t *buf, size_t length);
+void sdbus_read_data_buf(SDBus *sd, uint8_t *buf, size_t length);
 bool sdbus_data_ready(SDBus *sd);
 bool sdbus_get_inserted(SDBus *sd);
 bool sdbus_get_readonly(SDBus *sd);
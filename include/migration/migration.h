@@ -217,6 +217,10 @@ void unix_start_incoming_migration(const char *path, Error **errp);
 
 void unix_start_outgoing_migration(MigrationState *s, const char *path, Error **errp);
 
+QIOChannel *socket_send_channel_create(Error **errp);
+
+void socket_send_channel_reset(void);
+
 void fd_start_incoming_migration(const char *path, Error **errp);
 
 void fd_start_outgoing_migration(MigrationState *s, const char *fdname, Error **errp);
@@ -248,6 +252,11 @@ void migrate_compress_threads_create(void);
 void migrate_compress_threads_join(void);
 void migrate_decompress_threads_create(void);
 void migrate_decompress_threads_join(void);
+void multifd_send_shutdown(void);
+void multifd_recv_setup(void);
+void multifd_recv_cleanup(void);
+bool multifd_recv_all_channels_created(void);
+void multifd_recv_new_channel(QIOChannel *ioc);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_transferred(void);
 uint64_t ram_bytes_total(void);
@@ -308,6 +317,9 @@ bool migrate_use_compression(void);
 int migrate_compress_level(void);
 int migrate_compress_threads(void);
 int migrate_decompress_threads(void);
+bool migrate_use_multifd(void);
+int migrate_multifd_channels(void);
+bool migrate_background_snapshot(void);
 bool migrate_use_events(void);
 
 /* Sending on the return path - generic and then for each message type */
@@ -16,8 +16,9 @@
 
 #include "qemu-common.h"
 #include "qapi/qmp/qlist.h"
+#include "qapi/qmp/json-streamer.h"
 
-QObject *json_parser_parse(GQueue *tokens, va_list *ap);
-QObject *json_parser_parse_err(GQueue *tokens, va_list *ap, Error **errp);
+QObject *json_parser_parse(JSONToken *tokens, size_t nb_tokens,
+                           va_list *ap, Error **errp);
 
 #endif
@@ -20,21 +20,35 @@ typedef struct JSONToken {
     int type;
     int x;
     int y;
-    char str[];
+    size_t offset;              /* Of the text in JSONMessageParser.text */
+    const char *str;            /* Only valid while the message is parsed */
 } JSONToken;
 
+/*
+ * The tokens of the message being assembled live in one array and their
+ * text in one buffer, both reused from message to message, so lexing a
+ * message does not allocate memory once they have grown to size.  When
+ * the message is complete it is parsed on the spot and handed to @emit
+ * as a QObject; @json is NULL and @err set on a parse error, while a
+ * lexical error or an oversized message gives NULL for both.  @emit
+ * takes ownership of @json and @err.
+ */
 typedef struct JSONMessageParser
 {
-    void (*emit)(struct JSONMessageParser *parser, GQueue *tokens);
+    void (*emit)(struct JSONMessageParser *parser, QObject *json, Error *err);
+    va_list *ap;
     JSONLexer lexer;
     int brace_count;
     int bracket_count;
-    GQueue *tokens;
+    GArray *tokens;
+    GString *text;
     uint64_t token_size;
 } JSONMessageParser;
 
 void json_message_parser_init(JSONMessageParser *parser,
-                              void (*func)(JSONMessageParser *, GQueue *));
+                              void (*func)(JSONMessageParser *, QObject *,
+                                           Error *),
+                              va_list *ap);
 
 int json_message_parser_feed(JSONMessageParser *parser,
                              const char *buffer, size_t size);
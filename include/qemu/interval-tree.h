@@ -0,0 +1,82 @@
+/*
+ * Interval trees
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_INTERVAL_TREE_H
+#define QEMU_INTERVAL_TREE_H
+
+/*
+ * An interval tree is a search tree of closed intervals [start, last],
+ * ordered by start and augmented with the highest last of each subtree,
+ * so that the intervals overlapping a given range are found in
+ * O(log n + k).  Intervals may overlap each other.
+ *
+ * The tree is a treap: nodes are balanced by random priorities with
+ * rotations, which keeps the code short and the expected depth
+ * logarithmic.
+ *
+ * Nodes are embedded in the user's structures and are neither allocated
+ * nor freed by the tree.
+ *
+ * Updates must be serialized by the caller.  interval_tree_iter_first()
+ * may run concurrently with updates inside an RCU read-side critical
+ * section, provided removed nodes are freed only after a grace period:
+ * such a lookup never returns a node that does not overlap the range,
+ * but may miss one that is being moved by a rotation, so a negative
+ * answer has to be confirmed with the updates excluded.
+ */
+
+typedef struct IntervalTreeNode IntervalTreeNode;
+
+struct IntervalTreeNode {
+    IntervalTreeNode *parent;
+    IntervalTreeNode *left;
+    IntervalTreeNode *right;
+
+    uint64_t start;         /* First address of the interval */
+    uint64_t last;          /* Last address of the interval, inclusive */
+    uint64_t subtree_last;  /* Highest last in the subtree, private */
+    uint32_t priority;      /* Private */
+};
+
+typedef struct IntervalTreeRoot {
+    IntervalTreeNode *root;
+    uint32_t seed;
+} IntervalTreeRoot;
+
+/**
+ * interval_tree_insert: Add @node to the tree
+ *
+ * @node->start and @node->last must be set; the other fields are
+ * initialized by the tree.
+ */
+void interval_tree_insert(IntervalTreeNode *node, IntervalTreeRoot *root);
+
+/**
+ * interval_tree_remove: Remove @node from the tree
+ *
+ * The node may be reused or, after an RCU grace period, freed.
+ */
+void interval_tree_remove(IntervalTreeNode *node, IntervalTreeRoot *root);
+
+/**
+ * interval_tree_iter_first: Find the lowest interval overlapping a range
+ *
+ * Return the node with the lowest start among those that overlap
+ * [@start, @last], or NULL.
+ */
+IntervalTreeNode *interval_tree_iter_first(IntervalTreeRoot *root,
+                                           uint64_t start, uint64_t last);
+
+/**
+ * interval_tree_iter_next: Find the next interval overlapping a range
+ *
+ * Return the node after @node, in start order, that overlaps
+ * [@start, @last], or NULL.  Not usable concurrently with updates.
+ */
+IntervalTreeNode *interval_tree_iter_next(IntervalTreeNode *node,
+                                          uint64_t start, uint64_t last);
+
+#endif
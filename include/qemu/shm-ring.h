@@ -0,0 +1,133 @@
+/*
+ * Lock-free single-producer/single-consumer byte rings in shared memory
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_SHM_RING_H
+#define QEMU_SHM_RING_H
+
+#include "qemu/atomic.h"
+
+/*
+ * Layout of the shared memory segment used by the "shm" chardev backend.
+ *
+ * The segment starts with a ShmRingHeader, followed at data_offset by the
+ * data of the two rings, ring_size bytes each.  The head and tail indexes
+ * run freely and are reduced modulo ring_size, which is a power of two;
+ * the ring is empty when they are equal.
+ *
+ * The producer notifies the consumer only when it adds data to a ring
+ * that was empty.  A consumer that finds the ring empty after publishing
+ * its tail may therefore sleep until the next notification.
+ */
+
+#define SHM_RING_MAGIC      0x4d485351  /* "QSHM" */
+#define SHM_RING_VERSION    1
+
+enum {
+    SHM_RING_TO_CLIENT,
+    SHM_RING_FROM_CLIENT,
+    SHM_RING_COUNT,
+};
+
+/* The two indexes live on separate cache lines to avoid false sharing */
+typedef struct ShmRing {
+    uint32_t head QEMU_ALIGNED(64);     /* written by the producer */
+    uint32_t tail QEMU_ALIGNED(64);     /* written by the consumer */
+} ShmRing;
+
+typedef struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t data_offset;
+    ShmRing rings[SHM_RING_COUNT];
+} ShmRingHeader;
+
+/*
+ * Local view of one ring.  The geometry is kept out of shared memory so
+ * that a misbehaving peer cannot make us access memory outside the data.
+ */
+typedef struct ShmRingPort {
+    ShmRing *ring;
+    uint8_t *data;
+    uint32_t size;
+} ShmRingPort;
+
+static inline void shm_ring_port_init(ShmRingPort *p, void *base,
+                                      uint32_t ring_size,
+                                      uint32_t data_offset, int n)
+{
+    ShmRingHeader *hdr = base;
+
+    p->ring = &hdr->rings[n];
+    p->data = (uint8_t *)base + data_offset + (size_t)n * ring_size;
+    p->size = ring_size;
+}
+
+static inline uint32_t shm_ring_used(ShmRingPort *p, uint32_t head,
+                                     uint32_t tail)
+{
+    return MIN(head - tail, p->size);
+}
+
+/*
+ * Producer side: copy up to @len bytes into the ring.  Returns the number
+ * of bytes copied, and sets *@notify if the consumer must be woken up.
+ */
+static inline size_t shm_ring_write(ShmRingPort *p, const void *buf,
+                                    size_t len, bool *notify)
+{
+    uint32_t head = atomic_read(&p->ring->head);
+    uint32_t tail = atomic_read(&p->ring->tail);
+    uint32_t off = head & (p->size - 1);
+    size_t n;
+
+    /* Do not overwrite data before the consumer is done with it */
+    smp_mb();
+
+    len = MIN(len, p->size - shm_ring_used(p, head, tail));
+    n = MIN(len, p->size - off);
+    memcpy(p->data + off, buf, n);
+    memcpy(p->data, (const uint8_t *)buf + n, len - n);
+
+    smp_wmb();
+    atomic_set(&p->ring->head, head + len);
+
+    /* Pairs with the barrier in shm_ring_consume() */
+    smp_mb();
+    *notify = len && atomic_read(&p->ring->tail) == head;
+    return len;
+}
+
+/*
+ * Consumer side: return the number of bytes that can be read contiguously
+ * at *@data, 0 if the ring is empty.
+ */
+static inline size_t shm_ring_peek(ShmRingPort *p, const uint8_t **data)
+{
+    uint32_t tail = atomic_read(&p->ring->tail);
+    uint32_t head = atomic_read(&p->ring->head);
+    uint32_t off = tail & (p->size - 1);
+
+    /* Read the data after the index that published it */
+    smp_rmb();
+
+    *data = p->data + off;
+    return MIN(shm_ring_used(p, head, tail), p->size - off);
+}
+
+/* Consumer side: release @len bytes returned by shm_ring_peek() */
+static inline void shm_ring_consume(ShmRingPort *p, size_t len)
+{
+    /* Finish reading the data before the producer may overwrite it */
+    smp_mb();
+    atomic_set(&p->ring->tail, atomic_read(&p->ring->tail) + len);
+
+    /* Pairs with the barrier in shm_ring_write() */
+    smp_mb();
+}
+
+#endif
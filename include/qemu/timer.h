@@ -72,6 +72,7 @@ struct QEMUTimer {
     void *opaque;
     QEMUTimer *next;
     int scale;
+    int64_t slack;              /* in nanoseconds */
 };
 
 extern QEMUTimerListGroup main_loop_tlg;
@@ -324,6 +325,21 @@ bool timerlist_expired(QEMUTimerList *timer_list);
  */
 int64_t timerlist_deadline_ns(QEMUTimerList *timer_list);
 
+/**
+ * timerlist_deadline_slack_ns:
+ * @timer_list: the timer list to operate on
+ * @slack: set to the slack of the deadline
+ *
+ * Like timerlist_deadline_ns(), but also compute how long after the
+ * deadline the caller may wake up without firing any timer later than
+ * its slack allows (see timer_set_slack()).
+ *
+ * Returns: the number of nanoseconds until the earliest
+ * timer expires -1 if none
+ */
+int64_t timerlist_deadline_slack_ns(QEMUTimerList *timer_list,
+                                    int64_t *slack);
+
 /**
  * timerlist_get_clock:
  * @timer_list: the timer list to operate on
@@ -407,6 +423,21 @@ bool timerlistgroup_run_timers(QEMUTimerListGroup *tlg);
  */
 int64_t timerlistgroup_deadline_ns(QEMUTimerListGroup *tlg);
 
+/**
+ * timerlistgroup_deadline_slack_ns:
+ * @tlg: the timer list group
+ * @slack: set to the slack of the deadline
+ *
+ * Like timerlistgroup_deadline_ns(), but also compute how long after
+ * the deadline the caller may wake up, as in
+ * timerlist_deadline_slack_ns().
+ *
+ * Returns: the deadline in nanoseconds or -1 if no
+ * timers are to expire.
+ */
+int64_t timerlistgroup_deadline_slack_ns(QEMUTimerListGroup *tlg,
+                                         int64_t *slack);
+
 /*
  * QEMUTimer
  */
@@ -607,6 +638,18 @@ static inline QEMUTimer *timer_new_ms(QEMUClockType type, QEMUTimerCB *cb,
  */
 void timer_deinit(QEMUTimer *ts);
 
+/**
+ * timer_set_slack:
+ * @ts: the timer
+ * @slack: how late the timer may fire, in the timer's scale
+ *
+ * Allow @ts to fire up to @slack after its expiry time, so that the
+ * main loop can wake up once for several timers, and the host kernel
+ * can batch the wakeup with those of other processes.  Meant for timers
+ * whose lateness the guest cannot observe, like display refresh.
+ */
+void timer_set_slack(QEMUTimer *ts, int64_t slack);
+
 /**
  * timer_free:
  * @ts: the timer
@@ -279,6 +279,8 @@ struct qemu_work_item {
  * @opaque: User data.
  * @mem_io_pc: Host Program Counter at which the memory was accessed.
  * @mem_io_vaddr: Target virtual address at which the memory was accessed.
+ * @dirty_ring: Pages this CPU made dirty for migration since the last sync.
+ * @dirty_ring_count: Number of entries used in @dirty_ring.
  * @kvm_fd: vCPU file descriptor for KVM.
  * @work_mutex: Lock to prevent multiple access to queued_work_*.
  * @queued_work_first: First asynchronous work pending.
@@ -345,6 +347,13 @@ struct CPUState {
     uintptr_t mem_io_pc;
     vaddr mem_io_vaddr;
 
+    /* Filled from the TCG notdirty slow path, so that a migration dirty
+     * bitmap sync only has to look at the pages that were written.
+     * Protected by the iothread lock.
+     */
+    unsigned long *dirty_ring;
+    unsigned int dirty_ring_count;
+
     int kvm_fd;
     bool kvm_vcpu_dirty;
     struct KVMState *kvm_state;
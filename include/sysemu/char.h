@@ -58,6 +58,10 @@ struct ParallelIOArg {
 
 typedef void IOEventHandler(void *opaque, int event);
 
+/* Called with @full true when the transmit buffer fills up, and with
+ * @full false when it has been emptied again.  */
+typedef void IOTxbufHandler(void *opaque, bool full);
+
 struct CharDriverState {
     QemuMutex chr_write_lock;
     void (*init)(struct CharDriverState *s);
@@ -94,6 +98,16 @@ struct CharDriverState {
     guint fd_in_tag;
     QemuOpts *opts;
     bool replay;
+    /* transmit buffer, protected by chr_write_lock */
+    uint8_t *txbuf;
+    size_t txbuf_size;
+    size_t txbuf_head;
+    size_t txbuf_len;
+    ChardevTxbufPolicy txbuf_policy;
+    guint txbuf_tag;
+    bool txbuf_full;
+    IOTxbufHandler *txbuf_handler;
+    void *txbuf_opaque;
     QTAILQ_ENTRY(CharDriverState) next;
 };
 
@@ -280,6 +294,30 @@ int qemu_chr_fe_write(CharDriverState *s, const uint8_t *buf, int len);
  */
 int qemu_chr_fe_write_all(CharDriverState *s, const uint8_t *buf, int len);
 
+/**
+ * @qemu_chr_fe_set_txbuf_handler:
+ *
+ * Ask to be notified when the transmit buffer of the backend (see the
+ * txbuf option) becomes full and when it has been emptied, so that the
+ * front end can apply flow control instead of having data dropped or
+ * the writer stalled.  @fd_txbuf is called from the thread that writes
+ * when the buffer fills up, and from the main loop when it is emptied.
+ *
+ * @fd_txbuf the handler, or NULL to remove it
+ * @opaque the opaque pointer to pass to @fd_txbuf
+ *
+ * Returns: false if the backend has no transmit buffer
+ */
+bool qemu_chr_fe_set_txbuf_handler(CharDriverState *s,
+                                   IOTxbufHandler *fd_txbuf, void *opaque);
+
+/**
+ * @qemu_chr_fe_txbuf_full:
+ *
+ * Returns: true if the transmit buffer of the backend is full
+ */
+bool qemu_chr_fe_txbuf_full(CharDriverState *s);
+
 /**
  * @qemu_chr_fe_read_all:
  *
@@ -120,7 +120,8 @@ static int pending_cpus;
 /* Make sure everything is in a consistent state for calling fork().  */
 void fork_start(void)
 {
-    qemu_mutex_lock(&tcg_ctx.tb_ctx.tb_lock);
+    qemu_mutex_lock(&tb_ctx.tb_lock);
+    tb_translate_fork_start();
     pthread_mutex_lock(&exclusive_lock);
     mmap_fork_start();
 }
@@ -142,11 +143,13 @@ void fork_end(int child)
         pthread_mutex_init(&cpu_list_mutex, NULL);
         pthread_cond_init(&exclusive_cond, NULL);
         pthread_cond_init(&exclusive_resume, NULL);
-        qemu_mutex_init(&tcg_ctx.tb_ctx.tb_lock);
+        tb_translate_fork_end(child);
+        qemu_mutex_init(&tb_ctx.tb_lock);
         gdbserver_fork(thread_cpu);
     } else {
         pthread_mutex_unlock(&exclusive_lock);
-        qemu_mutex_unlock(&tcg_ctx.tb_ctx.tb_lock);
+        tb_translate_fork_end(child);
+        qemu_mutex_unlock(&tb_ctx.tb_lock);
     }
 }
 
@@ -4451,7 +4454,12 @@ int main(int argc, char **argv, char **envp)
     /* Now that we've loaded the binary, GUEST_BASE is fixed.  Delay
        generating the prologue until now so that the prologue can take
        the real value of GUEST_BASE into account.  */
-    tcg_prologue_init(&tcg_ctx);
+    tcg_prologue_init(tcg_ctx);
+#ifdef TARGET_PARALLEL_TRANSLATE
+    /* Translate without tb_lock; tcg_init_ctx is left to the threads
+       that run out of code buffer regions.  */
+    tcg_register_thread(tcg_ctx);
+#endif
 
 #if defined(TARGET_I386)
     env->cr[0] = CR0_PG_MASK | CR0_WP_MASK | CR0_PE_MASK;
@@ -43,6 +43,11 @@ void mmap_unlock(void)
     }
 }
 
+bool have_mmap_lock(void)
+{
+    return mmap_lock_count > 0;
+}
+
 /* Grab lock to make sure things are in a consistent state after fork().  */
 void mmap_fork_start(void)
 {
@@ -143,9 +148,10 @@ static int mmap_frag(abi_ulong real_start,
 
     /* get the protection of the target pages outside the mapping */
     prot1 = 0;
-    for(addr = real_start; addr < real_end; addr++) {
-        if (addr < start || addr >= end)
+    for (addr = real_start; addr < real_end; addr += TARGET_PAGE_SIZE) {
+        if (addr < start || addr >= end) {
             prot1 |= page_get_flags(addr);
+        }
     }
 
     if (prot1 == 0) {
@@ -201,47 +207,33 @@ abi_ulong mmap_next_start = TASK_UNMAPPED_BASE;
 unsigned long last_brk;
 
 /* Subroutine of mmap_find_vma, used when we have pre-allocated a chunk
-   of guest address space.  */
+   of guest address space.  The search skips over whole mappings, in
+   the tree of page flags, instead of probing every page.  */
 static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size)
 {
-    abi_ulong addr;
-    abi_ulong end_addr;
-    int prot;
-    int looped = 0;
+    abi_ulong addr = (abi_ulong)-1;
+    abi_ulong low;
 
     if (size > reserved_va) {
         return (abi_ulong)-1;
     }
 
-    size = HOST_PAGE_ALIGN(size);
-    end_addr = start + size;
-    if (end_addr > reserved_va) {
-        end_addr = reserved_va;
-    }
-    addr = end_addr - qemu_host_page_size;
+    /* Never hand out the pages below mmap_min_addr, nor page 0.  */
+    low = (mmap_min_addr > qemu_host_page_size
+           ? HOST_PAGE_ALIGN(mmap_min_addr) : qemu_host_page_size);
 
-    while (1) {
-        if (addr > end_addr) {
-            if (looped) {
-                return (abi_ulong)-1;
-            }
-            end_addr = reserved_va;
-            addr = end_addr - qemu_host_page_size;
-            looped = 1;
-            continue;
-        }
-        prot = page_get_flags(addr);
-        if (prot) {
-            end_addr = addr;
-        }
-        if (addr + size == end_addr) {
-            break;
-        }
-        addr -= qemu_host_page_size;
+    if (start < reserved_va) {
+        addr = page_find_range_empty(MAX(start, low), reserved_va - 1, size,
+                                     qemu_host_page_size);
+    }
+    if (addr == (abi_ulong)-1 && start > low) {
+        /* Restart at the beginning of the address space.  */
+        addr = page_find_range_empty(low, MIN(start, reserved_va) - 1, size,
+                                     qemu_host_page_size);
     }
 
-    if (start == mmap_next_start) {
-        mmap_next_start = addr;
+    if (addr != (abi_ulong)-1 && start == mmap_next_start) {
+        mmap_next_start = addr + size;
     }
 
     return addr;
@@ -572,34 +564,24 @@ static void mmap_reserve(abi_ulong start, abi_ulong size)
 {
     abi_ulong real_start;
     abi_ulong real_end;
-    abi_ulong addr;
     abi_ulong end;
-    int prot;
+    bool empty;
 
     real_start = start & qemu_host_page_mask;
     real_end = HOST_PAGE_ALIGN(start + size);
     end = start + size;
     if (start > real_start) {
         /* handle host page containing start */
-        prot = 0;
-        for (addr = real_start; addr < start; addr += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(addr);
-        }
+        empty = page_check_range_empty(real_start, start - 1);
         if (real_end == real_start + qemu_host_page_size) {
-            for (addr = end; addr < real_end; addr += TARGET_PAGE_SIZE) {
-                prot |= page_get_flags(addr);
-            }
+            empty &= page_check_range_empty(end, real_end - 1);
             end = real_end;
         }
-        if (prot != 0)
+        if (!empty)
             real_start += qemu_host_page_size;
     }
     if (end < real_end) {
-        prot = 0;
-        for (addr = end; addr < real_end; addr += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(addr);
-        }
-        if (prot != 0)
+        if (!page_check_range_empty(end, real_end - 1))
             real_end -= qemu_host_page_size;
     }
     if (real_start != real_end) {
@@ -611,8 +593,9 @@ static void mmap_reserve(abi_ulong start, abi_ulong size)
 
 int target_munmap(abi_ulong start, abi_ulong len)
 {
-    abi_ulong end, real_start, real_end, addr;
-    int prot, ret;
+    abi_ulong end, real_start, real_end;
+    bool empty;
+    int ret;
 
 #ifdef DEBUG_MMAP
     printf("munmap: start=0x" TARGET_ABI_FMT_lx " len=0x"
@@ -631,25 +614,16 @@ int target_munmap(abi_ulong start, abi_ulong len)
 
     if (start > real_start) {
         /* handle host page containing start */
-        prot = 0;
-        for(addr = real_start; addr < start; addr += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(addr);
-        }
+        empty = page_check_range_empty(real_start, start - 1);
         if (real_end == real_start + qemu_host_page_size) {
-            for(addr = end; addr < real_end; addr += TARGET_PAGE_SIZE) {
-                prot |= page_get_flags(addr);
-            }
+            empty &= page_check_range_empty(end, real_end - 1);
             end = real_end;
         }
-        if (prot != 0)
+        if (!empty)
             real_start += qemu_host_page_size;
     }
     if (end < real_end) {
-        prot = 0;
-        for(addr = end; addr < real_end; addr += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(addr);
-        }
-        if (prot != 0)
+        if (!page_check_range_empty(end, real_end - 1))
             real_end -= qemu_host_page_size;
     }
 
@@ -709,16 +683,12 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
             }
         }
     } else {
-        int prot = 0;
+        bool empty = true;
         if (reserved_va && old_size < new_size) {
-            abi_ulong addr;
-            for (addr = old_addr + old_size;
-                 addr < old_addr + new_size;
-                 addr++) {
-                prot |= page_get_flags(addr);
-            }
+            empty = page_check_range_empty(old_addr + old_size,
+                                           old_addr + new_size - 1);
         }
-        if (prot == 0) {
+        if (empty) {
             host_addr = mremap(g2h(old_addr), old_size, new_size, flags);
             if (host_addr != MAP_FAILED && reserved_va && old_size > new_size) {
                 mmap_reserve(old_addr + old_size, new_size - old_size);
@@ -111,6 +111,7 @@ int __clone2(int (*fn)(void *), void *child_stack_base,
 #include "uname.h"
 
 #include "qemu.h"
+#include "tcg.h"
 
 #define CLONE_NPTL_FLAGS2 (CLONE_SETTLS | \
     CLONE_PARENT_SETTID | CLONE_CHILD_SETTID | CLONE_CHILD_CLEARTID)
@@ -5920,6 +5921,7 @@ typedef struct {
     abi_ulong child_tidptr;
     abi_ulong parent_tidptr;
     sigset_t sigmask;
+    TCGContext *tcg_ctx;
 } new_thread_info;
 
 static void *clone_func(void *arg)
@@ -5930,6 +5932,10 @@ static void *clone_func(void *arg)
     TaskState *ts;
 
     rcu_register_thread();
+#ifdef TARGET_PARALLEL_TRANSLATE
+    /* The parent is waiting for us, its context is not in use.  */
+    tcg_register_thread(info->tcg_ctx);
+#endif
     env = info->env;
     cpu = ENV_GET_CPU(env);
     thread_cpu = cpu;
@@ -6007,6 +6013,7 @@ static int do_fork(CPUArchState *env, unsigned int flags, abi_ulong newsp,
         pthread_mutex_lock(&info.mutex);
         pthread_cond_init(&info.cond, NULL);
         info.env = new_env;
+        info.tcg_ctx = tcg_ctx;
         if (nptl_flags & CLONE_CHILD_SETTID)
             info.child_tidptr = child_tidptr;
         if (nptl_flags & CLONE_PARENT_SETTID)
@@ -7365,6 +7372,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             thread_cpu = NULL;
             object_unref(OBJECT(cpu));
             g_free(ts);
+            tcg_unregister_thread();
             rcu_unregister_thread();
             pthread_exit(NULL);
         }
@@ -36,6 +36,10 @@
 
 #include "qemu/compatfd.h"
 
+#ifdef CONFIG_PRCTL_PR_SET_TIMERSLACK
+#include <sys/prctl.h>
+#endif
+
 /* If we have signalfd, we mask out the signals we want to handle and then
  * use signalfd to listen for them.  We rely on whatever the current signal
  * handler is to dispatch the signals when we receive them.
@@ -216,12 +220,35 @@ static void glib_pollfds_poll(void)
 
 #define MAX_MAIN_LOOP_SPIN (1000)
 
-static int os_host_main_loop_wait(int64_t timeout)
+/*
+ * init_clocks() asks the kernel for exact wakeups.  When the deadline
+ * comes from timers with some slack, pass it on so that the kernel can
+ * batch our wakeup with other ones on the host.
+ */
+static void main_loop_set_timer_slack(int64_t slack)
+{
+#ifdef CONFIG_PRCTL_PR_SET_TIMERSLACK
+    static int64_t cur_slack = 1;
+
+    slack = MAX(slack, 1);
+    if (slack != cur_slack) {
+        prctl(PR_SET_TIMERSLACK, (unsigned long)slack, 0, 0, 0);
+        cur_slack = slack;
+    }
+#endif
+}
+
+static int os_host_main_loop_wait(int64_t timeout, int64_t slack)
 {
     int ret;
     static int spin_counter;
+    int64_t timer_timeout = timeout;
 
     glib_pollfds_fill(&timeout);
+    if (timeout != timer_timeout) {
+        /* A file descriptor source wants to run earlier, on time */
+        slack = 0;
+    }
 
     /* If the I/O thread is very busy or we are incorrectly busy waiting in
      * the I/O thread, this can lead to starvation of the BQL such that the
@@ -244,6 +271,9 @@ static int os_host_main_loop_wait(int64_t timeout)
 
     if (timeout) {
         spin_counter = 0;
+        if (timeout > 0) {
+            main_loop_set_timer_slack(slack);
+        }
         qemu_mutex_unlock_iothread();
     } else {
         spin_counter++;
@@ -398,7 +428,7 @@ static void pollfds_poll(GArray *pollfds, int nfds, fd_set *rfds,
     }
 }
 
-static int os_host_main_loop_wait(int64_t timeout)
+static int os_host_main_loop_wait(int64_t timeout, int64_t slack)
 {
     GMainContext *context = g_main_context_default();
     GPollFD poll_fds[1024 * 2]; /* this is probably overkill */
@@ -480,7 +510,7 @@ int main_loop_wait(int nonblocking)
 {
     int ret;
     uint32_t timeout = UINT32_MAX;
-    int64_t timeout_ns;
+    int64_t timeout_ns, timer_ns, slack_ns;
 
     if (nonblocking) {
         timeout = 0;
@@ -499,11 +529,13 @@ int main_loop_wait(int nonblocking)
         timeout_ns = (uint64_t)timeout * (int64_t)(SCALE_MS);
     }
 
-    timeout_ns = qemu_soonest_timeout(timeout_ns,
-                                      timerlistgroup_deadline_ns(
-                                          &main_loop_tlg));
+    timer_ns = timerlistgroup_deadline_slack_ns(&main_loop_tlg, &slack_ns);
+    timeout_ns = qemu_soonest_timeout(timeout_ns, timer_ns);
+    if (timeout_ns != timer_ns) {
+        slack_ns = 0;
+    }
 
-    ret = os_host_main_loop_wait(timeout_ns);
+    ret = os_host_main_loop_wait(timeout_ns, slack_ns);
 #ifdef CONFIG_SLIRP
     slirp_pollfds_poll(gpollfds, (ret < 0));
 #endif
@@ -54,6 +54,8 @@
 /* Define default autoconverge cpu throttle migration parameters */
 #define DEFAULT_MIGRATE_CPU_THROTTLE_INITIAL 20
 #define DEFAULT_MIGRATE_CPU_THROTTLE_INCREMENT 10
+/* Default number of additional multifd connections */
+#define DEFAULT_MIGRATE_MULTIFD_CHANNELS 2
 
 /* Migration XBZRLE default cache size */
 #define DEFAULT_MIGRATE_CACHE_SIZE (64 * 1024 * 1024)
@@ -89,6 +91,7 @@ MigrationState *migrate_get_current(void)
             .decompress_threads = DEFAULT_MIGRATE_DECOMPRESS_THREAD_COUNT,
             .cpu_throttle_initial = DEFAULT_MIGRATE_CPU_THROTTLE_INITIAL,
             .cpu_throttle_increment = DEFAULT_MIGRATE_CPU_THROTTLE_INCREMENT,
+            .x_multifd_channels = DEFAULT_MIGRATE_MULTIFD_CHANNELS,
         },
     };
 
@@ -403,12 +406,17 @@ static void process_incoming_migration_co(void *opaque)
 
     qemu_fclose(f);
     free_xbzrle_decoded_buf();
+    if (ret >= 0) {
+        /* All pages have been received by now */
+        multifd_recv_cleanup();
+    }
 
     if (ret < 0) {
         migrate_set_state(&mis->state, MIGRATION_STATUS_ACTIVE,
                           MIGRATION_STATUS_FAILED);
         error_report("load of migration failed: %s", strerror(-ret));
         migrate_decompress_threads_join();
+        multifd_recv_cleanup();
         exit(EXIT_FAILURE);
     }
 
@@ -421,6 +429,7 @@ void migration_fd_process_incoming(QEMUFile *f)
     Coroutine *co = qemu_coroutine_create(process_incoming_migration_co, f);
 
     migrate_decompress_threads_create();
+    multifd_recv_setup();
     qemu_file_set_blocking(f, false);
     qemu_coroutine_enter(co);
 }
@@ -566,6 +575,7 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->cpu_throttle_increment = s->parameters.cpu_throttle_increment;
     params->tls_creds = g_strdup(s->parameters.tls_creds);
     params->tls_hostname = g_strdup(s->parameters.tls_hostname);
+    params->x_multifd_channels = s->parameters.x_multifd_channels;
 
     return params;
 }
@@ -757,6 +767,35 @@ void qmp_migrate_set_capabilities(MigrationCapabilityStatusList *params,
                 false;
         }
     }
+
+    if (migrate_use_multifd()) {
+        /* Only plain pages are sent over the additional channels, and
+         * the destination writes them from its receive threads.
+         */
+        if (migrate_postcopy_ram() || migrate_use_compression() ||
+            migrate_use_xbzrle()) {
+            error_report("Multifd is not currently compatible with "
+                         "postcopy, compression or xbzrle");
+            s->enabled_capabilities[MIGRATION_CAPABILITY_X_MULTIFD] = false;
+        }
+    }
+
+    if (migrate_background_snapshot()) {
+        /* Only TCG writes to guest RAM can be intercepted, and pages must
+         * be saved exactly once, as they were at the snapshot point.
+         */
+        if (!tcg_enabled()) {
+            error_report("Background snapshots require TCG");
+            s->enabled_capabilities[MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT] =
+                false;
+        } else if (migrate_postcopy_ram() || migrate_use_compression() ||
+                   migrate_use_xbzrle() || migrate_use_multifd()) {
+            error_report("Background snapshots are not compatible with "
+                         "postcopy, compression, xbzrle or multifd");
+            s->enabled_capabilities[MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT] =
+                false;
+        }
+    }
 }
 
 void qmp_migrate_set_parameters(bool has_compress_level,
@@ -773,6 +812,8 @@ void qmp_migrate_set_parameters(bool has_compress_level,
                                 const char *tls_creds,
                                 bool has_tls_hostname,
                                 const char *tls_hostname,
+                                bool has_x_multifd_channels,
+                                int64_t x_multifd_channels,
                                 Error **errp)
 {
     MigrationState *s = migrate_get_current();
@@ -808,6 +849,13 @@ void qmp_migrate_set_parameters(bool has_compress_level,
                    "cpu_throttle_increment",
                    "an integer in the range of 1 to 99");
     }
+    if (has_x_multifd_channels &&
+            (x_multifd_channels < 1 || x_multifd_channels > 255)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "x_multifd_channels",
+                   "is invalid, it should be in the range of 1 to 255");
+        return;
+    }
 
     if (has_compress_level) {
         s->parameters.compress_level = compress_level;
@@ -832,6 +880,9 @@ void qmp_migrate_set_parameters(bool has_compress_level,
         g_free(s->parameters.tls_hostname);
         s->parameters.tls_hostname = g_strdup(tls_hostname);
     }
+    if (has_x_multifd_channels) {
+        s->parameters.x_multifd_channels = x_multifd_channels;
+    }
 }
 
 
@@ -941,6 +992,7 @@ static void migrate_fd_cancel(MigrationState *s)
      */
     if (s->state == MIGRATION_STATUS_CANCELLING && f) {
         qemu_file_shutdown(f);
+        multifd_send_shutdown();
     }
 }
 
@@ -1096,6 +1148,7 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
     }
 
     s = migrate_init(&params);
+    socket_send_channel_reset();
 
     if (strstart(uri, "tcp:", &p)) {
         tcp_start_outgoing_migration(s, p, &local_err);
@@ -1252,6 +1305,33 @@ int migrate_decompress_threads(void)
     return s->parameters.decompress_threads;
 }
 
+bool migrate_use_multifd(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_X_MULTIFD];
+}
+
+int migrate_multifd_channels(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.x_multifd_channels;
+}
+
+bool migrate_background_snapshot(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT];
+}
+
 bool migrate_use_events(void)
 {
     MigrationState *s;
@@ -1850,6 +1930,132 @@ static void *migration_thread(void *opaque)
     return NULL;
 }
 
+/*
+ * Background snapshot thread: the VM is only stopped while the device
+ * state is saved, to a buffer that goes at the end of the stream.  RAM is
+ * then saved as it was at that point while the VM runs, see the
+ * copy-on-write in migration/ram.c.
+ */
+static void *background_snapshot_thread(void *opaque)
+{
+    MigrationState *s = opaque;
+    QEMUFile *f = s->to_dst_file;
+    int64_t setup_start = qemu_clock_get_ms(QEMU_CLOCK_HOST);
+    int64_t initial_time, current_time, start_time, end_time;
+    bool old_vm_running;
+    RunState old_runstate;
+    QIOChannelBuffer *bioc;
+    QEMUFile *fb;
+    int ret;
+
+    rcu_register_thread();
+
+    bioc = qio_channel_buffer_new(4096);
+    fb = qemu_fopen_channel_output(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    qemu_savevm_state_header(f);
+
+    qemu_mutex_lock_iothread();
+    start_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    old_vm_running = runstate_is_running();
+    old_runstate = runstate_get();
+    ret = global_state_store();
+    if (!ret) {
+        ret = vm_stop_force_state(RUN_STATE_FINISH_MIGRATE);
+    }
+    qemu_mutex_unlock_iothread();
+
+    if (ret < 0) {
+        migrate_set_state(&s->state, MIGRATION_STATUS_SETUP,
+                          MIGRATION_STATUS_FAILED);
+        goto out;
+    }
+
+    /* Takes the snapshot point for RAM */
+    qemu_savevm_state_begin(f, &s->params);
+
+    qemu_mutex_lock_iothread();
+    cpu_synchronize_all_states();
+    qemu_savevm_state_complete_precopy_non_iterable(fb, false);
+    qemu_fflush(fb);
+    s->downtime = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) - start_time;
+    if (old_vm_running) {
+        vm_start();
+    } else {
+        runstate_set(old_runstate);
+    }
+    qemu_mutex_unlock_iothread();
+
+    s->setup_time = qemu_clock_get_ms(QEMU_CLOCK_HOST) - setup_start;
+    migrate_set_state(&s->state, MIGRATION_STATUS_SETUP,
+                      MIGRATION_STATUS_ACTIVE);
+
+    initial_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    while (s->state == MIGRATION_STATUS_ACTIVE &&
+           !qemu_file_get_error(f) && !qemu_file_get_error(fb)) {
+        uint64_t pend_post, pend_nonpost;
+
+        current_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+        if (current_time >= initial_time + BUFFER_DELAY) {
+            qemu_file_reset_rate_limit(f);
+            initial_time = current_time;
+        }
+        if (qemu_file_rate_limit(f)) {
+            /* usleep expects microseconds */
+            g_usleep((initial_time + BUFFER_DELAY - current_time) * 1000);
+            continue;
+        }
+
+        qemu_savevm_state_pending(f, 0, &pend_nonpost, &pend_post);
+        if (!pend_nonpost && !pend_post) {
+            qemu_mutex_lock_iothread();
+            qemu_savevm_state_complete_precopy(f, true);
+            qemu_mutex_unlock_iothread();
+            qemu_put_buffer(f, bioc->data, bioc->usage);
+            qemu_fflush(f);
+            if (!qemu_file_get_error(f)) {
+                migrate_set_state(&s->state, MIGRATION_STATUS_ACTIVE,
+                                  MIGRATION_STATUS_COMPLETED);
+            }
+            break;
+        }
+        qemu_savevm_state_iterate(f, false);
+    }
+
+    if (s->state == MIGRATION_STATUS_ACTIVE) {
+        migrate_set_state(&s->state, MIGRATION_STATUS_ACTIVE,
+                          MIGRATION_STATUS_FAILED);
+    }
+
+out:
+    qemu_fclose(fb);
+    end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+
+    qemu_mutex_lock_iothread();
+    qemu_savevm_state_cleanup();
+    if (s->state == MIGRATION_STATUS_COMPLETED) {
+        uint64_t transferred_bytes = qemu_ftell(f);
+        s->total_time = end_time - s->total_time;
+        if (s->total_time) {
+            s->mbps = (((double) transferred_bytes * 8.0) /
+                       ((double) s->total_time)) / 1000;
+        }
+    } else if (runstate_check(RUN_STATE_FINISH_MIGRATE)) {
+        /* Failed before the VM was given back */
+        if (old_vm_running) {
+            vm_start();
+        } else {
+            runstate_set(old_runstate);
+        }
+    }
+    qemu_bh_schedule(s->cleanup_bh);
+    qemu_mutex_unlock_iothread();
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
 void migrate_fd_connect(MigrationState *s)
 {
     /* This is a best 1st approximation. ns to ms */
@@ -1878,8 +2084,14 @@ void migrate_fd_connect(MigrationState *s)
     }
 
     migrate_compress_threads_create();
-    qemu_thread_create(&s->thread, "migration", migration_thread, s,
-                       QEMU_THREAD_JOINABLE);
+    if (migrate_background_snapshot()) {
+        qemu_thread_create(&s->thread, "bgsnapshot",
+                           background_snapshot_thread, s,
+                           QEMU_THREAD_JOINABLE);
+    } else {
+        qemu_thread_create(&s->thread, "migration", migration_thread, s,
+                           QEMU_THREAD_JOINABLE);
+    }
     s->migration_thread_running = true;
 }
 
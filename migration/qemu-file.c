@@ -569,6 +569,17 @@ void qemu_file_reset_rate_limit(QEMUFile *f)
     f->bytes_xfer = 0;
 }
 
+/*
+ * Account for @size bytes that were sent on behalf of this file over
+ * another channel, so that they count against the rate limit and show
+ * up in the file position.
+ */
+void qemu_file_credit_transfer(QEMUFile *f, int64_t size)
+{
+    f->bytes_xfer += size;
+    f->pos += size;
+}
+
 void qemu_put_be16(QEMUFile *f, unsigned int v)
 {
     qemu_put_byte(f, v >> 8);
@@ -35,6 +35,7 @@
 #include "qemu/bitmap.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
+#include "qemu/coroutine.h"
 #include "migration/migration.h"
 #include "migration/postcopy-ram.h"
 #include "exec/address-spaces.h"
@@ -43,6 +44,7 @@
 #include "trace.h"
 #include "exec/ram_addr.h"
 #include "qemu/rcu_queue.h"
+#include "sysemu/sysemu.h"
 
 #ifdef DEBUG_MIGRATION_RAM
 #define DPRINTF(fmt, ...) \
@@ -68,12 +70,13 @@ static uint64_t bitmap_sync_count;
 #define RAM_SAVE_FLAG_XBZRLE   0x40
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
+#define RAM_SAVE_FLAG_MULTIFD_SYNC     0x200
 
 static const uint8_t ZERO_TARGET_PAGE[TARGET_PAGE_SIZE];
 
 static inline bool is_zero_range(uint8_t *p, uint64_t size)
 {
-    return buffer_find_nonzero_offset(p, size) == size;
+    return buffer_is_zero(p, size);
 }
 
 /* struct contains XBZRLE cache and a static page
@@ -237,6 +240,8 @@ struct PageSearchStatus {
     ram_addr_t   offset;
     /* Set once we wrap around */
     bool         complete_round;
+    /* Set if the last page went to a multifd channel */
+    bool         multifd;
 };
 typedef struct PageSearchStatus PageSearchStatus;
 
@@ -255,6 +260,10 @@ static struct BitmapRcu {
 struct CompressParam {
     bool done;
     bool quit;
+    /* The page handed to the thread has not been accounted yet */
+    bool pending;
+    /* Set by the thread when the page it was handed is all zeroes */
+    bool zero_page;
     QEMUFile *file;
     QemuMutex mutex;
     QemuCond cond;
@@ -282,6 +291,8 @@ static QemuThread *compress_threads;
  */
 static QemuMutex comp_done_lock;
 static QemuCond comp_done_cond;
+/* Where compress_page_with_multi_thread starts looking for an idle thread */
+static int comp_next_idx;
 /* The empty QEMUFileOps will be used by file in CompressParam */
 static const QEMUFileOps empty_ops = { };
 
@@ -292,7 +303,7 @@ static QemuMutex decomp_done_lock;
 static QemuCond decomp_done_cond;
 
 static int do_compress_ram_page(QEMUFile *f, RAMBlock *block,
-                                ram_addr_t offset);
+                                ram_addr_t offset, bool *zero_page);
 
 static void *do_data_compress(void *opaque)
 {
@@ -308,7 +319,8 @@ static void *do_data_compress(void *opaque)
             param->block = NULL;
             qemu_mutex_unlock(&param->mutex);
 
-            do_compress_ram_page(param->file, block, offset);
+            do_compress_ram_page(param->file, block, offset,
+                                 &param->zero_page);
 
             qemu_mutex_lock(&comp_done_lock);
             param->done = true;
@@ -369,6 +381,7 @@ void migrate_compress_threads_create(void)
         return;
     }
     compression_switch = true;
+    comp_next_idx = 0;
     thread_count = migrate_compress_threads();
     compress_threads = g_new0(QemuThread, thread_count);
     comp_param = g_new0(CompressParam, thread_count);
@@ -583,6 +596,328 @@ static inline bool migration_bitmap_clear_dirty(ram_addr_t addr)
     return ret;
 }
 
+/* Multiple channel (multifd) migration
+ *
+ * When the x-multifd capability is enabled, normal RAM pages are sent
+ * over additional connections, each serviced by its own thread, while
+ * zero pages and everything else stay on the main stream.  A page sent
+ * again after a dirty bitmap sync may go over a different channel, so
+ * the channels and the main stream are synchronized at the sync points:
+ * the destination applies no page sent after a sync point before all
+ * the pages sent before it have been written to guest RAM.
+ *
+ * Each channel starts with a header (magic, version, channel id and
+ * channel count) followed by be64 records made of a page offset ORed
+ * with MULTIFD_FLAG_* bits.
+ */
+
+#define MULTIFD_MAGIC   0x4d554c54 /* "MULT" */
+#define MULTIFD_VERSION 1
+
+#define MULTIFD_FLAG_PAGE     0x01 /* followed by block name and data */
+#define MULTIFD_FLAG_SYNC     0x02 /* followed by be64 sequence number */
+#define MULTIFD_FLAG_EOS      0x04
+#define MULTIFD_FLAG_CONTINUE 0x08 /* same block as the previous page */
+
+#define MULTIFD_QUEUE_SIZE 128
+
+struct MultiFDItem {
+    RAMBlock *block;    /* NULL for a sync point */
+    ram_addr_t offset;
+    uint64_t seq;
+};
+typedef struct MultiFDItem MultiFDItem;
+
+struct MultiFDSendParams {
+    int id;
+    QemuThread thread;
+    bool running;
+    QIOChannel *c;
+    QEMUFile *f;
+    QemuMutex mutex;
+    /* Signalled both when items are queued and when room is made */
+    QemuCond cond;
+    MultiFDItem queue[MULTIFD_QUEUE_SIZE];
+    int queue_head;
+    int queue_len;
+    /* send what is queued, then EOS, and exit */
+    bool finish;
+    /* exit as soon as possible */
+    bool quit;
+};
+typedef struct MultiFDSendParams MultiFDSendParams;
+
+struct MultiFDSendState {
+    MultiFDSendParams *params;
+    int count;
+    int next;
+    uint64_t seq;
+    /* set when the dirty bitmap was synced after the last sync point */
+    bool need_sync;
+};
+typedef struct MultiFDSendState MultiFDSendState;
+
+static MultiFDSendState *multifd_send_state;
+
+static void multifd_send_item(MultiFDSendParams *p, MultiFDItem *item,
+                              RAMBlock **last_block)
+{
+    size_t len;
+
+    if (!item->block) {
+        qemu_put_be64(p->f, MULTIFD_FLAG_SYNC);
+        qemu_put_be64(p->f, item->seq);
+        return;
+    }
+
+    if (item->block == *last_block) {
+        qemu_put_be64(p->f, item->offset | MULTIFD_FLAG_PAGE |
+                      MULTIFD_FLAG_CONTINUE);
+    } else {
+        len = strlen(item->block->idstr);
+        qemu_put_be64(p->f, item->offset | MULTIFD_FLAG_PAGE);
+        qemu_put_byte(p->f, len);
+        qemu_put_buffer(p->f, (uint8_t *)item->block->idstr, len);
+        *last_block = item->block;
+    }
+    qemu_put_buffer_async(p->f, item->block->host + item->offset,
+                          TARGET_PAGE_SIZE);
+}
+
+static void *multifd_send_thread(void *opaque)
+{
+    MultiFDSendParams *p = opaque;
+    RAMBlock *last_block = NULL;
+    MultiFDItem item;
+
+    rcu_register_thread();
+
+    qemu_put_be32(p->f, MULTIFD_MAGIC);
+    qemu_put_be32(p->f, MULTIFD_VERSION);
+    qemu_put_be32(p->f, p->id);
+    qemu_put_be32(p->f, multifd_send_state->count);
+    qemu_fflush(p->f);
+
+    qemu_mutex_lock(&p->mutex);
+    while (!p->quit && !qemu_file_get_error(p->f)) {
+        if (!p->queue_len) {
+            if (p->finish) {
+                qemu_put_be64(p->f, MULTIFD_FLAG_EOS);
+                qemu_fflush(p->f);
+                break;
+            }
+            qemu_cond_wait(&p->cond, &p->mutex);
+            continue;
+        }
+
+        item = p->queue[p->queue_head];
+        p->queue_head = (p->queue_head + 1) % MULTIFD_QUEUE_SIZE;
+        p->queue_len--;
+        qemu_cond_signal(&p->cond);
+        qemu_mutex_unlock(&p->mutex);
+
+        multifd_send_item(p, &item, &last_block);
+
+        qemu_mutex_lock(&p->mutex);
+        /* Pages are queued by reference to guest RAM, so flush whenever
+         * the queue runs dry rather than let them sit in the buffer.
+         */
+        if (!p->queue_len) {
+            qemu_mutex_unlock(&p->mutex);
+            qemu_fflush(p->f);
+            qemu_mutex_lock(&p->mutex);
+        }
+    }
+    /* Do not leave the migration thread waiting for room */
+    p->quit = true;
+    qemu_cond_signal(&p->cond);
+    qemu_mutex_unlock(&p->mutex);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void multifd_queue_item(MultiFDSendParams *p, RAMBlock *block,
+                               ram_addr_t offset, uint64_t seq)
+{
+    MultiFDItem *item;
+
+    qemu_mutex_lock(&p->mutex);
+    while (!p->quit && p->queue_len == MULTIFD_QUEUE_SIZE) {
+        qemu_cond_wait(&p->cond, &p->mutex);
+    }
+    if (!p->quit) {
+        item = &p->queue[(p->queue_head + p->queue_len) % MULTIFD_QUEUE_SIZE];
+        item->block = block;
+        item->offset = offset;
+        item->seq = seq;
+        p->queue_len++;
+        qemu_cond_signal(&p->cond);
+    } else {
+        /* The channel is gone, make sure the migration fails */
+        qemu_file_set_error(migrate_get_current()->to_dst_file, -EIO);
+    }
+    qemu_mutex_unlock(&p->mutex);
+}
+
+/**
+ * multifd_send_page: queue a normal page on one of the multifd channels
+ *
+ * The page is charged to the main stream, so that rate limiting and the
+ * bandwidth estimate take the additional channels into account.
+ *
+ * @f: main migration stream
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ * @bytes_transferred: increase it with the number of transferred bytes
+ */
+static void multifd_send_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset,
+                              uint64_t *bytes_transferred)
+{
+    int idx = multifd_send_state->next;
+
+    multifd_send_state->next = (idx + 1) % multifd_send_state->count;
+    multifd_queue_item(&multifd_send_state->params[idx], block, offset, 0);
+
+    qemu_file_credit_transfer(f, TARGET_PAGE_SIZE);
+    *bytes_transferred += TARGET_PAGE_SIZE;
+}
+
+/**
+ * multifd_send_sync_main: add a sync point to all the streams
+ *
+ * Unless @force is set, this is only done once the dirty bitmap was
+ * synced, since a page is never queued twice between two bitmap syncs.
+ *
+ * @f: main migration stream
+ * @force: add a sync point even if the dirty bitmap was not synced
+ * @bytes_transferred: increase it with the number of transferred bytes
+ */
+static void multifd_send_sync_main(QEMUFile *f, bool force,
+                                   uint64_t *bytes_transferred)
+{
+    int i;
+
+    if (!multifd_send_state ||
+        !(force || multifd_send_state->need_sync)) {
+        return;
+    }
+
+    multifd_send_state->need_sync = false;
+    multifd_send_state->seq++;
+    for (i = 0; i < multifd_send_state->count; i++) {
+        multifd_queue_item(&multifd_send_state->params[i], NULL, 0,
+                           multifd_send_state->seq);
+    }
+    qemu_put_be64(f, RAM_SAVE_FLAG_MULTIFD_SYNC);
+    qemu_put_be64(f, multifd_send_state->seq);
+    *bytes_transferred += 16;
+}
+
+static int multifd_save_setup(void)
+{
+    MultiFDSendState *state;
+    Error *local_err = NULL;
+    int i, count;
+
+    if (migrate_get_current()->parameters.tls_creds) {
+        error_report("Multifd is not currently compatible with TLS");
+        return -1;
+    }
+
+    count = migrate_multifd_channels();
+    state = g_new0(MultiFDSendState, 1);
+    state->params = g_new0(MultiFDSendParams, count);
+
+    for (i = 0; i < count; i++) {
+        MultiFDSendParams *p = &state->params[i];
+
+        p->c = socket_send_channel_create(&local_err);
+        if (!p->c) {
+            error_report_err(local_err);
+            break;
+        }
+        p->id = i;
+        p->f = qemu_fopen_channel_output(p->c);
+        object_unref(OBJECT(p->c));
+        qemu_mutex_init(&p->mutex);
+        qemu_cond_init(&p->cond);
+        state->count++;
+    }
+
+    /* Published to migrate_fd_cancel() only once fully set up; the
+     * channels that were opened are closed by ram_migration_cleanup().
+     */
+    atomic_mb_set(&multifd_send_state, state);
+    if (state->count < count) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        state->params[i].running = true;
+        qemu_thread_create(&state->params[i].thread, "multifdsend",
+                           multifd_send_thread, &state->params[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+    return 0;
+}
+
+/* Called with iothread lock */
+void multifd_send_shutdown(void)
+{
+    MultiFDSendState *state = atomic_mb_read(&multifd_send_state);
+    int i;
+
+    if (!state) {
+        return;
+    }
+
+    for (i = 0; i < state->count; i++) {
+        MultiFDSendParams *p = &state->params[i];
+
+        qio_channel_shutdown(p->c, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+        qemu_mutex_lock(&p->mutex);
+        p->quit = true;
+        qemu_cond_signal(&p->cond);
+        qemu_mutex_unlock(&p->mutex);
+    }
+}
+
+/* Called with iothread lock */
+static void multifd_save_cleanup(void)
+{
+    MultiFDSendState *state = multifd_send_state;
+    int i;
+
+    if (!state) {
+        return;
+    }
+
+    if (migrate_get_current()->state != MIGRATION_STATUS_COMPLETED) {
+        /* The threads may be stuck writing to a broken connection */
+        multifd_send_shutdown();
+    }
+
+    for (i = 0; i < state->count; i++) {
+        MultiFDSendParams *p = &state->params[i];
+
+        if (p->running) {
+            qemu_mutex_lock(&p->mutex);
+            p->finish = true;
+            qemu_cond_signal(&p->cond);
+            qemu_mutex_unlock(&p->mutex);
+            qemu_thread_join(&p->thread);
+        }
+        qemu_fclose(p->f);
+        qemu_mutex_destroy(&p->mutex);
+        qemu_cond_destroy(&p->cond);
+    }
+
+    atomic_mb_set(&multifd_send_state, NULL);
+    g_free(state->params);
+    g_free(state);
+}
+
 static void migration_bitmap_sync_range(ram_addr_t start, ram_addr_t length)
 {
     unsigned long *bitmap;
@@ -591,6 +926,18 @@ static void migration_bitmap_sync_range(ram_addr_t start, ram_addr_t length)
         cpu_physical_memory_sync_dirty_bitmap(bitmap, start, length);
 }
 
+static bool migration_bitmap_sync_rings(void)
+{
+    unsigned long *bitmap;
+    uint64_t num_dirty = 0;
+    bool complete;
+
+    bitmap = atomic_rcu_read(&migration_bitmap_rcu)->bmap;
+    complete = cpu_physical_memory_sync_dirty_rings(bitmap, &num_dirty);
+    migration_dirty_pages += num_dirty;
+    return complete;
+}
+
 /* Fix me: there are too many global variables used in migration process. */
 static int64_t start_time;
 static int64_t bytes_xfer_prev;
@@ -616,6 +963,9 @@ static void migration_bitmap_sync(void)
     int64_t bytes_xfer_now;
 
     bitmap_sync_count++;
+    if (multifd_send_state) {
+        multifd_send_state->need_sync = true;
+    }
 
     if (!bytes_xfer_prev) {
         bytes_xfer_prev = ram_bytes_transferred();
@@ -630,9 +980,16 @@ static void migration_bitmap_sync(void)
 
     qemu_mutex_lock(&migration_bitmap_mutex);
     rcu_read_lock();
-    QLIST_FOREACH_RCU(block, &ram_list.blocks, next) {
-        migration_bitmap_sync_range(block->offset, block->used_length);
+    /* Usually only the pages written by TCG since the last sync need to
+     * be looked at; walk the whole bitmap when something else dirtied
+     * memory or a vCPU dirty ring overflowed.
+     */
+    if (!migration_bitmap_sync_rings()) {
+        QLIST_FOREACH_RCU(block, &ram_list.blocks, next) {
+            migration_bitmap_sync_range(block->offset, block->used_length);
+        }
     }
+    cpu_physical_memory_rearm_dirty_tracking();
     rcu_read_unlock();
     qemu_mutex_unlock(&migration_bitmap_mutex);
 
@@ -712,6 +1069,117 @@ static int save_zero_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset,
     return pages;
 }
 
+/* Copy-on-write of guest RAM for background snapshots
+ *
+ * The snapshot point is taken with the VM stopped, then the VM resumes
+ * while RAM is saved by the migration thread.  Pages that are about to be
+ * written before they were saved are first copied aside by
+ * ram_cow_prepare_write(): TCG gets there from the notdirty slow path,
+ * since the dirty bitmap sync in ram_save_setup() write-protected RAM,
+ * and the other writers of guest RAM in exec.c call it before writing.
+ *
+ * In the worst case, every page is copied before being saved.
+ */
+bool ram_cow_active;
+
+static struct {
+    /* Protects the pages table and the migration bitmap against writers */
+    QemuMutex lock;
+    /* Page number -> copy of the page at the snapshot point */
+    GHashTable *pages;
+    /* Contents of the page being saved */
+    uint8_t *buf;
+} ram_cow;
+
+void ram_cow_prepare_write(ram_addr_t start, ram_addr_t length)
+{
+    unsigned long page, end;
+    unsigned long *bitmap;
+    uint8_t *copy;
+
+    end = TARGET_PAGE_ALIGN(start + length) >> TARGET_PAGE_BITS;
+    page = start >> TARGET_PAGE_BITS;
+
+    rcu_read_lock();
+    qemu_mutex_lock(&ram_cow.lock);
+    if (ram_cow_active) {
+        bitmap = atomic_rcu_read(&migration_bitmap_rcu)->bmap;
+        for (; page < end; page++) {
+            gpointer key = GSIZE_TO_POINTER(page);
+
+            /* Not saved yet, and not copied by an earlier write */
+            if (test_bit(page, bitmap) &&
+                !g_hash_table_contains(ram_cow.pages, key)) {
+                copy = g_memdup(qemu_map_ram_ptr(NULL, page << TARGET_PAGE_BITS),
+                                TARGET_PAGE_SIZE);
+                g_hash_table_insert(ram_cow.pages, key, copy);
+            }
+        }
+    }
+    qemu_mutex_unlock(&ram_cow.lock);
+    rcu_read_unlock();
+}
+
+/* Called with iothread lock, the VM stopped and the dirty bitmap synced */
+static void ram_cow_start(void)
+{
+    ram_cow.pages = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                          NULL, g_free);
+    ram_cow.buf = g_malloc(TARGET_PAGE_SIZE);
+    atomic_mb_set(&ram_cow_active, true);
+}
+
+/* Called with iothread lock */
+static void ram_cow_stop(void)
+{
+    if (!ram_cow_active) {
+        return;
+    }
+
+    qemu_mutex_lock(&ram_cow.lock);
+    atomic_mb_set(&ram_cow_active, false);
+    g_hash_table_destroy(ram_cow.pages);
+    ram_cow.pages = NULL;
+    g_free(ram_cow.buf);
+    ram_cow.buf = NULL;
+    qemu_mutex_unlock(&ram_cow.lock);
+}
+
+/**
+ * ram_cow_clear_dirty: claim a page for saving in a background snapshot
+ *
+ * Like migration_bitmap_clear_dirty(), and copies the contents of the page
+ * at the snapshot point to ram_cow.buf if it was dirty.  This is done
+ * under ram_cow.lock, so that the page cannot be written in between.
+ *
+ * Returns: true if the page was dirty
+ *
+ * @block: block that contains the page
+ * @offset: offset inside the block for the page
+ * @addr: ram_addr of the page
+ */
+static bool ram_cow_clear_dirty(RAMBlock *block, ram_addr_t offset,
+                                ram_addr_t addr)
+{
+    gpointer key = GSIZE_TO_POINTER(addr >> TARGET_PAGE_BITS);
+    uint8_t *copy;
+    bool dirty;
+
+    qemu_mutex_lock(&ram_cow.lock);
+    dirty = migration_bitmap_clear_dirty(addr);
+    if (dirty) {
+        copy = g_hash_table_lookup(ram_cow.pages, key);
+        memcpy(ram_cow.buf, copy ? copy : block->host + offset,
+               TARGET_PAGE_SIZE);
+        if (copy) {
+            g_hash_table_remove(ram_cow.pages, key);
+        }
+    }
+    qemu_mutex_unlock(&ram_cow.lock);
+
+    return dirty;
+}
+
 /**
  * ram_save_page: Send the given page to the stream
  *
@@ -734,11 +1202,13 @@ static int ram_save_page(QEMUFile *f, PageSearchStatus *pss,
     ram_addr_t current_addr;
     uint8_t *p;
     int ret;
-    bool send_async = true;
+    bool send_async = !ram_cow_active;
     RAMBlock *block = pss->block;
     ram_addr_t offset = pss->offset;
 
-    p = block->host + offset;
+    /* Background snapshots save the copy made by ram_cow_clear_dirty() */
+    p = ram_cow_active ? ram_cow.buf : block->host + offset;
+    pss->multifd = false;
 
     /* In doubt sent page as normal */
     bytes_xmit = 0;
@@ -783,6 +1253,14 @@ static int ram_save_page(QEMUFile *f, PageSearchStatus *pss,
         }
     }
 
+    /* Normal pages go to the multifd channels when there are some */
+    if (pages == -1 && multifd_send_state) {
+        multifd_send_page(f, block, pss->offset, bytes_transferred);
+        pss->multifd = true;
+        pages = 1;
+        acct_info.norm_pages++;
+    }
+
     /* XBZRLE overflow or normal page */
     if (pages == -1) {
         *bytes_transferred += save_page_header(f, block,
@@ -803,11 +1281,22 @@ static int ram_save_page(QEMUFile *f, PageSearchStatus *pss,
 }
 
 static int do_compress_ram_page(QEMUFile *f, RAMBlock *block,
-                                ram_addr_t offset)
+                                ram_addr_t offset, bool *zero_page)
 {
     int bytes_sent, blen;
     uint8_t *p = block->host + (offset & TARGET_PAGE_MASK);
 
+    /* Zero pages are detected here rather than in the migration thread,
+     * so that scanning them is spread over the compression threads too.
+     */
+    *zero_page = is_zero_range(p, TARGET_PAGE_SIZE);
+    if (*zero_page) {
+        bytes_sent = save_page_header(f, block,
+                                      offset | RAM_SAVE_FLAG_COMPRESS);
+        qemu_put_byte(f, 0);
+        return bytes_sent + 1;
+    }
+
     bytes_sent = save_page_header(f, block, offset |
                                   RAM_SAVE_FLAG_COMPRESS_PAGE);
     blen = qemu_put_compression_data(f, p, TARGET_PAGE_SIZE,
@@ -825,9 +1314,24 @@ static int do_compress_ram_page(QEMUFile *f, RAMBlock *block,
 
 static uint64_t bytes_transferred;
 
+/* Copy out the data produced by an idle compression thread */
+static void collect_compressed_page(QEMUFile *f, CompressParam *param,
+                                    uint64_t *bytes_transferred)
+{
+    *bytes_transferred += qemu_put_qemu_file(f, param->file);
+    if (param->pending) {
+        param->pending = false;
+        if (param->zero_page) {
+            acct_info.dup_pages++;
+        } else {
+            acct_info.norm_pages++;
+        }
+    }
+}
+
 static void flush_compressed_data(QEMUFile *f)
 {
-    int idx, len, thread_count;
+    int idx, thread_count;
 
     if (!migrate_use_compression()) {
         return;
@@ -845,8 +1349,7 @@ static void flush_compressed_data(QEMUFile *f)
     for (idx = 0; idx < thread_count; idx++) {
         qemu_mutex_lock(&comp_param[idx].mutex);
         if (!comp_param[idx].quit) {
-            len = qemu_put_qemu_file(f, comp_param[idx].file);
-            bytes_transferred += len;
+            collect_compressed_page(f, &comp_param[idx], &bytes_transferred);
         }
         qemu_mutex_unlock(&comp_param[idx].mutex);
     }
@@ -863,34 +1366,43 @@ static int compress_page_with_multi_thread(QEMUFile *f, RAMBlock *block,
                                            ram_addr_t offset,
                                            uint64_t *bytes_transferred)
 {
-    int idx, thread_count, bytes_xmit = -1, pages = -1;
+    CompressParam *param = NULL;
+    int i, idx, thread_count;
 
     thread_count = migrate_compress_threads();
     qemu_mutex_lock(&comp_done_lock);
-    while (true) {
-        for (idx = 0; idx < thread_count; idx++) {
+    while (!param) {
+        /* Start after the thread used last time, so that the pages are
+         * spread evenly instead of piling up on the first threads.
+         */
+        for (i = 0; i < thread_count; i++) {
+            idx = (comp_next_idx + i) % thread_count;
             if (comp_param[idx].done) {
                 comp_param[idx].done = false;
-                bytes_xmit = qemu_put_qemu_file(f, comp_param[idx].file);
-                qemu_mutex_lock(&comp_param[idx].mutex);
-                set_compress_params(&comp_param[idx], block, offset);
-                qemu_cond_signal(&comp_param[idx].cond);
-                qemu_mutex_unlock(&comp_param[idx].mutex);
-                pages = 1;
-                acct_info.norm_pages++;
-                *bytes_transferred += bytes_xmit;
+                comp_next_idx = (idx + 1) % thread_count;
+                param = &comp_param[idx];
                 break;
             }
         }
-        if (pages > 0) {
-            break;
-        } else {
+        if (!param) {
             qemu_cond_wait(&comp_done_cond, &comp_done_lock);
         }
     }
     qemu_mutex_unlock(&comp_done_lock);
 
-    return pages;
+    /* The thread stays idle until it gets the next page, so its buffer
+     * can be drained without holding comp_done_lock; this lets the other
+     * threads report completion meanwhile.
+     */
+    collect_compressed_page(f, param, bytes_transferred);
+
+    qemu_mutex_lock(&param->mutex);
+    set_compress_params(param, block, offset);
+    param->pending = true;
+    qemu_cond_signal(&param->cond);
+    qemu_mutex_unlock(&param->mutex);
+
+    return 1;
 }
 
 /**
@@ -957,12 +1469,10 @@ static int ram_save_compressed_page(QEMUFile *f, PageSearchStatus *pss,
                 }
             }
         } else {
+            /* Zero pages are detected by the compression threads */
             offset |= RAM_SAVE_FLAG_CONTINUE;
-            pages = save_zero_page(f, block, offset, p, bytes_transferred);
-            if (pages == -1) {
-                pages = compress_page_with_multi_thread(f, block, offset,
-                                                        bytes_transferred);
-            }
+            pages = compress_page_with_multi_thread(f, block, offset,
+                                                    bytes_transferred);
         }
     }
 
@@ -1231,9 +1741,16 @@ static int ram_save_target_page(MigrationState *ms, QEMUFile *f,
                                 ram_addr_t dirty_ram_abs)
 {
     int res = 0;
+    bool dirty;
+
+    if (ram_cow_active) {
+        dirty = ram_cow_clear_dirty(pss->block, pss->offset, dirty_ram_abs);
+    } else {
+        dirty = migration_bitmap_clear_dirty(dirty_ram_abs);
+    }
 
     /* Check the pages is dirty and if it is send it */
-    if (migration_bitmap_clear_dirty(dirty_ram_abs)) {
+    if (dirty) {
         unsigned long *unsentmap;
         if (compression_switch && migrate_use_compression()) {
             res = ram_save_compressed_page(f, pss,
@@ -1253,9 +1770,9 @@ static int ram_save_target_page(MigrationState *ms, QEMUFile *f,
         }
         /* Only update last_sent_block if a block was actually sent; xbzrle
          * might have decided the page was identical so didn't bother writing
-         * to the stream.
+         * to the stream, and multifd pages do not go to the main stream.
          */
-        if (res > 0) {
+        if (res > 0 && !pss->multifd) {
             last_sent_block = pss->block;
         }
     }
@@ -1418,6 +1935,9 @@ static void ram_migration_cleanup(void *opaque)
      * no writing race against this migration_bitmap
      */
     struct BitmapRcu *bitmap = migration_bitmap_rcu;
+
+    /* Writers look at the bitmap as long as the snapshot is active */
+    ram_cow_stop();
     atomic_rcu_set(&migration_bitmap_rcu, NULL);
     if (bitmap) {
         memory_global_dirty_log_stop();
@@ -1434,6 +1954,8 @@ static void ram_migration_cleanup(void *opaque)
         XBZRLE.current_buf = NULL;
     }
     XBZRLE_cache_unlock();
+
+    multifd_save_cleanup();
 }
 
 static void reset_ram_globals(void)
@@ -1915,6 +2437,14 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
         acct_clear();
     }
 
+    /* savevm goes through here too, but only to a local file */
+    if (migrate_use_multifd() && !runstate_check(RUN_STATE_SAVE_VM) &&
+        f == migrate_get_current()->to_dst_file) {
+        if (multifd_save_setup() < 0) {
+            return -1;
+        }
+    }
+
     /* For memory_global_dirty_log_start below.  */
     qemu_mutex_lock_iothread();
 
@@ -1941,6 +2471,11 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
 
     memory_global_dirty_log_start();
     migration_bitmap_sync();
+    if (migrate_background_snapshot() &&
+        f == migrate_get_current()->to_dst_file) {
+        /* Only the contents at this point are saved from now on */
+        ram_cow_start();
+    }
     qemu_mutex_unlock_ramlist();
     qemu_mutex_unlock_iothread();
 
@@ -1978,6 +2513,7 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
     smp_rmb();
 
     ram_control_before_iterate(f, RAM_CONTROL_ROUND);
+    multifd_send_sync_main(f, false, &bytes_transferred);
 
     t0 = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     i = 0;
@@ -2032,11 +2568,12 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
 {
     rcu_read_lock();
 
-    if (!migration_in_postcopy(migrate_get_current())) {
+    if (!migration_in_postcopy(migrate_get_current()) && !ram_cow_active) {
         migration_bitmap_sync();
     }
 
     ram_control_before_iterate(f, RAM_CONTROL_FINISH);
+    multifd_send_sync_main(f, false, &bytes_transferred);
 
     /* try transferring iterative blocks of memory */
 
@@ -2056,6 +2593,8 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
 
     rcu_read_unlock();
 
+    /* The destination must have all the pages before it goes on */
+    multifd_send_sync_main(f, true, &bytes_transferred);
     qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
 
     return 0;
@@ -2069,7 +2608,7 @@ static void ram_save_pending(QEMUFile *f, void *opaque, uint64_t max_size,
 
     remaining_size = ram_save_remaining() * TARGET_PAGE_SIZE;
 
-    if (!migration_in_postcopy(migrate_get_current()) &&
+    if (!migration_in_postcopy(migrate_get_current()) && !ram_cow_active &&
         remaining_size < max_size) {
         qemu_mutex_lock_iothread();
         rcu_read_lock();
@@ -2167,6 +2706,310 @@ static inline void *host_from_ram_block_offset(RAMBlock *block,
     return block->host + offset;
 }
 
+struct MultiFDRecvParams {
+    QemuThread thread;
+    QIOChannel *c;
+    QEMUFile *f;
+    /* last sync point reached, protected by multifd_recv_state->mutex */
+    uint64_t seq;
+    bool done;
+};
+typedef struct MultiFDRecvParams MultiFDRecvParams;
+
+struct MultiFDRecvState {
+    MultiFDRecvParams *params;
+    int count;
+    /* number of channels accepted so far, only used by the main thread */
+    int connected;
+    QemuMutex mutex;
+    QemuCond cond;
+    /* last sync point reached by the main stream */
+    uint64_t main_seq;
+    bool quit;
+    bool error;
+    /* incoming migration coroutine waiting for the channels */
+    Coroutine *waiting_co;
+    QEMUBH *bh;
+};
+typedef struct MultiFDRecvState MultiFDRecvState;
+
+static MultiFDRecvState *multifd_recv_state;
+
+/* Called with multifd_recv_state->mutex held */
+static bool multifd_recv_reached(uint64_t seq)
+{
+    int i;
+
+    if (multifd_recv_state->connected < multifd_recv_state->count) {
+        return false;
+    }
+    for (i = 0; i < multifd_recv_state->count; i++) {
+        if (multifd_recv_state->params[i].seq < seq) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Called with multifd_recv_state->mutex held */
+static void multifd_recv_kick(void)
+{
+    qemu_cond_broadcast(&multifd_recv_state->cond);
+    if (multifd_recv_state->waiting_co) {
+        qemu_bh_schedule(multifd_recv_state->bh);
+    }
+}
+
+static void multifd_recv_bh(void *opaque)
+{
+    Coroutine *co;
+
+    qemu_mutex_lock(&multifd_recv_state->mutex);
+    co = multifd_recv_state->waiting_co;
+    multifd_recv_state->waiting_co = NULL;
+    qemu_mutex_unlock(&multifd_recv_state->mutex);
+
+    if (co) {
+        qemu_coroutine_enter(co);
+    }
+}
+
+static int multifd_recv_header(QEMUFile *f)
+{
+    uint32_t magic, version, count;
+
+    magic = qemu_get_be32(f);
+    version = qemu_get_be32(f);
+    qemu_get_be32(f); /* channel id */
+    count = qemu_get_be32(f);
+
+    if (qemu_file_get_error(f)) {
+        return -EIO;
+    }
+    if (magic != MULTIFD_MAGIC || version != MULTIFD_VERSION) {
+        error_report("Bad multifd channel header %#x version %u",
+                     magic, version);
+        return -EINVAL;
+    }
+    if (count != multifd_recv_state->count) {
+        error_report("Source uses %u multifd channels, %d expected",
+                     count, multifd_recv_state->count);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int multifd_recv_sync(MultiFDRecvParams *p)
+{
+    uint64_t seq = qemu_get_be64(p->f);
+
+    if (qemu_file_get_error(p->f)) {
+        return -EIO;
+    }
+
+    qemu_mutex_lock(&multifd_recv_state->mutex);
+    p->seq = seq;
+    multifd_recv_kick();
+    /* Pages after the sync point may overwrite older copies sent over
+     * the other streams, so wait for all of them to get there.
+     */
+    while (!multifd_recv_state->quit &&
+           (multifd_recv_state->main_seq < seq ||
+            !multifd_recv_reached(seq))) {
+        qemu_cond_wait(&multifd_recv_state->cond, &multifd_recv_state->mutex);
+    }
+    qemu_mutex_unlock(&multifd_recv_state->mutex);
+    return 0;
+}
+
+static void *multifd_recv_thread(void *opaque)
+{
+    MultiFDRecvParams *p = opaque;
+    RAMBlock *block = NULL;
+    int flags = 0, ret;
+
+    rcu_register_thread();
+
+    ret = multifd_recv_header(p->f);
+    while (!ret && !atomic_read(&multifd_recv_state->quit)) {
+        ram_addr_t addr;
+        void *host;
+        char id[256];
+        uint8_t len;
+
+        addr = qemu_get_be64(p->f);
+        flags = addr & ~TARGET_PAGE_MASK;
+        addr &= TARGET_PAGE_MASK;
+        if (qemu_file_get_error(p->f)) {
+            ret = -EIO;
+            break;
+        }
+
+        if (flags & MULTIFD_FLAG_EOS) {
+            break;
+        }
+        if (flags & MULTIFD_FLAG_SYNC) {
+            ret = multifd_recv_sync(p);
+            continue;
+        }
+        if (!(flags & MULTIFD_FLAG_PAGE)) {
+            error_report("Unknown multifd flags: %#x", flags);
+            ret = -EINVAL;
+            break;
+        }
+
+        rcu_read_lock();
+        if (!(flags & MULTIFD_FLAG_CONTINUE)) {
+            len = qemu_get_byte(p->f);
+            qemu_get_buffer(p->f, (uint8_t *)id, len);
+            id[len] = 0;
+            block = qemu_ram_block_by_name(id);
+        }
+        host = block ? host_from_ram_block_offset(block, addr) : NULL;
+        if (!host) {
+            error_report("Illegal multifd RAM offset " RAM_ADDR_FMT, addr);
+            ret = -EINVAL;
+        } else {
+            qemu_get_buffer(p->f, host, TARGET_PAGE_SIZE);
+        }
+        rcu_read_unlock();
+    }
+
+    qemu_mutex_lock(&multifd_recv_state->mutex);
+    p->done = true;
+    if (ret) {
+        multifd_recv_state->error = true;
+    }
+    multifd_recv_kick();
+    qemu_mutex_unlock(&multifd_recv_state->mutex);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/**
+ * multifd_recv_sync_main: wait for the multifd channels at a sync point
+ *
+ * Called from the incoming migration coroutine, which yields until all
+ * the channels got to sync point @seq.
+ *
+ * Returns: 0 on success, negative on error
+ */
+static int multifd_recv_sync_main(uint64_t seq)
+{
+    int ret = 0;
+
+    if (!multifd_recv_state) {
+        error_report("Multifd sync point found, but multifd is not enabled");
+        return -EINVAL;
+    }
+    if (!qemu_in_coroutine()) {
+        error_report("Multifd is only supported for incoming migration");
+        return -EINVAL;
+    }
+
+    qemu_mutex_lock(&multifd_recv_state->mutex);
+    multifd_recv_state->main_seq = seq;
+    qemu_cond_broadcast(&multifd_recv_state->cond);
+    while (!multifd_recv_state->error && !multifd_recv_reached(seq)) {
+        int i;
+
+        for (i = 0; i < multifd_recv_state->connected; i++) {
+            MultiFDRecvParams *p = &multifd_recv_state->params[i];
+
+            if (p->done && p->seq < seq) {
+                error_report("Multifd channel closed before sync point");
+                multifd_recv_state->error = true;
+            }
+        }
+        if (multifd_recv_state->error) {
+            break;
+        }
+        multifd_recv_state->waiting_co = qemu_coroutine_self();
+        qemu_mutex_unlock(&multifd_recv_state->mutex);
+        qemu_coroutine_yield();
+        qemu_mutex_lock(&multifd_recv_state->mutex);
+    }
+    if (multifd_recv_state->error) {
+        ret = -EIO;
+    }
+    qemu_mutex_unlock(&multifd_recv_state->mutex);
+    return ret;
+}
+
+void multifd_recv_setup(void)
+{
+    if (!migrate_use_multifd()) {
+        return;
+    }
+
+    multifd_recv_state = g_new0(MultiFDRecvState, 1);
+    multifd_recv_state->count = migrate_multifd_channels();
+    multifd_recv_state->params = g_new0(MultiFDRecvParams,
+                                        multifd_recv_state->count);
+    qemu_mutex_init(&multifd_recv_state->mutex);
+    qemu_cond_init(&multifd_recv_state->cond);
+    multifd_recv_state->bh = qemu_bh_new(multifd_recv_bh, NULL);
+}
+
+bool multifd_recv_all_channels_created(void)
+{
+    return !multifd_recv_state ||
+           multifd_recv_state->connected == multifd_recv_state->count;
+}
+
+void multifd_recv_new_channel(QIOChannel *ioc)
+{
+    MultiFDRecvParams *p;
+
+    if (multifd_recv_all_channels_created()) {
+        error_report("Unexpected multifd channel, closing it");
+        return;
+    }
+
+    p = &multifd_recv_state->params[multifd_recv_state->connected];
+    p->c = ioc;
+    p->f = qemu_fopen_channel_input(ioc);
+    /* The receive threads rely on blocking reads */
+    qio_channel_set_blocking(ioc, true, NULL);
+
+    qemu_mutex_lock(&multifd_recv_state->mutex);
+    multifd_recv_state->connected++;
+    qemu_mutex_unlock(&multifd_recv_state->mutex);
+
+    qemu_thread_create(&p->thread, "multifdrecv", multifd_recv_thread, p,
+                       QEMU_THREAD_JOINABLE);
+}
+
+void multifd_recv_cleanup(void)
+{
+    int i;
+
+    if (!multifd_recv_state) {
+        return;
+    }
+
+    qemu_mutex_lock(&multifd_recv_state->mutex);
+    atomic_set(&multifd_recv_state->quit, true);
+    qemu_cond_broadcast(&multifd_recv_state->cond);
+    qemu_mutex_unlock(&multifd_recv_state->mutex);
+
+    for (i = 0; i < multifd_recv_state->connected; i++) {
+        MultiFDRecvParams *p = &multifd_recv_state->params[i];
+
+        qio_channel_shutdown(p->c, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+        qemu_thread_join(&p->thread);
+        qemu_fclose(p->f);
+    }
+
+    qemu_bh_delete(multifd_recv_state->bh);
+    qemu_cond_destroy(&multifd_recv_state->cond);
+    qemu_mutex_destroy(&multifd_recv_state->mutex);
+    g_free(multifd_recv_state->params);
+    g_free(multifd_recv_state);
+    multifd_recv_state = NULL;
+}
+
 /*
  * If a page (or a whole RDMA chunk) has been
  * determined to be zero, then zap it.
@@ -2557,6 +3400,9 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
         case RAM_SAVE_FLAG_EOS:
             /* normal exit */
             break;
+        case RAM_SAVE_FLAG_MULTIFD_SYNC:
+            ret = multifd_recv_sync_main(qemu_get_be64(f));
+            break;
         default:
             if (flags & RAM_SAVE_FLAG_HOOK) {
                 ram_control_load_hook(f, RAM_CONTROL_HOOK, NULL);
@@ -2591,5 +3437,6 @@ static SaveVMHandlers savevm_ram_handlers = {
 void ram_mig_init(void)
 {
     qemu_mutex_init(&XBZRLE.lock);
+    qemu_mutex_init(&ram_cow.lock);
     register_savevm_live(NULL, "ram", 0, 4, &savevm_ram_handlers, NULL);
 }
@@ -55,6 +55,35 @@ static SocketAddress *unix_build_address(const char *path)
 }
 
 
+/* Address of the current outgoing migration, used to open the
+ * additional channels for multifd.
+ */
+static SocketAddress *outgoing_saddr;
+
+QIOChannel *socket_send_channel_create(Error **errp)
+{
+    QIOChannelSocket *sioc;
+
+    if (!outgoing_saddr) {
+        error_setg(errp, "Multiple migration channels require a tcp: or "
+                   "unix: migration URI");
+        return NULL;
+    }
+
+    sioc = qio_channel_socket_new();
+    if (qio_channel_socket_connect_sync(sioc, outgoing_saddr, errp) < 0) {
+        object_unref(OBJECT(sioc));
+        return NULL;
+    }
+    return QIO_CHANNEL(sioc);
+}
+
+void socket_send_channel_reset(void)
+{
+    qapi_free_SocketAddress(outgoing_saddr);
+    outgoing_saddr = NULL;
+}
+
 struct SocketConnectData {
     MigrationState *s;
     char *hostname;
@@ -105,7 +134,8 @@ static void socket_start_outgoing_migration(MigrationState *s,
                                      socket_outgoing_migration,
                                      data,
                                      socket_connect_data_free);
-    qapi_free_SocketAddress(saddr);
+    qapi_free_SocketAddress(outgoing_saddr);
+    outgoing_saddr = saddr;
 }
 
 void tcp_start_outgoing_migration(MigrationState *s,
@@ -142,10 +172,20 @@ static gboolean socket_accept_incoming_migration(QIOChannel *ioc,
 
     trace_migration_socket_incoming_accepted();
 
-    migration_channel_process_incoming(migrate_get_current(),
-                                       QIO_CHANNEL(sioc));
+    if (migrate_use_multifd() && migration_incoming_get_current()) {
+        /* The main channel is always the first one to connect */
+        multifd_recv_new_channel(QIO_CHANNEL(sioc));
+    } else {
+        migration_channel_process_incoming(migrate_get_current(),
+                                           QIO_CHANNEL(sioc));
+    }
     object_unref(OBJECT(sioc));
 
+    if (migrate_use_multifd() && !multifd_recv_all_channels_created()) {
+        /* Keep listening for the remaining multifd channels */
+        return TRUE;
+    }
+
 out:
     /* Close listening socket as its no longer needed */
     qio_channel_close(ioc, NULL);
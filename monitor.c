@@ -3940,10 +3940,11 @@ static QDict *qmp_check_input_obj(QObject *input_obj, Error **errp)
     return input_dict;
 }
 
-static void handle_qmp_command(JSONMessageParser *parser, GQueue *tokens)
+static void handle_qmp_command(JSONMessageParser *parser, QObject *req,
+                               Error *err)
 {
     Error *local_err = NULL;
-    QObject *obj, *data;
+    QObject *obj = req, *data;
     QDict *input, *args;
     const mon_cmd_t *cmd;
     const char *cmd_name;
@@ -3952,9 +3953,9 @@ static void handle_qmp_command(JSONMessageParser *parser, GQueue *tokens)
     args = input = NULL;
     data = NULL;
 
-    obj = json_parser_parse(tokens, NULL);
     if (!obj) {
         // FIXME: should be triggered in json_parser_parse()
+        error_free(err);
         error_setg(&local_err, QERR_JSON_PARSING);
         goto err_out;
     }
@@ -4083,7 +4084,8 @@ static void monitor_qmp_event(void *opaque, int event)
         break;
     case CHR_EVENT_CLOSED:
         json_message_parser_destroy(&mon->qmp.parser);
-        json_message_parser_init(&mon->qmp.parser, handle_qmp_command);
+        json_message_parser_init(&mon->qmp.parser, handle_qmp_command,
+                                 NULL);
         mon_refcount--;
         monitor_fdsets_cleanup();
         break;
@@ -4210,7 +4212,8 @@ void monitor_init(CharDriverState *chr, int flags)
         qemu_chr_add_handlers(chr, monitor_can_read, monitor_qmp_read,
                               monitor_qmp_event, mon);
         qemu_chr_fe_set_echo(chr, true);
-        json_message_parser_init(&mon->qmp.parser, handle_qmp_command);
+        json_message_parser_init(&mon->qmp.parser, handle_qmp_command,
+                                 NULL);
     } else {
         qemu_chr_add_handlers(chr, monitor_can_read, monitor_read,
                               monitor_event, mon);
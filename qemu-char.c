@@ -41,6 +41,10 @@
 #include "io/channel-file.h"
 #include "io/channel-tls.h"
 #include "sysemu/replay.h"
+#include "qapi/util.h"
+#include "qemu/event_notifier.h"
+#include "qemu/main-loop.h"
+#include "qemu/shm-ring.h"
 
 #include <zlib.h>
 
@@ -56,6 +60,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/select.h>
+#include <sys/mman.h>
 #ifdef CONFIG_BSD
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
 #include <dev/ppbus/ppi.h>
@@ -167,7 +172,19 @@ static void qemu_chr_free_common(CharDriverState *chr);
 
 CharDriverState *qemu_chr_alloc(ChardevCommon *backend, Error **errp)
 {
-    CharDriverState *chr = g_malloc0(sizeof(CharDriverState));
+    CharDriverState *chr;
+
+    if (backend->has_txbuf_policy &&
+        backend->txbuf_policy >= CHARDEV_TXBUF_POLICY__MAX) {
+        error_setg(errp, "Invalid txbuf-policy");
+        return NULL;
+    }
+    if (backend->has_txbuf && backend->txbuf > INT_MAX) {
+        error_setg(errp, "txbuf size must not exceed %d bytes", INT_MAX);
+        return NULL;
+    }
+
+    chr = g_malloc0(sizeof(CharDriverState));
     qemu_mutex_init(&chr->chr_write_lock);
 
     if (backend->has_logfile) {
@@ -190,6 +207,13 @@ CharDriverState *qemu_chr_alloc(ChardevCommon *backend, Error **errp)
         chr->logfd = -1;
     }
 
+    if (backend->has_txbuf && backend->txbuf) {
+        chr->txbuf_size = backend->txbuf;
+        chr->txbuf = g_malloc(chr->txbuf_size);
+        chr->txbuf_policy = backend->has_txbuf_policy ?
+            backend->txbuf_policy : CHARDEV_TXBUF_POLICY_DROP_OLDEST;
+    }
+
     return chr;
 }
 
@@ -271,6 +295,194 @@ static int qemu_chr_fe_write_buffer(CharDriverState *s, const uint8_t *buf, int
     return res;
 }
 
+/*
+ * Transmit buffer
+ *
+ * Output that the backend does not accept right away is kept in a ring
+ * buffer and written from the main loop when the backend is ready for
+ * it, so that slow readers do not stall the guest.
+ */
+
+static void qemu_chr_txbuf_arm_locked(CharDriverState *s);
+
+/* How long the stall policy waits for the backend before dropping data */
+#define TXBUF_STALL_TIMEOUT_MS 1000
+
+/* Write as much buffered data as the backend accepts */
+static void qemu_chr_txbuf_flush_locked(CharDriverState *s)
+{
+    size_t n;
+    int ret;
+
+    while (s->txbuf_len) {
+        n = MIN(s->txbuf_len, s->txbuf_size - s->txbuf_head);
+        ret = s->chr_write(s, s->txbuf + s->txbuf_head, n);
+        if (ret <= 0) {
+            if (ret < 0 && errno != EAGAIN) {
+                /* Nobody is going to read it */
+                s->txbuf_len = 0;
+            }
+            break;
+        }
+        s->txbuf_head = (s->txbuf_head + ret) % s->txbuf_size;
+        s->txbuf_len -= ret;
+    }
+    if (!s->txbuf_len) {
+        s->txbuf_head = 0;
+    }
+}
+
+/* Append to the buffer, overwriting the oldest data if it overflows */
+static void qemu_chr_txbuf_push_locked(CharDriverState *s,
+                                       const uint8_t *buf, size_t len)
+{
+    size_t tail, n;
+
+    if (len > s->txbuf_size) {
+        buf += len - s->txbuf_size;
+        len = s->txbuf_size;
+    }
+    if (len > s->txbuf_size - s->txbuf_len) {
+        n = len - (s->txbuf_size - s->txbuf_len);
+        s->txbuf_head = (s->txbuf_head + n) % s->txbuf_size;
+        s->txbuf_len -= n;
+    }
+    while (len) {
+        tail = (s->txbuf_head + s->txbuf_len) % s->txbuf_size;
+        n = MIN(len, s->txbuf_size - tail);
+        memcpy(s->txbuf + tail, buf, n);
+        s->txbuf_len += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+/* Returns true if the buffer was full and has just been emptied */
+static bool qemu_chr_txbuf_drained_locked(CharDriverState *s)
+{
+    if (s->txbuf_full && !s->txbuf_len) {
+        atomic_set(&s->txbuf_full, false);
+        return true;
+    }
+    return false;
+}
+
+static gboolean qemu_chr_txbuf_watch(GIOChannel *chan, GIOCondition cond,
+                                     void *opaque)
+{
+    CharDriverState *s = opaque;
+    bool drained;
+
+    qemu_mutex_lock(&s->chr_write_lock);
+    s->txbuf_tag = 0;
+    qemu_chr_txbuf_flush_locked(s);
+    qemu_chr_txbuf_arm_locked(s);
+    drained = qemu_chr_txbuf_drained_locked(s);
+    qemu_mutex_unlock(&s->chr_write_lock);
+
+    if (drained && s->txbuf_handler) {
+        s->txbuf_handler(s->txbuf_opaque, false);
+    }
+    return FALSE;
+}
+
+static void qemu_chr_txbuf_arm_locked(CharDriverState *s)
+{
+    if (s->txbuf_len && !s->txbuf_tag) {
+        s->txbuf_tag = qemu_chr_fe_add_watch(s, G_IO_OUT | G_IO_HUP,
+                                             qemu_chr_txbuf_watch, s);
+    }
+}
+
+/*
+ * Write through the transmit buffer.  If @all is false, only accept what
+ * fits in the buffer, like a non-blocking write; otherwise apply the
+ * buffer's policy.  Returns the number of bytes consumed.
+ */
+static int qemu_chr_txbuf_write(CharDriverState *s, const uint8_t *buf,
+                                int len, bool all)
+{
+    int done = 0;
+    int ret;
+    bool full = false;
+    bool drained;
+    int64_t deadline;
+
+    qemu_mutex_lock(&s->chr_write_lock);
+    qemu_chr_txbuf_flush_locked(s);
+    if (!s->txbuf_len) {
+        ret = s->chr_write(s, buf, len);
+        if (ret > 0) {
+            done = ret;
+        } else if (ret < 0 && errno != EAGAIN) {
+            /* Nobody is going to read it */
+            done = len;
+        }
+    }
+    if (len - done > s->txbuf_size - s->txbuf_len) {
+        full = true;
+        if (!all) {
+            len = done + (s->txbuf_size - s->txbuf_len);
+        } else if (s->txbuf_policy == CHARDEV_TXBUF_POLICY_STALL) {
+            /* If the backend does not drain in time, fall back to
+             * dropping the oldest data.
+             */
+            deadline = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                       TXBUF_STALL_TIMEOUT_MS;
+            while (len - done > s->txbuf_size - s->txbuf_len &&
+                   qemu_clock_get_ms(QEMU_CLOCK_REALTIME) < deadline) {
+                g_usleep(100);
+                qemu_chr_txbuf_flush_locked(s);
+                if (!s->txbuf_len) {
+                    ret = s->chr_write(s, buf + done, len - done);
+                    if (ret > 0) {
+                        done += ret;
+                    } else if (ret < 0 && errno != EAGAIN) {
+                        done = len;
+                    }
+                }
+            }
+        }
+    }
+    qemu_chr_txbuf_push_locked(s, buf + done, len - done);
+    if (len > 0) {
+        qemu_chr_fe_write_log(s, buf, len);
+    }
+    qemu_chr_txbuf_arm_locked(s);
+
+    full |= s->txbuf_len == s->txbuf_size;
+    if (full && !s->txbuf_full) {
+        atomic_set(&s->txbuf_full, true);
+    } else {
+        full = false;
+    }
+    drained = qemu_chr_txbuf_drained_locked(s);
+    qemu_mutex_unlock(&s->chr_write_lock);
+
+    if (s->txbuf_handler && (full || drained)) {
+        s->txbuf_handler(s->txbuf_opaque, full);
+    }
+    return len;
+}
+
+bool qemu_chr_fe_set_txbuf_handler(CharDriverState *s,
+                                   IOTxbufHandler *fd_txbuf, void *opaque)
+{
+    if (!s->txbuf) {
+        return false;
+    }
+    qemu_mutex_lock(&s->chr_write_lock);
+    s->txbuf_handler = fd_txbuf;
+    s->txbuf_opaque = opaque;
+    qemu_mutex_unlock(&s->chr_write_lock);
+    return true;
+}
+
+bool qemu_chr_fe_txbuf_full(CharDriverState *s)
+{
+    return s->txbuf && atomic_read(&s->txbuf_full);
+}
+
 int qemu_chr_fe_write(CharDriverState *s, const uint8_t *buf, int len)
 {
     int ret;
@@ -283,6 +495,10 @@ int qemu_chr_fe_write(CharDriverState *s, const uint8_t *buf, int len)
         return ret;
     }
 
+    if (s->txbuf && !s->replay) {
+        return qemu_chr_txbuf_write(s, buf, len, false);
+    }
+
     qemu_mutex_lock(&s->chr_write_lock);
     ret = s->chr_write(s, buf, len);
 
@@ -311,6 +527,10 @@ int qemu_chr_fe_write_all(CharDriverState *s, const uint8_t *buf, int len)
         return res;
     }
 
+    if (s->txbuf && !s->replay) {
+        return qemu_chr_txbuf_write(s, buf, len, true);
+    }
+
     res = qemu_chr_fe_write_buffer(s, buf, len, &offset);
 
     if (s->replay && replay_mode == REPLAY_MODE_RECORD) {
@@ -3554,6 +3774,300 @@ char *qmp_ringbuf_read(const char *device, int64_t size,
     return data;
 }
 
+/*********************************************************/
+/* Shared memory chardev */
+
+#ifndef _WIN32
+
+#define HAVE_CHARDEV_SHM 1
+
+/*
+ * The data goes through the rings described in qemu/shm-ring.h.  A client
+ * connects to the unix socket and receives the segment and one notifier
+ * per direction as file descriptors; only one client is served at a time.
+ */
+typedef struct {
+    void *base;
+    size_t map_size;
+    int shm_fd;
+    ShmRingPort tx;                 /* to the client */
+    ShmRingPort rx;                 /* from the client */
+    EventNotifier tx_notifier;
+    EventNotifier rx_notifier;
+    QIOChannelSocket *listen_ioc;
+    guint listen_tag;
+    QIOChannel *ioc;
+    guint hup_tag;
+} ShmCharDriver;
+
+static gboolean shm_chr_accept(QIOChannel *channel, GIOCondition cond,
+                               void *opaque);
+
+/* Called with chr_write_lock held.  */
+static int shm_chr_write(CharDriverState *chr, const uint8_t *buf, int len)
+{
+    ShmCharDriver *d = chr->opaque;
+    bool notify;
+    size_t n;
+
+    if (!d->ioc) {
+        /* Nobody is listening, discard the data */
+        return len;
+    }
+
+    n = shm_ring_write(&d->tx, buf, len, &notify);
+    if (notify) {
+        event_notifier_set(&d->tx_notifier);
+    }
+    if (!n) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return n;
+}
+
+/* Pass data from the client to the front end, straight from the ring */
+static void shm_chr_pump(CharDriverState *chr)
+{
+    ShmCharDriver *d = chr->opaque;
+    const uint8_t *data;
+    size_t n;
+    int len;
+
+    while (d->ioc && (n = shm_ring_peek(&d->rx, &data)) > 0) {
+        len = qemu_chr_be_can_write(chr);
+        if (len <= 0) {
+            /* Resumed by shm_chr_accept_input() */
+            break;
+        }
+        n = MIN(n, len);
+        qemu_chr_be_write(chr, (uint8_t *)data, n);
+        shm_ring_consume(&d->rx, n);
+    }
+}
+
+static void shm_chr_read(void *opaque)
+{
+    CharDriverState *chr = opaque;
+    ShmCharDriver *d = chr->opaque;
+
+    event_notifier_test_and_clear(&d->rx_notifier);
+    shm_chr_pump(chr);
+}
+
+static void shm_chr_accept_input(CharDriverState *chr)
+{
+    shm_chr_pump(chr);
+}
+
+static void shm_chr_drop_client(CharDriverState *chr)
+{
+    ShmCharDriver *d = chr->opaque;
+
+    if (d->hup_tag) {
+        g_source_remove(d->hup_tag);
+        d->hup_tag = 0;
+    }
+    qemu_set_fd_handler(event_notifier_get_fd(&d->rx_notifier),
+                        NULL, NULL, NULL);
+    object_unref(OBJECT(d->ioc));
+    d->ioc = NULL;
+}
+
+/* The client is not expected to send anything, so this only sees EOF */
+static gboolean shm_chr_hup(QIOChannel *channel, GIOCondition cond,
+                            void *opaque)
+{
+    CharDriverState *chr = opaque;
+    ShmCharDriver *d = chr->opaque;
+    char buf[64];
+    ssize_t ret;
+
+    ret = qio_channel_read(channel, buf, sizeof(buf), NULL);
+    if (ret > 0 || ret == QIO_CHANNEL_ERR_BLOCK) {
+        return TRUE;
+    }
+
+    d->hup_tag = 0;
+    shm_chr_drop_client(chr);
+    d->listen_tag = qio_channel_add_watch(QIO_CHANNEL(d->listen_ioc),
+                                          G_IO_IN, shm_chr_accept, chr, NULL);
+    qemu_chr_be_event(chr, CHR_EVENT_CLOSED);
+    return FALSE;
+}
+
+static gboolean shm_chr_accept(QIOChannel *channel, GIOCondition cond,
+                               void *opaque)
+{
+    CharDriverState *chr = opaque;
+    ShmCharDriver *d = chr->opaque;
+    ShmRingHeader *hdr = d->base;
+    QIOChannelSocket *sioc;
+    uint32_t version = SHM_RING_VERSION;
+    struct iovec iov = { .iov_base = &version, .iov_len = sizeof(version) };
+    int fds[3];
+
+    sioc = qio_channel_socket_accept(QIO_CHANNEL_SOCKET(channel), NULL);
+    if (!sioc) {
+        return TRUE;
+    }
+
+    /* Start afresh, whatever the previous client left behind */
+    memset(hdr->rings, 0, sizeof(hdr->rings));
+    event_notifier_test_and_clear(&d->tx_notifier);
+    event_notifier_test_and_clear(&d->rx_notifier);
+
+    fds[0] = d->shm_fd;
+    fds[1] = d->tx_notifier.rfd;
+    fds[2] = d->rx_notifier.wfd;
+    if (qio_channel_writev_full(QIO_CHANNEL(sioc), &iov, 1,
+                                fds, ARRAY_SIZE(fds), NULL) != iov.iov_len) {
+        object_unref(OBJECT(sioc));
+        return TRUE;
+    }
+
+    d->ioc = QIO_CHANNEL(sioc);
+    d->hup_tag = qio_channel_add_watch(d->ioc, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                       shm_chr_hup, chr, NULL);
+    qemu_set_fd_handler(event_notifier_get_fd(&d->rx_notifier),
+                        shm_chr_read, NULL, chr);
+    d->listen_tag = 0;
+    qemu_chr_be_generic_open(chr);
+    return FALSE;
+}
+
+static void shm_chr_close(CharDriverState *chr)
+{
+    ShmCharDriver *d = chr->opaque;
+
+    if (d->ioc) {
+        shm_chr_drop_client(chr);
+    }
+    if (d->listen_tag) {
+        g_source_remove(d->listen_tag);
+    }
+    object_unref(OBJECT(d->listen_ioc));
+    munmap(d->base, d->map_size);
+    close(d->shm_fd);
+    event_notifier_cleanup(&d->rx_notifier);
+    event_notifier_cleanup(&d->tx_notifier);
+    g_free(d);
+    chr->opaque = NULL;
+    qemu_chr_be_event(chr, CHR_EVENT_CLOSED);
+}
+
+static CharDriverState *qemu_chr_open_shm(const char *id,
+                                          ChardevBackend *backend,
+                                          ChardevReturn *ret,
+                                          Error **errp)
+{
+    ChardevShm *opts = backend->u.shm.data;
+    ChardevCommon *common = qapi_ChardevShm_base(opts);
+    CharDriverState *chr;
+    ShmCharDriver *d;
+    ShmRingHeader *hdr;
+    SocketAddress *addr;
+    uint32_t data_offset;
+    int64_t size = opts->has_size ? opts->size : 65536;
+    char *name;
+    int err;
+
+    /* The size must be power of 2 */
+    if (size <= 0 || size > (1 << 30) || (size & (size - 1))) {
+        error_setg(errp, "size of shm chardev must be power of two, "
+                   "at most 1G");
+        return NULL;
+    }
+
+    chr = qemu_chr_alloc(common, errp);
+    if (!chr) {
+        return NULL;
+    }
+    d = g_new0(ShmCharDriver, 1);
+
+    err = event_notifier_init(&d->tx_notifier, 0);
+    if (err < 0) {
+        error_setg_errno(errp, -err, "chardev: shm: cannot create notifier");
+        goto fail;
+    }
+    err = event_notifier_init(&d->rx_notifier, 0);
+    if (err < 0) {
+        error_setg_errno(errp, -err, "chardev: shm: cannot create notifier");
+        goto fail_tx;
+    }
+
+    name = g_strdup_printf("/qemu-chr-%d-%s", getpid(), id);
+    d->shm_fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (d->shm_fd < 0) {
+        error_setg_errno(errp, errno, "chardev: shm: cannot create %s", name);
+        g_free(name);
+        goto fail_rx;
+    }
+    /* Clients get the segment by file descriptor only */
+    shm_unlink(name);
+    g_free(name);
+
+    data_offset = ROUND_UP(sizeof(ShmRingHeader), getpagesize());
+    d->map_size = data_offset + SHM_RING_COUNT * size;
+    if (ftruncate(d->shm_fd, d->map_size) < 0) {
+        error_setg_errno(errp, errno, "chardev: shm: cannot resize segment");
+        goto fail_fd;
+    }
+    d->base = mmap(NULL, d->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   d->shm_fd, 0);
+    if (d->base == MAP_FAILED) {
+        error_setg_errno(errp, errno, "chardev: shm: cannot map segment");
+        goto fail_fd;
+    }
+
+    hdr = d->base;
+    hdr->magic = SHM_RING_MAGIC;
+    hdr->version = SHM_RING_VERSION;
+    hdr->ring_size = size;
+    hdr->data_offset = data_offset;
+    shm_ring_port_init(&d->tx, d->base, size, data_offset,
+                       SHM_RING_TO_CLIENT);
+    shm_ring_port_init(&d->rx, d->base, size, data_offset,
+                       SHM_RING_FROM_CLIENT);
+
+    addr = g_new0(SocketAddress, 1);
+    addr->type = SOCKET_ADDRESS_KIND_UNIX;
+    addr->u.q_unix.data = g_new0(UnixSocketAddress, 1);
+    addr->u.q_unix.data->path = g_strdup(opts->path);
+    d->listen_ioc = qio_channel_socket_new();
+    err = qio_channel_socket_listen_sync(d->listen_ioc, addr, errp);
+    qapi_free_SocketAddress(addr);
+    if (err < 0) {
+        goto fail_map;
+    }
+    d->listen_tag = qio_channel_add_watch(QIO_CHANNEL(d->listen_ioc),
+                                          G_IO_IN, shm_chr_accept, chr, NULL);
+
+    chr->opaque = d;
+    chr->chr_write = shm_chr_write;
+    chr->chr_accept_input = shm_chr_accept_input;
+    chr->chr_close = shm_chr_close;
+    chr->explicit_be_open = true;
+
+    return chr;
+
+fail_map:
+    object_unref(OBJECT(d->listen_ioc));
+    munmap(d->base, d->map_size);
+fail_fd:
+    close(d->shm_fd);
+fail_rx:
+    event_notifier_cleanup(&d->rx_notifier);
+fail_tx:
+    event_notifier_cleanup(&d->tx_notifier);
+fail:
+    g_free(d);
+    qemu_chr_free_common(chr);
+    return NULL;
+}
+
+#endif /* !_WIN32 */
+
 QemuOpts *qemu_chr_parse_compat(const char *label, const char *filename)
 {
     char host[65], port[33], width[8], height[8];
@@ -3699,12 +4213,27 @@ fail:
 void qemu_chr_parse_common(QemuOpts *opts, ChardevCommon *backend)
 {
     const char *logfile = qemu_opt_get(opts, "logfile");
+    const char *policy;
 
     backend->has_logfile = logfile != NULL;
     backend->logfile = logfile ? g_strdup(logfile) : NULL;
 
     backend->has_logappend = true;
     backend->logappend = qemu_opt_get_bool(opts, "logappend", false);
+
+    backend->has_txbuf = qemu_opt_get(opts, "txbuf") != NULL;
+    backend->txbuf = qemu_opt_get_size(opts, "txbuf", 0);
+
+    /* An invalid policy is reported by qemu_chr_alloc() */
+    policy = qemu_opt_get(opts, "txbuf-policy");
+    backend->has_txbuf_policy = policy != NULL;
+    if (policy) {
+        backend->txbuf_policy = qapi_enum_parse(ChardevTxbufPolicy_lookup,
+                                                policy,
+                                                CHARDEV_TXBUF_POLICY__MAX,
+                                                CHARDEV_TXBUF_POLICY__MAX,
+                                                NULL);
+    }
 }
 
 
@@ -3802,6 +4331,30 @@ static void qemu_chr_parse_ringbuf(QemuOpts *opts, ChardevBackend *backend,
     }
 }
 
+#ifdef HAVE_CHARDEV_SHM
+static void qemu_chr_parse_shm(QemuOpts *opts, ChardevBackend *backend,
+                               Error **errp)
+{
+    const char *path = qemu_opt_get(opts, "path");
+    ChardevShm *shm;
+    uint64_t val;
+
+    if (path == NULL) {
+        error_setg(errp, "chardev: shm: no socket path given");
+        return;
+    }
+    shm = backend->u.shm.data = g_new0(ChardevShm, 1);
+    qemu_chr_parse_common(opts, qapi_ChardevShm_base(shm));
+    shm->path = g_strdup(path);
+
+    val = qemu_opt_get_size(opts, "size", 0);
+    if (val != 0) {
+        shm->has_size = true;
+        shm->size = val;
+    }
+}
+#endif
+
 static void qemu_chr_parse_mux(QemuOpts *opts, ChardevBackend *backend,
                                Error **errp)
 {
@@ -4188,12 +4741,16 @@ static void qemu_chr_free_common(CharDriverState *chr)
     if (chr->logfd != -1) {
         close(chr->logfd);
     }
+    g_free(chr->txbuf);
     qemu_mutex_destroy(&chr->chr_write_lock);
     g_free(chr);
 }
 
 void qemu_chr_free(CharDriverState *chr)
 {
+    if (chr->txbuf_tag) {
+        g_source_remove(chr->txbuf_tag);
+    }
     if (chr->chr_close) {
         chr->chr_close(chr);
     }
@@ -4345,6 +4902,12 @@ QemuOptsList qemu_chardev_opts = {
         },{
             .name = "logappend",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "txbuf",
+            .type = QEMU_OPT_SIZE,
+        },{
+            .name = "txbuf-policy",
+            .type = QEMU_OPT_STRING,
         },
         { /* end of list */ }
     },
@@ -4741,6 +5304,10 @@ static void register_types(void)
                          qmp_chardev_open_udp);
     register_char_driver("ringbuf", CHARDEV_BACKEND_KIND_RINGBUF,
                          qemu_chr_parse_ringbuf, qemu_chr_open_ringbuf);
+#ifdef HAVE_CHARDEV_SHM
+    register_char_driver("shm", CHARDEV_BACKEND_KIND_SHM,
+                         qemu_chr_parse_shm, qemu_chr_open_shm);
+#endif
     register_char_driver("file", CHARDEV_BACKEND_KIND_FILE,
                          qemu_chr_parse_file_out, qmp_chardev_open_file);
     register_char_driver("stdio", CHARDEV_BACKEND_KIND_STDIO,
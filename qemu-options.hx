@@ -2171,6 +2171,8 @@ DEF("chardev", HAS_ARG, QEMU_OPTION_chardev,
     "-chardev serial,id=id,path=path[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
 #else
     "-chardev pty,id=id[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
+    "-chardev shm,id=id,path=path[,size=size][,mux=on|off][,logfile=PATH]\n"
+    "         [,logappend=on|off]\n"
     "-chardev stdio,id=id[,mux=on|off][,signal=on|off][,logfile=PATH][,logappend=on|off]\n"
 #endif
 #ifdef CONFIG_BRLAPI
@@ -2202,6 +2204,7 @@ Backend is one of:
 @option{msmouse},
 @option{vc},
 @option{ringbuf},
+@option{shm},
 @option{file},
 @option{pipe},
 @option{console},
@@ -2269,6 +2272,17 @@ to a file to record all data transmitted via the backend. The @option{logappend}
 option controls whether the log file will be truncated or appended to when
 opened.
 
+Every backend also supports the @option{txbuf=@var{size}} option, which
+buffers up to @var{size} bytes of output that the backend cannot accept
+immediately, for instance because the program reading a pty is slow.  The
+buffer is emptied in the background, so that the emulated device does not
+stall the guest while it waits.  @option{txbuf-policy=drop-oldest}, the
+default, discards the oldest data when the buffer is full;
+@option{txbuf-policy=stall} waits for the backend instead, for up to one
+second.  Devices that
+model a transmit FIFO can use the buffer state to signal flow control to
+the guest.
+
 Further options to each backend are described below.
 
 @item -chardev null ,id=@var{id}
@@ -2370,6 +2384,18 @@ console with the given dimensions.
 Create a ring buffer with fixed size @option{size}.
 @var{size} must be a power of two, and defaults to @code{64K}).
 
+@item -chardev shm ,id=@var{id} ,path=@var{path} [,size=@var{size}]
+
+Exchange data with a host program through two lock-free rings, one per
+direction, in a POSIX shared memory segment.  The program connects to the
+unix socket @option{path} and receives the segment and two notification
+descriptors; it is only woken up when data arrives in an empty ring.
+@var{size} is the size of each ring, must be a power of two, and defaults
+to @code{64K}.  Only one client is served at a time.  The layout of the
+segment is described in @file{include/qemu/shm-ring.h}, and a client
+library is provided in @file{contrib/shm-client}.  Not available on
+Windows hosts.
+
 @item -chardev file ,id=@var{id} ,path=@var{path}
 
 Log all traffic received from the guest to a file.
@@ -211,9 +211,19 @@ bool qemu_clock_expired(QEMUClockType type)
 
 int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
 {
+    int64_t slack;
+
+    return timerlist_deadline_slack_ns(timer_list, &slack);
+}
+
+int64_t timerlist_deadline_slack_ns(QEMUTimerList *timer_list,
+                                    int64_t *slack)
+{
+    QEMUTimer *ts;
     int64_t delta;
-    int64_t expire_time;
+    int64_t expire_time, latest;
 
+    *slack = 0;
     if (!timer_list->clock->enabled) {
         return -1;
     }
@@ -227,9 +237,17 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
         qemu_mutex_unlock(&timer_list->active_timers_lock);
         return -1;
     }
-    expire_time = timer_list->active_timers->expire_time;
+    ts = timer_list->active_timers;
+    expire_time = ts->expire_time;
+    latest = expire_time + ts->slack;
+
+    /* A later timer whose slack runs out first also bounds the wakeup */
+    for (ts = ts->next; ts && ts->expire_time < latest; ts = ts->next) {
+        latest = MIN(latest, ts->expire_time + ts->slack);
+    }
     qemu_mutex_unlock(&timer_list->active_timers_lock);
 
+    *slack = latest - expire_time;
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
 
     if (delta <= 0) {
@@ -338,9 +356,15 @@ void timer_init_tl(QEMUTimer *ts,
     ts->cb = cb;
     ts->opaque = opaque;
     ts->scale = scale;
+    ts->slack = 0;
     ts->expire_time = -1;
 }
 
+void timer_set_slack(QEMUTimer *ts, int64_t slack)
+{
+    ts->slack = slack * ts->scale;
+}
+
 void timer_deinit(QEMUTimer *ts)
 {
     assert(ts->expire_time == -1);
@@ -568,14 +592,28 @@ bool timerlistgroup_run_timers(QEMUTimerListGroup *tlg)
 
 int64_t timerlistgroup_deadline_ns(QEMUTimerListGroup *tlg)
 {
-    int64_t deadline = -1;
+    int64_t slack;
+
+    return timerlistgroup_deadline_slack_ns(tlg, &slack);
+}
+
+int64_t timerlistgroup_deadline_slack_ns(QEMUTimerListGroup *tlg,
+                                         int64_t *slack)
+{
+    int64_t deadline = -1, latest = -1;
+    int64_t tl_deadline, tl_slack;
     QEMUClockType type;
     bool play = replay_mode == REPLAY_MODE_PLAY;
     for (type = 0; type < QEMU_CLOCK_MAX; type++) {
         if (qemu_clock_use_for_deadline(type)) {
             if (!play || type == QEMU_CLOCK_REALTIME) {
-                deadline = qemu_soonest_timeout(deadline,
-                                                timerlist_deadline_ns(tlg->tl[type]));
+                tl_deadline = timerlist_deadline_slack_ns(tlg->tl[type],
+                                                          &tl_slack);
+                if (tl_deadline == -1) {
+                    continue;
+                }
+                deadline = qemu_soonest_timeout(deadline, tl_deadline);
+                latest = qemu_soonest_timeout(latest, tl_deadline + tl_slack);
             } else {
                 /* Read clock from the replay file and
                    do not calculate the deadline, based on virtual clock. */
@@ -583,6 +621,7 @@ int64_t timerlistgroup_deadline_ns(QEMUTimerListGroup *tlg)
             }
         }
     }
+    *slack = deadline == -1 ? 0 : latest - deadline;
     return deadline;
 }
 
@@ -566,17 +566,17 @@ static void process_command(GAState *s, QDict *req)
 }
 
 /* handle requests/control events coming in over the channel */
-static void process_event(JSONMessageParser *parser, GQueue *tokens)
+static void process_event(JSONMessageParser *parser, QObject *json,
+                          Error *err)
 {
     GAState *s = container_of(parser, GAState, parser);
     QDict *qdict;
-    Error *err = NULL;
     int ret;
 
     g_assert(s && parser);
 
     g_debug("process_event: called");
-    qdict = qobject_to_qdict(json_parser_parse_err(tokens, NULL, &err));
+    qdict = qobject_to_qdict(json);
     if (err || !qdict) {
         QDECREF(qdict);
         qdict = qdict_new();
@@ -1281,7 +1281,7 @@ static int run_agent(GAState *s, GAConfig *config)
     s->command_state = ga_command_state_new();
     ga_command_state_init(s, s->command_state);
     ga_command_state_init_all(s->command_state);
-    json_message_parser_init(&s->parser, process_event);
+    json_message_parser_init(&s->parser, process_event, NULL);
     ga_state = s;
 #ifndef _WIN32
     if (!register_signal_handlers()) {
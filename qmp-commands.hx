@@ -469,6 +469,72 @@ Example:
                             "filename": "/tmp/physical-mem-dump" } }
 <- { "return": {} }
 
+EQMP
+
+    {
+        .name       = "memory-read",
+        .args_type  = "ranges:q,physical:b?,cpu-index:i?,fdname:s?,offset:l?",
+        .mhandler.cmd_new = qmp_marshal_memory_read,
+    },
+
+SQMP
+memory-read
+-----------
+
+Read ranges of guest RAM or ROM without stopping the guest.
+
+Arguments:
+
+- "ranges": list of ranges, each with "addr" and "size" (json-array)
+- "physical": whether the addresses are physical, default true (json-bool,
+  optional)
+- "cpu-index": virtual CPU translating virtual addresses (json-int, optional)
+- "fdname": file descriptor received with "getfd"; the data is written there
+  instead of being returned, and the descriptor is closed (json-string,
+  optional)
+- "offset": file offset of the data, default 0 (json-int, optional)
+
+Example:
+
+-> { "execute": "memory-read",
+             "arguments": { "ranges": [ { "addr": 536870912, "size": 4 },
+                                        { "addr": 536871936, "size": 2 } ] } }
+<- { "return": [ { "addr": 536870912, "size": 4, "data": "AAAAIA==" },
+                 { "addr": 536871936, "size": 2, "data": "eFY=" } ] }
+
+EQMP
+
+    {
+        .name       = "memory-write",
+        .args_type  = "ranges:q,physical:b?,cpu-index:i?,fdname:s?,offset:l?",
+        .mhandler.cmd_new = qmp_marshal_memory_write,
+    },
+
+SQMP
+memory-write
+------------
+
+Write ranges of guest RAM without stopping the guest.  Nothing is written
+unless all the ranges are valid.
+
+Arguments:
+
+- "ranges": list of ranges, each with "addr" and either "data" in base64
+  or, with "fdname", "size" (json-array)
+- "physical": whether the addresses are physical, default true (json-bool,
+  optional)
+- "cpu-index": virtual CPU translating virtual addresses (json-int, optional)
+- "fdname": file descriptor received with "getfd" to read the data from; the
+  descriptor is closed (json-string, optional)
+- "offset": file offset of the data, default 0 (json-int, optional)
+
+Example:
+
+-> { "execute": "memory-write",
+             "arguments": { "ranges": [ { "addr": 536870912,
+                                          "data": "AAAAIA==" } ] } }
+<- { "return": {} }
+
 EQMP
 
     {
@@ -3723,6 +3789,9 @@ Enable/Disable migration capabilities
 - "compress": use multiple compression threads to accelerate live migration
 - "events": generate events for each migration state change
 - "postcopy-ram": postcopy mode for live migration
+- "x-multifd": send RAM pages over multiple connections
+- "background-snapshot": save RAM while the VM runs, as of the start of
+                         the migration
 
 Arguments:
 
@@ -3753,6 +3822,8 @@ Query current migration capabilities
          - "compress": Multiple compression threads state (json-bool)
          - "events": Migration state change event state (json-bool)
          - "postcopy-ram": postcopy ram state (json-bool)
+         - "x-multifd": multiple connections state (json-bool)
+         - "background-snapshot": background snapshot state (json-bool)
 
 Arguments:
 
@@ -3766,7 +3837,9 @@ Example:
      {"state": false, "capability": "zero-blocks"},
      {"state": false, "capability": "compress"},
      {"state": true, "capability": "events"},
-     {"state": false, "capability": "postcopy-ram"}
+     {"state": false, "capability": "postcopy-ram"},
+     {"state": false, "capability": "x-multifd"},
+     {"state": false, "capability": "background-snapshot"}
    ]}
 
 EQMP
@@ -3790,6 +3863,8 @@ Set migration parameters
                           throttled for auto-converge (json-int)
 - "cpu-throttle-increment": set throttle increasing percentage for
                             auto-converge (json-int)
+- "x-multifd-channels": set number of additional connections used by
+                        x-multifd (json-int)
 
 Arguments:
 
@@ -3803,7 +3878,7 @@ EQMP
     {
         .name       = "migrate-set-parameters",
         .args_type  =
-            "compress-level:i?,compress-threads:i?,decompress-threads:i?,cpu-throttle-initial:i?,cpu-throttle-increment:i?",
+            "compress-level:i?,compress-threads:i?,decompress-threads:i?,cpu-throttle-initial:i?,cpu-throttle-increment:i?,x-multifd-channels:i?",
         .mhandler.cmd_new = qmp_marshal_migrate_set_parameters,
     },
 SQMP
@@ -3820,6 +3895,8 @@ Query current migration parameters
                                     throttled (json-int)
          - "cpu-throttle-increment" : throttle increasing percentage for
                                       auto-converge (json-int)
+         - "x-multifd-channels" : number of additional connections used
+                                  by x-multifd (json-int)
 
 Arguments:
 
@@ -3832,7 +3909,8 @@ Example:
          "cpu-throttle-increment": 10,
          "compress-threads": 8,
          "compress-level": 1,
-         "cpu-throttle-initial": 20
+         "cpu-throttle-initial": 20,
+         "x-multifd-channels": 2
       }
    }
 
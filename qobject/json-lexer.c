@@ -13,8 +13,13 @@
 
 #include "qemu/osdep.h"
 #include "qemu-common.h"
+#include "qemu/host-utils.h"
 #include "qapi/qmp/json-lexer.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define MAX_TOKEN_SIZE (64ULL << 20)
 
 /*
@@ -286,6 +291,18 @@ void json_lexer_init(JSONLexer *lexer, JSONLexerEmitter func)
     lexer->x = lexer->y = 0;
 }
 
+/* Do not let a single token grow to an arbitrarily large size,
+ * this is a security consideration.
+ */
+static void json_lexer_check_token_size(JSONLexer *lexer)
+{
+    if (lexer->token->len > MAX_TOKEN_SIZE) {
+        lexer->emit(lexer, lexer->token, lexer->state, lexer->x, lexer->y);
+        g_string_truncate(lexer->token, 0);
+        lexer->state = IN_START;
+    }
+}
+
 static int json_lexer_feed_char(JSONLexer *lexer, char ch, bool flush)
 {
     int char_consumed, new_state;
@@ -347,16 +364,51 @@ static int json_lexer_feed_char(JSONLexer *lexer, char ch, bool flush)
         lexer->state = new_state;
     } while (!char_consumed && !flush);
 
-    /* Do not let a single token grow to an arbitrarily large size,
-     * this is a security consideration.
-     */
-    if (lexer->token->len > MAX_TOKEN_SIZE) {
-        lexer->emit(lexer, lexer->token, lexer->state, lexer->x, lexer->y);
-        g_string_truncate(lexer->token, 0);
-        lexer->state = IN_START;
+    json_lexer_check_token_size(lexer);
+    return 0;
+}
+
+/*
+ * Return the length of the run of plain characters at the start of
+ * @buf, inside a string delimited by @quote.  Plain characters are the
+ * ASCII ones other than NUL, newline, backslash and the quote: they
+ * leave the state machine in the string state, so they can be appended
+ * to the token in bulk.  Everything else, including the UTF-8 sequences
+ * that the table validates, goes through json_lexer_feed_char().
+ */
+static size_t json_lexer_string_run(const char *buf, size_t size, char quote)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i vquote = _mm_set1_epi8(quote);
+    const __m128i vbslash = _mm_set1_epi8('\\');
+    const __m128i vnl = _mm_set1_epi8('\n');
+    const __m128i vzero = _mm_setzero_si128();
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i stop = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, vquote),
+                                                 _mm_cmpeq_epi8(v, vbslash)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(v, vnl),
+                                                 _mm_cmpeq_epi8(v, vzero)));
+        /* Bytes with the top bit set are not ASCII.  */
+        int mask = _mm_movemask_epi8(_mm_or_si128(stop, v));
+
+        if (mask) {
+            return i + ctz32(mask);
+        }
     }
+#endif
 
-    return 0;
+    for (; i < size; i++) {
+        uint8_t ch = buf[i];
+
+        if (ch == 0 || ch >= 0x80 || ch == '\n' || ch == '\\' || ch == quote) {
+            break;
+        }
+    }
+    return i;
 }
 
 int json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
@@ -366,6 +418,21 @@ int json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
     for (i = 0; i < size; i++) {
         int err;
 
+        if (lexer->state == IN_DQ_STRING || lexer->state == IN_SQ_STRING) {
+            char quote = lexer->state == IN_DQ_STRING ? '"' : '\'';
+            size_t run = json_lexer_string_run(buffer + i, size - i, quote);
+
+            if (run) {
+                g_string_append_len(lexer->token, buffer + i, run);
+                lexer->x += run;
+                i += run;
+                json_lexer_check_token_size(lexer);
+                if (i == size) {
+                    break;
+                }
+            }
+        }
+
         err = json_lexer_feed_char(lexer, buffer[i], false);
         if (err < 0) {
             return err;
@@ -22,8 +22,9 @@
 typedef struct JSONParserContext
 {
     Error *err;
-    JSONToken *current;
-    GQueue *buf;
+    JSONToken *tokens;
+    size_t nb_tokens;
+    size_t pos;
 } JSONParserContext;
 
 #define BUG_ON(cond) assert(!(cond))
@@ -204,12 +205,10 @@ static QString *qstring_from_escaped_str(JSONParserContext *ctxt,
                 goto out;
             }
         } else {
-            char dummy[2];
+            size_t len = strcspn(ptr, double_quote ? "\"\\" : "'\\");
 
-            dummy[0] = *ptr++;
-            dummy[1] = 0;
-
-            qstring_append(str, dummy);
+            qstring_append_len(str, ptr, len);
+            ptr += len;
         }
     }
 
@@ -220,49 +219,20 @@ out:
     return NULL;
 }
 
-/* Note: the token object returned by parser_context_peek_token or
- * parser_context_pop_token is deleted as soon as parser_context_pop_token
- * is called again.
- */
 static JSONToken *parser_context_pop_token(JSONParserContext *ctxt)
 {
-    g_free(ctxt->current);
-    assert(!g_queue_is_empty(ctxt->buf));
-    ctxt->current = g_queue_pop_head(ctxt->buf);
-    return ctxt->current;
-}
-
-static JSONToken *parser_context_peek_token(JSONParserContext *ctxt)
-{
-    assert(!g_queue_is_empty(ctxt->buf));
-    return g_queue_peek_head(ctxt->buf);
-}
-
-static JSONParserContext *parser_context_new(GQueue *tokens)
-{
-    JSONParserContext *ctxt;
-
-    if (!tokens) {
+    if (ctxt->pos == ctxt->nb_tokens) {
         return NULL;
     }
-
-    ctxt = g_malloc0(sizeof(JSONParserContext));
-    ctxt->buf = tokens;
-
-    return ctxt;
+    return &ctxt->tokens[ctxt->pos++];
 }
 
-/* to support error propagation, ctxt->err must be freed separately */
-static void parser_context_free(JSONParserContext *ctxt)
+static JSONToken *parser_context_peek_token(JSONParserContext *ctxt)
 {
-    if (ctxt) {
-        while (!g_queue_is_empty(ctxt->buf)) {
-            parser_context_pop_token(ctxt);
-        }
-        g_free(ctxt->current);
-        g_queue_free(ctxt->buf);
-        g_free(ctxt);
+    if (ctxt->pos == ctxt->nb_tokens) {
+        return NULL;
     }
+    return &ctxt->tokens[ctxt->pos];
 }
 
 /**
@@ -551,25 +521,18 @@ static QObject *parse_value(JSONParserContext *ctxt, va_list *ap)
     }
 }
 
-QObject *json_parser_parse(GQueue *tokens, va_list *ap)
+QObject *json_parser_parse(JSONToken *tokens, size_t nb_tokens,
+                           va_list *ap, Error **errp)
 {
-    return json_parser_parse_err(tokens, ap, NULL);
-}
-
-QObject *json_parser_parse_err(GQueue *tokens, va_list *ap, Error **errp)
-{
-    JSONParserContext *ctxt = parser_context_new(tokens);
+    JSONParserContext ctxt = {
+        .tokens = tokens,
+        .nb_tokens = nb_tokens,
+    };
     QObject *result;
 
-    if (!ctxt) {
-        return NULL;
-    }
-
-    result = parse_value(ctxt, ap);
-
-    error_propagate(errp, ctxt->err);
+    result = parse_value(&ctxt, ap);
 
-    parser_context_free(ctxt);
+    error_propagate(errp, ctxt.err);
 
     return result;
 }
@@ -38,8 +38,12 @@ typedef	uint32_t tcp_seq;
 #define      PR_SLOWHZ       2               /* 2 slow timeouts per second (approx) */
 #define      PR_FASTHZ       5               /* 5 fast timeouts per second (not important) */
 
-#define TCP_SNDSPACE 8192
-#define TCP_RCVSPACE 8192
+/*
+ * Large enough for a fast host connection to fill the pipe; windows above
+ * 64K are only advertised when the peer agrees to window scaling.
+ */
+#define TCP_SNDSPACE (128 * 1024)
+#define TCP_RCVSPACE (128 * 1024)
 
 /*
  * TCP header.
@@ -254,6 +254,13 @@ tcp_input(struct mbuf *m, int iphlen, struct socket *inso, unsigned short af)
 		tiwin = ti->ti_win;
 		tiflags = ti->ti_flags;
 
+		/* The options of the SYN are still in the saved mbuf */
+		off = ti->ti_off << 2;
+		if (off > sizeof (struct tcphdr)) {
+		  optlen = off - sizeof (struct tcphdr);
+		  optp = (caddr_t)(ti + 1);
+		}
+
 		goto cont_conn;
 	}
 	slirp = m->slirp;
@@ -475,7 +482,13 @@ findso:
 	if (tp->t_state == TCPS_CLOSED)
 		goto drop;
 
-	tiwin = ti->ti_win;
+	/*
+	 * The window in a SYN is never scaled.
+	 */
+	if (tiflags & TH_SYN)
+		tiwin = ti->ti_win;
+	else
+		tiwin = (u_long)ti->ti_win << tp->snd_scale;
 
 	/*
 	 * Segment received on connection.
@@ -805,6 +818,13 @@ findso:
 			soisfconnected(so);
 			tp->t_state = TCPS_ESTABLISHED;
 
+			/* Do window scaling on this connection? */
+			if ((tp->t_flags & (TF_RCVD_SCALE|TF_REQ_SCALE)) ==
+				(TF_RCVD_SCALE|TF_REQ_SCALE)) {
+				tp->snd_scale = tp->requested_s_scale;
+				tp->rcv_scale = tp->request_r_scale;
+			}
+
 			(void) tcp_reass(tp, (struct tcpiphdr *)0,
 				(struct mbuf *)0);
 			/*
@@ -984,6 +1004,13 @@ trimthenstep6:
 		    SEQ_GT(ti->ti_ack, tp->snd_max))
 			goto dropwithreset;
 		tp->t_state = TCPS_ESTABLISHED;
+
+		/* Do window scaling? */
+		if ((tp->t_flags & (TF_RCVD_SCALE|TF_REQ_SCALE)) ==
+			(TF_RCVD_SCALE|TF_REQ_SCALE)) {
+			tp->snd_scale = tp->requested_s_scale;
+			tp->rcv_scale = tp->request_r_scale;
+		}
 		/*
 		 * The sent SYN is ack'ed with our sequence number +1
 		 * The first data byte already in the buffer will get
@@ -1439,6 +1466,15 @@ tcp_dooptions(struct tcpcb *tp, u_char *cp, int cnt, struct tcpiphdr *ti)
 			NTOHS(mss);
 			(void) tcp_mss(tp, mss);	/* sets t_maxseg */
 			break;
+
+		case TCPOPT_WINDOW:
+			if (optlen != TCPOLEN_WINDOW)
+				continue;
+			if (!(ti->ti_flags & TH_SYN))
+				continue;
+			tp->t_flags |= TF_RCVD_SCALE;
+			tp->requested_s_scale = min(cp[2], TCP_MAX_WINSHIFT);
+			break;
 		}
 	}
 }
@@ -42,8 +42,8 @@
 #include "slirp.h"
 
 /* patchable/settable parameters for tcp */
-/* Don't do rfc1323 performance enhancements */
-#define TCP_DO_RFC1323 0
+/* Do rfc1323 window scaling, but not timestamps */
+#define TCP_DO_RFC1323 1
 
 /*
  * Tcp initialization
@@ -255,7 +255,7 @@ tcp_newtcpcb(struct socket *so)
 	tp->seg_next = tp->seg_prev = (struct tcpiphdr*)tp;
 	tp->t_maxseg = (so->so_ffamily == AF_INET) ? TCP_MSS : TCP6_MSS;
 
-	tp->t_flags = TCP_DO_RFC1323 ? (TF_REQ_SCALE|TF_REQ_TSTMP) : 0;
+	tp->t_flags = TCP_DO_RFC1323 ? TF_REQ_SCALE : 0;
 	tp->t_socket = so;
 
 	/*
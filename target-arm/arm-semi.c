@@ -679,21 +679,9 @@ target_ulong do_arm_semihosting(CPUARMState *env)
             if (cortexm_graphic_board_is_graphic_context_initialised(
                     board_graphic_context)) {
 
-#pragma GCC diagnostic push
-#if defined(__clang__)
-#pragma clang diagnostic ignored "-Wint-to-void-pointer-cast"
-#endif
-#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
-                cortexm_graphic_push_event(GRAPHIC_EVENT_EXIT, (void*) ret,
-                        NULL);
-#pragma GCC diagnostic pop
-
-                // Unlock the I/O loop, to process the graphic event.
+                // The atexit() handler waits for the graphic event loop
+                // to quit; unlock the I/O loop, which may be running it.
                 qemu_mutex_unlock_iothread();
-                while (1) {
-                    sleep(1);
-                    fprintf(stderr, "*");
-                }
             }
         }
 
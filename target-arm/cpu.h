@@ -97,6 +97,11 @@
  */
 #define TARGET_INSN_START_EXTRA_WORDS 2
 
+/* The translator keeps no state outside tcg_ctx and DisasContext that is
+ * shared between threads, so user-mode threads may translate concurrently.
+ */
+#define TARGET_PARALLEL_TRANSLATE 1
+
 /* The 2nd extra word holding syndrome info for data aborts does not use
  * the upper 6 bits nor the lower 14 bits. We mask and shift it down to
  * help the sleb128 encoder do a better job.
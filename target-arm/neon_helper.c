@@ -11,6 +11,7 @@
 #include "cpu.h"
 #include "exec/exec-all.h"
 #include "exec/helper-proto.h"
+#include "crypto/arm-ce.h"
 
 #define SIGNBIT (uint32_t)0x80000000
 #define SIGNBIT64 ((uint64_t)1 << 63)
@@ -2217,26 +2218,9 @@ void HELPER(neon_zip16)(CPUARMState *env, uint32_t rd, uint32_t rm)
  */
 uint64_t HELPER(neon_pmull_64_lo)(uint64_t op1, uint64_t op2)
 {
-    int bitnum;
-    uint64_t res = 0;
-
-    for (bitnum = 0; bitnum < 64; bitnum++) {
-        if (op1 & (1ULL << bitnum)) {
-            res ^= op2 << bitnum;
-        }
-    }
-    return res;
+    return arm_ce_pmull_64_lo(op1, op2);
 }
 uint64_t HELPER(neon_pmull_64_hi)(uint64_t op1, uint64_t op2)
 {
-    int bitnum;
-    uint64_t res = 0;
-
-    /* bit 0 of op1 can't influence the high 64 bits at all */
-    for (bitnum = 1; bitnum < 64; bitnum++) {
-        if (op1 & (1ULL << bitnum)) {
-            res ^= op2 >> (64 - bitnum);
-        }
-    }
-    return res;
+    return arm_ce_pmull_64_hi(op1, op2);
 }
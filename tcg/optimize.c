@@ -40,8 +40,9 @@ struct tcg_temp_info {
     tcg_target_ulong mask;
 };
 
-static struct tcg_temp_info temps[TCG_MAX_TEMPS];
-static TCGTempSet temps_used;
+/* Per thread, as several threads may optimize their TBs concurrently.  */
+static __thread struct tcg_temp_info temps[TCG_MAX_TEMPS];
+static __thread TCGTempSet temps_used;
 
 static inline bool temp_is_const(TCGArg arg)
 {
@@ -242,7 +242,7 @@ static void tcg_out_label(TCGContext *s, TCGLabel *l, tcg_insn_unit *ptr)
 
 TCGLabel *gen_new_label(void)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     TCGLabel *l = tcg_malloc(sizeof(TCGLabel));
 
     *l = (TCGLabel){
@@ -422,6 +422,48 @@ void tcg_prologue_init(TCGContext *s)
 #endif
 }
 
+/* Give the calling thread a context of its own, copied from @s, so that
+   it can generate code concurrently with the other threads.  @s must be
+   initialized, including the prologue, and not in use during the copy.  */
+void tcg_register_thread(TCGContext *s)
+{
+    TCGContext *n = g_new(TCGContext, 1);
+    int i;
+
+    memcpy(n, s, sizeof(*n));
+    n->pool_cur = n->pool_end = NULL;
+    n->pool_first = n->pool_current = n->pool_first_large = NULL;
+
+    /* Relink the pointers between the temps.  */
+    for (i = 0; i < n->nb_globals; i++) {
+        if (s->temps[i].mem_base) {
+            n->temps[i].mem_base = &n->temps[s->temps[i].mem_base - s->temps];
+        }
+    }
+    if (s->frame_temp) {
+        n->frame_temp = &n->temps[s->frame_temp - s->temps];
+    }
+    tcg_ctx = n;
+}
+
+/* Free the context of a thread that is about to exit.  */
+void tcg_unregister_thread(void)
+{
+    TCGContext *s = tcg_ctx;
+    TCGPool *p, *t;
+
+    if (s == &tcg_init_ctx) {
+        return;
+    }
+    tcg_pool_reset(s);
+    for (p = s->pool_first; p; p = t) {
+        t = p->next;
+        g_free(p);
+    }
+    tcg_ctx = &tcg_init_ctx;
+    g_free(s);
+}
+
 void tcg_func_start(TCGContext *s)
 {
     tcg_pool_reset(s);
@@ -497,7 +539,7 @@ void tcg_set_frame(TCGContext *s, TCGReg reg, intptr_t start, intptr_t size)
 
 TCGv_i32 tcg_global_reg_new_i32(TCGReg reg, const char *name)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     int idx;
 
     if (tcg_regset_test_reg(s->reserved_regs, reg)) {
@@ -509,7 +551,7 @@ TCGv_i32 tcg_global_reg_new_i32(TCGReg reg, const char *name)
 
 TCGv_i64 tcg_global_reg_new_i64(TCGReg reg, const char *name)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     int idx;
 
     if (tcg_regset_test_reg(s->reserved_regs, reg)) {
@@ -522,7 +564,7 @@ TCGv_i64 tcg_global_reg_new_i64(TCGReg reg, const char *name)
 int tcg_global_mem_new_internal(TCGType type, TCGv_ptr base,
                                 intptr_t offset, const char *name)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     TCGTemp *base_ts = &s->temps[GET_TCGV_PTR(base)];
     TCGTemp *ts = tcg_global_alloc(s);
     int indirect_reg = 0, bigendian = 0;
@@ -577,7 +619,7 @@ int tcg_global_mem_new_internal(TCGType type, TCGv_ptr base,
 
 static int tcg_temp_new_internal(TCGType type, int temp_local)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     TCGTemp *ts;
     int idx, k;
 
@@ -639,7 +681,7 @@ TCGv_i64 tcg_temp_new_internal_i64(int temp_local)
 
 static void tcg_temp_free_internal(int idx)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     TCGTemp *ts;
     int k;
 
@@ -704,13 +746,13 @@ TCGv_i64 tcg_const_local_i64(int64_t val)
 #if defined(CONFIG_DEBUG_TCG)
 void tcg_clear_temp_count(void)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     s->temps_in_use = 0;
 }
 
 int tcg_check_temp_count(void)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     if (s->temps_in_use) {
         /* Clear the count so that we don't give another
          * warning immediately next time around.
@@ -2693,7 +2735,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 #ifdef CONFIG_PROFILER
 void tcg_dump_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    TCGContext *s = &tcg_ctx;
+    TCGContext *s = tcg_ctx;
     int64_t tb_count = s->tb_count;
     int64_t tb_div_count = tb_count ? tb_count : 1;
     int64_t tot = s->interm_time + s->code_time;
@@ -12,8 +12,10 @@
  */
 #include "qemu/osdep.h"
 
+#include "qapi/error.h"
 #include "qapi/qmp/types.h"
 #include "qapi/qmp/qjson.h"
+#include "qapi/qmp/json-streamer.h"
 #include "qemu-common.h"
 
 static void escaped_string(void)
@@ -1502,6 +1504,107 @@ static void limits_nesting(void)
     g_assert(obj == NULL);
 }
 
+typedef struct StreamState {
+    JSONMessageParser parser;
+    int count;
+    int errors;
+    QDict *last;
+} StreamState;
+
+static void stream_emit(JSONMessageParser *parser, QObject *json, Error *err)
+{
+    StreamState *s = container_of(parser, StreamState, parser);
+
+    s->count++;
+    if (!json) {
+        s->errors++;
+        error_free(err);
+        return;
+    }
+    QDECREF(s->last);
+    s->last = qobject_to_qdict(json);
+    g_assert(s->last);
+}
+
+static const char stream_commands[] =
+    "{ \"execute\": \"qom-get\", \"arguments\": "
+    "{ \"path\": \"/machine/mcu/stm32/RCC\", \"property\": \"cr\" },"
+    " \"id\": 1 }\n"
+    "{ \"execute\": \"query-status\" }\n"
+    "{ 'execute': 'memsave', 'arguments': { 'val': 536870912, 'size': 64,"
+    " 'filename': '/tmp/caf\\u00e9 \\\\ \xc3\xa9 \\'q\\'' } }\n";
+
+/*
+ * Feed the same stream whole and in every chunk size up to 32 bytes, so
+ * that the string fast path is cut at every possible position.
+ */
+static void stream_split(void)
+{
+    size_t len = strlen(stream_commands);
+    size_t n, chunk, i;
+    StreamState s;
+
+    for (n = 1; n <= 33; n++) {
+        chunk = n <= 32 ? n : len;
+        memset(&s, 0, sizeof(s));
+        json_message_parser_init(&s.parser, stream_emit, NULL);
+        for (i = 0; i < len; i += chunk) {
+            json_message_parser_feed(&s.parser, stream_commands + i,
+                                     MIN(chunk, len - i));
+        }
+        json_message_parser_flush(&s.parser);
+        json_message_parser_destroy(&s.parser);
+
+        g_assert_cmpint(s.count, ==, 3);
+        g_assert_cmpint(s.errors, ==, 0);
+        g_assert_cmpstr(qdict_get_str(s.last, "execute"), ==, "memsave");
+        g_assert_cmpstr(qdict_get_str(qdict_get_qdict(s.last, "arguments"),
+                                      "filename"),
+                        ==, "/tmp/caf\xc3\xa9 \\ \xc3\xa9 'q'");
+        QDECREF(s.last);
+    }
+}
+
+/* A bad message must not swallow the ones that follow.  */
+static void stream_recover(void)
+{
+    static const char input[] = "{ \"a\": 1 \xff }{ \"c\": 1 }";
+    StreamState s;
+
+    memset(&s, 0, sizeof(s));
+    json_message_parser_init(&s.parser, stream_emit, NULL);
+    json_message_parser_feed(&s.parser, input, strlen(input));
+    json_message_parser_flush(&s.parser);
+    json_message_parser_destroy(&s.parser);
+
+    g_assert_cmpint(s.errors, >=, 1);
+    g_assert(s.last && qdict_get_int(s.last, "c") == 1);
+    QDECREF(s.last);
+}
+
+/* Rate at which a monitor could parse commands arriving back to back.  */
+static void perf_stream(void)
+{
+    size_t len = strlen(stream_commands);
+    int n, count = 100000;
+    double elapsed;
+    StreamState s;
+
+    memset(&s, 0, sizeof(s));
+    json_message_parser_init(&s.parser, stream_emit, NULL);
+    g_test_timer_start();
+    for (n = 0; n < count; n++) {
+        json_message_parser_feed(&s.parser, stream_commands, len);
+    }
+    elapsed = g_test_timer_elapsed();
+    json_message_parser_destroy(&s.parser);
+    QDECREF(s.last);
+
+    g_assert_cmpint(s.count, ==, 3 * count);
+    g_test_message("%.0f commands/s, %.1f MB/s", s.count / elapsed,
+                   count * len / elapsed / 1e6);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1539,5 +1642,11 @@ int main(int argc, char **argv)
     g_test_add_func("/errors/unterminated/literal", unterminated_literal);
     g_test_add_func("/errors/limits/nesting", limits_nesting);
 
+    g_test_add_func("/stream/split", stream_split);
+    g_test_add_func("/stream/recover", stream_recover);
+    if (g_test_perf()) {
+        g_test_add_func("/stream/perf", perf_stream);
+    }
+
     return g_test_run();
 }
@@ -0,0 +1,92 @@
+/*
+ * QTest testcase for the memory-read and memory-write QMP commands
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/types.h"
+
+/* RAM and PL011 UART of the ARM virt board */
+#define RAM_BASE  0x40000000
+#define UART_BASE 0x09000000
+
+static void test_read(void)
+{
+    QDict *resp;
+    QList *ranges;
+    QDict *range;
+
+    writel(RAM_BASE + 0x100, 0x20000000);
+    writew(RAM_BASE + 0x400, 0x5678);
+
+    resp = qmp("{ 'execute': 'memory-read', 'arguments': { 'ranges': ["
+               " { 'addr': %" PRId64 ", 'size': 4 },"
+               " { 'addr': %" PRId64 ", 'size': 2 },"
+               " { 'addr': %" PRId64 ", 'size': 0 } ] } }",
+               (int64_t)RAM_BASE + 0x100, (int64_t)RAM_BASE + 0x400,
+               (int64_t)RAM_BASE);
+    g_assert(qdict_haskey(resp, "return"));
+    ranges = qdict_get_qlist(resp, "return");
+    g_assert_cmpint(qlist_size(ranges), ==, 3);
+
+    range = qobject_to_qdict(qlist_peek(ranges));
+    g_assert_cmpint(qdict_get_int(range, "addr"), ==, RAM_BASE + 0x100);
+    g_assert_cmpint(qdict_get_int(range, "size"), ==, 4);
+    g_assert_cmpstr(qdict_get_str(range, "data"), ==, "AAAAIA==");
+    QDECREF(resp);
+
+    /* Device registers are not read */
+    resp = qmp("{ 'execute': 'memory-read', 'arguments': { 'ranges': ["
+               " { 'addr': %d, 'size': 4 } ] } }", UART_BASE);
+    g_assert(qdict_haskey(resp, "error"));
+    QDECREF(resp);
+}
+
+static void test_write(void)
+{
+    QDict *resp;
+
+    resp = qmp("{ 'execute': 'memory-write', 'arguments': { 'ranges': ["
+               " { 'addr': %" PRId64 ", 'data': 'AAAAIA==' },"
+               " { 'addr': %" PRId64 ", 'data': 'eFY=' } ] } }",
+               (int64_t)RAM_BASE + 0x200, (int64_t)RAM_BASE + 0x800);
+    g_assert(qdict_haskey(resp, "return"));
+    QDECREF(resp);
+
+    g_assert_cmphex(readl(RAM_BASE + 0x200), ==, 0x20000000);
+    g_assert_cmphex(readw(RAM_BASE + 0x800), ==, 0x5678);
+
+    /* A bad range makes the whole command fail without writing */
+    resp = qmp("{ 'execute': 'memory-write', 'arguments': { 'ranges': ["
+               " { 'addr': %" PRId64 ", 'data': 'AQIDBA==' },"
+               " { 'addr': %d, 'data': 'AQIDBA==' } ] } }",
+               (int64_t)RAM_BASE + 0x200, UART_BASE);
+    g_assert(qdict_haskey(resp, "error"));
+    QDECREF(resp);
+    g_assert_cmphex(readl(RAM_BASE + 0x200), ==, 0x20000000);
+
+    resp = qmp("{ 'execute': 'memory-write', 'arguments': { 'ranges': ["
+               " { 'addr': %" PRId64 ", 'data': '!!' } ] } }",
+               (int64_t)RAM_BASE);
+    g_assert(qdict_haskey(resp, "error"));
+    QDECREF(resp);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/memory-rw/read", test_read);
+    qtest_add_func("/memory-rw/write", test_write);
+
+    qtest_start("-machine virt");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
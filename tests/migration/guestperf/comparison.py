@@ -121,4 +121,18 @@ COMPARISONS = [
         Scenario("compr-xbzrle-cache-50",
                  compression_xbzrle=True, compression_xbzrle_cache=50),
     ]),
+
+
+    # Looking at effect of multiple migration connections with
+    # varying numbers of channels
+    Comparison("multifd", scenarios = [
+        Scenario("multifd-channels-1",
+                 multifd=True, multifd_channels=1),
+        Scenario("multifd-channels-2",
+                 multifd=True, multifd_channels=2),
+        Scenario("multifd-channels-4",
+                 multifd=True, multifd_channels=4),
+        Scenario("multifd-channels-8",
+                 multifd=True, multifd_channels=8),
+    ]),
 ]
@@ -558,13 +558,22 @@ class Plot(object):
     <th>XBZRLE compression cache:</th>
     <td>%d%% of RAM</td>
   </tr>
+  <tr>
+    <th>Multifd:</th>
+    <td>%s</td>
+  </tr>
+  <tr>
+    <th>Multifd channels:</th>
+    <td>%d</td>
+  </tr>
 """ % (scenario._downtime, scenario._bandwidth,
        scenario._max_iters, scenario._max_time,
        "yes" if scenario._pause else "no", scenario._pause_iters,
        "yes" if scenario._post_copy else "no", scenario._post_copy_iters,
        "yes" if scenario._auto_converge else "no", scenario._auto_converge_step,
        "yes" if scenario._compression_mt else "no", scenario._compression_mt_threads,
-       "yes" if scenario._compression_xbzrle else "no", scenario._compression_xbzrle_cache))
+       "yes" if scenario._compression_xbzrle else "no", scenario._compression_xbzrle_cache,
+       "yes" if scenario._multifd else "no", scenario._multifd_channels))
 
             pieces.append("""
 </table>
@@ -504,6 +504,61 @@ static void test_timer_schedule(void)
     timer_del(&data.timer);
 }
 
+static void dummy_timer_cb(void *opaque)
+{
+}
+
+static void test_timer_slack(void)
+{
+    QEMUTimer a, b, c;
+    int64_t now_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    int64_t deadline, slack;
+
+    aio_timer_init(ctx, &a, QEMU_CLOCK_REALTIME, SCALE_MS,
+                   dummy_timer_cb, NULL);
+    aio_timer_init(ctx, &b, QEMU_CLOCK_REALTIME, SCALE_MS,
+                   dummy_timer_cb, NULL);
+    aio_timer_init(ctx, &c, QEMU_CLOCK_REALTIME, SCALE_MS,
+                   dummy_timer_cb, NULL);
+    timer_set_slack(&a, 20);
+    timer_set_slack(&c, 50);
+
+    timer_mod(&a, now_ms + 1000);
+    deadline = timerlistgroup_deadline_slack_ns(&ctx->tlg, &slack);
+    g_assert_cmpint(deadline, >, 0);
+    g_assert_cmpint(deadline, <=, 1000 * SCALE_MS);
+    g_assert_cmpint(slack, ==, 20 * SCALE_MS);
+
+    /* An exact timer within the slack of a shortens it */
+    timer_mod(&b, now_ms + 1010);
+    deadline = timerlistgroup_deadline_slack_ns(&ctx->tlg, &slack);
+    g_assert_cmpint(deadline, <=, 1000 * SCALE_MS);
+    g_assert_cmpint(slack, ==, 10 * SCALE_MS);
+
+    /* One expiring after that does not matter */
+    timer_mod(&c, now_ms + 1015);
+    timerlistgroup_deadline_slack_ns(&ctx->tlg, &slack);
+    g_assert_cmpint(slack, ==, 10 * SCALE_MS);
+
+    timer_del(&b);
+    timerlistgroup_deadline_slack_ns(&ctx->tlg, &slack);
+    g_assert_cmpint(slack, ==, 20 * SCALE_MS);
+
+    /* Without slack the deadline is exact */
+    timer_del(&a);
+    timer_del(&c);
+    timer_set_slack(&a, 0);
+    timer_mod(&a, now_ms + 1000);
+    deadline = timerlistgroup_deadline_slack_ns(&ctx->tlg, &slack);
+    g_assert_cmpint(deadline, >, 0);
+    g_assert_cmpint(slack, ==, 0);
+
+    timer_del(&a);
+    deadline = timerlistgroup_deadline_slack_ns(&ctx->tlg, &slack);
+    g_assert_cmpint(deadline, ==, -1);
+    g_assert_cmpint(slack, ==, 0);
+}
+
 /* Now the same tests, using the context as a GSource.  They are
  * very similar to the ones above, with g_main_context_iteration
  * replacing aio_poll.  However:
@@ -857,6 +912,7 @@ int main(int argc, char **argv)
     g_test_add_func("/aio/event/flush",             test_flush_event_notifier);
     g_test_add_func("/aio/external-client",         test_aio_external_client);
     g_test_add_func("/aio/timer/schedule",          test_timer_schedule);
+    g_test_add_func("/aio/timer/slack",             test_timer_slack);
 
     g_test_add_func("/aio-gsource/flush",                   test_source_flush);
     g_test_add_func("/aio-gsource/bh/schedule",             test_source_bh_schedule);
@@ -8,6 +8,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/bitops.h"
+#include "qemu/bitmap.h"
 
 typedef struct {
     uint32_t value;
@@ -133,6 +134,52 @@ static void test_half_unshuffle64(void)
     }
 }
 
+/*
+ * Sparse bitmaps, with zero runs longer and shorter than what
+ * find_next_bit() skips with buffer_is_zero().
+ */
+static void test_find_next_bit(void)
+{
+    const unsigned long nbits = 64 * 1024;
+    static const unsigned long steps[] = { 1, 63, 65, 257, 4093, 4096, 20000 };
+    unsigned long *map = bitmap_new(nbits);
+    unsigned long *bits = g_new(unsigned long, nbits);
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(steps); i++) {
+        unsigned long bit, found, n = 0;
+        unsigned long j;
+
+        bitmap_zero(map, nbits);
+        for (bit = steps[i] / 2; bit < nbits; bit += steps[i]) {
+            set_bit(bit, map);
+            bits[n++] = bit;
+        }
+
+        found = find_next_bit(map, nbits, 0);
+        for (j = 0; j < n; j++) {
+            unsigned long run = j ? bits[j - 1] + 1 : 0;
+
+            g_assert_cmpint(found, ==, bits[j]);
+            /* Also start the search in the middle of the zero run. */
+            g_assert_cmpint(find_next_bit(map, nbits, (run + found) / 2), ==,
+                            found);
+            found = find_next_bit(map, nbits, found + 1);
+        }
+        g_assert_cmpint(found, ==, nbits);
+
+        /* The size bounds the search, even inside a run of zeroes. */
+        g_assert_cmpint(find_next_bit(map, bits[0], 0), ==, bits[0]);
+        if (n > 1) {
+            g_assert_cmpint(find_next_bit(map, bits[1], bits[0] + 1), ==,
+                            bits[1]);
+        }
+    }
+
+    g_free(bits);
+    g_free(map);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -142,5 +189,6 @@ int main(int argc, char **argv)
     g_test_add_func("/bitops/half_shuffle64", test_half_shuffle64);
     g_test_add_func("/bitops/half_unshuffle32", test_half_unshuffle32);
     g_test_add_func("/bitops/half_unshuffle64", test_half_unshuffle64);
+    g_test_add_func("/bitops/find_next_bit", test_find_next_bit);
     return g_test_run();
 }
@@ -0,0 +1,103 @@
+/*
+ * QEMU buffer_is_zero test
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+
+static char buffer[8 * 1024 * 1024];
+
+static void test_1(void)
+{
+    size_t s, a, o;
+
+    /* Basic positive test.  */
+    g_assert(buffer_is_zero(buffer, sizeof(buffer)));
+
+    /* Basic negative test.  */
+    buffer[sizeof(buffer) - 1] = 1;
+    g_assert(!buffer_is_zero(buffer, sizeof(buffer)));
+    buffer[sizeof(buffer) - 1] = 0;
+
+    /* Positive tests for size and alignment.  */
+    for (a = 1; a <= 64; a++) {
+        for (s = 1; s < 1024; s++) {
+            buffer[a - 1] = 1;
+            buffer[a + s] = 1;
+            g_assert(buffer_is_zero(buffer + a, s));
+            buffer[a - 1] = 0;
+            buffer[a + s] = 0;
+        }
+    }
+
+    /* Negative tests for size, alignment, and the offset of the marker.  */
+    for (a = 1; a <= 64; a++) {
+        for (s = 1; s < 1024; s++) {
+            for (o = 0; o < s; ++o) {
+                buffer[a + o] = 1;
+                g_assert(!buffer_is_zero(buffer + a, s));
+                buffer[a + o] = 0;
+            }
+        }
+    }
+}
+
+/* Run the tests with each implementation the host can run. */
+static void test_2(void)
+{
+    do {
+        test_1();
+    } while (test_buffer_is_zero_next_accel());
+}
+
+/*
+ * Throughput on a zero buffer (the worst case, which is the usual one
+ * for migration and convert), for several sizes and alignments.
+ */
+static void perf_zero(void)
+{
+    static const size_t sizes[] = { 64, 256, 4096, 64 * 1024, 1024 * 1024 };
+    static const size_t aligns[] = { 0, 1, 8, 32 };
+    int level = 0;
+    size_t i, j;
+
+    do {
+        for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+            for (j = 0; j < ARRAY_SIZE(aligns); j++) {
+                size_t len = sizes[i];
+                size_t count = MAX(sizeof(buffer) / len, 64) * 16;
+                const char *p = buffer + aligns[j];
+                size_t n;
+                double elapsed;
+
+                g_test_timer_start();
+                for (n = 0; n < count; n++) {
+                    g_assert(buffer_is_zero(p, len));
+                }
+                elapsed = g_test_timer_elapsed();
+
+                g_test_message("level %d size %7zu align %2zu: %8.1f MB/s",
+                               level, len, aligns[j],
+                               count * len / elapsed / 1e6);
+            }
+        }
+        level++;
+    } while (test_buffer_is_zero_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    /* Both walk through the implementations, which cannot be rewound. */
+    if (g_test_perf()) {
+        g_test_add_func("/cutils/bufferiszero/perf", perf_zero);
+    } else {
+        g_test_add_func("/cutils/bufferiszero", test_2);
+    }
+
+    return g_test_run();
+}
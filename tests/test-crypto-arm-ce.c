@@ -0,0 +1,334 @@
+/*
+ * QEMU ARMv8 Crypto Extensions data path
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "qemu/osdep.h"
+
+#include "crypto/aes.h"
+#include "crypto/arm-ce.h"
+
+/*
+ * The arm_ce_*() functions may run on the host crypto instructions;
+ * they must give the same results as the portable versions for any
+ * input, and these must compute AES and SHA-256 when chained the way
+ * guests do.
+ */
+
+#define RANDOM_ITERATIONS 100000
+
+static uint32_t get_word(const ArmCEState *st, int i)
+{
+    return st->l[i / 2] >> (32 * (i % 2));
+}
+
+static void set_word(ArmCEState *st, int i, uint32_t w)
+{
+    int shift = 32 * (i % 2);
+
+    st->l[i / 2] &= ~(0xffffffffULL << shift);
+    st->l[i / 2] |= (uint64_t)w << shift;
+}
+
+static uint8_t get_byte(const ArmCEState *st, int i)
+{
+    return st->l[i / 8] >> (8 * (i % 8));
+}
+
+static void set_byte(ArmCEState *st, int i, uint8_t b)
+{
+    int shift = 8 * (i % 8);
+
+    st->l[i / 8] &= ~(0xffULL << shift);
+    st->l[i / 8] |= (uint64_t)b << shift;
+}
+
+static uint64_t random_u64(void)
+{
+    return ((uint64_t)g_test_rand_int() << 32) | (uint32_t)g_test_rand_int();
+}
+
+static ArmCEState random_state(void)
+{
+    ArmCEState st = { .l = { random_u64(), random_u64() } };
+
+    return st;
+}
+
+static void assert_state_equal(const ArmCEState *a, const ArmCEState *b)
+{
+    g_assert_cmphex(a->l[0], ==, b->l[0]);
+    g_assert_cmphex(a->l[1], ==, b->l[1]);
+}
+
+static void test_aes_random(void)
+{
+    int i, decrypt;
+
+    for (i = 0; i < RANDOM_ITERATIONS; i++) {
+        ArmCEState st = random_state();
+        ArmCEState rk = random_state();
+
+        for (decrypt = 0; decrypt < 2; decrypt++) {
+            ArmCEState a = st, b = st;
+
+            arm_ce_aese(&a, &rk, decrypt);
+            arm_ce_aese_generic(&b, &rk, decrypt);
+            assert_state_equal(&a, &b);
+
+            a = b = st;
+            arm_ce_aesmc(&a, decrypt);
+            arm_ce_aesmc_generic(&b, decrypt);
+            assert_state_equal(&a, &b);
+        }
+    }
+}
+
+static void test_sha1_random(void)
+{
+    int i, op;
+
+    for (i = 0; i < RANDOM_ITERATIONS; i++) {
+        ArmCEState d = random_state();
+        ArmCEState n = random_state();
+        ArmCEState m = random_state();
+        ArmCEState a, b;
+
+        for (op = 0; op < 4; op++) {
+            a = b = d;
+            arm_ce_sha1_3reg(&a, &n, &m, op);
+            arm_ce_sha1_3reg_generic(&b, &n, &m, op);
+            assert_state_equal(&a, &b);
+        }
+
+        a = b = d;
+        arm_ce_sha1su1(&a, &m);
+        arm_ce_sha1su1_generic(&b, &m);
+        assert_state_equal(&a, &b);
+    }
+}
+
+static void test_sha256_random(void)
+{
+    int i;
+
+    for (i = 0; i < RANDOM_ITERATIONS; i++) {
+        ArmCEState d = random_state();
+        ArmCEState n = random_state();
+        ArmCEState m = random_state();
+        ArmCEState a, b;
+
+        a = b = d;
+        arm_ce_sha256h(&a, &n, &m);
+        arm_ce_sha256h_generic(&b, &n, &m);
+        assert_state_equal(&a, &b);
+
+        a = b = d;
+        arm_ce_sha256h2(&a, &n, &m);
+        arm_ce_sha256h2_generic(&b, &n, &m);
+        assert_state_equal(&a, &b);
+
+        a = b = d;
+        arm_ce_sha256su0(&a, &m);
+        arm_ce_sha256su0_generic(&b, &m);
+        assert_state_equal(&a, &b);
+
+        a = b = d;
+        arm_ce_sha256su1(&a, &n, &m);
+        arm_ce_sha256su1_generic(&b, &n, &m);
+        assert_state_equal(&a, &b);
+    }
+}
+
+static void test_pmull_random(void)
+{
+    int i;
+
+    g_assert_cmphex(arm_ce_pmull_64_lo(3, 3), ==, 5);
+    g_assert_cmphex(arm_ce_pmull_64_hi(3, 3), ==, 0);
+    g_assert_cmphex(arm_ce_pmull_64_lo(1ULL << 63, 6), ==, 0);
+    g_assert_cmphex(arm_ce_pmull_64_hi(1ULL << 63, 6), ==, 3);
+
+    for (i = 0; i < RANDOM_ITERATIONS; i++) {
+        uint64_t op1 = random_u64();
+        uint64_t op2 = random_u64();
+
+        g_assert_cmphex(arm_ce_pmull_64_lo(op1, op2), ==,
+                        arm_ce_pmull_64_lo_generic(op1, op2));
+        g_assert_cmphex(arm_ce_pmull_64_hi(op1, op2), ==,
+                        arm_ce_pmull_64_hi_generic(op1, op2));
+    }
+}
+
+/* FIPS-197, appendix C.1 */
+static const uint8_t aes_key[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+static const uint8_t aes_plain[16] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+};
+static const uint8_t aes_cipher[16] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a,
+};
+
+static ArmCEState load_bytes(const uint8_t *bytes)
+{
+    ArmCEState st = { .l = { 0, 0 } };
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        set_byte(&st, i, bytes[i]);
+    }
+    return st;
+}
+
+static ArmCEState round_key(const AES_KEY *key, int round)
+{
+    ArmCEState rk = { .l = { 0, 0 } };
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        set_byte(&rk, i, key->rd_key[4 * round + i / 4] >> (24 - 8 * (i % 4)));
+    }
+    return rk;
+}
+
+/*
+ * AESE/AESMC and AESD/AESIMC chained as an AES-128 block operation,
+ * with the round keys of the table based implementation.
+ */
+static void test_aes_block(void)
+{
+    AES_KEY key;
+    ArmCEState st, rk;
+    int round, i;
+
+    g_assert(AES_set_encrypt_key(aes_key, 128, &key) == 0);
+    st = load_bytes(aes_plain);
+    for (round = 0; round < key.rounds; round++) {
+        rk = round_key(&key, round);
+        arm_ce_aese(&st, &rk, false);
+        if (round < key.rounds - 1) {
+            arm_ce_aesmc(&st, false);
+        }
+    }
+    rk = round_key(&key, key.rounds);
+    for (i = 0; i < 16; i++) {
+        g_assert_cmphex(get_byte(&st, i) ^ get_byte(&rk, i), ==,
+                        aes_cipher[i]);
+    }
+
+    g_assert(AES_set_decrypt_key(aes_key, 128, &key) == 0);
+    st = load_bytes(aes_cipher);
+    for (round = 0; round < key.rounds; round++) {
+        rk = round_key(&key, round);
+        arm_ce_aese(&st, &rk, true);
+        if (round < key.rounds - 1) {
+            arm_ce_aesmc(&st, true);
+        }
+    }
+    rk = round_key(&key, key.rounds);
+    for (i = 0; i < 16; i++) {
+        g_assert_cmphex(get_byte(&st, i) ^ get_byte(&rk, i), ==,
+                        aes_plain[i]);
+    }
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/*
+ * SHA-256 of "abc", one block compressed with SHA256H/SHA256H2 and
+ * scheduled with SHA256SU0/SHA256SU1, as the Linux arm64 driver does.
+ */
+static void test_sha256_block(void)
+{
+    static const uint32_t h0[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    static const uint32_t digest[8] = {
+        0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+        0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad,
+    };
+    ArmCEState w[4], abcd, efgh, abcd0, wk;
+    int i, j;
+
+    memset(w, 0, sizeof(w));
+    memset(&abcd, 0, sizeof(abcd));
+    memset(&efgh, 0, sizeof(efgh));
+    memset(&wk, 0, sizeof(wk));
+    set_word(&w[0], 0, 0x61626380);
+    set_word(&w[3], 3, 24);
+
+    for (i = 0; i < 4; i++) {
+        set_word(&abcd, i, h0[i]);
+        set_word(&efgh, i, h0[4 + i]);
+    }
+
+    for (i = 0; i < 16; i++) {
+        ArmCEState *x = &w[i % 4];
+
+        if (i >= 4) {
+            /* w[i % 4] holds the words 16 positions before */
+            arm_ce_sha256su0(x, &w[(i + 1) % 4]);
+            arm_ce_sha256su1(x, &w[(i + 2) % 4], &w[(i + 3) % 4]);
+        }
+        for (j = 0; j < 4; j++) {
+            set_word(&wk, j, get_word(x, j) + sha256_k[4 * i + j]);
+        }
+
+        abcd0 = abcd;
+        arm_ce_sha256h(&abcd, &efgh, &wk);
+        arm_ce_sha256h2(&efgh, &abcd0, &wk);
+    }
+
+    for (i = 0; i < 4; i++) {
+        g_assert_cmphex(get_word(&abcd, i) + h0[i], ==, digest[i]);
+        g_assert_cmphex(get_word(&efgh, i) + h0[4 + i], ==, digest[4 + i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/crypto/arm-ce/aes/random", test_aes_random);
+    g_test_add_func("/crypto/arm-ce/aes/block", test_aes_block);
+    g_test_add_func("/crypto/arm-ce/sha1/random", test_sha1_random);
+    g_test_add_func("/crypto/arm-ce/sha256/random", test_sha256_random);
+    g_test_add_func("/crypto/arm-ce/sha256/block", test_sha256_block);
+    g_test_add_func("/crypto/arm-ce/pmull/random", test_pmull_random);
+    return g_test_run();
+}
@@ -0,0 +1,168 @@
+/*
+ * Interval tree tests
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/interval-tree.h"
+
+#define N 2000
+
+static IntervalTreeRoot root;
+static IntervalTreeNode nodes[N];
+static bool inserted[N];
+
+/* Check the ordering, heap, parent and subtree_last invariants.  */
+static uint64_t check_subtree(IntervalTreeNode *node, IntervalTreeNode *parent,
+                              uint64_t min_start, uint64_t max_start)
+{
+    uint64_t last;
+
+    g_assert(node->parent == parent);
+    g_assert(node->start >= min_start && node->start <= max_start);
+    g_assert(node->start <= node->last);
+    if (parent) {
+        g_assert(node->priority <= parent->priority);
+    }
+
+    last = node->last;
+    if (node->left) {
+        last = MAX(last, check_subtree(node->left, node, min_start,
+                                       node->start));
+    }
+    if (node->right) {
+        last = MAX(last, check_subtree(node->right, node, node->start,
+                                       max_start));
+    }
+    g_assert(node->subtree_last == last);
+    return last;
+}
+
+static void check_tree(void)
+{
+    if (root.root) {
+        check_subtree(root.root, NULL, 0, UINT64_MAX);
+    }
+}
+
+/* Compare the iterators with a linear scan.  */
+static void check_query(uint64_t start, uint64_t last)
+{
+    IntervalTreeNode *node;
+    bool seen[N] = { false };
+    uint64_t prev_start = 0;
+    int i, expected = 0, found = 0;
+
+    for (i = 0; i < N; i++) {
+        if (inserted[i] && nodes[i].start <= last && start <= nodes[i].last) {
+            expected++;
+        }
+    }
+
+    for (node = interval_tree_iter_first(&root, start, last); node;
+         node = interval_tree_iter_next(node, start, last)) {
+        i = node - nodes;
+        g_assert(inserted[i]);
+        g_assert(!seen[i]);
+        g_assert(node->start <= last && start <= node->last);
+        g_assert(node->start >= prev_start);
+        seen[i] = true;
+        prev_start = node->start;
+        found++;
+    }
+    g_assert_cmpint(found, ==, expected);
+}
+
+static void set_random(IntervalTreeNode *node, uint64_t range)
+{
+    node->start = g_test_rand_int_range(0, range);
+    node->last = node->start + g_test_rand_int_range(0, range / 16);
+}
+
+static void test_random(void)
+{
+    int i, j;
+
+    for (i = 0; i < 20 * N; i++) {
+        j = g_test_rand_int_range(0, N);
+        if (inserted[j]) {
+            interval_tree_remove(&nodes[j], &root);
+            inserted[j] = false;
+        } else {
+            set_random(&nodes[j], 100000);
+            interval_tree_insert(&nodes[j], &root);
+            inserted[j] = true;
+        }
+        if (i % 64 == 0) {
+            IntervalTreeNode q;
+
+            check_tree();
+            set_random(&q, 100000);
+            check_query(q.start, q.last);
+        }
+    }
+
+    for (j = 0; j < N; j++) {
+        if (inserted[j]) {
+            interval_tree_remove(&nodes[j], &root);
+            inserted[j] = false;
+        }
+    }
+    g_assert(root.root == NULL);
+}
+
+/* Disjoint intervals, as used for the guest page flags.  */
+static void test_disjoint(void)
+{
+    IntervalTreeNode *node;
+    int i;
+
+    for (i = 0; i < N; i++) {
+        nodes[i].start = (uint64_t)i << 12;
+        nodes[i].last = nodes[i].start + 0x7ff;
+        interval_tree_insert(&nodes[i], &root);
+        inserted[i] = true;
+    }
+    check_tree();
+
+    for (i = 0; i < N; i++) {
+        node = interval_tree_iter_first(&root, nodes[i].start + 0x100,
+                                        nodes[i].start + 0x100);
+        g_assert(node == &nodes[i]);
+        node = interval_tree_iter_first(&root, nodes[i].start + 0x800,
+                                        nodes[i].start + 0xfff);
+        g_assert(node == NULL);
+    }
+
+    /* The whole address space, in order.  */
+    node = interval_tree_iter_first(&root, 0, UINT64_MAX);
+    for (i = 0; i < N; i++) {
+        g_assert(node == &nodes[i]);
+        node = interval_tree_iter_next(node, 0, UINT64_MAX);
+    }
+    g_assert(node == NULL);
+
+    /* Remove every other one and look again.  */
+    for (i = 0; i < N; i += 2) {
+        interval_tree_remove(&nodes[i], &root);
+        inserted[i] = false;
+    }
+    check_tree();
+    check_query(0, UINT64_MAX);
+    check_query(0x1000, 0x5000);
+
+    for (i = 1; i < N; i += 2) {
+        interval_tree_remove(&nodes[i], &root);
+        inserted[i] = false;
+    }
+    g_assert(root.root == NULL);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/interval-tree/disjoint", test_disjoint);
+    g_test_add_func("/interval-tree/random", test_random);
+    return g_test_run();
+}
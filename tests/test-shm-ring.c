@@ -0,0 +1,202 @@
+/*
+ * Shared memory ring tests
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/shm-ring.h"
+
+#define RING_SIZE 4096
+
+typedef struct {
+    void *base;
+    ShmRingPort prod;
+    ShmRingPort cons;
+    uint64_t total;
+    size_t chunk;
+    uint64_t received;
+    bool ok;
+} RingTest;
+
+static void ring_init(RingTest *t, uint32_t ring_size)
+{
+    uint32_t data_offset = ROUND_UP(sizeof(ShmRingHeader), 64);
+
+    t->base = g_malloc0(data_offset + SHM_RING_COUNT * ring_size);
+    shm_ring_port_init(&t->prod, t->base, ring_size, data_offset,
+                       SHM_RING_TO_CLIENT);
+    shm_ring_port_init(&t->cons, t->base, ring_size, data_offset,
+                       SHM_RING_TO_CLIENT);
+}
+
+static void test_notify(void)
+{
+    RingTest t;
+    uint8_t buf[RING_SIZE + 1] = { 0 };
+    const uint8_t *data;
+    bool notify;
+
+    ring_init(&t, RING_SIZE);
+
+    /* Only a write to an empty ring notifies */
+    g_assert_cmpint(shm_ring_write(&t.prod, buf, 10, &notify), ==, 10);
+    g_assert_true(notify);
+    g_assert_cmpint(shm_ring_write(&t.prod, buf, 10, &notify), ==, 10);
+    g_assert_false(notify);
+
+    g_assert_cmpint(shm_ring_peek(&t.cons, &data), ==, 20);
+    shm_ring_consume(&t.cons, 5);
+    g_assert_cmpint(shm_ring_write(&t.prod, buf, 1, &notify), ==, 1);
+    g_assert_false(notify);
+
+    shm_ring_consume(&t.cons, 16);
+    g_assert_cmpint(shm_ring_peek(&t.cons, &data), ==, 0);
+    g_assert_cmpint(shm_ring_write(&t.prod, buf, 1, &notify), ==, 1);
+    g_assert_true(notify);
+
+    /* A full ring accepts nothing, and does not notify */
+    g_assert_cmpint(shm_ring_write(&t.prod, buf, sizeof(buf), &notify), ==,
+                    RING_SIZE - 1);
+    g_assert_false(notify);
+    g_assert_cmpint(shm_ring_write(&t.prod, buf, 1, &notify), ==, 0);
+    g_assert_false(notify);
+
+    g_free(t.base);
+}
+
+static void test_wrap(void)
+{
+    RingTest t;
+    uint8_t in[RING_SIZE], out[RING_SIZE];
+    const uint8_t *data;
+    bool notify;
+    size_t n, done;
+    int i;
+
+    ring_init(&t, RING_SIZE);
+    for (i = 0; i < RING_SIZE; i++) {
+        in[i] = i * 7;
+    }
+
+    /* Move the indexes to the middle, then fill the whole ring */
+    shm_ring_write(&t.prod, in, RING_SIZE / 2 + 3, &notify);
+    shm_ring_consume(&t.cons, shm_ring_peek(&t.cons, &data));
+    g_assert_cmpint(shm_ring_write(&t.prod, in, RING_SIZE, &notify), ==,
+                    RING_SIZE);
+
+    /* The data comes back in two contiguous pieces */
+    done = 0;
+    while ((n = shm_ring_peek(&t.cons, &data)) > 0) {
+        g_assert_cmpint(n, <, RING_SIZE);
+        memcpy(out + done, data, n);
+        shm_ring_consume(&t.cons, n);
+        done += n;
+    }
+    g_assert_cmpint(done, ==, RING_SIZE);
+    g_assert_cmpint(memcmp(in, out, RING_SIZE), ==, 0);
+
+    g_free(t.base);
+}
+
+/* The consumer checks that it receives a running byte counter */
+static void *consumer_thread(void *opaque)
+{
+    RingTest *t = opaque;
+    const uint8_t *data;
+    size_t n, i;
+
+    t->ok = true;
+    while (t->received < t->total) {
+        n = shm_ring_peek(&t->cons, &data);
+        if (!n) {
+            g_thread_yield();
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (data[i] != (uint8_t)(t->received + i)) {
+                t->ok = false;
+            }
+        }
+        shm_ring_consume(&t->cons, n);
+        t->received += n;
+    }
+    return NULL;
+}
+
+static void run_stream(RingTest *t, uint32_t ring_size, size_t chunk,
+                       uint64_t total)
+{
+    QemuThread thread;
+    uint8_t *buf;
+    uint64_t sent = 0;
+    bool notify;
+    size_t i, n;
+
+    ring_init(t, ring_size);
+    t->total = total;
+    t->chunk = chunk;
+    t->received = 0;
+    buf = g_malloc(chunk + 256);
+    for (i = 0; i < chunk + 256; i++) {
+        buf[i] = i;
+    }
+
+    qemu_thread_create(&thread, "consumer", consumer_thread, t,
+                       QEMU_THREAD_JOINABLE);
+    while (sent < total) {
+        n = MIN(chunk, total - sent);
+        n = shm_ring_write(&t->prod, buf + sent % 256, n, &notify);
+        if (!n) {
+            g_thread_yield();
+        }
+        sent += n;
+    }
+    qemu_thread_join(&thread);
+
+    g_assert_true(t->ok);
+    g_assert_cmpint(t->received, ==, total);
+    g_free(buf);
+    g_free(t->base);
+}
+
+static void test_stream(void)
+{
+    static const size_t chunks[] = { 1, 3, 64, 1000, RING_SIZE * 2 };
+    RingTest t;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+        run_stream(&t, RING_SIZE, chunks[i], 1 << 20);
+    }
+}
+
+static void perf_stream(void)
+{
+    static const size_t chunks[] = { 64, 4096, 65536 };
+    const uint64_t total = 1ULL << 30;
+    RingTest t;
+    double duration;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+        g_test_timer_start();
+        run_stream(&t, 1 << 16, chunks[i], total);
+        duration = g_test_timer_elapsed();
+        g_test_message("%zu byte writes: %.0f MB/s", chunks[i],
+                       total / 1e6 / duration);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/shm-ring/notify", test_notify);
+    g_test_add_func("/shm-ring/wrap", test_wrap);
+    g_test_add_func("/shm-ring/stream", test_stream);
+    if (g_test_perf()) {
+        g_test_add_func("/shm-ring/perf/stream", perf_stream);
+    }
+    return g_test_run();
+}
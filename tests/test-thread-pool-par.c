@@ -0,0 +1,59 @@
+/*
+ * Run the thread pool benchmark as a stress test
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+
+#define TEST_THREAD_POOL_STRING "tests/thread-pool-bench 1>/dev/null 2>&1 "
+
+static void test_thread_pool(int n_threads, int work, int duration)
+{
+    char *str;
+    int rc;
+
+    str = g_strdup_printf(TEST_THREAD_POOL_STRING "-n %d -w %d -d %d",
+                          n_threads, work, duration);
+    rc = system(str);
+    g_free(str);
+    g_assert_cmpint(rc, ==, 0);
+}
+
+static void test_4th0w1s(void)
+{
+    test_thread_pool(4, 0, 1);
+}
+
+static void test_4th1000w1s(void)
+{
+    test_thread_pool(4, 1000, 1);
+}
+
+static void test_4th0w5s(void)
+{
+    test_thread_pool(4, 0, 5);
+}
+
+static void test_4th1000w5s(void)
+{
+    test_thread_pool(4, 1000, 5);
+}
+
+int main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (g_test_quick()) {
+        g_test_add_func("/thread-pool/parallel/4threads-0work-1s",
+                        test_4th0w1s);
+        g_test_add_func("/thread-pool/parallel/4threads-1000work-1s",
+                        test_4th1000w1s);
+    } else {
+        g_test_add_func("/thread-pool/parallel/4threads-0work-5s",
+                        test_4th0w5s);
+        g_test_add_func("/thread-pool/parallel/4threads-1000work-5s",
+                        test_4th1000w5s);
+    }
+    return g_test_run();
+}
@@ -0,0 +1,165 @@
+/*
+ * Thread pool submit/complete throughput benchmark
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "block/aio.h"
+#include "block/thread-pool.h"
+#include "qapi/error.h"
+#include "qemu/timer.h"
+#include "qemu/error-report.h"
+
+static AioContext *ctx;
+static ThreadPool *pool;
+
+static unsigned int duration = 1;
+static unsigned int n_threads = 1;
+static unsigned int queue_depth = 64;
+static unsigned long work_iterations;
+
+static bool test_stop;
+static unsigned int in_flight;
+static uint64_t completed;
+
+static const char commands_string[] =
+    " -d = duration, in seconds\n"
+    " -n = number of worker threads (1 to 64)\n"
+    " -q = number of requests kept in flight\n"
+    " -w = busy-loop iterations per request";
+
+static void usage_complete(int argc, char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+    exit(-1);
+}
+
+static int work_cb(void *opaque)
+{
+    unsigned long i;
+
+    for (i = 0; i < work_iterations; i++) {
+        barrier();
+    }
+    return 0;
+}
+
+static void submit_one(void);
+
+static void done_cb(void *opaque, int ret)
+{
+    /* Callbacks are serialized, so no need to use atomic ops.  */
+    completed++;
+    in_flight--;
+    if (!test_stop) {
+        submit_one();
+    }
+}
+
+static void submit_one(void)
+{
+    in_flight++;
+    thread_pool_submit_aio(pool, work_cb, NULL, done_cb, NULL);
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" duration:          %u s\n", duration);
+    printf(" # of threads:      %u\n", n_threads);
+    printf(" queue depth:       %u\n", queue_depth);
+    printf(" work iterations:   %lu\n", work_iterations);
+}
+
+static void pr_stats(int64_t elapsed_ns)
+{
+    double tx = (double)completed / 1e6 / (elapsed_ns / 1e9);
+
+    printf("Results:\n");
+    printf(" Completed:         %.2f M\n", (double)completed / 1e6);
+    printf(" Throughput:        %.2f MT/s\n", tx);
+    printf(" Throughput/thread: %.2f MT/s/thread\n", tx / n_threads);
+}
+
+static int64_t run_test(void)
+{
+    int64_t start, end;
+    unsigned int i;
+
+    for (i = 0; i < queue_depth; i++) {
+        submit_one();
+    }
+
+    start = get_clock();
+    end = start + duration * NANOSECONDS_PER_SECOND;
+    while (get_clock() < end) {
+        aio_poll(ctx, true);
+    }
+    end = get_clock();
+
+    test_stop = true;
+    while (in_flight > 0) {
+        aio_poll(ctx, true);
+    }
+    return end - start;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "d:hn:q:w:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'h':
+            usage_complete(argc, argv);
+            exit(0);
+        case 'n':
+            n_threads = atoi(optarg);
+            break;
+        case 'q':
+            queue_depth = atoi(optarg);
+            break;
+        case 'w':
+            work_iterations = atol(optarg);
+            break;
+        }
+    }
+    if (n_threads < 1 || n_threads > 64 || queue_depth < 1) {
+        usage_complete(argc, argv);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Error *local_error = NULL;
+    int64_t elapsed;
+
+    parse_args(argc, argv);
+    init_clocks();
+
+    ctx = aio_context_new(&local_error);
+    if (!ctx) {
+        error_reportf_err(local_error, "Failed to create AIO Context: ");
+        exit(1);
+    }
+    pool = thread_pool_new(ctx);
+    thread_pool_set_max_threads(pool, n_threads);
+
+    pr_params();
+    elapsed = run_test();
+    pr_stats(elapsed);
+
+    thread_pool_free(pool);
+    aio_context_unref(ctx);
+    return 0;
+}
@@ -26,6 +26,9 @@
 static void do_spawn_thread(ThreadPool *pool);
 
 typedef struct ThreadPoolElement ThreadPoolElement;
+typedef struct ThreadPoolWorker ThreadPoolWorker;
+
+#define THREAD_POOL_MAX_THREADS 64
 
 enum ThreadState {
     THREAD_QUEUED,
@@ -39,68 +42,212 @@ struct ThreadPoolElement {
     ThreadPoolFunc *func;
     void *arg;
 
-    /* Moving state out of THREAD_QUEUED is protected by lock.  After
-     * that, only the worker thread can write to it.  Reads and writes
-     * of state and ret are ordered with memory barriers.
+    /* Moving state out of THREAD_QUEUED is protected by worker->lock.
+     * After that, only the worker thread can write to it.  Reads and
+     * writes of state and ret are ordered with memory barriers.
      */
     enum ThreadState state;
     int ret;
 
-    /* Access to this list is protected by lock.  */
+    /* The worker whose queue the element was put on.  Set before the
+     * element becomes visible to other threads and never changed.
+     */
+    ThreadPoolWorker *worker;
+
+    /* Access to this list is protected by worker->lock.  */
     QTAILQ_ENTRY(ThreadPoolElement) reqs;
 
     /* Access to this list is protected by the global mutex.  */
     QLIST_ENTRY(ThreadPoolElement) all;
 };
 
+/* Each worker thread owns a slot with its own request queue, so that
+ * submissions and worker threads do not all serialize on a single lock
+ * and semaphore.  A worker that runs out of work steals requests from
+ * the other queues before going to sleep.
+ */
+struct ThreadPoolWorker {
+    ThreadPool *pool;
+    QemuSemaphore sem;
+
+    /* Protects request_list and writes to running.  */
+    QemuMutex lock;
+    QTAILQ_HEAD(, ThreadPoolElement) request_list;
+
+    /* True while a thread owns the slot or is about to be started for
+     * it; requests may only be queued to running slots.
+     */
+    bool running;
+
+    /* Set by the thread owning the slot before it waits on sem, cleared
+     * by whoever claims the wakeup (see worker_kick).
+     */
+    bool idle;
+
+    /* Protected by pool->lock.  */
+    bool spawn_pending;
+};
+
 struct ThreadPool {
     AioContext *ctx;
     QEMUBH *completion_bh;
     QemuMutex lock;
     QemuCond worker_stopped;
-    QemuSemaphore sem;
     int max_threads;
     QEMUBH *new_thread_bh;
 
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    unsigned int next_worker;
+
+    /* Accessed with atomic operations.  */
+    int idle_threads;
+    bool stopping;
 
     /* The following variables are protected by lock.  */
-    QTAILQ_HEAD(, ThreadPoolElement) request_list;
     int cur_threads;
-    int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
     int pending_threads; /* threads created but not running yet */
-    bool stopping;
+
+    ThreadPoolWorker workers[THREAD_POOL_MAX_THREADS];
 };
 
+static bool worker_has_requests(ThreadPoolWorker *worker)
+{
+    return atomic_read(&worker->request_list.tqh_first) != NULL;
+}
+
+static ThreadPoolElement *worker_take_request(ThreadPoolWorker *worker)
+{
+    ThreadPoolElement *req;
+
+    if (!worker_has_requests(worker)) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&worker->lock);
+    req = QTAILQ_FIRST(&worker->request_list);
+    if (req) {
+        QTAILQ_REMOVE(&worker->request_list, req, reqs);
+        req->state = THREAD_ACTIVE;
+    }
+    qemu_mutex_unlock(&worker->lock);
+    return req;
+}
+
+static ThreadPoolElement *worker_steal_request(ThreadPoolWorker *worker)
+{
+    ThreadPool *pool = worker->pool;
+    ThreadPoolElement *req;
+    int start = worker - pool->workers;
+    int i;
+
+    for (i = 1; i < THREAD_POOL_MAX_THREADS; i++) {
+        ThreadPoolWorker *victim =
+            &pool->workers[(start + i) % THREAD_POOL_MAX_THREADS];
+
+        req = worker_take_request(victim);
+        if (req) {
+            return req;
+        }
+    }
+    return NULL;
+}
+
+static bool thread_pool_has_requests(ThreadPool *pool)
+{
+    int i;
+
+    for (i = 0; i < THREAD_POOL_MAX_THREADS; i++) {
+        if (worker_has_requests(&pool->workers[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int worker_wait(ThreadPoolWorker *worker)
+{
+    ThreadPool *pool = worker->pool;
+    bool has_requests;
+    int ret;
+
+    atomic_inc(&pool->idle_threads);
+    atomic_set(&worker->idle, true);
+
+    /* Pairs with smp_mb() in thread_pool_kick_idle.  Either we see the
+     * request that was just queued, or the submitter sees us idle and
+     * kicks our semaphore.
+     */
+    smp_mb();
+    has_requests = thread_pool_has_requests(pool);
+    if (!has_requests && qemu_sem_timedwait(&worker->sem, 10000) == 0) {
+        ret = 0;
+    } else if (!atomic_xchg(&worker->idle, false)) {
+        /* A submitter claimed the wakeup after all; take its token so
+         * that it does not cause a spurious wakeup later.
+         */
+        qemu_sem_wait(&worker->sem);
+        ret = 0;
+    } else {
+        ret = has_requests ? 0 : -1;
+    }
+
+    atomic_set(&worker->idle, false);
+    atomic_dec(&pool->idle_threads);
+    return ret;
+}
+
+/* Post @worker's semaphore if it is waiting on it.  Clearing idle claims
+ * the wakeup, so that a waiting worker gets exactly one token no matter
+ * how many submitters see it idle.
+ */
+static bool worker_kick(ThreadPoolWorker *worker)
+{
+    if (atomic_read(&worker->idle) && atomic_xchg(&worker->idle, false)) {
+        qemu_sem_post(&worker->sem);
+        return true;
+    }
+    return false;
+}
+
+static bool worker_retire(ThreadPoolWorker *worker)
+{
+    bool retire;
+
+    qemu_mutex_lock(&worker->lock);
+    retire = QTAILQ_EMPTY(&worker->request_list);
+    if (retire) {
+        atomic_set(&worker->running, false);
+    }
+    qemu_mutex_unlock(&worker->lock);
+    return retire;
+}
+
 static void *worker_thread(void *opaque)
 {
-    ThreadPool *pool = opaque;
+    ThreadPoolWorker *worker = opaque;
+    ThreadPool *pool = worker->pool;
 
     qemu_mutex_lock(&pool->lock);
     pool->pending_threads--;
     do_spawn_thread(pool);
+    qemu_mutex_unlock(&pool->lock);
 
-    while (!pool->stopping) {
+    while (!atomic_read(&pool->stopping)) {
         ThreadPoolElement *req;
         int ret;
 
-        do {
-            pool->idle_threads++;
-            qemu_mutex_unlock(&pool->lock);
-            ret = qemu_sem_timedwait(&pool->sem, 10000);
-            qemu_mutex_lock(&pool->lock);
-            pool->idle_threads--;
-        } while (ret == -1 && !QTAILQ_EMPTY(&pool->request_list));
-        if (ret == -1 || pool->stopping) {
-            break;
+        req = worker_take_request(worker);
+        if (!req) {
+            req = worker_steal_request(worker);
+        }
+        if (!req) {
+            if (worker_wait(worker) == -1 && worker_retire(worker)) {
+                break;
+            }
+            continue;
         }
-
-        req = QTAILQ_FIRST(&pool->request_list);
-        QTAILQ_REMOVE(&pool->request_list, req, reqs);
-        req->state = THREAD_ACTIVE;
-        qemu_mutex_unlock(&pool->lock);
 
         ret = req->func(req->arg);
 
@@ -109,11 +256,13 @@ static void *worker_thread(void *opaque)
         smp_wmb();
         req->state = THREAD_DONE;
 
-        qemu_mutex_lock(&pool->lock);
-
+        /* Completions that arrive before the bottom half runs are
+         * collected by a single invocation of it.
+         */
         qemu_bh_schedule(pool->completion_bh);
     }
 
+    qemu_mutex_lock(&pool->lock);
     pool->cur_threads--;
     qemu_cond_signal(&pool->worker_stopped);
     qemu_mutex_unlock(&pool->lock);
@@ -122,17 +271,29 @@ static void *worker_thread(void *opaque)
 
 static void do_spawn_thread(ThreadPool *pool)
 {
+    ThreadPoolWorker *worker = NULL;
     QemuThread t;
+    int i;
 
     /* Runs with lock taken.  */
     if (!pool->new_threads) {
         return;
     }
 
+    for (i = 0; i < THREAD_POOL_MAX_THREADS; i++) {
+        if (pool->workers[i].spawn_pending) {
+            worker = &pool->workers[i];
+            break;
+        }
+    }
+    assert(worker);
+
+    worker->spawn_pending = false;
     pool->new_threads--;
     pool->pending_threads++;
 
-    qemu_thread_create(&t, "worker", worker_thread, pool, QEMU_THREAD_DETACHED);
+    qemu_thread_create(&t, "worker", worker_thread, worker,
+                       QEMU_THREAD_DETACHED);
 }
 
 static void spawn_thread_bh_fn(void *opaque)
@@ -146,6 +307,25 @@ static void spawn_thread_bh_fn(void *opaque)
 
 static void spawn_thread(ThreadPool *pool)
 {
+    ThreadPoolWorker *worker = NULL;
+    int i;
+
+    /* Runs with lock taken.  Claim a free slot, so that requests can be
+     * queued to it before the thread is actually running.  A slot is
+     * released by its thread before cur_threads is decremented, so there
+     * is always a free one here.
+     */
+    for (i = 0; i < THREAD_POOL_MAX_THREADS && !worker; i++) {
+        qemu_mutex_lock(&pool->workers[i].lock);
+        if (!pool->workers[i].running) {
+            worker = &pool->workers[i];
+            atomic_set(&worker->running, true);
+        }
+        qemu_mutex_unlock(&pool->workers[i].lock);
+    }
+    assert(worker);
+
+    worker->spawn_pending = true;
     pool->cur_threads++;
     pool->new_threads++;
     /* If there are threads being created, they will spawn new workers, so
@@ -160,6 +340,84 @@ static void spawn_thread(ThreadPool *pool)
     }
 }
 
+static ThreadPoolWorker *thread_pool_pick_worker(ThreadPool *pool)
+{
+    ThreadPoolWorker *fallback = NULL;
+    int i;
+
+    /* Prefer an idle worker, otherwise go round-robin over the running
+     * ones.  Both checks are only hints; the caller rechecks running
+     * under the worker lock.
+     */
+    for (i = 0; i < THREAD_POOL_MAX_THREADS; i++) {
+        ThreadPoolWorker *worker =
+            &pool->workers[(pool->next_worker + i) % THREAD_POOL_MAX_THREADS];
+
+        if (!atomic_read(&worker->running)) {
+            continue;
+        }
+        if (atomic_read(&worker->idle)) {
+            return worker;
+        }
+        if (!fallback) {
+            fallback = worker;
+        }
+    }
+    return fallback;
+}
+
+static void thread_pool_queue_request(ThreadPool *pool, ThreadPoolElement *req)
+{
+    ThreadPoolWorker *worker;
+
+    for (;;) {
+        worker = thread_pool_pick_worker(pool);
+        if (!worker) {
+            /* All threads have retired.  */
+            qemu_mutex_lock(&pool->lock);
+            spawn_thread(pool);
+            qemu_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        qemu_mutex_lock(&worker->lock);
+        if (worker->running) {
+            req->worker = worker;
+            QTAILQ_INSERT_TAIL(&worker->request_list, req, reqs);
+            qemu_mutex_unlock(&worker->lock);
+            break;
+        }
+        qemu_mutex_unlock(&worker->lock);
+    }
+
+    pool->next_worker = (worker - pool->workers + 1) % THREAD_POOL_MAX_THREADS;
+}
+
+/* Wake up the worker that @req was queued to, or, if it is running and
+ * will find the request by itself, another idle worker that can steal it.
+ */
+static void thread_pool_kick_idle(ThreadPool *pool, ThreadPoolElement *req)
+{
+    int i;
+
+    /* Pairs with smp_mb() in worker_wait.  */
+    smp_mb();
+    if (!atomic_read(&pool->idle_threads)) {
+        return;
+    }
+
+    if (worker_kick(req->worker)) {
+        return;
+    }
+    for (i = 0; i < THREAD_POOL_MAX_THREADS; i++) {
+        ThreadPoolWorker *worker = &pool->workers[i];
+
+        if (worker != req->worker && worker_kick(worker)) {
+            return;
+        }
+    }
+}
+
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPool *pool = opaque;
@@ -197,25 +455,23 @@ static void thread_pool_cancel(BlockAIOCB *acb)
 {
     ThreadPoolElement *elem = (ThreadPoolElement *)acb;
     ThreadPool *pool = elem->pool;
+    ThreadPoolWorker *worker = elem->worker;
 
     trace_thread_pool_cancel(elem, elem->common.opaque);
 
-    qemu_mutex_lock(&pool->lock);
-    if (elem->state == THREAD_QUEUED &&
-        /* No thread has yet started working on elem. we can try to "steal"
-         * the item from the worker if we can get a signal from the
-         * semaphore.  Because this is non-blocking, we can do it with
-         * the lock taken and ensure that elem will remain THREAD_QUEUED.
-         */
-        qemu_sem_timedwait(&pool->sem, 0) == 0) {
-        QTAILQ_REMOVE(&pool->request_list, elem, reqs);
+    /* No thread has yet started working on elem, so we can take it off
+     * the queue.  If the worker was kicked for it, it finds nothing to
+     * do and goes back to waiting.
+     */
+    qemu_mutex_lock(&worker->lock);
+    if (elem->state == THREAD_QUEUED) {
+        QTAILQ_REMOVE(&worker->request_list, elem, reqs);
         qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
     }
-
-    qemu_mutex_unlock(&pool->lock);
+    qemu_mutex_unlock(&worker->lock);
 }
 
 static AioContext *thread_pool_get_aio_context(BlockAIOCB *acb)
@@ -247,13 +503,15 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
 
     trace_thread_pool_submit(pool, req, arg);
 
-    qemu_mutex_lock(&pool->lock);
-    if (pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
-        spawn_thread(pool);
+    if (atomic_read(&pool->idle_threads) == 0) {
+        qemu_mutex_lock(&pool->lock);
+        if (pool->cur_threads < pool->max_threads) {
+            spawn_thread(pool);
+        }
+        qemu_mutex_unlock(&pool->lock);
     }
-    QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
-    qemu_mutex_unlock(&pool->lock);
-    qemu_sem_post(&pool->sem);
+    thread_pool_queue_request(pool, req);
+    thread_pool_kick_idle(pool, req);
     return &req->common;
 }
 
@@ -287,6 +545,8 @@ void thread_pool_submit(ThreadPool *pool, ThreadPoolFunc *func, void *arg)
 
 static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
 {
+    int i;
+
     if (!ctx) {
         ctx = qemu_get_aio_context();
     }
@@ -296,12 +556,18 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->completion_bh = aio_bh_new(ctx, thread_pool_completion_bh, pool);
     qemu_mutex_init(&pool->lock);
     qemu_cond_init(&pool->worker_stopped);
-    qemu_sem_init(&pool->sem, 0);
-    pool->max_threads = 64;
+    pool->max_threads = THREAD_POOL_MAX_THREADS;
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
-    QTAILQ_INIT(&pool->request_list);
+    for (i = 0; i < THREAD_POOL_MAX_THREADS; i++) {
+        ThreadPoolWorker *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        qemu_mutex_init(&worker->lock);
+        qemu_sem_init(&worker->sem, 0);
+        QTAILQ_INIT(&worker->request_list);
+    }
 }
 
 ThreadPool *thread_pool_new(AioContext *ctx)
@@ -311,8 +577,19 @@ ThreadPool *thread_pool_new(AioContext *ctx)
     return pool;
 }
 
+void thread_pool_set_max_threads(ThreadPool *pool, int max_threads)
+{
+    assert(max_threads > 0 && max_threads <= THREAD_POOL_MAX_THREADS);
+
+    qemu_mutex_lock(&pool->lock);
+    pool->max_threads = max_threads;
+    qemu_mutex_unlock(&pool->lock);
+}
+
 void thread_pool_free(ThreadPool *pool)
 {
+    int i;
+
     if (!pool) {
         return;
     }
@@ -327,16 +604,21 @@ void thread_pool_free(ThreadPool *pool)
     pool->new_threads = 0;
 
     /* Wait for worker threads to terminate */
-    pool->stopping = true;
+    atomic_set(&pool->stopping, true);
     while (pool->cur_threads > 0) {
-        qemu_sem_post(&pool->sem);
+        for (i = 0; i < THREAD_POOL_MAX_THREADS; i++) {
+            qemu_sem_post(&pool->workers[i].sem);
+        }
         qemu_cond_wait(&pool->worker_stopped, &pool->lock);
     }
 
     qemu_mutex_unlock(&pool->lock);
 
     qemu_bh_delete(pool->completion_bh);
-    qemu_sem_destroy(&pool->sem);
+    for (i = 0; i < THREAD_POOL_MAX_THREADS; i++) {
+        qemu_sem_destroy(&pool->workers[i].sem);
+        qemu_mutex_destroy(&pool->workers[i].lock);
+    }
     qemu_cond_destroy(&pool->worker_stopped);
     qemu_mutex_destroy(&pool->lock);
     g_free(pool);
@@ -55,6 +55,10 @@
 #include "qemu/bitmap.h"
 #include "qemu/timer.h"
 #include "exec/log.h"
+#if defined(CONFIG_USER_ONLY)
+#include "qemu/interval-tree.h"
+#include "qemu/rcu.h"
+#endif
 
 //#define DEBUG_TB_INVALIDATE
 //#define DEBUG_FLUSH
@@ -76,8 +80,6 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned int code_write_count;
     unsigned long *code_bitmap;
-#else
-    unsigned long flags;
 #endif
 } PageDesc;
 
@@ -118,18 +120,123 @@ intptr_t qemu_host_page_mask;
 static void *l1_map[V_L1_SIZE];
 
 /* code generation context */
-TCGContext tcg_ctx;
+TCGContext tcg_init_ctx;
+__thread TCGContext *tcg_ctx = &tcg_init_ctx;
 
 /* translation block context */
+TBContext tb_ctx;
+
+/* The code buffer is split in regions, each of them filled by a single
+ * context together with its slice of tb_ctx.tbs, so that threads with
+ * their own tcg_ctx can generate code at the same time.  tcg_init_ctx
+ * is shared by the threads that translate under tb_lock.  A context
+ * takes a new region when its own is full; threads with their own
+ * context may only take half of the regions, and fall back to the shared
+ * context when none is left for them.  The whole buffer is flushed when
+ * the shared context runs out.  System emulation uses a single region.
+ */
+typedef struct TBRegion {
+    TranslationBlock *tbs;
+    int nb_tbs;
+    void *code_ptr;             /* next free byte */
+} TBRegion;
+
+static struct {
+    void *buf;                  /* start of the code buffer */
+    size_t size;                /* size of each region, the last one has
+                                   the remainder too */
+    size_t n;
+    size_t next;                /* next region to hand out */
+    size_t nb_private;          /* regions asked for by threads with their
+                                   own tcg_ctx */
+    int max_tbs;                /* TBs per region */
+    TBRegion *regions;
+} tb_regions;
+
+#ifdef CONFIG_USER_ONLY
+/* Size of the regions for user-mode emulation.  */
+#define TB_REGION_SIZE (1024u * 1024)
+#endif
+
+/* Room left at the end of a region for the code of the last opcode.  */
+#define TB_REGION_HIGHWATER 1024
+
+/* The region a context is filling, as long as tb_ctx.tb_flush_count
+   has not changed since it was taken.  */
+typedef struct TBRegionSlot {
+    TBRegion *region;
+    int flush_count;
+} TBRegionSlot;
+
+/* The slot of tcg_init_ctx, protected by tb_lock, and the one of the
+   calling thread's own tcg_ctx.  */
+static TBRegionSlot tb_region_shared;
+static __thread TBRegionSlot tb_region_own;
+
+static inline TBRegionSlot *tb_region_slot(void)
+{
+    return tcg_ctx == &tcg_init_ctx ? &tb_region_shared : &tb_region_own;
+}
+
 #ifdef CONFIG_USER_ONLY
 __thread int have_tb_lock;
+
+/* Held for reading while a thread generates code without tb_lock, and
+ * for writing by tb_flush(), which takes the regions back.
+ */
+static pthread_rwlock_t tb_translate_lock;
+static __thread int have_tb_translate_lock;
+
+static void tb_translate_lock_init(void)
+{
+    pthread_rwlockattr_t attr;
+
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    /* Do not let a stream of translations starve tb_flush().  */
+    pthread_rwlockattr_setkind_np(&attr,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&tb_translate_lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+}
+
+static void tb_translate_lock_rd(void)
+{
+    assert(!have_tb_translate_lock);
+    pthread_rwlock_rdlock(&tb_translate_lock);
+    have_tb_translate_lock = 1;
+}
+
+static void tb_translate_unlock(void)
+{
+    assert(have_tb_translate_lock);
+    have_tb_translate_lock = 0;
+    pthread_rwlock_unlock(&tb_translate_lock);
+}
+
+/* Keep translations from starting while the process forks.  Called
+   with tb_lock held.  */
+void tb_translate_fork_start(void)
+{
+    pthread_rwlock_wrlock(&tb_translate_lock);
+}
+
+void tb_translate_fork_end(int child)
+{
+    if (child) {
+        tb_translate_lock_init();
+    } else {
+        pthread_rwlock_unlock(&tb_translate_lock);
+    }
+}
 #endif
 
 void tb_lock(void)
 {
 #ifdef CONFIG_USER_ONLY
     assert(!have_tb_lock);
-    qemu_mutex_lock(&tcg_ctx.tb_ctx.tb_lock);
+    qemu_mutex_lock(&tb_ctx.tb_lock);
     have_tb_lock++;
 #endif
 }
@@ -139,7 +246,7 @@ void tb_unlock(void)
 #ifdef CONFIG_USER_ONLY
     assert(have_tb_lock);
     have_tb_lock--;
-    qemu_mutex_unlock(&tcg_ctx.tb_ctx.tb_lock);
+    qemu_mutex_unlock(&tb_ctx.tb_lock);
 #endif
 }
 
@@ -147,9 +254,12 @@ void tb_lock_reset(void)
 {
 #ifdef CONFIG_USER_ONLY
     if (have_tb_lock) {
-        qemu_mutex_unlock(&tcg_ctx.tb_ctx.tb_lock);
+        qemu_mutex_unlock(&tb_ctx.tb_lock);
         have_tb_lock = 0;
     }
+    if (have_tb_translate_lock) {
+        tb_translate_unlock();
+    }
 #endif
 }
 
@@ -157,7 +267,7 @@ static TranslationBlock *tb_find_pc(uintptr_t tc_ptr);
 
 void cpu_gen_init(void)
 {
-    tcg_context_init(&tcg_ctx); 
+    tcg_context_init(&tcg_init_ctx);
 }
 
 /* Encode VAL as a signed leb128 sequence at P.
@@ -215,7 +325,7 @@ static target_long decode_sleb128(uint8_t **pp)
 
 static int encode_search(TranslationBlock *tb, uint8_t *block)
 {
-    uint8_t *highwater = tcg_ctx.code_gen_highwater;
+    uint8_t *highwater = tcg_ctx->code_gen_highwater;
     uint8_t *p = block;
     int i, j, n;
 
@@ -228,12 +338,12 @@ static int encode_search(TranslationBlock *tb, uint8_t *block)
             if (i == 0) {
                 prev = (j == 0 ? tb->pc : 0);
             } else {
-                prev = tcg_ctx.gen_insn_data[i - 1][j];
+                prev = tcg_ctx->gen_insn_data[i - 1][j];
             }
-            p = encode_sleb128(p, tcg_ctx.gen_insn_data[i][j] - prev);
+            p = encode_sleb128(p, tcg_ctx->gen_insn_data[i][j] - prev);
         }
-        prev = (i == 0 ? 0 : tcg_ctx.gen_insn_end_off[i - 1]);
-        p = encode_sleb128(p, tcg_ctx.gen_insn_end_off[i] - prev);
+        prev = (i == 0 ? 0 : tcg_ctx->gen_insn_end_off[i - 1]);
+        p = encode_sleb128(p, tcg_ctx->gen_insn_end_off[i] - prev);
 
         /* Test for (pending) buffer overflow.  The assumption is that any
            one row beginning below the high water mark cannot overrun
@@ -289,8 +399,8 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
     restore_state_to_opc(env, tb, data);
 
 #ifdef CONFIG_PROFILER
-    tcg_ctx.restore_time += profile_getclock() - ti;
-    tcg_ctx.restore_count++;
+    tcg_ctx->restore_time += profile_getclock() - ti;
+    tcg_ctx->restore_count++;
 #endif
     return 0;
 }
@@ -441,6 +551,155 @@ static inline PageDesc *page_find(tb_page_addr_t index)
 }
 
 #if defined(CONFIG_USER_ONLY)
+/*
+ * The flags of the guest pages are kept in an interval tree, with one
+ * node for each run of contiguous pages with the same flags; unmapped
+ * pages have no node.  This makes the updates done by mmap and munmap
+ * independent of the size of the region, and keeps the VMA layout
+ * available for the searches done by mmap.
+ *
+ * The tree is updated with mmap_lock held.  Lookups run without it under
+ * RCU and may miss a node that is being moved, so a failed lookup is
+ * repeated with the lock held.
+ */
+typedef struct PageFlagsNode {
+    struct rcu_head rcu;
+    IntervalTreeNode itree;
+    int flags;
+} PageFlagsNode;
+
+static IntervalTreeRoot pageflags_root;
+
+static PageFlagsNode *pageflags_find(target_ulong start, target_ulong last)
+{
+    IntervalTreeNode *n;
+
+    n = interval_tree_iter_first(&pageflags_root, start, last);
+    return n ? container_of(n, PageFlagsNode, itree) : NULL;
+}
+
+static PageFlagsNode *pageflags_next(PageFlagsNode *p, target_ulong start,
+                                     target_ulong last)
+{
+    IntervalTreeNode *n;
+
+    n = interval_tree_iter_next(&p->itree, start, last);
+    return n ? container_of(n, PageFlagsNode, itree) : NULL;
+}
+
+static void pageflags_create(target_ulong start, target_ulong last, int flags)
+{
+    PageFlagsNode *p = g_new(PageFlagsNode, 1);
+
+    p->itree.start = start;
+    p->itree.last = last;
+    p->flags = flags;
+    interval_tree_insert(&p->itree, &pageflags_root);
+}
+
+static void pageflags_remove(PageFlagsNode *p)
+{
+    interval_tree_remove(&p->itree, &pageflags_root);
+    g_free_rcu(p, rcu);
+}
+
+/* Join the runs on each side of @addr if they have the same flags.  */
+static void pageflags_merge(target_ulong addr)
+{
+    PageFlagsNode *a, *b;
+
+    if (addr == 0) {
+        return;
+    }
+    a = pageflags_find(addr - 1, addr - 1);
+    b = pageflags_find(addr, addr);
+    if (!a || !b || a == b || a->flags != b->flags) {
+        return;
+    }
+    pageflags_create(a->itree.start, b->itree.last, a->flags);
+    pageflags_remove(a);
+    pageflags_remove(b);
+}
+
+/* Set the flags of [start, last] to @flags, or unmap it if zero.  */
+static void pageflags_set(target_ulong start, target_ulong last, int flags)
+{
+    PageFlagsNode *p = pageflags_find(start, last);
+
+    if (p && p->itree.start == start && p->itree.last == last) {
+        /* Same run, as for mprotect of a whole mapping.  */
+        if (flags) {
+            atomic_set(&p->flags, flags);
+        } else {
+            pageflags_remove(p);
+        }
+    } else {
+        for (; p; p = pageflags_find(start, last)) {
+            if (p->itree.start < start) {
+                pageflags_create(p->itree.start, start - 1, p->flags);
+            }
+            if (p->itree.last > last) {
+                pageflags_create(last + 1, p->itree.last, p->flags);
+            }
+            pageflags_remove(p);
+        }
+        if (flags) {
+            pageflags_create(start, last, flags);
+        }
+    }
+
+    pageflags_merge(start);
+    if (last + 1 != 0) {
+        pageflags_merge(last + 1);
+    }
+}
+
+/*
+ * Change the flags of the mapped pages of [start, last] to
+ * (flags & ~clear_flags) | set_flags, and return the union of
+ * their previous flags.
+ */
+static int pageflags_set_clear(target_ulong start, target_ulong last,
+                               int set_flags, int clear_flags)
+{
+    PageFlagsNode *p;
+    target_ulong cur = start;
+    int prot = 0;
+
+    while ((p = pageflags_find(cur, last)) != NULL) {
+        target_ulong p_start = p->itree.start;
+        target_ulong p_last = p->itree.last;
+        int p_flags = p->flags;
+        int flags = (p_flags & ~clear_flags) | set_flags;
+
+        prot |= p_flags;
+        if (flags == p_flags) {
+            /* Nothing to do.  */
+        } else if (p_start >= cur && p_last <= last) {
+            atomic_set(&p->flags, flags);
+        } else {
+            if (p_start < cur) {
+                pageflags_create(p_start, cur - 1, p_flags);
+            }
+            pageflags_create(MAX(p_start, cur), MIN(p_last, last), flags);
+            if (p_last > last) {
+                pageflags_create(last + 1, p_last, p_flags);
+            }
+            pageflags_remove(p);
+        }
+        pageflags_merge(MAX(p_start, cur));
+        if (p_last >= last) {
+            break;
+        }
+        cur = p_last + 1;
+    }
+
+    if (last + 1 != 0) {
+        pageflags_merge(last + 1);
+    }
+    return prot;
+}
+
 /* Currently it is not recommended to allocate big chunks of data in
    user mode. It will change when a dedicated libc will be used.  */
 /* ??? 64-bit hosts ought to have no problem mmaping data outside the
@@ -529,7 +788,7 @@ static inline void *split_cross_256mb(void *buf1, size_t size1)
         buf1 = buf2;
     }
 
-    tcg_ctx.code_gen_buffer_size = size1;
+    tcg_ctx->code_gen_buffer_size = size1;
     return buf1;
 }
 #endif
@@ -592,16 +851,16 @@ static inline void *alloc_code_gen_buffer(void)
     size = full_size - qemu_real_host_page_size;
 
     /* Honor a command-line option limiting the size of the buffer.  */
-    if (size > tcg_ctx.code_gen_buffer_size) {
-        size = (((uintptr_t)buf + tcg_ctx.code_gen_buffer_size)
+    if (size > tcg_ctx->code_gen_buffer_size) {
+        size = (((uintptr_t)buf + tcg_ctx->code_gen_buffer_size)
                 & qemu_real_host_page_mask) - (uintptr_t)buf;
     }
-    tcg_ctx.code_gen_buffer_size = size;
+    tcg_ctx->code_gen_buffer_size = size;
 
 #ifdef __mips__
     if (cross_256mb(buf, size)) {
         buf = split_cross_256mb(buf, size);
-        size = tcg_ctx.code_gen_buffer_size;
+        size = tcg_ctx->code_gen_buffer_size;
     }
 #endif
 
@@ -614,7 +873,7 @@ static inline void *alloc_code_gen_buffer(void)
 #elif defined(_WIN32)
 static inline void *alloc_code_gen_buffer(void)
 {
-    size_t size = tcg_ctx.code_gen_buffer_size;
+    size_t size = tcg_ctx->code_gen_buffer_size;
     void *buf1, *buf2;
 
     /* Perform the allocation in two steps, so that the guard page
@@ -633,7 +892,7 @@ static inline void *alloc_code_gen_buffer(void)
 {
     int flags = MAP_PRIVATE | MAP_ANONYMOUS;
     uintptr_t start = 0;
-    size_t size = tcg_ctx.code_gen_buffer_size;
+    size_t size = tcg_ctx->code_gen_buffer_size;
     void *buf;
 
     /* Constrain the position of the buffer based on the host cpu.
@@ -650,7 +909,7 @@ static inline void *alloc_code_gen_buffer(void)
     flags |= MAP_32BIT;
     /* Cannot expect to map more than 800MB in low memory.  */
     if (size > 800u * 1024 * 1024) {
-        tcg_ctx.code_gen_buffer_size = size = 800u * 1024 * 1024;
+        tcg_ctx->code_gen_buffer_size = size = 800u * 1024 * 1024;
     }
 # elif defined(__sparc__)
     start = 0x40000000ul;
@@ -690,7 +949,7 @@ static inline void *alloc_code_gen_buffer(void)
         default:
             /* Split the original buffer.  Free the smaller half.  */
             buf2 = split_cross_256mb(buf, size);
-            size2 = tcg_ctx.code_gen_buffer_size;
+            size2 = tcg_ctx->code_gen_buffer_size;
             if (buf == buf2) {
                 munmap(buf + size2 + qemu_real_host_page_size, size - size2);
             } else {
@@ -714,30 +973,94 @@ static inline void *alloc_code_gen_buffer(void)
 }
 #endif /* USE_STATIC_CODE_GEN_BUFFER, WIN32, POSIX */
 
-static inline void code_gen_alloc(size_t tb_size)
+static void tb_regions_init(void)
 {
-    tcg_ctx.code_gen_buffer_size = size_code_gen_buffer(tb_size);
-    tcg_ctx.code_gen_buffer = alloc_code_gen_buffer();
-    if (tcg_ctx.code_gen_buffer == NULL) {
-        fprintf(stderr, "Could not allocate dynamic translator buffer\n");
-        exit(1);
-    }
+    size_t i, size = tcg_ctx->code_gen_buffer_size;
+
+#ifdef CONFIG_USER_ONLY
+    tb_regions.n = MAX(size / TB_REGION_SIZE, 1);
+#else
+    tb_regions.n = 1;
+#endif
+    tb_regions.buf = tcg_ctx->code_gen_buffer;
+    tb_regions.size = QEMU_ALIGN_DOWN(size / tb_regions.n, CODE_GEN_ALIGN);
 
     /* Estimate a good size for the number of TBs we can support.  We
        still haven't deducted the prologue from the buffer size here,
        but that's minimal and won't affect the estimate much.  */
-    tcg_ctx.code_gen_max_blocks
-        = tcg_ctx.code_gen_buffer_size / CODE_GEN_AVG_BLOCK_SIZE;
-    tcg_ctx.tb_ctx.tbs = g_new(TranslationBlock, tcg_ctx.code_gen_max_blocks);
+    tb_regions.max_tbs = tb_regions.size / CODE_GEN_AVG_BLOCK_SIZE;
+    tb_ctx.tbs = g_new(TranslationBlock,
+                       tb_regions.n * tb_regions.max_tbs);
+
+    tb_regions.regions = g_new0(TBRegion, tb_regions.n);
+    for (i = 0; i < tb_regions.n; i++) {
+        tb_regions.regions[i].tbs = tb_ctx.tbs + i * tb_regions.max_tbs;
+    }
+}
+
+/* The prologue is carved from the start of the first region, and the
+   last region runs to the end of the buffer.  */
+static void tb_region_bounds(size_t i, void **pstart, void **pend)
+{
+    void *start = tb_regions.buf + i * tb_regions.size;
+    void *end = start + tb_regions.size;
+
+    if (i == 0) {
+        start = tcg_init_ctx.code_gen_buffer;
+    }
+    if (i == tb_regions.n - 1) {
+        end = tcg_init_ctx.code_gen_buffer + tcg_init_ctx.code_gen_buffer_size;
+    }
+    *pstart = start;
+    *pend = end;
+}
+
+/* Give the next free region to the current context.  Return false if
+   there is none left for it: the thread must then use the shared
+   context or, if that is the shared context, flush the buffer.  */
+static bool tb_region_alloc(void)
+{
+    TBRegionSlot *slot = tb_region_slot();
+    size_t i;
+    void *start, *end;
+
+    if (slot != &tb_region_shared &&
+        atomic_fetch_inc(&tb_regions.nb_private) >= tb_regions.n / 2) {
+        return false;
+    }
+    i = atomic_fetch_inc(&tb_regions.next);
+    if (i >= tb_regions.n) {
+        return false;
+    }
+    tb_region_bounds(i, &start, &end);
+    slot->region = &tb_regions.regions[i];
+    slot->region->code_ptr = start;
+    slot->flush_count = tb_ctx.tb_flush_count;
+    tcg_ctx->code_gen_highwater = end - TB_REGION_HIGHWATER;
+    return true;
+}
+
+static inline void code_gen_alloc(size_t tb_size)
+{
+    tcg_ctx->code_gen_buffer_size = size_code_gen_buffer(tb_size);
+    tcg_ctx->code_gen_buffer = alloc_code_gen_buffer();
+    if (tcg_ctx->code_gen_buffer == NULL) {
+        fprintf(stderr, "Could not allocate dynamic translator buffer\n");
+        exit(1);
+    }
 
-    qemu_mutex_init(&tcg_ctx.tb_ctx.tb_lock);
+    tb_regions_init();
+    qemu_mutex_init(&tb_ctx.tb_lock);
+#ifdef CONFIG_USER_ONLY
+    tb_translate_lock_init();
+#endif
 }
 
 static void tb_htable_init(void)
 {
     unsigned int mode = QHT_MODE_AUTO_RESIZE;
 
-    qht_init(&tcg_ctx.tb_ctx.htable, CODE_GEN_HTABLE_SIZE, mode);
+    qht_init(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE, mode);
 }
 
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
@@ -752,40 +1075,76 @@ void tcg_exec_init(unsigned long tb_size)
 #if defined(CONFIG_SOFTMMU)
     /* There's no guest base to take into account, so go ahead and
        initialize the prologue now.  */
-    tcg_prologue_init(&tcg_ctx);
+    tcg_prologue_init(&tcg_init_ctx);
 #endif
 }
 
 bool tcg_enabled(void)
 {
-    return tcg_ctx.code_gen_buffer != NULL;
+    return tcg_init_ctx.code_gen_buffer != NULL;
 }
 
 /* Allocate a new translation block. Flush the translation buffer if
    too many translation blocks or too much generated code. */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    TBRegionSlot *slot = tb_region_slot();
+    TBRegion *r = slot->region;
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs >= tcg_ctx.code_gen_max_blocks) {
-        return NULL;
+    if (unlikely(!r || slot->flush_count != tb_ctx.tb_flush_count ||
+                 r->nb_tbs >= tb_regions.max_tbs)) {
+        if (!tb_region_alloc()) {
+            return NULL;
+        }
+        r = slot->region;
     }
-    tb = &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs++];
+    tb = &r->tbs[r->nb_tbs];
     tb->pc = pc;
     tb->cflags = 0;
+    tb->tc_ptr = r->code_ptr;
+    /* tb_find_pc() may look at the region from another thread.  */
+    smp_wmb();
+    atomic_set(&r->nb_tbs, r->nb_tbs + 1);
     return tb;
 }
 
 void tb_free(TranslationBlock *tb)
 {
+    TBRegionSlot *slot = tb_region_slot();
+    TBRegion *r = slot->region;
+
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (tcg_ctx.tb_ctx.nb_tbs > 0 &&
-            tb == &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs - 1]) {
-        tcg_ctx.code_gen_ptr = tb->tc_ptr;
-        tcg_ctx.tb_ctx.nb_tbs--;
+    if (r && slot->flush_count == tb_ctx.tb_flush_count &&
+        r->nb_tbs > 0 && tb == &r->tbs[r->nb_tbs - 1]) {
+        r->code_ptr = tb->tc_ptr;
+        atomic_set(&r->nb_tbs, r->nb_tbs - 1);
+    }
+}
+
+static int tb_count(void)
+{
+    size_t i;
+    int n = 0;
+
+    for (i = 0; i < tb_regions.n; i++) {
+        n += atomic_read(&tb_regions.regions[i].nb_tbs);
+    }
+    return n;
+}
+
+static size_t tb_code_size(void)
+{
+    size_t i, size = 0;
+    void *start, *end;
+
+    for (i = 0; i < MIN(atomic_read(&tb_regions.next), tb_regions.n); i++) {
+        tb_region_bounds(i, &start, &end);
+        size += atomic_read(&tb_regions.regions[i].code_ptr) - start;
     }
+    return size;
 }
 
 static inline void invalidate_page_bitmap(PageDesc *p)
@@ -830,38 +1189,53 @@ static void page_flush_tb(void)
     }
 }
 
-/* flush all the translation blocks */
-/* XXX: tb_flush is currently not thread safe */
+/* flush all the translation blocks
+ *
+ * Called with tb_lock and mmap_lock held.  In user mode it also takes
+ * tb_translate_lock for writing, so the caller must not hold it for
+ * reading (as tb_gen_code_parallel() does while it generates code):
+ * that would deadlock on itself.
+ */
 void tb_flush(CPUState *cpu)
 {
+    size_t i;
+
     if (!tcg_enabled()) {
         return;
     }
+#ifdef CONFIG_USER_ONLY
+    assert(!have_tb_translate_lock);
+    /* Wait for the threads that are generating code in their regions.  */
+    pthread_rwlock_wrlock(&tb_translate_lock);
+#endif
 #if defined(DEBUG_FLUSH)
-    printf("qemu: flush code_size=%ld nb_tbs=%d avg_tb_size=%ld\n",
-           (unsigned long)(tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer),
-           tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.tb_ctx.nb_tbs > 0 ?
-           ((unsigned long)(tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer)) /
-           tcg_ctx.tb_ctx.nb_tbs : 0);
+    printf("qemu: flush code_size=%zu nb_tbs=%d avg_tb_size=%zu\n",
+           tb_code_size(), tb_count(),
+           tb_count() > 0 ? tb_code_size() / tb_count() : 0);
 #endif
-    if ((unsigned long)(tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer)
-        > tcg_ctx.code_gen_buffer_size) {
+    if (tb_code_size() > tcg_init_ctx.code_gen_buffer_size) {
         cpu_abort(cpu, "Internal error: code buffer overflow\n");
     }
-    tcg_ctx.tb_ctx.nb_tbs = 0;
+    for (i = 0; i < tb_regions.n; i++) {
+        tb_regions.regions[i].nb_tbs = 0;
+    }
+    tb_regions.next = 0;
+    tb_regions.nb_private = 0;
 
     CPU_FOREACH(cpu) {
         memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
         cpu->tb_flushed = true;
     }
 
-    qht_reset_size(&tcg_ctx.tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
+    qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
 
-    tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
-    tcg_ctx.tb_ctx.tb_flush_count++;
+    tb_ctx.tb_flush_count++;
+#ifdef CONFIG_USER_ONLY
+    pthread_rwlock_unlock(&tb_translate_lock);
+#endif
 }
 
 #ifdef DEBUG_TB_CHECK
@@ -881,7 +1255,7 @@ do_tb_invalidate_check(struct qht *ht, void *p, uint32_t hash, void *userp)
 static void tb_invalidate_check(target_ulong address)
 {
     address &= TARGET_PAGE_MASK;
-    qht_iter(&tcg_ctx.tb_ctx.htable, do_tb_invalidate_check, &address);
+    qht_iter(&tb_ctx.htable, do_tb_invalidate_check, &address);
 }
 
 static void
@@ -901,7 +1275,7 @@ do_tb_page_check(struct qht *ht, void *p, uint32_t hash, void *userp)
 /* verify that all the pages have correct rights for code */
 static void tb_page_check(void)
 {
-    qht_iter(&tcg_ctx.tb_ctx.htable, do_tb_page_check, NULL);
+    qht_iter(&tb_ctx.htable, do_tb_page_check, NULL);
 }
 
 #endif
@@ -993,7 +1367,7 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     /* remove the TB from the hash list */
     phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
     h = tb_hash_func(phys_pc, tb->pc, tb->flags);
-    qht_remove(&tcg_ctx.tb_ctx.htable, tb, h);
+    qht_remove(&tb_ctx.htable, tb, h);
 
     /* remove the TB from the page list */
     if (tb->page_addr[0] != page_addr) {
@@ -1022,7 +1396,7 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     /* suppress any remaining jumps to this TB */
     tb_jmp_unlink(tb);
 
-    tcg_ctx.tb_ctx.tb_phys_invalidate_count++;
+    tb_ctx.tb_phys_invalidate_count++;
 }
 
 #ifdef CONFIG_SOFTMMU
@@ -1078,25 +1452,15 @@ static inline void tb_alloc_page(TranslationBlock *tb,
     invalidate_page_bitmap(p);
 
 #if defined(CONFIG_USER_ONLY)
-    if (p->flags & PAGE_WRITE) {
-        target_ulong addr;
-        PageDesc *p2;
+    if (page_get_flags(page_addr) & PAGE_WRITE) {
         int prot;
 
         /* force the host page as non writable (writes will have a
            page fault + mprotect overhead) */
         page_addr &= qemu_host_page_mask;
-        prot = 0;
-        for (addr = page_addr; addr < page_addr + qemu_host_page_size;
-            addr += TARGET_PAGE_SIZE) {
-
-            p2 = page_find(addr >> TARGET_PAGE_BITS);
-            if (!p2) {
-                continue;
-            }
-            prot |= p2->flags;
-            p2->flags &= ~PAGE_WRITE;
-          }
+        prot = pageflags_set_clear(page_addr,
+                                   page_addr + qemu_host_page_size - 1,
+                                   0, PAGE_WRITE);
         mprotect(g2h(page_addr), qemu_host_page_size,
                  (prot & PAGE_BITS) & ~PAGE_WRITE);
 #ifdef DEBUG_TB_INVALIDATE
@@ -1126,7 +1490,7 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
 
     /* add in the hash table */
     h = tb_hash_func(phys_pc, tb->pc, tb->flags);
-    qht_insert(&tcg_ctx.tb_ctx.htable, tb, h);
+    qht_insert(&tb_ctx.htable, tb, h);
 
     /* add in the page list */
     tb_alloc_page(tb, 0, phys_pc & TARGET_PAGE_MASK);
@@ -1141,10 +1505,14 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
 #endif
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu,
-                              target_ulong pc, target_ulong cs_base,
-                              uint32_t flags, int cflags)
+/* Generate the code of a new TB in the region of the calling thread,
+ * using its own tcg_ctx.  The TB is not linked yet: the caller must pass
+ * it to tb_link_page() or tb_free().  Return NULL if there is no room
+ * left before the buffer is flushed.
+ */
+static TranslationBlock *tb_translate(CPUState *cpu,
+                                      target_ulong pc, target_ulong cs_base,
+                                      uint32_t flags, int cflags)
 {
     CPUArchState *env = cpu->env_ptr;
     TranslationBlock *tb;
@@ -1161,73 +1529,69 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         cflags |= CF_USE_ICOUNT;
     }
 
+ retry:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
- buffer_overflow:
-        /* flush must be done */
-        tb_flush(cpu);
-        /* cannot fail at this point */
-        tb = tb_alloc(pc);
-        assert(tb != NULL);
+        return NULL;
     }
 
-    gen_code_buf = tcg_ctx.code_gen_ptr;
-    tb->tc_ptr = gen_code_buf;
+    gen_code_buf = tb->tc_ptr;
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
 
 #ifdef CONFIG_PROFILER
-    tcg_ctx.tb_count1++; /* includes aborted translations because of
+    tcg_ctx->tb_count1++; /* includes aborted translations because of
                        exceptions */
     ti = profile_getclock();
 #endif
 
-    tcg_func_start(&tcg_ctx);
+    tcg_func_start(tcg_ctx);
 
-    tcg_ctx.cpu = ENV_GET_CPU(env);
+    tcg_ctx->cpu = ENV_GET_CPU(env);
     gen_intermediate_code(env, tb);
-    tcg_ctx.cpu = NULL;
+    tcg_ctx->cpu = NULL;
 
     trace_translate_block(tb, tb->pc, tb->tc_ptr);
 
     /* generate machine code */
     tb->jmp_reset_offset[0] = TB_JMP_RESET_OFFSET_INVALID;
     tb->jmp_reset_offset[1] = TB_JMP_RESET_OFFSET_INVALID;
-    tcg_ctx.tb_jmp_reset_offset = tb->jmp_reset_offset;
+    tcg_ctx->tb_jmp_reset_offset = tb->jmp_reset_offset;
 #ifdef USE_DIRECT_JUMP
-    tcg_ctx.tb_jmp_insn_offset = tb->jmp_insn_offset;
-    tcg_ctx.tb_jmp_target_addr = NULL;
+    tcg_ctx->tb_jmp_insn_offset = tb->jmp_insn_offset;
+    tcg_ctx->tb_jmp_target_addr = NULL;
 #else
-    tcg_ctx.tb_jmp_insn_offset = NULL;
-    tcg_ctx.tb_jmp_target_addr = tb->jmp_target_addr;
+    tcg_ctx->tb_jmp_insn_offset = NULL;
+    tcg_ctx->tb_jmp_target_addr = tb->jmp_target_addr;
 #endif
 
 #ifdef CONFIG_PROFILER
-    tcg_ctx.tb_count++;
-    tcg_ctx.interm_time += profile_getclock() - ti;
-    tcg_ctx.code_time -= profile_getclock();
+    tcg_ctx->tb_count++;
+    tcg_ctx->interm_time += profile_getclock() - ti;
+    tcg_ctx->code_time -= profile_getclock();
 #endif
 
     /* ??? Overflow could be handled better here.  In particular, we
        don't need to re-do gen_intermediate_code, nor should we re-do
        the tcg optimization currently hidden inside tcg_gen_code.  All
-       that should be required is to flush the TBs, allocate a new TB,
-       re-initialize it per above, and re-do the actual code generation.  */
-    gen_code_size = tcg_gen_code(&tcg_ctx, tb);
+       that should be required is to take a new region, allocate a new
+       TB, re-initialize it per above, and re-do the actual code
+       generation.  */
+    gen_code_size = tcg_gen_code(tcg_ctx, tb);
     if (unlikely(gen_code_size < 0)) {
-        goto buffer_overflow;
+        goto region_full;
     }
     search_size = encode_search(tb, (void *)gen_code_buf + gen_code_size);
     if (unlikely(search_size < 0)) {
-        goto buffer_overflow;
+        goto region_full;
     }
 
 #ifdef CONFIG_PROFILER
-    tcg_ctx.code_time += profile_getclock();
-    tcg_ctx.code_in_len += tb->size;
-    tcg_ctx.code_out_len += gen_code_size;
-    tcg_ctx.search_out_len += search_size;
+    tcg_ctx->code_time += profile_getclock();
+    tcg_ctx->code_in_len += tb->size;
+    tcg_ctx->code_out_len += gen_code_size;
+    tcg_ctx->search_out_len += search_size;
 #endif
 
 #ifdef DEBUG_DISAS
@@ -1240,9 +1604,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
 #endif
 
-    tcg_ctx.code_gen_ptr = (void *)
+    atomic_set(&tb_region_slot()->region->code_ptr, (void *)
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
-                 CODE_GEN_ALIGN);
+                 CODE_GEN_ALIGN));
 
     /* init jump list */
     assert(((uintptr_t)tb & 3) == 0);
@@ -1264,15 +1628,113 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
+    /* Kept for tb_link_page(), which sets them for good.  */
+    tb->page_addr[0] = phys_pc;
+    tb->page_addr[1] = phys_page2;
+    return tb;
+
+ region_full:
+    /* Start over in the next region, if there is one.  */
+    tb_free(tb);
+    if (!tb_region_alloc()) {
+        return NULL;
+    }
+    goto retry;
+}
+
+/* Called with mmap_lock held for user mode emulation.  */
+TranslationBlock *tb_gen_code(CPUState *cpu,
+                              target_ulong pc, target_ulong cs_base,
+                              uint32_t flags, int cflags)
+{
+    TranslationBlock *tb;
+
+    tb = tb_translate(cpu, pc, cs_base, flags, cflags);
+    while (unlikely(!tb)) {
+        /* flush must be done */
+        tb_flush(cpu);
+        tb = tb_translate(cpu, pc, cs_base, flags, cflags);
+    }
+
     /* As long as consistency of the TB stuff is provided by tb_lock in user
      * mode and is implicit in single-threaded softmmu emulation, no explicit
      * memory barrier is required before tb_link_page() makes the TB visible
      * through the physical hash table and physical page list.
      */
-    tb_link_page(tb, phys_pc, phys_page2);
+    tb_link_page(tb, tb->page_addr[0], tb->page_addr[1]);
+    return tb;
+}
+
+#ifdef CONFIG_USER_ONLY
+/* Translate with the shared context, for a thread that has no region
+   of its own left.  Called with mmap_lock and tb_lock held.  */
+static TranslationBlock *tb_gen_code_shared(CPUState *cpu,
+                                            target_ulong pc,
+                                            target_ulong cs_base,
+                                            uint32_t flags, int cflags)
+{
+    TCGContext *s = tcg_ctx;
+    TranslationBlock *tb;
+
+    tcg_ctx = &tcg_init_ctx;
+    tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+    tcg_ctx = s;
     return tb;
 }
 
+/* Like tb_gen_code(), but called without any lock held: the code is
+ * generated with the thread's own tcg_ctx and region, and only
+ * publishing the TB takes mmap_lock and tb_lock, so that threads
+ * translate concurrently.  If another thread published the same TB in
+ * the meantime, that one is returned instead.  A thread that has no
+ * region left translates under the locks with the shared context.
+ *
+ * Returns with tb_lock held.
+ */
+TranslationBlock *tb_gen_code_parallel(CPUState *cpu,
+                                       target_ulong pc, target_ulong cs_base,
+                                       uint32_t flags, int cflags)
+{
+    TranslationBlock *tb, *found;
+    unsigned write_count;
+    int flush_count;
+
+    while (true) {
+        tb_translate_lock_rd();
+        flush_count = tb_ctx.tb_flush_count;
+        write_count = atomic_read(&tb_ctx.code_write_count);
+        smp_rmb();
+        tb = tb_translate(cpu, pc, cs_base, flags, cflags);
+        tb_translate_unlock();
+
+        mmap_lock();
+        tb_lock();
+        if (tb_ctx.tb_flush_count != flush_count) {
+            /* The region has been taken back, try again.  */
+        } else if (tb && tb_ctx.code_write_count != write_count) {
+            /* The code may have changed while it was translated.  */
+            tb_free(tb);
+        } else {
+            found = tb_htable_lookup(cpu, pc, cs_base, flags);
+            if (found) {
+                if (tb) {
+                    tb_free(tb);
+                }
+                tb = found;
+            } else if (!tb) {
+                tb = tb_gen_code_shared(cpu, pc, cs_base, flags, cflags);
+            } else {
+                tb_link_page(tb, tb->page_addr[0], tb->page_addr[1]);
+            }
+            mmap_unlock();
+            return tb;
+        }
+        tb_unlock();
+        mmap_unlock();
+    }
+}
+#endif
+
 /*
  * Invalidate all TBs which intersect with the target physical address range
  * [start;end[. NOTE: start and end may refer to *different* physical pages.
@@ -1284,10 +1746,21 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  */
 void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t end)
 {
+    atomic_set(&tb_ctx.code_write_count, tb_ctx.code_write_count + 1);
     while (start < end) {
-        tb_invalidate_phys_page_range(start, end, 0);
-        start &= TARGET_PAGE_MASK;
-        start += TARGET_PAGE_SIZE;
+        if (page_find(start >> TARGET_PAGE_BITS)) {
+            tb_invalidate_phys_page_range(start, end, 0);
+            start &= TARGET_PAGE_MASK;
+            start += TARGET_PAGE_SIZE;
+        } else {
+            /* No code anywhere in this level 0 table, skip it.  */
+            tb_page_addr_t next = (start | (((tb_page_addr_t)V_L2_SIZE
+                                             << TARGET_PAGE_BITS) - 1)) + 1;
+            if (next <= start) {
+                break;
+            }
+            start = next;
+        }
     }
 }
 
@@ -1510,20 +1983,28 @@ static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
     int m_min, m_max, m;
     uintptr_t v;
     TranslationBlock *tb;
+    TBRegion *r;
+    size_t i;
 
-    if (tcg_ctx.tb_ctx.nb_tbs <= 0) {
+    if (tc_ptr < (uintptr_t)tcg_init_ctx.code_gen_buffer ||
+        tc_ptr >= (uintptr_t)tcg_init_ctx.code_gen_buffer +
+                  tcg_init_ctx.code_gen_buffer_size) {
         return NULL;
     }
-    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
-        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_ptr) {
+    /* TBs are sorted by tc_ptr within each region.  */
+    i = MIN((tc_ptr - (uintptr_t)tb_regions.buf) / tb_regions.size,
+            tb_regions.n - 1);
+    r = &tb_regions.regions[i];
+    m_max = atomic_read(&r->nb_tbs) - 1;
+    smp_rmb();
+    if (m_max < 0) {
         return NULL;
     }
     /* binary search (cf Knuth) */
     m_min = 0;
-    m_max = tcg_ctx.tb_ctx.nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tcg_ctx.tb_ctx.tbs[m];
+        tb = &r->tbs[m];
         v = (uintptr_t)tb->tc_ptr;
         if (v == tc_ptr) {
             return tb;
@@ -1533,7 +2014,7 @@ static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
             m_min = m + 1;
         }
     }
-    return &tcg_ctx.tb_ctx.tbs[m_max];
+    return m_max < 0 ? NULL : &r->tbs[m_max];
 }
 
 #if !defined(CONFIG_USER_ONLY)
@@ -1706,8 +2187,9 @@ static void print_qht_statistics(FILE *f, fprintf_function cpu_fprintf,
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
+    int j, nb_tbs, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    size_t i, code_size;
     TranslationBlock *tb;
     struct qht_stats hst;
 
@@ -1716,59 +2198,54 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for (i = 0; i < tcg_ctx.tb_ctx.nb_tbs; i++) {
-        tb = &tcg_ctx.tb_ctx.tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size) {
-            max_target_code_size = tb->size;
-        }
-        if (tb->page_addr[1] != -1) {
-            cross_page++;
-        }
-        if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
-            direct_jmp_count++;
-            if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
-                direct_jmp2_count++;
+    for (i = 0; i < tb_regions.n; i++) {
+        for (j = 0; j < tb_regions.regions[i].nb_tbs; j++) {
+            tb = &tb_regions.regions[i].tbs[j];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size) {
+                max_target_code_size = tb->size;
+            }
+            if (tb->page_addr[1] != -1) {
+                cross_page++;
+            }
+            if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+                direct_jmp_count++;
+                if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
+    nb_tbs = tb_count();
+    code_size = tb_code_size();
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
-    cpu_fprintf(f, "gen code size       %td/%zd\n",
-                tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer,
-                tcg_ctx.code_gen_highwater - tcg_ctx.code_gen_buffer);
-    cpu_fprintf(f, "TB count            %d/%d\n",
-            tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.code_gen_max_blocks);
+    cpu_fprintf(f, "gen code size       %zd/%zd\n",
+                code_size, tcg_init_ctx.code_gen_buffer_size);
+    cpu_fprintf(f, "TB count            %d/%zd\n",
+            nb_tbs, tb_regions.n * tb_regions.max_tbs);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
-            tcg_ctx.tb_ctx.nb_tbs ? target_code_size /
-                    tcg_ctx.tb_ctx.nb_tbs : 0,
+            nb_tbs ? target_code_size / nb_tbs : 0,
             max_target_code_size);
-    cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-            tcg_ctx.tb_ctx.nb_tbs ? (tcg_ctx.code_gen_ptr -
-                                     tcg_ctx.code_gen_buffer) /
-                                     tcg_ctx.tb_ctx.nb_tbs : 0,
-                target_code_size ? (double) (tcg_ctx.code_gen_ptr -
-                                             tcg_ctx.code_gen_buffer) /
-                                             target_code_size : 0);
+    cpu_fprintf(f, "TB avg host size    %zd bytes (expansion ratio: %0.1f)\n",
+            nb_tbs ? code_size / nb_tbs : 0,
+            target_code_size ? (double) code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n", cross_page,
-            tcg_ctx.tb_ctx.nb_tbs ? (cross_page * 100) /
-                                    tcg_ctx.tb_ctx.nb_tbs : 0);
+            nb_tbs ? (cross_page * 100) / nb_tbs : 0);
     cpu_fprintf(f, "direct jump count   %d (%d%%) (2 jumps=%d %d%%)\n",
                 direct_jmp_count,
-                tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp_count * 100) /
-                        tcg_ctx.tb_ctx.nb_tbs : 0,
+                nb_tbs ? (direct_jmp_count * 100) / nb_tbs : 0,
                 direct_jmp2_count,
-                tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp2_count * 100) /
-                        tcg_ctx.tb_ctx.nb_tbs : 0);
+                nb_tbs ? (direct_jmp2_count * 100) / nb_tbs : 0);
 
-    qht_statistics_init(&tcg_ctx.tb_ctx.htable, &hst);
+    qht_statistics_init(&tb_ctx.htable, &hst);
     print_qht_statistics(f, cpu_fprintf, hst);
     qht_statistics_destroy(&hst);
 
     cpu_fprintf(f, "\nStatistics:\n");
-    cpu_fprintf(f, "TB flush count      %d\n", tcg_ctx.tb_ctx.tb_flush_count);
+    cpu_fprintf(f, "TB flush count      %d\n", tb_ctx.tb_flush_count);
     cpu_fprintf(f, "TB invalidate count %d\n",
-            tcg_ctx.tb_ctx.tb_phys_invalidate_count);
+            tb_ctx.tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
     tcg_dump_info(f, cpu_fprintf);
 }
@@ -1790,88 +2267,35 @@ void cpu_interrupt(CPUState *cpu, int mask)
  * Walks guest process memory "regions" one by one
  * and calls callback function 'fn' for each region.
  */
-struct walk_memory_regions_data {
-    walk_memory_regions_fn fn;
-    void *priv;
-    target_ulong start;
-    int prot;
-};
-
-static int walk_memory_regions_end(struct walk_memory_regions_data *data,
-                                   target_ulong end, int new_prot)
-{
-    if (data->start != -1u) {
-        int rc = data->fn(data->priv, data->start, end, data->prot);
-        if (rc != 0) {
-            return rc;
-        }
-    }
-
-    data->start = (new_prot ? end : -1u);
-    data->prot = new_prot;
-
-    return 0;
-}
-
-static int walk_memory_regions_1(struct walk_memory_regions_data *data,
-                                 target_ulong base, int level, void **lp)
+int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
 {
-    target_ulong pa;
-    int i, rc;
-
-    if (*lp == NULL) {
-        return walk_memory_regions_end(data, base, 0);
-    }
-
-    if (level == 0) {
-        PageDesc *pd = *lp;
+    PageFlagsNode *p;
+    target_ulong start = 0, end = 0;
+    int prot = 0;
+    int rc = 0;
 
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            int prot = pd[i].flags;
-
-            pa = base | (i << TARGET_PAGE_BITS);
-            if (prot != data->prot) {
-                rc = walk_memory_regions_end(data, pa, prot);
-                if (rc != 0) {
-                    return rc;
-                }
-            }
+    mmap_lock();
+    for (p = pageflags_find(0, -1); p; p = pageflags_next(p, 0, -1)) {
+        if (prot && p->itree.start == end && p->flags == prot) {
+            end = p->itree.last + 1;
+            continue;
         }
-    } else {
-        void **pp = *lp;
-
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            pa = base | ((target_ulong)i <<
-                (TARGET_PAGE_BITS + V_L2_BITS * level));
-            rc = walk_memory_regions_1(data, pa, level - 1, pp + i);
+        if (prot) {
+            rc = fn(priv, start, end, prot);
             if (rc != 0) {
-                return rc;
+                break;
             }
         }
+        start = p->itree.start;
+        end = p->itree.last + 1;
+        prot = p->flags;
     }
-
-    return 0;
-}
-
-int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
-{
-    struct walk_memory_regions_data data;
-    uintptr_t i;
-
-    data.fn = fn;
-    data.priv = priv;
-    data.start = -1u;
-    data.prot = 0;
-
-    for (i = 0; i < V_L1_SIZE; i++) {
-        int rc = walk_memory_regions_1(&data, (target_ulong)i << (V_L1_SHIFT + TARGET_PAGE_BITS),
-                                       V_L1_SHIFT / V_L2_BITS - 1, l1_map + i);
-        if (rc != 0) {
-            return rc;
-        }
+    if (rc == 0 && prot) {
+        rc = fn(priv, start, end, prot);
     }
+    mmap_unlock();
 
-    return walk_memory_regions_end(&data, 0, 0);
+    return rc;
 }
 
 static int dump_region(void *priv, target_ulong start,
@@ -1900,13 +2324,88 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageDesc *p;
+    PageFlagsNode *p;
+    int flags = 0;
+    bool found;
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        return 0;
+    rcu_read_lock();
+    p = pageflags_find(address, address);
+    found = p != NULL;
+    if (found) {
+        flags = atomic_read(&p->flags);
+    }
+    rcu_read_unlock();
+
+    if (found || have_mmap_lock()) {
+        return flags;
+    }
+
+    mmap_lock();
+    p = pageflags_find(address, address);
+    flags = p ? p->flags : 0;
+    mmap_unlock();
+    return flags;
+}
+
+/* Return true if no page of [start, last] is mapped.
+   The mmap_lock should already be held.  */
+bool page_check_range_empty(target_ulong start, target_ulong last)
+{
+    assert(start <= last);
+    return pageflags_find(start, last) == NULL;
+}
+
+/* Find the lowest range of @len bytes, aligned to @align, with no page
+   mapped within [min, max], or return -1.
+   The mmap_lock should already be held.  */
+target_ulong page_find_range_empty(target_ulong min, target_ulong max,
+                                   target_ulong len, target_ulong align)
+{
+    assert(len != 0);
+    assert(is_power_of_2(align));
+
+    while (true) {
+        target_ulong aligned = ROUND_UP(min, align);
+        PageFlagsNode *p;
+
+        if (aligned < min || aligned > max || len - 1 > max - aligned) {
+            return -1;
+        }
+        min = aligned;
+
+        p = pageflags_find(min, min + len - 1);
+        if (!p) {
+            return min;
+        }
+        if (p->itree.last >= max) {
+            return -1;
+        }
+        /* Skip over the mapping.  */
+        min = p->itree.last + 1;
+    }
+}
+
+/* Invalidate the code in the pages of [start, last] that are not
+   writable.  Only the pages with code have a PageDesc, so skip the
+   missing parts of the map a level 0 table at a time.  */
+static void page_invalidate_unwritable(target_ulong start, target_ulong last)
+{
+    tb_page_addr_t index = start >> TARGET_PAGE_BITS;
+    tb_page_addr_t last_index = last >> TARGET_PAGE_BITS;
+
+    while (index <= last_index) {
+        PageDesc *p = page_find(index);
+
+        if (!p) {
+            index = (index | (V_L2_SIZE - 1)) + 1;
+            continue;
+        }
+        if (p->first_tb &&
+            !(page_get_flags(index << TARGET_PAGE_BITS) & PAGE_WRITE)) {
+            tb_invalidate_phys_page(index << TARGET_PAGE_BITS, 0);
+        }
+        index++;
     }
-    return p->flags;
 }
 
 /* Modify the flags of a page and invalidate the code if necessary.
@@ -1914,7 +2413,7 @@ int page_get_flags(target_ulong address)
    on PAGE_WRITE.  The mmap_lock should already be held.  */
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
-    target_ulong addr, len;
+    target_ulong last;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -1925,33 +2424,59 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     assert(start < end);
 
     start = start & TARGET_PAGE_MASK;
-    end = TARGET_PAGE_ALIGN(end);
+    last = TARGET_PAGE_ALIGN(end) - 1;
 
     if (flags & PAGE_WRITE) {
         flags |= PAGE_WRITE_ORG;
-    }
-
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
 
         /* If the write protection bit is set, then we invalidate
            the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0);
+        page_invalidate_unwritable(start, last);
+    }
+
+    pageflags_set(start, last, flags);
+}
+
+/* Return -1 if [start, last] is not all mapped with @flags, 1 if it is
+   but some of it was made read-only because it holds code, else 0.  */
+static int pageflags_check(target_ulong start, target_ulong last, int flags)
+{
+    int ret = 0;
+
+    while (true) {
+        PageFlagsNode *p = pageflags_find(start, last);
+        int p_flags;
+
+        if (!p || p->itree.start > start) {
+            return -1;
+        }
+        p_flags = atomic_read(&p->flags);
+        if (!(p_flags & PAGE_VALID)) {
+            return -1;
+        }
+        if ((flags & PAGE_READ) && !(p_flags & PAGE_READ)) {
+            return -1;
+        }
+        if (flags & PAGE_WRITE) {
+            if (!(p_flags & PAGE_WRITE_ORG)) {
+                return -1;
+            }
+            if (!(p_flags & PAGE_WRITE)) {
+                ret = 1;
+            }
+        }
+        if (p->itree.last >= last) {
+            return ret;
         }
-        p->flags = flags;
+        start = p->itree.last + 1;
     }
 }
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
-    PageDesc *p;
-    target_ulong end;
+    target_ulong last;
     target_ulong addr;
+    int ret;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -1963,43 +2488,39 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     if (len == 0) {
         return 0;
     }
-    if (start + len - 1 < start) {
+    last = start + len - 1;
+    if (last < start) {
         /* We've wrapped around.  */
         return -1;
     }
 
-    /* must do before we loose bits in the next step */
-    end = TARGET_PAGE_ALIGN(start + len);
-    start = start & TARGET_PAGE_MASK;
-
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
-        if (!p) {
-            return -1;
-        }
-        if (!(p->flags & PAGE_VALID)) {
-            return -1;
-        }
+    rcu_read_lock();
+    ret = pageflags_check(start, last, flags);
+    rcu_read_unlock();
+    if (ret == 0) {
+        return 0;
+    }
 
-        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
-            return -1;
-        }
-        if (flags & PAGE_WRITE) {
-            if (!(p->flags & PAGE_WRITE_ORG)) {
-                return -1;
-            }
+    /* Confirm the failure, or unprotect the code pages, with the lock.  */
+    mmap_lock();
+    ret = pageflags_check(start, last, flags);
+    if (ret > 0) {
+        ret = 0;
+        for (addr = start & TARGET_PAGE_MASK; ; addr += TARGET_PAGE_SIZE) {
             /* unprotect the page if it was put read-only because it
                contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
-                if (!page_unprotect(addr, 0)) {
-                    return -1;
-                }
+            if (!(page_get_flags(addr) & PAGE_WRITE) &&
+                !page_unprotect(addr, 0)) {
+                ret = -1;
+                break;
+            }
+            if (addr == (last & TARGET_PAGE_MASK)) {
+                break;
             }
         }
     }
-    return 0;
+    mmap_unlock();
+    return ret;
 }
 
 /* called from signal handler: invalidate the code and unprotect the
@@ -2012,7 +2533,7 @@ int page_unprotect(target_ulong address, uintptr_t pc)
 {
     unsigned int prot;
     bool current_tb_invalidated;
-    PageDesc *p;
+    PageFlagsNode *p;
     target_ulong host_start, host_end, addr;
 
     /* Technically this isn't safe inside a signal handler.  However we
@@ -2020,7 +2541,7 @@ int page_unprotect(target_ulong address, uintptr_t pc)
        practice it seems to be ok.  */
     mmap_lock();
 
-    p = page_find(address >> TARGET_PAGE_BITS);
+    p = pageflags_find(address, address);
     if (!p) {
         mmap_unlock();
         return 0;
@@ -2032,13 +2553,11 @@ int page_unprotect(target_ulong address, uintptr_t pc)
         host_start = address & qemu_host_page_mask;
         host_end = host_start + qemu_host_page_size;
 
-        prot = 0;
+        prot = pageflags_set_clear(host_start, host_end - 1,
+                                   PAGE_WRITE, 0) | PAGE_WRITE;
+        atomic_set(&tb_ctx.code_write_count, tb_ctx.code_write_count + 1);
         current_tb_invalidated = false;
         for (addr = host_start ; addr < host_end ; addr += TARGET_PAGE_SIZE) {
-            p = page_find(addr >> TARGET_PAGE_BITS);
-            p->flags |= PAGE_WRITE;
-            prot |= p->flags;
-
             /* and since the content will be modified, we must invalidate
                the corresponding translated code. */
             current_tb_invalidated |= tb_invalidate_phys_page(addr, pc);
@@ -240,6 +240,8 @@ static void gui_setup_refresh(DisplayState *ds)
 
     if (need_timer && ds->gui_timer == NULL) {
         ds->gui_timer = timer_new_ms(QEMU_CLOCK_REALTIME, gui_update, ds);
+        /* A refresh a little late goes unnoticed */
+        timer_set_slack(ds->gui_timer, GUI_REFRESH_INTERVAL_DEFAULT / 3);
         timer_mod(ds->gui_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME));
     }
     if (!need_timer && ds->gui_timer != NULL) {
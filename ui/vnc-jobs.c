@@ -44,18 +44,27 @@
  * - VncState::output lock: used to make sure the output buffer is not corrupted
  *                          if two threads try to write on it at the same time
  *
- * While the VNC worker thread is working, the VncDisplay global lock is held
- * to avoid screen corruption (this does not block vnc_refresh() because it
- * uses trylock()) but the output lock is not held because the thread works on
- * its own output buffer.
+ * While a VNC worker thread is working, it holds the VncDisplay global lock
+ * in shared mode to avoid screen corruption (this does not block
+ * vnc_refresh() because it uses trylock(), unless the trylock has failed
+ * VNC_REFRESH_MAX_BUSY times in a row) but the output lock is not held
+ * because the thread works on its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * There are several worker threads, so that clients are encoded in
+ * parallel.  The encoders keep zlib streams and other state in VncState
+ * across updates, so the jobs of one client are still run one at a time
+ * and in order; a job stays on the queue until it is done.
  */
 
+#define VNC_MAX_WORKER_THREADS 4
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
+    QemuThread threads[VNC_MAX_WORKER_THREADS];
+    int nthreads;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
 };
@@ -63,8 +72,7 @@ struct VncJobQueue {
 typedef struct VncJobQueue VncJobQueue;
 
 /*
- * We use a single global queue, but most of the functions are
- * already reentrant, so we can easily add more than one encoding thread
+ * We use a single global queue, served by all the encoding threads
  */
 static VncJobQueue *queue;
 
@@ -144,7 +152,7 @@ void vnc_jobs_clear(VncState *vs)
 
     vnc_lock_queue(queue);
     QTAILQ_FOREACH_SAFE(job, &queue->jobs, next, tmp) {
-        if (job->vs == vs || !vs) {
+        if ((job->vs == vs || !vs) && !job->running) {
             QTAILQ_REMOVE(&queue->jobs, job, next);
         }
     }
@@ -215,6 +223,31 @@ static void vnc_async_encoding_end(VncState *orig, VncState *local)
     orig->lossy_rect = local->lossy_rect;
 }
 
+/*
+ * Return the first job that no other thread is running, and that does
+ * not have to wait for an earlier job of the same client.
+ */
+static VncJob *vnc_next_job_locked(VncJobQueue *queue)
+{
+    VncJob *job, *prev;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        if (job->running) {
+            continue;
+        }
+        for (prev = QTAILQ_FIRST(&queue->jobs); prev != job;
+             prev = QTAILQ_NEXT(prev, next)) {
+            if (prev->vs == job->vs) {
+                break;
+            }
+        }
+        if (prev == job) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
 static int vnc_worker_thread_loop(VncJobQueue *queue)
 {
     VncJob *job;
@@ -224,11 +257,13 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     int saved_offset;
 
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    while (!(job = vnc_next_job_locked(queue)) && !queue->exit) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
     /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
+    if (job) {
+        job->running = true;
+    }
     vnc_unlock_queue(queue);
 
     if (queue->exit) {
@@ -260,12 +295,12 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     saved_offset = vs.output.offset;
     vnc_write_u16(&vs, 0);
 
-    vnc_lock_display(job->vs->vd);
+    vnc_lock_display_shared(job->vs->vd);
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
         int n;
 
         if (job->vs->ioc == NULL) {
-            vnc_unlock_display(job->vs->vd);
+            vnc_unlock_display_shared(job->vs->vd);
             /* Copy persistent encoding data */
             vnc_async_encoding_end(job->vs, &vs);
             goto disconnected;
@@ -279,7 +314,7 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
         }
         g_free(entry);
     }
-    vnc_unlock_display(job->vs->vd);
+    vnc_unlock_display_shared(job->vs->vd);
 
     /* Put n_rectangles at the beginning of the message */
     vs.output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
@@ -329,14 +364,31 @@ static void vnc_queue_clear(VncJobQueue *q)
 static void *vnc_worker_thread(void *arg)
 {
     VncJobQueue *queue = arg;
-
-    qemu_thread_get_self(&queue->thread);
+    bool last;
 
     while (!vnc_worker_thread_loop(queue)) ;
-    vnc_queue_clear(queue);
+
+    vnc_lock_queue(queue);
+    last = --queue->nthreads == 0;
+    vnc_unlock_queue(queue);
+    if (last) {
+        vnc_queue_clear(queue);
+    }
     return NULL;
 }
 
+static long vnc_host_cpus(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO sysinfo;
+
+    GetSystemInfo(&sysinfo);
+    return sysinfo.dwNumberOfProcessors;
+#else
+    return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
 static bool vnc_worker_thread_running(void)
 {
     return queue; /* Check global queue */
@@ -345,12 +397,19 @@ static bool vnc_worker_thread_running(void)
 void vnc_start_worker_thread(void)
 {
     VncJobQueue *q;
+    long ncpus;
+    int i;
 
     if (vnc_worker_thread_running())
         return ;
 
+    /* Leave at least one CPU to the guest */
+    ncpus = vnc_host_cpus();
     q = vnc_queue_init();
-    qemu_thread_create(&q->thread, "vnc_worker", vnc_worker_thread, q,
-                       QEMU_THREAD_DETACHED);
+    q->nthreads = MAX(1, MIN(VNC_MAX_WORKER_THREADS, ncpus - 1));
     queue = q; /* Set global queue */
+    for (i = 0; i < q->nthreads; i++) {
+        qemu_thread_create(&q->threads[i], "vnc_worker", vnc_worker_thread, q,
+                           QEMU_THREAD_DETACHED);
+    }
 }
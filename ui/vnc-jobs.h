@@ -42,14 +42,30 @@ void vnc_jobs_consume_buffer(VncState *vs);
 void vnc_start_worker_thread(void);
 
 /* Locks */
+/* Fails if the display is locked or worker threads are encoding from it */
 static inline int vnc_trylock_display(VncDisplay *vd)
 {
-    return qemu_mutex_trylock(&vd->mutex);
+    int ret = qemu_mutex_trylock(&vd->mutex);
+
+    if (!ret && vd->encoders) {
+        qemu_mutex_unlock(&vd->mutex);
+        ret = EBUSY;
+    }
+    return ret;
 }
 
+/* Waits for the worker threads to stop encoding from the display; new
+ * encoders wait until the display is unlocked again.
+ */
 static inline void vnc_lock_display(VncDisplay *vd)
 {
     qemu_mutex_lock(&vd->mutex);
+    vd->lock_waiting = true;
+    while (vd->encoders) {
+        qemu_cond_wait(&vd->encoders_cond, &vd->mutex);
+    }
+    vd->lock_waiting = false;
+    qemu_cond_broadcast(&vd->encoders_cond);
 }
 
 static inline void vnc_unlock_display(VncDisplay *vd)
@@ -57,6 +73,26 @@ static inline void vnc_unlock_display(VncDisplay *vd)
     qemu_mutex_unlock(&vd->mutex);
 }
 
+/* Shared lock taken by the worker threads, which only read the display */
+static inline void vnc_lock_display_shared(VncDisplay *vd)
+{
+    qemu_mutex_lock(&vd->mutex);
+    while (vd->lock_waiting) {
+        qemu_cond_wait(&vd->encoders_cond, &vd->mutex);
+    }
+    vd->encoders++;
+    qemu_mutex_unlock(&vd->mutex);
+}
+
+static inline void vnc_unlock_display_shared(VncDisplay *vd)
+{
+    qemu_mutex_lock(&vd->mutex);
+    if (--vd->encoders == 0 && vd->lock_waiting) {
+        qemu_cond_broadcast(&vd->encoders_cond);
+    }
+    qemu_mutex_unlock(&vd->mutex);
+}
+
 static inline void vnc_lock_output(VncState *vs)
 {
     qemu_mutex_lock(&vs->output_mutex);
@@ -49,6 +49,7 @@
 #define VNC_REFRESH_INTERVAL_BASE GUI_REFRESH_INTERVAL_DEFAULT
 #define VNC_REFRESH_INTERVAL_INC  50
 #define VNC_REFRESH_INTERVAL_MAX  GUI_REFRESH_INTERVAL_IDLE
+#define VNC_REFRESH_MAX_BUSY      4
 static const struct timeval VNC_REFRESH_STATS = { 0, 500000 };
 static const struct timeval VNC_REFRESH_LOSSY = { 2, 0 };
 
@@ -2945,9 +2946,16 @@ static void vnc_refresh(DisplayChangeListener *dcl)
     graphic_hw_update(vd->dcl.con);
 
     if (vnc_trylock_display(vd)) {
-        update_displaychangelistener(&vd->dcl, VNC_REFRESH_INTERVAL_BASE);
-        return;
+        if (++vd->refresh_busy < VNC_REFRESH_MAX_BUSY) {
+            update_displaychangelistener(&vd->dcl, VNC_REFRESH_INTERVAL_BASE);
+            return;
+        }
+        /* Under steady encoding load, wait for the encoders rather than
+         * starve the refresh.
+         */
+        vnc_lock_display(vd);
     }
+    vd->refresh_busy = 0;
 
     has_dirty = vnc_refresh_server_surface(vd);
     vnc_unlock_display(vd);
@@ -3156,6 +3164,7 @@ void vnc_display_init(const char *id)
     vs->connections_limit = 32;
 
     qemu_mutex_init(&vs->mutex);
+    qemu_cond_init(&vs->encoders_cond);
     vnc_start_worker_thread();
 
     vs->dcl.ops = &dcl_ops;
@@ -157,6 +157,10 @@ struct VncDisplay
     int lock_key_sync;
     int key_delay_ms;
     QemuMutex mutex;
+    int encoders; /* worker threads reading the server surface */
+    QemuCond encoders_cond;
+    bool lock_waiting; /* vnc_lock_display() waits for the encoders */
+    int refresh_busy; /* refreshes skipped because of the encoders */
 
     QEMUCursor *cursor;
     int cursor_msize;
@@ -245,6 +249,7 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    bool running;
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
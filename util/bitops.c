@@ -13,8 +13,10 @@
 
 #include "qemu/osdep.h"
 #include "qemu/bitops.h"
+#include "qemu/cutils.h"
 
 #define BITOP_WORD(nr)		((nr) / BITS_PER_LONG)
+#define BITOP_SKIP_BITS		(512 * BITS_PER_BYTE)
 
 /*
  * Find the next set bit in a memory region.
@@ -58,6 +60,17 @@ unsigned long find_next_bit(const unsigned long *addr, unsigned long size,
         p += 4;
         result += 4*BITS_PER_LONG;
         size -= 4*BITS_PER_LONG;
+        /*
+         * A zero quad is a hint that the bitmap is sparse (dirty bitmaps
+         * usually are); skip the zero blocks that follow with the
+         * vectorized zero check.
+         */
+        while (size >= BITOP_SKIP_BITS &&
+               buffer_is_zero(p, BITOP_SKIP_BITS / BITS_PER_BYTE)) {
+            p += BITOP_SKIP_BITS / BITS_PER_LONG;
+            result += BITOP_SKIP_BITS;
+            size -= BITOP_SKIP_BITS;
+        }
     }
     while (size >= BITS_PER_LONG) {
         if ((tmp = *(p++))) {
@@ -0,0 +1,204 @@
+/*
+ * Interval trees
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ *
+ * The tree is a treap: a binary search tree on start which is also a
+ * max-heap on a random priority given to each node.  Insertion adds a
+ * leaf and rotates it up past the parents with a lower priority; removal
+ * rotates the node down, past its child with the higher priority, until
+ * it is a leaf.  Each node caches the highest last of its subtree, which
+ * the rotations keep up to date on the two nodes they move.
+ *
+ * The child links are published with atomic_rcu_set(), children first,
+ * so that a lookup running concurrently with an update always follows
+ * valid nodes and terminates; it may however miss the nodes that are
+ * being rotated, as documented in the header.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/interval-tree.h"
+
+static uint64_t interval_tree_subtree_last(IntervalTreeNode *node)
+{
+    uint64_t last = node->last;
+
+    if (node->left && node->left->subtree_last > last) {
+        last = node->left->subtree_last;
+    }
+    if (node->right && node->right->subtree_last > last) {
+        last = node->right->subtree_last;
+    }
+    return last;
+}
+
+/* Make the link from @parent (or the root) to @old point to @new.  */
+static void interval_tree_replace_child(IntervalTreeRoot *root,
+                                        IntervalTreeNode *parent,
+                                        IntervalTreeNode *old,
+                                        IntervalTreeNode *new)
+{
+    if (!parent) {
+        atomic_rcu_set(&root->root, new);
+    } else if (parent->left == old) {
+        atomic_rcu_set(&parent->left, new);
+    } else {
+        atomic_rcu_set(&parent->right, new);
+    }
+}
+
+/* Move @node above its parent, keeping the in-order sequence.  */
+static void interval_tree_rotate_up(IntervalTreeRoot *root,
+                                    IntervalTreeNode *node)
+{
+    IntervalTreeNode *parent = node->parent;
+    IntervalTreeNode *grandparent = parent->parent;
+    IntervalTreeNode *child;
+
+    if (parent->left == node) {
+        child = node->right;
+        atomic_rcu_set(&parent->left, child);
+        atomic_rcu_set(&node->right, parent);
+    } else {
+        child = node->left;
+        atomic_rcu_set(&parent->right, child);
+        atomic_rcu_set(&node->left, parent);
+    }
+    if (child) {
+        child->parent = parent;
+    }
+    parent->parent = node;
+    node->parent = grandparent;
+
+    parent->subtree_last = interval_tree_subtree_last(parent);
+    node->subtree_last = interval_tree_subtree_last(node);
+
+    interval_tree_replace_child(root, grandparent, parent, node);
+}
+
+void interval_tree_insert(IntervalTreeNode *node, IntervalTreeRoot *root)
+{
+    IntervalTreeNode *parent = NULL;
+    IntervalTreeNode **link = &root->root;
+    uint32_t seed = root->seed ? root->seed : 0x9e3779b9;
+
+    /* xorshift32 */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    root->seed = seed;
+
+    node->left = NULL;
+    node->right = NULL;
+    node->subtree_last = node->last;
+    node->priority = seed;
+
+    while (*link) {
+        parent = *link;
+        if (parent->subtree_last < node->last) {
+            parent->subtree_last = node->last;
+        }
+        link = node->start < parent->start ? &parent->left : &parent->right;
+    }
+    node->parent = parent;
+    atomic_rcu_set(link, node);
+
+    while (node->parent && node->parent->priority < node->priority) {
+        interval_tree_rotate_up(root, node);
+    }
+}
+
+void interval_tree_remove(IntervalTreeNode *node, IntervalTreeRoot *root)
+{
+    IntervalTreeNode *parent;
+
+    while (node->left || node->right) {
+        if (!node->right ||
+            (node->left && node->left->priority > node->right->priority)) {
+            interval_tree_rotate_up(root, node->left);
+        } else {
+            interval_tree_rotate_up(root, node->right);
+        }
+    }
+
+    parent = node->parent;
+    interval_tree_replace_child(root, parent, node, NULL);
+    for (; parent; parent = parent->parent) {
+        parent->subtree_last = interval_tree_subtree_last(parent);
+    }
+}
+
+/*
+ * Lowest node of the subtree of @node overlapping [start, last].
+ *
+ * If the left subtree has an interval ending at or after @start, the
+ * leftmost such interval is either the answer or starts after @last, in
+ * which case nothing to its right overlaps either; so there is no need
+ * to come back up.
+ */
+static IntervalTreeNode *interval_tree_subtree_search(IntervalTreeNode *node,
+                                                      uint64_t start,
+                                                      uint64_t last)
+{
+    while (true) {
+        IntervalTreeNode *left = atomic_rcu_read(&node->left);
+
+        if (left && start <= left->subtree_last) {
+            node = left;
+            continue;
+        }
+        if (node->start <= last) {
+            if (start <= node->last) {
+                return node;
+            }
+            node = atomic_rcu_read(&node->right);
+            if (node && start <= node->subtree_last) {
+                continue;
+            }
+        }
+        return NULL;
+    }
+}
+
+IntervalTreeNode *interval_tree_iter_first(IntervalTreeRoot *root,
+                                           uint64_t start, uint64_t last)
+{
+    IntervalTreeNode *node = atomic_rcu_read(&root->root);
+
+    if (!node || node->subtree_last < start) {
+        return NULL;
+    }
+    return interval_tree_subtree_search(node, start, last);
+}
+
+IntervalTreeNode *interval_tree_iter_next(IntervalTreeNode *node,
+                                          uint64_t start, uint64_t last)
+{
+    IntervalTreeNode *right = node->right;
+    IntervalTreeNode *prev;
+
+    while (true) {
+        if (right && start <= right->subtree_last) {
+            return interval_tree_subtree_search(right, start, last);
+        }
+
+        /* Go up until we come from a left child.  */
+        do {
+            prev = node;
+            node = node->parent;
+            if (!node) {
+                return NULL;
+            }
+            right = node->right;
+        } while (prev == right);
+
+        if (last < node->start) {
+            return NULL;
+        }
+        if (start <= node->last) {
+            return node;
+        }
+    }
+}
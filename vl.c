@@ -70,11 +70,13 @@ static QemuThread app_main_thread;
 
 int main(int argc, char **argv)
 {
-    int code;
+    int code = 0;
 
     args.argc = argc;
     args.argv = argv;
 
+    cortexm_graphic_init();
+
 #if !defined(USE_GRAPHIC_POLL_EVENT)
 
     // On POSIX, create a separate thread for all initialisations and
@@ -87,8 +89,10 @@ int main(int argc, char **argv)
     // fails on macOS and GNU/Linux.
     cortexm_graphic_event_loop();
 
-    // The event loop terminates if SDL_Quit() was called.
-    code = 0;
+    // The event loop returns right away with -nographic, or after
+    // SDL_Quit() was called from the atexit() handler of the
+    // application thread; either way, that thread exits the process.
+    qemu_thread_exit(NULL);
 
 #else
 
@@ -96,10 +100,10 @@ int main(int argc, char **argv)
     // so compromise on polling the graphic event loop.
     code = qemu_main(args.argc, args.argv, NULL);
 
-#endif /* !defined(USE_GRAPHIC_POLL_EVENT) */
-
     cortexm_graphic_quit();
 
+#endif /* !defined(USE_GRAPHIC_POLL_EVENT) */
+
     qemu_log_mask(LOG_TRACE, "%s() done.\n", __FUNCTION__);
 
     exit(code);
@@ -701,6 +705,15 @@ static const RunStateTransition runstate_transitions_def[] = {
     { RUN_STATE_FINISH_MIGRATE, RUN_STATE_RUNNING },
     { RUN_STATE_FINISH_MIGRATE, RUN_STATE_POSTMIGRATE },
     { RUN_STATE_FINISH_MIGRATE, RUN_STATE_PRELAUNCH },
+    /* A background snapshot puts a stopped VM back in its previous state */
+    { RUN_STATE_FINISH_MIGRATE, RUN_STATE_DEBUG },
+    { RUN_STATE_FINISH_MIGRATE, RUN_STATE_INTERNAL_ERROR },
+    { RUN_STATE_FINISH_MIGRATE, RUN_STATE_IO_ERROR },
+    { RUN_STATE_FINISH_MIGRATE, RUN_STATE_PAUSED },
+    { RUN_STATE_FINISH_MIGRATE, RUN_STATE_SHUTDOWN },
+    { RUN_STATE_FINISH_MIGRATE, RUN_STATE_SUSPENDED },
+    { RUN_STATE_FINISH_MIGRATE, RUN_STATE_WATCHDOG },
+    { RUN_STATE_FINISH_MIGRATE, RUN_STATE_GUEST_PANICKED },
 
     { RUN_STATE_RESTORE_VM, RUN_STATE_RUNNING },
     { RUN_STATE_RESTORE_VM, RUN_STATE_PRELAUNCH },
@@ -746,6 +759,11 @@ bool runstate_check(RunState state)
     return current_run_state == state;
 }
 
+RunState runstate_get(void)
+{
+    return current_run_state;
+}
+
 bool runstate_store(char *str, size_t size)
 {
     const char *state = RunState_lookup[current_run_state];